@@ -18,8 +18,14 @@
 
 // Algs and utilities
 #include "modules/LSM9DS1/LSM9DS1.h"
+#include "modules/utilities/events.h"
+#include "modules/utilities/flightrec.h"
+#include "modules/utilities/idle.h"
 #include "modules/utilities/logging.h"
+#include "modules/utilities/pt.h"
+#include "modules/utilities/report.h"
 #include "modules/utilities/scheduler.h"
+#include "modules/utilities/timebase.h"
 
 // STM Drivers
 #include "peripherals/stm32f3-configuration/stm32f3xx_hal_conf.h"
@@ -34,9 +40,12 @@
 #include "peripherals/stm32-usb/usb_lib.h"
 
 #include "modules/CDC/cdc.h"
+#include "modules/HID/hid.h"
 
 //! Level of log messages we will print out to the user
 #define LOGGING_LEVEL (kLogLevelInfo)
+//! How often queued log messages are sent out
+#define LOG_DRAIN_PERIOD_MS (10)
 
 //! HAL millisecond tick
 extern __IO uint32_t uwTick;
@@ -46,13 +55,40 @@ extern __IO uint32_t uwTick;
 critical_errors_t gCriticalErrors;
 //! The scheduler for all tasks to be run in the main context
 schedule_t gMainSchedule;
+//! Work deferred from interrupts, drained by the main loop before the scheduler runs
+events_t gMainEvents;
+
+//! Reports from the host over UART
+static report_parser_t gUartReports;
+
+//! Heartbeat's schedule ID, for waking it when its status read is in
+static uint8_t gHeartbeatId;
+
+//! Log messages over USB CDC (when connected), always into RAM, and over UART in debug builds
+static log_sink_t gUsbLog, gRamLog;
+#ifdef DEBUG
+static log_sink_t gUartLog;
+#endif
+
+//! How the main loop sleeps between deadlines
+static const idle_port_t gIdlePort = {
+    .get_time_us = time_us,
+    .irq_disable = hw_irqDisable,
+    .irq_enable = hw_irqEnable,
+    .sleep = hw_sleep,
+};
 
 // Local functions
 ret_t heartbeat(int32_t *new_callback_time_ms);
 ret_t workloop_flash(int32_t *new_callback_time_ms);
 ret_t button_handler(int32_t *new_callback_time_ms);
+ret_t log_task(int32_t *new_callback_time_ms);
+ret_t uart_rxHandler(uint16_t num_posts);
 void USB_pullup_set(uint8_t value);
 
+//! Services sensor interrupts between callbacks, so they don't wait out a whole pass
+static void service_events(void) { events_dispatch(&gMainEvents); }
+
 #ifdef WATCHDOG_ENABLE
 //! Global indicating whether or not to pet the watchdog
 static bool gPetWdg = false;
@@ -120,6 +156,15 @@ ret_t print(char *string)
     return cdc_inTransfer_start((uint8_t *)string, string_len);
 }
 
+//! Log sink over USB CDC. Messages wait in the log queue until the host is connected.
+static ret_t usb_logWrite(uint8_t *data_ptr, uint32_t num_bytes)
+{
+    if (bDeviceState != CONFIGURED) {
+        return RET_BUSY_ERR;
+    }
+    return cdc_inTransfer_start(data_ptr, (uint8_t)num_bytes);
+}
+
 /*! Main function code. Does the following:
  *      1. Initializes all sub-modules
  *      2. Loops forever and behaves as such given switch state:
@@ -129,7 +174,8 @@ ret_t print(char *string)
 int main(void)
 {
     uint8_t i = 0;
-    int32_t time_until_next_cb_ms;
+    uint32_t reset_flags;
+    int32_t time_until_next_cb_us;
     gyro_ODR_t gyro_ODR = kGyroODR_14_9_Hz;
     accel_ODR_t accel_ODR = kAccelODR_10_Hz;
     gyro_fullscale_t gyro_FS = k2000DPS_fullscale;
@@ -138,14 +184,32 @@ int main(void)
     // system configuration...
     HAL_Init();
     SystemClock_Config();
+    hw_timebase_init(); // time_us() for the scheduler and sample timestamps
+    // before anything can record over what the last run left behind
+    reset_flags = hw_getResetFlags();
+    flightrec_init(HAL_GetTick, reset_flags, hw_resetByWatchdog(reset_flags));
     configure_pins();
     clear_critical_errors();
+    events_init(&gMainEvents); // before anything that registers events
 
     // Initialize UART and logging
     check_retval_fatal(__FILE__, __LINE__, UART_init(460800));
     UART_sendString("\n"); // Get rid of annoying crap
-    log_init(LOGGING_LEVEL, UART_sendString, HAL_GetTick);
+    log_init(HAL_GetTick);
+    log_setLock(hw_irqSave, hw_irqRestore); // USB interrupts log too
+    log_addSink(&gRamLog, LOGGING_LEVEL, log_ramWrite, LOG_SINK_MAX_WRITE);
+    // short of a full packet, so the host doesn't wait on a zero length one to end the transfer
+    log_addSink(&gUsbLog, LOGGING_LEVEL, usb_logWrite, PENSEL_DATA_SIZE - 1);
+#ifdef DEBUG
+    log_addSink(&gUartLog, LOGGING_LEVEL, UART_sendData, UART_TX_RING_SIZE);
+#endif
+    log_setRecorder(flightrec_log);
     LOG_MSG(kLogLevelInfo, "Log module initialized");
+    if (flightrec_hasCrash()) {
+        LOG_MSG(kLogLevelWarning, "Last run crashed, read the flight recorder report");
+    }
+
+    check_retval_fatal(__FILE__, __LINE__, idle_init(&gIdlePort, &gMainEvents));
 
 #ifdef WATCHDOG_ENABLE
     if (wdg_isSet()) {
@@ -160,6 +224,16 @@ int main(void)
     gPetWdg = true;
 #endif
 
+    // initalize the scheduler first, drivers add their own tasks to it
+    scheduler_init(&gMainSchedule);
+#ifdef SCHEDULER_PROFILING
+    hw_cycleCounter_init();
+    scheduler_setCycleCounter(&gMainSchedule, hw_getCycles);
+    scheduler_setTimeSource(&gMainSchedule, time_us);
+#endif
+    scheduler_setBetweenCallbacksHook(&gMainSchedule, service_events);
+    scheduler_setTraceHook(&gMainSchedule, flightrec_taskTrace);
+
     // peripheral configuration
     check_retval_fatal(__FILE__, __LINE__, I2C_init());
 
@@ -169,44 +243,71 @@ int main(void)
     hw_USB_init();
     USB_init();
     check_retval_fatal(__FILE__, __LINE__, LSM9DS1_init(gyro_ODR, gyro_FS, accel_ODR, accel_FS));
-
-    // initalize the scheduler and add some periodic tasks
-    scheduler_init(&gMainSchedule);
-    scheduler_add(&gMainSchedule, 0, heartbeat, &i);
-    scheduler_add(&gMainSchedule, 0, workloop_flash, &i);
+    check_retval_fatal(__FILE__, __LINE__, hid_init());
+    check_retval_fatal(__FILE__, __LINE__, report_init(&gUartReports, gHidUartReports,
+                                                       gHidUartReportsLen, UART_sendReport,
+                                                       UART_sendData));
+    check_retval_fatal(__FILE__, __LINE__, UART_setRxHandler(uart_rxHandler));
+
+    // add some periodic tasks
+    scheduler_addWithPriority(&gMainSchedule, kSchedulerPriorityLow, 0, heartbeat, &gHeartbeatId);
+    scheduler_addWithPriority(&gMainSchedule, kSchedulerPriorityLow, 0, workloop_flash, &i);
     scheduler_add(&gMainSchedule, 0, button_handler, &i);
+    scheduler_addWithPriority(&gMainSchedule, kSchedulerPriorityLow, 0, log_task, &i);
 
 #ifdef WATCHDOG_ENABLE
-    scheduler_add(&gMainSchedule, 0, watchdog_pet, &i);
+    scheduler_addWithPriority(&gMainSchedule, kSchedulerPriorityHigh, 0, watchdog_pet, &i);
 #endif
 
     // --- Main scheduler super loop!
     uint32_t sleep_until = 0;
     while (true) {
-        sleep_until = HAL_GetTick(); // grab start of loop time
-        time_until_next_cb_ms = scheduler_run(&gMainSchedule, sleep_until);
-        sleep_until += time_until_next_cb_ms;
-
-        if (time_until_next_cb_ms > 0) {
-            // TODO: sleep CPU instead of dumb delay
-            if (HAL_GetTick() < sleep_until) {
-                HAL_Delay(sleep_until - HAL_GetTick());
-            }
+        events_dispatch(&gMainEvents);
+
+        sleep_until = time_us(); // grab start of loop time
+        time_until_next_cb_us = scheduler_run(&gMainSchedule, sleep_until);
+        sleep_until += time_until_next_cb_us;
+
+        if (time_until_next_cb_us > 0) {
+            // Sleep until the next deadline, or until an interrupt posts work for us
+            idle_sleepUntil(sleep_until);
         }
     } /* while (true) */
 } /* main() */
 
 /* --- Some common callbacks to be run --- */
 
-ret_t heartbeat(int32_t *new_callback_time_ms)
+//! Heartbeat's protothread, so it can wait on the status read without stalling everything else
+static pt_t gHeartbeatPt;
+
+//! The status read is in, wake the heartbeat up rather than having it poll
+static ret_t heartbeat_statusDone(i2c_transaction_t *UNUSED_PARAM(transaction))
+{
+    return scheduler_wake(&gMainSchedule, gHeartbeatId);
+}
+
+static pt_state_t heartbeat_thread(pt_t *pt)
 {
     static uint8_t tick = 0;
-    *new_callback_time_ms = 1000;
+    static uint8_t status;
+    static i2c_transaction_t status_read;
+    static ret_t ret;
+
+    PT_BEGIN(pt);
     LED_toggle(LED_0);
     TimingPin_toggle();
 
-    uint8_t status;
-    if (LSM9DS1_readStatus(&status) == RET_OK) {
+    // queues behind the sensor reads, unless the queue's full
+    PT_WAIT_UNTIL(pt,
+                  (ret = LSM9DS1_readStatusAsync(&status_read, &status, heartbeat_statusDone)) !=
+                      RET_BUSY_ERR,
+                  1);
+    if (ret == RET_OK) {
+        // heartbeat_statusDone() wakes us, the poll is only in case that goes wrong
+        PT_WAIT_UNTIL(pt, I2C_isDone(&status_read), 100);
+        ret = status_read.ret;
+    }
+    if (ret == RET_OK) {
         LOG_MSG_FMT(kLogLevelInfo, "LSM status: %i", status);
     } else {
         LOG_MSG(kLogLevelWarning, "LSM status read FAILED");
@@ -218,18 +319,25 @@ ret_t heartbeat(int32_t *new_callback_time_ms)
         LOG_MSG(kLogLevelDebug, "\tTock");
     }
     tick += 1;
+
+    PT_SLEEP(pt, 1000);
+    PT_END(pt);
+}
+
+ret_t heartbeat(int32_t *new_callback_time_ms)
+{
+    pt_state_t state = heartbeat_thread(&gHeartbeatPt);
+    // runs forever, starting over once it's slept
+    *new_callback_time_ms = (state == kPtEnded) ? 0 : pt_callbackTime(&gHeartbeatPt, state);
     return RET_OK;
 }
 
 ret_t workloop_flash(int32_t *new_callback_time_ms)
 {
-    static uint16_t i = 0;
-    *new_callback_time_ms = 0;
-
-    // toggle LED every 10,000 itterations over the workloop
-    if (i++ == 0) {
-        LED_toggle(LED_1);
-    }
+    // Blink to show the main loop is alive. This used to run every pass, which kept the CPU from
+    // ever sleeping.
+    *new_callback_time_ms = 250;
+    LED_toggle(LED_1);
     return RET_OK;
 }
 
@@ -241,6 +349,14 @@ ret_t button_handler(int32_t *new_callback_time_ms)
     return RET_OK;
 }
 
+ret_t log_task(int32_t *new_callback_time_ms)
+{
+    // Send out whatever was logged since last time. A sink that's backed up gets the rest later.
+    *new_callback_time_ms = LOG_DRAIN_PERIOD_MS;
+    log_drain();
+    return RET_OK;
+}
+
 /*! Error handler that is called when fatal exceptions are found.
  *
  * @param file (char *): File in which the error comes from. Use the __FILE__ macro.
@@ -252,15 +368,23 @@ void fatal_error_handler(char file[], uint32_t line, int8_t err_code)
 {
     // FREAK OUT
     char errMsg[64];
+    // log_drain() is main context only, and the sinks need interrupts to get anything out
+    bool can_drain = !hw_inInterrupt();
+    // where we were called from, for the post-mortem
+    flightrec_fault_t fault = {.pc = (uint32_t)(uintptr_t)__builtin_return_address(0)};
+    flightrec_crash(kFlightrecFatal, (uint16_t)err_code, line, &fault);
+    sprintf(errMsg, "Err: %i", err_code);
 #ifdef DEBUG
     uint32_t timer_count, i = 0;
     LED_set(LED_0, 0);
     LED_set(LED_1, 1);
-    sprintf(errMsg, "Err: %i", err_code);
 
     // Can't rely on HAL tick as we maybe in the ISR context...
     while (1) {
         log_logMessage(kLogLevelError, file, "?", line, errMsg);
+        if (can_drain) {
+            log_drain();
+        }
 
         for (i = 0; i < 25; i++) {
             while (timer_count < 100000) {
@@ -280,11 +404,25 @@ void fatal_error_handler(char file[], uint32_t line, int8_t err_code)
 #else
     // TODO: Reset everything
     log_logMessage(kLogLevelError, file, "?", line, errMsg);
-    // for now, just let the watchdog happen
-    while (1)
-        ;
+    // for now, just let the watchdog happen. Get the logs out while we wait, if we can.
+    while (1) {
+        if (can_drain) {
+            log_drain();
+        }
+    }
 #endif
 }
 
 // HAL uses this function. Call our error function.
 void assert_failed(uint8_t *file, uint32_t line) { fatal_error_handler((char *)file, line, -1); }
+
+ret_t uart_rxHandler(uint16_t UNUSED_PARAM(num_posts))
+{
+    // Feed the report parser straight out of the RX ring, a chunk at a time
+    uint8_t chunk[32];
+    uint32_t num_bytes;
+    while ((num_bytes = UART_read(chunk, sizeof(chunk))) != 0) {
+        report_parse(&gUartReports, chunk, num_bytes);
+    }
+    return RET_OK;
+}
@@ -5,7 +5,13 @@
 #include "common.h"
 #include "modules/LSM9DS1/LSM9DS1.h"
 #include "modules/orientation/datatypes.h"
+#include "modules/utilities/events.h"
+#include "modules/utilities/flightrec.h"
+#include "modules/utilities/idle.h"
+#include "modules/utilities/scheduler.h"
 #include "modules/utilities/logging.h"
+#include "modules/utilities/report.h"
+#include "peripherals/UART/UART.h"
 #include "peripherals/USB/usb_desc.h"
 #include "peripherals/stm32-usb/usb_lib.h"
 #include <string.h>
@@ -14,47 +20,209 @@
 #define CLEAR_STATS_MAGIC_NUMBER (0xAA)
 
 extern critical_errors_t gCriticalErrors;
+extern schedule_t gMainSchedule;
+extern events_t gMainEvents;
+
+/*! What each transport keeps to itself. USB reports run in the USB interrupt and UART ones in
+ *  main context, so they never share a cursor.
+ */
+typedef struct {
+    uint8_t readers[kLSM9DS1_numStreams]; //!< Reader IDs on the LSM9DS1 streams
+    uint16_t next_scheduler_slot;         //!< Next slot the scheduler stats report will return
+    uint8_t next_flightrec_entry;         //!< Next thing the flight recorder report will return
+} hid_port_t;
+
+//! Things a set report clears. They're shared with the main loop, so they're cleared from there.
+enum {
+    kHidClearIdle = 0x01,
+    kHidClearScheduler = 0x02,
+    kHidClearFlightrec = 0x04,
+    kHidClearCriticalErrors = 0x08,
+};
 
 static uint8_t genBuff[GEN_BUFF_SIZE];
 
+static hid_port_t gHidUsb = {.readers = {0xFF, 0xFF, 0xFF}};
+static hid_port_t gHidUart = {.readers = {0xFF, 0xFF, 0xFF}};
+
+static uint8_t gHidClearEvent;
+static volatile uint8_t gHidPendingClears; //!< kHidClear* flags waiting for priv_clearHandler()
+
+static ret_t priv_getReport(hid_port_t *port, report_id_t report_id, uint8_t payload_ptr[],
+                            uint8_t *payload_len_ptr);
+static ret_t priv_setReport(hid_port_t *port, report_id_t report_id, uint8_t *payload_ptr,
+                            uint8_t payload_len);
+
+#ifdef SCHEDULER_PROFILING
+/*! Fills in the stats of the next scheduled callback: the slot ID followed by its stats.
+ *
+ * Each get returns the next slot that's in use. Once every slot has been returned we return
+ * RET_NODATA_ERR and start over, so the host reads until then to get them all.
+ */
+static ret_t getNextSchedulerStats(hid_port_t *port, uint8_t payload_ptr[],
+                                   uint8_t *payload_len_ptr)
+{
+    while (port->next_scheduler_slot < SCHEDULER_NUM_SLOTS) {
+        uint8_t slot = (uint8_t)port->next_scheduler_slot++;
+        if (scheduler_getStats(&gMainSchedule, slot, (scheduler_slot_stats_t *)(payload_ptr + 1)) ==
+            RET_OK) {
+            payload_ptr[0] = slot;
+            *payload_len_ptr = 1 + sizeof(scheduler_slot_stats_t);
+            return RET_OK;
+        }
+    }
+    port->next_scheduler_slot = 0;
+    *payload_len_ptr = 0;
+    return RET_NODATA_ERR;
+}
+#endif
+
+/*! Fills in the next part of the flight recorder: an index byte, then the summary (index 0) or the
+ *  next entry, oldest first (index 1 on).
+ *
+ * Like the scheduler stats, once everything has been returned we return RET_NODATA_ERR and start
+ * over, so the host reads until then to get it all.
+ */
+static ret_t getNextFlightrecEntry(hid_port_t *port, uint8_t payload_ptr[],
+                                   uint8_t *payload_len_ptr)
+{
+    if (port->next_flightrec_entry == 0) {
+        flightrec_getSummary((flightrec_summary_t *)(payload_ptr + 1));
+        *payload_len_ptr = 1 + sizeof(flightrec_summary_t);
+    } else if (flightrec_getEntry(port->next_flightrec_entry - 1,
+                                  (flightrec_entry_t *)(payload_ptr + 1)) == RET_OK) {
+        *payload_len_ptr = 1 + sizeof(flightrec_entry_t);
+    } else {
+        port->next_flightrec_entry = 0;
+        *payload_len_ptr = 0;
+        return RET_NODATA_ERR;
+    }
+    payload_ptr[0] = port->next_flightrec_entry++;
+    return RET_OK;
+}
+
+//! Runs the clears that set reports asked for, in main context
+static ret_t priv_clearHandler(uint16_t UNUSED_PARAM(num_posts))
+{
+    uint8_t clears = __atomic_exchange_n(&gHidPendingClears, 0, __ATOMIC_ACQUIRE);
+
+    if (clears & kHidClearIdle) {
+        idle_resetStats();
+    }
+#ifdef SCHEDULER_PROFILING
+    if (clears & kHidClearScheduler) {
+        scheduler_resetStats(&gMainSchedule);
+    }
+#endif
+    if (clears & kHidClearFlightrec) {
+        flightrec_clear();
+    }
+    if (clears & kHidClearCriticalErrors) {
+        memset(&gCriticalErrors, 0, sizeof(gCriticalErrors));
+    }
+    return RET_OK;
+}
+
+static void priv_requestClear(uint8_t clear)
+{
+    __atomic_fetch_or(&gHidPendingClears, clear, __ATOMIC_RELEASE);
+    events_post(&gMainEvents, gHidClearEvent);
+}
+
+/*! Subscribes the HID reports (USB and UART each) to the sensor streams. Call after
+ *  LSM9DS1_init() and events_init().
+ */
+ret_t hid_init(void)
+{
+    ret_t ret = events_register(&gMainEvents, priv_clearHandler, &gHidClearEvent);
+    if (ret != RET_OK) {
+        return ret;
+    }
+    for (uint8_t stream = 0; stream < kLSM9DS1_numStreams; stream++) {
+        ret = LSM9DS1_subscribe((LSM9DS1_stream_t)stream, &gHidUsb.readers[stream]);
+        if (ret != RET_OK) {
+            return ret;
+        }
+        ret = LSM9DS1_subscribe((LSM9DS1_stream_t)stream, &gHidUart.readers[stream]);
+        if (ret != RET_OK) {
+            return ret;
+        }
+    }
+    return ret;
+}
+
+//! A HID get report from the host. Runs in the USB interrupt.
 ret_t hid_getReport(report_id_t report_id, uint8_t payload_ptr[], uint8_t *payload_len_ptr)
+{
+    ret_t ret = priv_getReport(&gHidUsb, report_id, payload_ptr, payload_len_ptr);
+
+    // the host polls the streams, so these come thick and fast
+    LOG_MSG_FMT_LIMITED(kLogLevelInfo, "Get Report: 0x%02X (len: %i) ret: %i", report_id,
+                        *payload_len_ptr, ret);
+    return ret;
+}
+
+//! A HID set report from the host. Runs in the USB interrupt.
+ret_t hid_setReport(report_id_t report_id, uint8_t *payload_ptr, uint8_t payload_len)
+{
+    return priv_setReport(&gHidUsb, report_id, payload_ptr, payload_len);
+}
+
+static ret_t priv_getReport(hid_port_t *port, report_id_t report_id, uint8_t payload_ptr[],
+                            uint8_t *payload_len_ptr)
 {
     ret_t ret = RET_OK;
-    accel_norm_t aPkt;
-    mag_norm_t mPkt;
-    gyro_norm_t gPkt;
 
     switch (report_id) {
         case kReportID_getAccelPacket:
-            ret = LSM9DS1_getAccelPacket(&aPkt);
+            // packets are packed, so they can be copied straight into the payload
+            ret = LSM9DS1_getAccelPacket(port->readers[kLSM9DS1_accelStream],
+                                         (accel_norm_t *)payload_ptr);
             if (ret == RET_OK) {
-                memcpy(payload_ptr, &aPkt, sizeof(aPkt));
-                *payload_len_ptr = sizeof(aPkt);
+                *payload_len_ptr = sizeof(accel_norm_t);
             } else {
                 *payload_len_ptr = 0;
             }
             break;
 
         case kReportID_getMagPacket:
-            ret = LSM9DS1_getMagPacket(&mPkt);
+            // packets are packed, so they can be copied straight into the payload
+            ret = LSM9DS1_getMagPacket(port->readers[kLSM9DS1_magStream],
+                                         (mag_norm_t *)payload_ptr);
             if (ret == RET_OK) {
-                memcpy(payload_ptr, &mPkt, sizeof(mPkt));
-                *payload_len_ptr = sizeof(mPkt);
+                *payload_len_ptr = sizeof(mag_norm_t);
             } else {
                 *payload_len_ptr = 0;
             }
             break;
 
         case kReportID_getGyroPacket:
-            ret = LSM9DS1_getGyroPacket(&gPkt);
+            // packets are packed, so they can be copied straight into the payload
+            ret = LSM9DS1_getGyroPacket(port->readers[kLSM9DS1_gyroStream],
+                                         (gyro_norm_t *)payload_ptr);
             if (ret == RET_OK) {
-                memcpy(payload_ptr, &gPkt, sizeof(gPkt));
-                *payload_len_ptr = sizeof(gPkt);
+                *payload_len_ptr = sizeof(gyro_norm_t);
             } else {
                 *payload_len_ptr = 0;
             }
             break;
 
+        case kReportID_idleStats:
+            idle_getStats((idle_stats_t *)payload_ptr);
+            *payload_len_ptr = sizeof(idle_stats_t);
+            ret = RET_OK;
+            break;
+
+#ifdef SCHEDULER_PROFILING
+        case kReportID_schedulerStats:
+            ret = getNextSchedulerStats(port, payload_ptr, payload_len_ptr);
+            break;
+#endif
+
+        case kReportID_flightRecorder:
+            ret = getNextFlightrecEntry(port, payload_ptr, payload_len_ptr);
+            break;
+
         case kReportID_criticalErrors:
             memcpy(payload_ptr, &gCriticalErrors, sizeof(gCriticalErrors));
             *payload_len_ptr = sizeof(gCriticalErrors);
@@ -77,13 +245,11 @@ ret_t hid_getReport(report_id_t report_id, uint8_t payload_ptr[], uint8_t *paylo
             ret = RET_GEN_ERR;
             break;
     }
-
-    LOG_MSG_FMT(kLogLevelInfo, "Get Report: 0x%02X (len: %i) ret: %i", report_id, *payload_len_ptr,
-                ret);
     return ret;
 }
 
-ret_t hid_setReport(report_id_t report_id, uint8_t *payload_ptr, uint8_t payload_len)
+static ret_t priv_setReport(hid_port_t *port, report_id_t report_id, uint8_t *payload_ptr,
+                            uint8_t payload_len)
 {
     ret_t ret = RET_OK;
 
@@ -100,9 +266,41 @@ ret_t hid_setReport(report_id_t report_id, uint8_t *payload_ptr, uint8_t payload
             ret = RET_GEN_ERR;
             break;
 
+        case kReportID_idleStats:
+            if (payload_len == 2 && payload_ptr[1] == CLEAR_STATS_MAGIC_NUMBER) {
+                priv_requestClear(kHidClearIdle);
+                ret = RET_OK;
+            } else {
+                ret = RET_GEN_ERR;
+            }
+            break;
+
+#ifdef SCHEDULER_PROFILING
+        case kReportID_schedulerStats:
+            if (payload_len == 2 && payload_ptr[1] == CLEAR_STATS_MAGIC_NUMBER) {
+                priv_requestClear(kHidClearScheduler);
+                port->next_scheduler_slot = 0;
+                ret = RET_OK;
+            } else {
+                ret = RET_GEN_ERR;
+            }
+            break;
+#endif
+
+        case kReportID_flightRecorder:
+            // let go of the crash once it's been read, and start recording again
+            if (payload_len == 2 && payload_ptr[1] == CLEAR_STATS_MAGIC_NUMBER) {
+                priv_requestClear(kHidClearFlightrec);
+                port->next_flightrec_entry = 0;
+                ret = RET_OK;
+            } else {
+                ret = RET_GEN_ERR;
+            }
+            break;
+
         case kReportID_criticalErrors:
             if (payload_len == 2 && payload_ptr[1] == CLEAR_STATS_MAGIC_NUMBER) {
-                memset(&gCriticalErrors, 0, sizeof(gCriticalErrors));
+                priv_requestClear(kHidClearCriticalErrors);
                 ret = RET_OK;
             } else {
                 ret = RET_GEN_ERR;
@@ -135,3 +333,83 @@ ret_t hid_setReport(report_id_t report_id, uint8_t *payload_ptr, uint8_t payload
     LOG_MSG_FMT(kLogLevelInfo, "Set Report: 0x%02X (len: %i) ret: %i", report_id, payload_len, ret);
     return ret;
 }
+
+/* ------ The same reports over UART (see report.h) ------ */
+
+/*! Runs a HID report for the UART parser: a get if there's no payload, otherwise a set. Sets get
+ *  the report ID in front of the payload, the way they come in over USB. Uses the UART's own
+ *  readers and cursors, so it doesn't step on the USB interrupt.
+ */
+static ret_t priv_uartReport(report_id_t report_id, uint8_t *in_p, uint8_t in_len, uint8_t *out_p,
+                             uint8_t *out_len_ptr)
+{
+    if (in_len == 0) {
+        return priv_getReport(&gHidUart, report_id, out_p, out_len_ptr);
+    }
+    if (in_len >= REPORT_MAX_PAYLOAD) {
+        return RET_MAX_LEN_ERR;
+    }
+    // out_p isn't needed for the reply, so it's where the ID goes in front
+    out_p[0] = (uint8_t)report_id;
+    memcpy(out_p + 1, in_p, in_len);
+    *out_len_ptr = 0;
+    return priv_setReport(&gHidUart, report_id, out_p, in_len + 1);
+}
+
+static ret_t rpt_hid_accelPacket(uint8_t *in_p, uint8_t in_len, uint8_t *out_p,
+                                 uint8_t *out_len_ptr)
+{
+    return priv_uartReport(kReportID_getAccelPacket, in_p, in_len, out_p, out_len_ptr);
+}
+
+static ret_t rpt_hid_magPacket(uint8_t *in_p, uint8_t in_len, uint8_t *out_p, uint8_t *out_len_ptr)
+{
+    return priv_uartReport(kReportID_getMagPacket, in_p, in_len, out_p, out_len_ptr);
+}
+
+static ret_t rpt_hid_gyroPacket(uint8_t *in_p, uint8_t in_len, uint8_t *out_p,
+                                uint8_t *out_len_ptr)
+{
+    return priv_uartReport(kReportID_getGyroPacket, in_p, in_len, out_p, out_len_ptr);
+}
+
+static ret_t rpt_hid_idleStats(uint8_t *in_p, uint8_t in_len, uint8_t *out_p, uint8_t *out_len_ptr)
+{
+    return priv_uartReport(kReportID_idleStats, in_p, in_len, out_p, out_len_ptr);
+}
+
+#ifdef SCHEDULER_PROFILING
+static ret_t rpt_hid_schedulerStats(uint8_t *in_p, uint8_t in_len, uint8_t *out_p,
+                                    uint8_t *out_len_ptr)
+{
+    return priv_uartReport(kReportID_schedulerStats, in_p, in_len, out_p, out_len_ptr);
+}
+#endif
+
+static ret_t rpt_hid_flightRecorder(uint8_t *in_p, uint8_t in_len, uint8_t *out_p,
+                                    uint8_t *out_len_ptr)
+{
+    return priv_uartReport(kReportID_flightRecorder, in_p, in_len, out_p, out_len_ptr);
+}
+
+static ret_t rpt_hid_criticalErrors(uint8_t *in_p, uint8_t in_len, uint8_t *out_p,
+                                    uint8_t *out_len_ptr)
+{
+    return priv_uartReport(kReportID_criticalErrors, in_p, in_len, out_p, out_len_ptr);
+}
+
+//! Reports the UART parser handles. The host only sends IDs up to 0x7F, so no echo / hello.
+const report_entry_t gHidUartReports[] = {
+    {.id = kReportID_getAccelPacket, .handler = rpt_hid_accelPacket},
+    {.id = kReportID_getMagPacket, .handler = rpt_hid_magPacket},
+    {.id = kReportID_getGyroPacket, .handler = rpt_hid_gyroPacket},
+    {.id = kReportID_idleStats, .handler = rpt_hid_idleStats},
+#ifdef SCHEDULER_PROFILING
+    {.id = kReportID_schedulerStats, .handler = rpt_hid_schedulerStats},
+#endif
+    {.id = kReportID_flightRecorder, .handler = rpt_hid_flightRecorder},
+    {.id = kReportID_criticalErrors, .handler = rpt_hid_criticalErrors},
+    {.id = kReportID_uartEcho, .handler = rpt_UART_echo},
+    {.id = kReportID_uartBaudrate, .handler = rpt_UART_baudrate},
+};
+const uint8_t gHidUartReportsLen = sizeof(gHidUartReports) / sizeof(gHidUartReports[0]);
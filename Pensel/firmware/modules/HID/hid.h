@@ -5,16 +5,27 @@
 #pragma once
 
 #include "common.h"
+#include "modules/utilities/report.h"
 #include <stdbool.h>
 
 typedef enum {
     kReportID_getAccelPacket = 0x40,
     kReportID_getMagPacket = 0x41,
     kReportID_getGyroPacket = 0x42,
+    kReportID_idleStats = 0x50,
+    kReportID_schedulerStats = 0x51,
+    kReportID_uartEcho = 0x7B,
+    kReportID_uartBaudrate = 0x7C,
+    kReportID_flightRecorder = 0x7E,
     kReportID_criticalErrors = 0x7F,
     kReportID_stringEcho = 0xf0,
     kReportID_helloWorld = 0xf1,
 } report_id_t;
 
+ret_t hid_init(void);
 ret_t hid_getReport(report_id_t report_id, uint8_t payload_ptr[], uint8_t *payload_len_ptr);
 ret_t hid_setReport(report_id_t report_id, uint8_t *payload_ptr, uint8_t payload_len);
+
+//! The reports above for the UART report parser (report_init())
+extern const report_entry_t gHidUartReports[];
+extern const uint8_t gHidUartReportsLen;
@@ -190,8 +190,8 @@ ret_t LSM303DLHC_init(accel_ODR_t accel_datarate, accel_sensitivity_t accel_sens
     LSM303DLHC.adjust_gain = true;
 
     // (re)set the queue
-    queue_init(&LSM303DLHC.accel_queue);
-    queue_init(&LSM303DLHC.mag_queue);
+    queue_init(&LSM303DLHC.accel_queue, kQueueOverwriteOldest);
+    queue_init(&LSM303DLHC.mag_queue, kQueueOverwriteOldest);
 
     // we've initialized properly!
     return RET_OK;
@@ -398,12 +398,9 @@ static inline ret_t LSM303DLHC_accel_putPacket(accel_raw_t pkt)
     pkt.frame_num = LSM303DLHC.accel_framenum;
     LSM303DLHC.accel_framenum++;
     pkt.timestamp = HAL_GetTick();
-    LSM303DLHC.accel_pkts[LSM303DLHC.accel_queue.head_ind] = pkt;
-
-    // move the head forward and handle overwrite cases
-    queue_increment_head(&LSM303DLHC.accel_queue, ACCEL_QUEUE_SIZE);
-
-    return RET_OK;
+    // copy it in and move the head forward, handling overwrite cases
+    return queue_push(&LSM303DLHC.accel_queue, ACCEL_QUEUE_SIZE, LSM303DLHC.accel_pkts, &pkt,
+                      sizeof(pkt));
 }
 
 /*! Puts the given data onto the mag queue.
@@ -420,13 +417,9 @@ static inline ret_t LSM303DLHC_mag_putPacket(mag_raw_t pkt)
     pkt.frame_num = LSM303DLHC.mag_framenum;
     LSM303DLHC.mag_framenum++;
     pkt.timestamp = HAL_GetTick();
-    // Put the data on the queue...
-    LSM303DLHC.mag_pkts[LSM303DLHC.mag_queue.head_ind] = pkt;
-
-    // now move the head forward and handle overwrite cases
-    queue_increment_head(&LSM303DLHC.mag_queue, MAG_QUEUE_SIZE);
-
-    return RET_OK;
+    // copy it in and move the head forward, handling overwrite cases
+    return queue_push(&LSM303DLHC.mag_queue, MAG_QUEUE_SIZE, LSM303DLHC.mag_pkts, &pkt,
+                      sizeof(pkt));
 }
 
 static void priv_accel_normalize(accel_raw_t *raw_pkt, accel_norm_t *norm_pkt_ptr, bool adjust_gain)
@@ -687,7 +680,7 @@ ret_t rpt_LSM303DLHC_getAccel(uint8_t *in_p, uint8_t in_len, uint8_t *out_p, uin
 {
     ret_t retval;
     accel_norm_t pkt;
-    bool peak, block;
+    bool peak;
 
     // do some bounds checking
     if (in_len != 1) {
@@ -701,16 +694,8 @@ ret_t rpt_LSM303DLHC_getAccel(uint8_t *in_p, uint8_t in_len, uint8_t *out_p, uin
         peak = false;
     }
 
-    // check if we should block on data being available
-    if (in_p[0] == 0b10) {
-        block = true;
-    } else {
-        block = false;
-    }
-
-    // if block, wait for data to be available
-    while (block && !LSM303DLHC_accel_dataAvailable())
-        ;
+    // The "block" bit (0b10) is ignored: report handlers run in the main loop and can't wait on
+    // the sensor. With no data the reply is empty and the host polls again.
 
     if (LSM303DLHC_accel_dataAvailable()) {
         // call the actual function
@@ -737,7 +722,7 @@ ret_t rpt_LSM303DLHC_getMag(uint8_t *in_p, uint8_t in_len, uint8_t *out_p, uint8
 {
     ret_t retval;
     mag_norm_t pkt;
-    bool peak, block;
+    bool peak;
 
     // do some bounds checking
     if (in_len != 1) {
@@ -751,16 +736,8 @@ ret_t rpt_LSM303DLHC_getMag(uint8_t *in_p, uint8_t in_len, uint8_t *out_p, uint8
         peak = false;
     }
 
-    // check if we should block on data being available
-    if (in_p[0] == 0b10) {
-        block = true;
-    } else {
-        block = false;
-    }
-
-    // if block, wait for data to be available
-    while (block && !LSM303DLHC_mag_dataAvailable())
-        ;
+    // The "block" bit (0b10) is ignored: report handlers run in the main loop and can't wait on
+    // the sensor. With no data the reply is empty and the host polls again.
 
     // call the actual function
     if (LSM303DLHC_mag_dataAvailable()) {
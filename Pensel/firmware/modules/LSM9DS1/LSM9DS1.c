@@ -9,14 +9,17 @@
 #include "LSM9DS1.h"
 #include "common.h"
 #include "modules/utilities/logging.h"
-#include "modules/utilities/newqueue.h"
+#include "modules/utilities/broadcast.h"
+#include "modules/utilities/events.h"
 #include "modules/utilities/scheduler.h"
+#include "modules/utilities/timebase.h"
 #include "peripherals/I2C/I2C.h"
 #include "peripherals/UART/UART.h"
 #include "peripherals/hardware/hardware.h"
 #include "peripherals/stm32f3/stm32f3xx_hal.h"
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 /* Accelerometer and gyroscope registers */
 
@@ -130,17 +133,23 @@
 #define INT_THS_H (0x33)
 
 // Other important definitions
-#define NUM_ACCEL_PACKETS (10) //!< Number of accel packets we'll hold in our queue
-#define NUM_MAG_PACKETS (10)   //!< Number of mag packets we'll hold in our queue
-#define NUM_GYRO_PACKETS (10)  //!< Number of gyro packets we'll hold in our queue
+#define NUM_ACCEL_PACKETS (10) //!< Number of accel packets we'll hold in our ring
+#define NUM_MAG_PACKETS (10)   //!< Number of mag packets we'll hold in our ring
+#define NUM_GYRO_PACKETS (10)  //!< Number of gyro packets we'll hold in our ring
 
 // --- important data / globals
-extern schedule_t gMainSchedule; // TODO: don't like externs. Better way to do this?
+extern events_t gMainEvents; // TODO: don't like externs. Better way to do this?
 
+//! A stream's sample read, and what it needs to publish the sample once it's in
 typedef struct {
-    newqueue_t mag_queue;
-    newqueue_t gyro_queue;
-    newqueue_t accel_queue;
+    i2c_transaction_t i2c; //!< First, so the I2C callback can get back to the rest
+    uint32_t drdy_time_us; //!< Timestamp of the sample being read, taken when it was submitted
+    uint16_t posts;        //!< DRDYs this read covers
+    uint8_t retries;       //!< Failed attempts at this sample so far
+} LSM9DS1_read_t;
+
+typedef struct {
+    broadcast_t streams[kLSM9DS1_numStreams]; //!< One ring per sensor, shared by all consumers
     uint32_t mag_framenum;
     uint32_t gyro_framenum;
     uint32_t accel_framenum;
@@ -150,18 +159,39 @@ typedef struct {
     accel_fullscale_t accel_FS;
     // mag_ODR_t mag_ODR;
     // mag_fullscale_t mag_FS;
+    uint8_t accel_event;
+    uint8_t gyro_event;
+    uint8_t mag_event;
+    uint16_t samples_waiting[kLSM9DS1_numStreams];       //!< DRDYs not read yet
+    volatile uint32_t drdy_time_us[kLSM9DS1_numStreams]; //!< time_us() of the latest DRDY
+    LSM9DS1_read_t reads[kLSM9DS1_numStreams];           //!< Output register read of each stream
+    bool reading[kLSM9DS1_numStreams];                   //!< Read queued, until its callback runs
+    bool backing_off;                                    //!< Reads failed, waiting to try again
+    int16_t read_data[kLSM9DS1_numStreams][3];           //!< Raw X, Y, Z being read
     LSM9DS1_critical_errors_t errors;
 } LSM9DS1_admin_t;
 
 static LSM9DS1_admin_t gLSM9DS1Admin;
 
+extern schedule_t gMainSchedule;
+
+// Packet storage for the broadcast rings. Written once by the sensor task, read in place.
+static accel_norm_t gAccelPackets[NUM_ACCEL_PACKETS];
+static gyro_norm_t gGyroPackets[NUM_GYRO_PACKETS];
+static mag_norm_t gMagPackets[NUM_MAG_PACKETS];
+
 // --- Private functions
-ret_t accelDataReadyHandler(int32_t *next_callback_ms);
-ret_t gyroDataReadyHandler(int32_t *next_callback_ms);
-ret_t magDataReadyHandler(int32_t *next_callback_ms);
+ret_t accelDataReadyHandler(uint16_t num_posts);
+ret_t gyroDataReadyHandler(uint16_t num_posts);
+ret_t magDataReadyHandler(uint16_t num_posts);
+static ret_t priv_sampleReady(LSM9DS1_stream_t stream, uint16_t num_posts);
+static ret_t priv_readDone(i2c_transaction_t *read);
 
 static void normalizeAccel(accel_raw_t *raw_pkt, accel_norm_t *norm_pkt_ptr);
 static void normalizeMag(mag_raw_t *raw_pkt, mag_norm_t *norm_pkt_ptr);
+static void normalizeGyro(gyro_raw_t *raw_pkt, gyro_norm_t *norm_pkt_ptr);
+static ret_t getPacket(LSM9DS1_stream_t stream, uint8_t reader_id, void *pkt_destination_ptr,
+                       uint32_t pkt_size);
 
 void enableSensorInterrupts(void);
 void disableSensorInterrupts(void);
@@ -176,20 +206,48 @@ ret_t LSM9DS1_init(gyro_ODR_t gyro_ODR, gyro_fullscale_t gyro_FS, accel_ODR_t ac
     ret_t ret = RET_OK;
     uint8_t tmp = 0;
 
-    // Initialize the admin struct
-    newqueue_init(&gLSM9DS1Admin.mag_queue, NUM_MAG_PACKETS, sizeof(mag_norm_t));
-    newqueue_init(&gLSM9DS1Admin.gyro_queue, NUM_GYRO_PACKETS, sizeof(gyro_norm_t));
-    newqueue_init(&gLSM9DS1Admin.accel_queue, NUM_ACCEL_PACKETS, sizeof(accel_norm_t));
+    // Initialize the admin struct. Sensor streams never wait on slow readers.
+    broadcast_init(&gLSM9DS1Admin.streams[kLSM9DS1_accelStream], gAccelPackets, NUM_ACCEL_PACKETS,
+                   sizeof(accel_norm_t));
+    broadcast_init(&gLSM9DS1Admin.streams[kLSM9DS1_gyroStream], gGyroPackets, NUM_GYRO_PACKETS,
+                   sizeof(gyro_norm_t));
+    broadcast_init(&gLSM9DS1Admin.streams[kLSM9DS1_magStream], gMagPackets, NUM_MAG_PACKETS,
+                   sizeof(mag_norm_t));
 
     gLSM9DS1Admin.errors.INT1_IRQs_missed = 0;
     gLSM9DS1Admin.errors.INT2_IRQs_missed = 0;
     gLSM9DS1Admin.errors.DRDY_IRQs_missed = 0;
+    gLSM9DS1Admin.errors.read_errors = 0;
     gLSM9DS1Admin.mag_framenum = 0;
     gLSM9DS1Admin.gyro_framenum = 0;
     gLSM9DS1Admin.accel_framenum = 0;
 
     disableSensorInterrupts();
 
+    // The DRDY ISRs only post these, the handlers run from the main loop
+    ret = events_register(&gMainEvents, accelDataReadyHandler, &gLSM9DS1Admin.accel_event);
+    CHECK_RET(ret);
+    ret = events_register(&gMainEvents, gyroDataReadyHandler, &gLSM9DS1Admin.gyro_event);
+    CHECK_RET(ret);
+    ret = events_register(&gMainEvents, magDataReadyHandler, &gLSM9DS1Admin.mag_event);
+    CHECK_RET(ret);
+
+    // One read per stream, so all of them can be queued on the bus at once
+    for (uint8_t stream = 0; stream < kLSM9DS1_numStreams; stream++) {
+        i2c_transaction_t *read = &gLSM9DS1Admin.reads[stream].i2c;
+        read->address = (stream == kLSM9DS1_magStream) ? MAG_ADDRESS : ACCEL_GYRO_ADDRESS;
+        read->mem_address = (stream == kLSM9DS1_magStream)
+                                ? OUT_X_L_M
+                                : (stream == kLSM9DS1_accelStream) ? OUT_X_LOW_XL : OUT_X_LOW_G;
+        read->write = false;
+        read->data_ptr = (uint8_t *)gLSM9DS1Admin.read_data[stream];
+        read->data_len = sizeof(gLSM9DS1Admin.read_data[stream]);
+        read->callback = priv_readDone;
+        gLSM9DS1Admin.reads[stream].retries = 0;
+        gLSM9DS1Admin.reading[stream] = false;
+    }
+    gLSM9DS1Admin.backing_off = false;
+
     // --- Make sure we can communicate with the chip
     // Check accel/gyro first
     ret = I2C_readData(ACCEL_GYRO_ADDRESS, WHO_AM_I, &tmp, 1);
@@ -244,9 +302,11 @@ ret_t LSM9DS1_init(gyro_ODR_t gyro_ODR, gyro_fullscale_t gyro_FS, accel_ODR_t ac
     ret = I2C_writeByte(ACCEL_GYRO_ADDRESS, INT2_CTRL, INT2_DRDY_XL, true);
     CHECK_RET(ret); // if (ret != RET_OK) { return ret; }
 
-    int32_t i;
-    accelDataReadyHandler(&i);
-    gyroDataReadyHandler(&i);
+    // Reading the samples that are already there clears the DRDYs, so they fire again
+    memset(gLSM9DS1Admin.samples_waiting, 0, sizeof(gLSM9DS1Admin.samples_waiting));
+    ret = priv_sampleReady(kLSM9DS1_accelStream, 1);
+    CHECK_RET(ret);
+    ret = priv_sampleReady(kLSM9DS1_gyroStream, 1);
 
     return ret;
 }
@@ -291,99 +351,183 @@ ret_t LSM9DS1_setGyro_ODR_FS(gyro_ODR_t gyro_ODR, gyro_fullscale_t gyro_FS)
     return ret;
 }
 
-ret_t LSM9DS1_readStatus(uint8_t *status_byte_ptr)
+/*! Queues a read of the accel / gyro status register. It's in once I2C_isDone(transaction), and
+ *  `callback` runs then.
+ *
+ * @param transaction (i2c_transaction_t *): for the read. Must stay valid until it's done.
+ * @param status_byte_ptr (uint8_t *): where to read it to. Must stay valid until it's done.
+ * @param callback (i2c_callback_t): run in main context once it's done, or NULL
+ * @retval RET_OK if queued, RET_BUSY_ERR if the I2C queue is full
+ */
+ret_t LSM9DS1_readStatusAsync(i2c_transaction_t *transaction, uint8_t *status_byte_ptr,
+                              i2c_callback_t callback)
 {
-    return I2C_readData(ACCEL_GYRO_ADDRESS, STATUS_REG_XL, status_byte_ptr, 1);
+    transaction->address = ACCEL_GYRO_ADDRESS;
+    transaction->mem_address = STATUS_REG_XL;
+    transaction->write = false;
+    transaction->data_ptr = status_byte_ptr;
+    transaction->data_len = 1;
+    transaction->callback = callback;
+    return I2C_submit(transaction);
 }
 
-/*! Function to be ran after DRDY from accel is detected. Should be ran in NON-interrupt context
+/*! Event handlers for the DRDY interrupts. They note that a sample is waiting and queue a read of
+ *  it, unless that stream's last read is still going (its callback picks this one up).
+ *
+ * The FIFO isn't enabled, so the output registers only ever hold the latest sample: one read
+ * drains everything there is, no matter how many DRDYs were coalesced. Any extra DRDYs were
+ * samples that got overwritten, and the frame number skips over them so readers can see the gap.
+ *
+ * @param num_posts (uint16_t): number of DRDYs since the last call
  */
-ret_t accelDataReadyHandler(int32_t *next_callback_ms)
+ret_t accelDataReadyHandler(uint16_t num_posts)
 {
-    ret_t ret = RET_OK;
-    int16_t data[3];
-    accel_raw_t rawPkt;
-    accel_norm_t normPkt;
-
-    LOG_MSG(kLogLevelDebug, "DRH - Accel");
+    return priv_sampleReady(kLSM9DS1_accelStream, num_posts);
+}
 
-    // We don't need to be called again until next ISR event
-    *next_callback_ms = SCHEDULER_FINISHED;
+ret_t gyroDataReadyHandler(uint16_t num_posts)
+{
+    return priv_sampleReady(kLSM9DS1_gyroStream, num_posts);
+}
 
-    // Read out the new data
-    ret = I2C_readData(ACCEL_GYRO_ADDRESS, OUT_X_LOW_XL, (uint8_t *)data, 6);
-    CHECK_RET(ret); // if (ret != RET_OK) { return ret; }
+ret_t magDataReadyHandler(uint16_t num_posts)
+{
+    return priv_sampleReady(kLSM9DS1_magStream, num_posts);
+}
 
-    // Build up a packet
-    rawPkt.header.timestamp = HAL_GetTick();
-    rawPkt.header.frame_num = gLSM9DS1Admin.accel_framenum;
-    gLSM9DS1Admin.accel_framenum += 1;
-    rawPkt.x = data[0];
-    rawPkt.y = data[1];
-    rawPkt.z = data[2];
+/*! Queues a read of the output registers of `stream`, if it has a sample waiting and isn't being
+ *  read already. The read takes the stream's DRDY count.
+ *
+ * @retval RET_OK, or what I2C_submit() returned if it couldn't be queued
+ */
+static ret_t priv_startRead(LSM9DS1_stream_t stream)
+{
+    ret_t ret;
 
-    // Normalize and queue it up
-    normalizeAccel(&rawPkt, &normPkt);
-    newqueue_push(&gLSM9DS1Admin.accel_queue, &normPkt, 1);
+    LSM9DS1_read_t *read = &gLSM9DS1Admin.reads[stream];
 
-    return ret;
+    if (gLSM9DS1Admin.samples_waiting[stream] == 0 || gLSM9DS1Admin.reading[stream] ||
+        gLSM9DS1Admin.backing_off) {
+        return RET_OK;
+    }
+    ret = I2C_submit(&read->i2c);
+    if (ret != RET_OK) {
+        // The queue's full. The samples stay waiting for the next DRDY to try again.
+        return (ret == RET_BUSY_ERR) ? RET_OK : ret;
+    }
+    gLSM9DS1Admin.reading[stream] = true;
+    read->posts = gLSM9DS1Admin.samples_waiting[stream];
+    // the DRDY of the sample in the output registers now, not whichever comes by the time it's in
+    read->drdy_time_us = gLSM9DS1Admin.drdy_time_us[stream];
+    gLSM9DS1Admin.samples_waiting[stream] = 0;
+    return RET_OK;
 }
 
-/*! Function to be ran after DRDY from gyro is detected. Should be ran in NON-interrupt context
- */
-ret_t gyroDataReadyHandler(int32_t *next_callback_ms)
+static ret_t priv_sampleReady(LSM9DS1_stream_t stream, uint16_t num_posts)
 {
-    ret_t ret = RET_OK;
-    int16_t data[3];
-
-    LOG_MSG(kLogLevelDebug, "DRH - Gyro");
+    if (num_posts == 0) {
+        // already counted when this post was
+        return RET_OK;
+    }
+    gLSM9DS1Admin.samples_waiting[stream] += num_posts;
+    return priv_startRead(stream);
+}
 
-    // We don't need to be called again until next ISR event
-    *next_callback_ms = SCHEDULER_FINISHED;
+//! Normalizes the sample that was just read straight into its ring and publishes it to all readers
+static void priv_publish(LSM9DS1_stream_t stream)
+{
+    LSM9DS1_read_t *read = &gLSM9DS1Admin.reads[stream];
+    broadcast_t *ring = &gLSM9DS1Admin.streams[stream];
+    int16_t *raw = gLSM9DS1Admin.read_data[stream];
+    uint32_t *framenum_ptr;
+    pkt_header_t header;
+
+    switch (stream) {
+        case kLSM9DS1_accelStream:
+            framenum_ptr = &gLSM9DS1Admin.accel_framenum;
+            break;
+        case kLSM9DS1_gyroStream:
+            framenum_ptr = &gLSM9DS1Admin.gyro_framenum;
+            break;
+        default:
+            framenum_ptr = &gLSM9DS1Admin.mag_framenum;
+            break;
+    }
 
-    // Read out the new data
-    // UART_sendString("g");
-    ret = I2C_readData(ACCEL_GYRO_ADDRESS, OUT_X_LOW_G, (uint8_t *)data, 6);
-    CHECK_RET(ret); // if (ret != RET_OK) { return ret; }
+    // Build up a packet
+    header.timestamp = read->drdy_time_us;
+    header.frame_num = *framenum_ptr;
+    *framenum_ptr += read->posts;
+
+    if (stream == kLSM9DS1_accelStream) {
+        accel_raw_t rawPkt = {header, raw[0], raw[1], raw[2]};
+        normalizeAccel(&rawPkt, broadcast_claim(ring));
+    } else if (stream == kLSM9DS1_gyroStream) {
+        gyro_raw_t rawPkt = {header, raw[0], raw[1], raw[2]};
+        normalizeGyro(&rawPkt, broadcast_claim(ring));
+    } else {
+        mag_raw_t rawPkt = {header, raw[0], raw[1], raw[2]};
+        normalizeMag(&rawPkt, broadcast_claim(ring));
+    }
+    broadcast_publish(ring);
+}
 
-    // Queue it up
+//! The backoff is over: reads start again, picking up whatever's been waiting
+static ret_t priv_retryReads(int32_t *callback_time_ms)
+{
+    ret_t ret = RET_OK;
 
-    // Check status register
+    *callback_time_ms = SCHEDULER_FINISHED;
+    gLSM9DS1Admin.backing_off = false;
+    for (uint8_t stream = 0; stream < kLSM9DS1_numStreams; stream++) {
+        ret_t stream_ret = priv_startRead((LSM9DS1_stream_t)stream);
+        if (stream_ret != RET_OK) {
+            ret = stream_ret;
+        }
+    }
     return ret;
 }
 
-/*! Function to be ran after DRDY from mag is detected.
+/*! A sample read is done (I2C callback, main context). Publishes it, then reads the stream
+ *  again if another DRDY came in while it was being read.
  *
- * Note: Should be ran in NON-interrupt context
+ * A failed read is counted and tried again, up to LSM9DS1_READ_RETRIES times: the sample is still
+ * in the chip, and its DRDY won't fire again until it's been read. After that the bus is in
+ * trouble (e.g. the sensor isn't answering), so reads stop for LSM9DS1_READ_BACKOFF_MS rather than
+ * keep the I2C queue full.
  */
-ret_t magDataReadyHandler(int32_t *next_callback_ms)
+static ret_t priv_readDone(i2c_transaction_t *transaction)
 {
-    ret_t ret = RET_OK;
-    int16_t data[3];
-    mag_raw_t rawPkt;
-    mag_norm_t normPkt;
-
-    LOG_MSG(kLogLevelDebug, "DRH - Mag");
-
-    // We don't need to be called again until next ISR event
-    *next_callback_ms = SCHEDULER_FINISHED;
+    LSM9DS1_read_t *read = (LSM9DS1_read_t *)transaction;
+    LSM9DS1_stream_t stream = (LSM9DS1_stream_t)(read - gLSM9DS1Admin.reads);
+    uint8_t schedule_id;
+    ret_t ret;
 
-    // Read out the new data
-    ret = I2C_readData(MAG_ADDRESS, OUT_X_L_M, (uint8_t *)data, 6);
-    CHECK_RET(ret); // if (ret != RET_OK) { return ret; }
+    gLSM9DS1Admin.reading[stream] = false;
+    if (transaction->ret != RET_OK) {
+        gLSM9DS1Admin.errors.read_errors += 1;
+        LOG_MSG_FMT_LIMITED(kLogLevelWarning, "Stream %u read failed: %i", stream,
+                            transaction->ret);
+        gLSM9DS1Admin.samples_waiting[stream] += read->posts;
+        if (read->retries < LSM9DS1_READ_RETRIES) {
+            read->retries += 1;
+            return priv_startRead(stream);
+        }
+        read->retries = 0;
+        if (gLSM9DS1Admin.backing_off) {
+            return RET_OK;
+        }
+        ret = scheduler_add(&gMainSchedule, LSM9DS1_READ_BACKOFF_MS, priv_retryReads, &schedule_id);
+        if (ret == RET_OK) {
+            gLSM9DS1Admin.backing_off = true;
+        }
+        return ret;
+    }
+    read->retries = 0;
 
-    // Build up a packet
-    rawPkt.header.timestamp = HAL_GetTick();
-    rawPkt.header.frame_num = gLSM9DS1Admin.mag_framenum;
-    gLSM9DS1Admin.mag_framenum += 1;
-    rawPkt.x = data[0];
-    rawPkt.y = data[1];
-    rawPkt.z = data[2];
-
-    // Normalize and queue it up
-    normalizeMag(&rawPkt, &normPkt);
-    newqueue_push(&gLSM9DS1Admin.mag_queue, &normPkt, 1);
-    return ret;
+    LOG_MSG_LIMITED(kLogLevelDebug, "DRH");
+    priv_publish(stream);
+    return priv_startRead(stream);
 }
 
 // -- Higher level data manipulation Functions
@@ -418,16 +562,31 @@ static void normalizeMag(mag_raw_t *raw_pkt, mag_norm_t *norm_pkt_ptr)
     // norm_pkt_ptr->z *= MagGainOffsets_Z[LSM303DLHC.mag_sensitivity - 1];
 }
 
+//! Degrees per second per LSB, indexed by gyro_fullscale_t (datasheet table 3, G_So)
+static const float gyro_sensitivity_dps[] = {
+    [k245DPS_fullscale] = 0.00875f,
+    [k500DPS_fullscale] = 0.0175f,
+    [k2000DPS_fullscale] = 0.07f,
+};
+
+//! Converts a raw gyro sample to degrees per second, for the full scale in use
+static void normalizeGyro(gyro_raw_t *raw_pkt, gyro_norm_t *norm_pkt_ptr)
+{
+    norm_pkt_ptr->header.frame_num = raw_pkt->header.frame_num;
+    norm_pkt_ptr->header.timestamp = raw_pkt->header.timestamp;
+    norm_pkt_ptr->x = (float)raw_pkt->x * gyro_sensitivity_dps[gLSM9DS1Admin.gyro_FS];
+    norm_pkt_ptr->y = (float)raw_pkt->y * gyro_sensitivity_dps[gLSM9DS1Admin.gyro_FS];
+    norm_pkt_ptr->z = (float)raw_pkt->z * gyro_sensitivity_dps[gLSM9DS1Admin.gyro_FS];
+}
+
 // --- ISR handlers that are called by EXTI IRQ handler in hardware.c
 
 void LSM9DS1_AGINT1_ISR(void)
 {
-    // queue up gyro DRDY handler for main to run
-    ret_t ret = RET_OK;
-    uint8_t sched_id; // we don't need to know the schedule ID...
-    ret = scheduler_add(&gMainSchedule, 0, gyroDataReadyHandler, &sched_id);
-    if (ret != RET_OK) {
-        // Critical error! we will miss INT1 ISR
+    // queue up gyro DRDY handler for main to run. If it's still pending from the last DRDY then
+    // main hasn't kept up and the sensor may have overwritten a sample.
+    gLSM9DS1Admin.drdy_time_us[kLSM9DS1_gyroStream] = time_us();
+    if (events_post(&gMainEvents, gLSM9DS1Admin.gyro_event)) {
         gLSM9DS1Admin.errors.INT1_IRQs_missed += 1;
     }
 
@@ -438,11 +597,8 @@ void LSM9DS1_AGINT1_ISR(void)
 void LSM9DS1_AGINT2_ISR(void)
 {
     // queue up accel DRDY handler for main to run
-    ret_t ret = RET_OK;
-    uint8_t sched_id; // we don't need to know the schedule ID...
-    ret = scheduler_add(&gMainSchedule, 0, accelDataReadyHandler, &sched_id);
-    if (ret != RET_OK) {
-        // Critical error! we will miss INT1 ISR
+    gLSM9DS1Admin.drdy_time_us[kLSM9DS1_accelStream] = time_us();
+    if (events_post(&gMainEvents, gLSM9DS1Admin.accel_event)) {
         gLSM9DS1Admin.errors.INT2_IRQs_missed += 1;
     }
 }
@@ -450,28 +606,72 @@ void LSM9DS1_AGINT2_ISR(void)
 void LSM9DS1_MDRDY_ISR(void)
 {
     // queue up Mag DRDY handler for main to run
-    ret_t ret = RET_OK;
-    uint8_t sched_id; // we don't need to know the schedule ID..
-    ret = scheduler_add(&gMainSchedule, 0, magDataReadyHandler, &sched_id);
-    if (ret != RET_OK) {
-        // Critical error! we will miss INT1 ISR
+    gLSM9DS1Admin.drdy_time_us[kLSM9DS1_magStream] = time_us();
+    if (events_post(&gMainEvents, gLSM9DS1Admin.mag_event)) {
         gLSM9DS1Admin.errors.DRDY_IRQs_missed += 1;
     }
 }
 
 // --- Accessor methods
 
-ret_t LSM9DS1_getAccelPacket(accel_norm_t *pkt_destination_ptr)
+/*! Subscribes a new consumer to one of the sensor streams. Every subscriber sees every packet, so
+ *  consumers never steal samples from each other.
+ *
+ * @param stream (LSM9DS1_stream_t): which sensor stream to follow
+ * @param reader_id_ptr (uint8_t *): set to the ID to pass to the other stream accessors
+ * @retval RET_OK if subscribed, RET_NOMEM_ERR if the stream has no free reader slots
+ */
+ret_t LSM9DS1_subscribe(LSM9DS1_stream_t stream, uint8_t *reader_id_ptr)
 {
-    return newqueue_pop(&gLSM9DS1Admin.accel_queue, pkt_destination_ptr, 1, eNoPeak);
+    if (stream >= kLSM9DS1_numStreams) {
+        return RET_INVALID_ARGS_ERR;
+    }
+    return broadcast_subscribe(&gLSM9DS1Admin.streams[stream], reader_id_ptr);
 }
 
-ret_t LSM9DS1_getGyroPacket(gyro_norm_t *pkt_destination_ptr)
+/*! Gives direct access to a stream's broadcast ring, for consumers that want to read packets in
+ *  place with broadcast_peek() / broadcast_release().
+ */
+broadcast_t *LSM9DS1_getStream(LSM9DS1_stream_t stream)
 {
-    return newqueue_pop(&gLSM9DS1Admin.gyro_queue, pkt_destination_ptr, 1, eNoPeak);
+    if (stream >= kLSM9DS1_numStreams) {
+        return NULL;
+    }
+    return &gLSM9DS1Admin.streams[stream];
 }
 
-ret_t LSM9DS1_getMagPacket(mag_norm_t *pkt_destination_ptr)
+ret_t LSM9DS1_getAccelPacket(uint8_t reader_id, accel_norm_t *pkt_destination_ptr)
 {
-    return newqueue_pop(&gLSM9DS1Admin.mag_queue, pkt_destination_ptr, 1, eNoPeak);
+    return getPacket(kLSM9DS1_accelStream, reader_id, pkt_destination_ptr, sizeof(accel_norm_t));
+}
+
+ret_t LSM9DS1_getGyroPacket(uint8_t reader_id, gyro_norm_t *pkt_destination_ptr)
+{
+    return getPacket(kLSM9DS1_gyroStream, reader_id, pkt_destination_ptr, sizeof(gyro_norm_t));
+}
+
+ret_t LSM9DS1_getMagPacket(uint8_t reader_id, mag_norm_t *pkt_destination_ptr)
+{
+    return getPacket(kLSM9DS1_magStream, reader_id, pkt_destination_ptr, sizeof(mag_norm_t));
+}
+
+/*! Copies the reader's oldest unread packet out of a stream. Packets that get overwritten while
+ *  being copied are thrown away and the next oldest one is tried.
+ */
+static ret_t getPacket(LSM9DS1_stream_t stream, uint8_t reader_id, void *pkt_destination_ptr,
+                       uint32_t pkt_size)
+{
+    ret_t ret;
+    const void *pkt_ptr;
+    broadcast_t *ring = &gLSM9DS1Admin.streams[stream];
+
+    do {
+        ret = broadcast_peek(ring, reader_id, &pkt_ptr);
+        if (ret != RET_OK) {
+            return ret;
+        }
+        memcpy(pkt_destination_ptr, pkt_ptr, pkt_size);
+    } while (broadcast_release(ring, reader_id) != RET_OK);
+
+    return RET_OK;
 }
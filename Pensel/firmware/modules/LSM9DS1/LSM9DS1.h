@@ -5,10 +5,19 @@
 
 #include "common.h"
 #include "modules/orientation/datatypes.h"
+#include "modules/utilities/broadcast.h"
+#include "peripherals/I2C/I2C.h"
 
 #define ACCEL_GYRO_ADDRESS (0b11010110) // 0xD6 (no R/W bit)
 #define MAG_ADDRESS (0b00111100)        // 0x1E (no R/W bit)
 
+#ifndef LSM9DS1_READ_RETRIES
+#define LSM9DS1_READ_RETRIES (3) //!< Times a failed sample read is tried again straight away
+#endif
+#ifndef LSM9DS1_READ_BACKOFF_MS
+#define LSM9DS1_READ_BACKOFF_MS (100) //!< How long reads wait once the retries are used up
+#endif
+
 // --- Public datatypes
 
 // CTRL_REG6_XL
@@ -63,17 +72,27 @@ typedef enum {
     kAccel_bandqidth_automatic,
 } accel_bandwidth_t;
 
+//! Sensor data streams that consumers can subscribe to
+typedef enum {
+    kLSM9DS1_accelStream,
+    kLSM9DS1_gyroStream,
+    kLSM9DS1_magStream,
+    kLSM9DS1_numStreams,
+} LSM9DS1_stream_t;
+
 typedef struct __attribute__((packed)) {
-    uint32_t INT1_IRQs_missed;
+    uint32_t INT1_IRQs_missed; //!< DRDY fired again before its handler got to run
     uint32_t INT2_IRQs_missed;
     uint32_t DRDY_IRQs_missed;
+    uint32_t read_errors;      //!< Sample reads that failed on the bus (and were tried again)
 } LSM9DS1_critical_errors_t;
 
 // --- Public functions
 
 ret_t LSM9DS1_init(gyro_ODR_t gyro_ODR, gyro_fullscale_t gyro_FS, accel_ODR_t accel_ODR,
                    accel_fullscale_t accel_FS);
-ret_t LSM9DS1_readStatus(uint8_t *status_byte_ptr);
+ret_t LSM9DS1_readStatusAsync(i2c_transaction_t *transaction, uint8_t *status_byte_ptr,
+                              i2c_callback_t callback);
 
 // Configuration methods...
 ret_t LSM9DS1_setAccel_ODR_FS(accel_ODR_t accel_ODR, accel_fullscale_t accel_FS);
@@ -86,6 +105,8 @@ void LSM9DS1_AGINT2_ISR(void);
 void LSM9DS1_MDRDY_ISR(void);
 
 // Accessors of new data
-ret_t LSM9DS1_getAccelPacket(accel_norm_t *pkt_destination_ptr);
-ret_t LSM9DS1_getGyroPacket(gyro_norm_t *pkt_destination_ptr);
-ret_t LSM9DS1_getMagPacket(mag_norm_t *pkt_destination_ptr);
+ret_t LSM9DS1_subscribe(LSM9DS1_stream_t stream, uint8_t *reader_id_ptr);
+broadcast_t *LSM9DS1_getStream(LSM9DS1_stream_t stream);
+ret_t LSM9DS1_getAccelPacket(uint8_t reader_id, accel_norm_t *pkt_destination_ptr);
+ret_t LSM9DS1_getGyroPacket(uint8_t reader_id, gyro_norm_t *pkt_destination_ptr);
+ret_t LSM9DS1_getMagPacket(uint8_t reader_id, mag_norm_t *pkt_destination_ptr);
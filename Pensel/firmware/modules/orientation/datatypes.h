@@ -5,7 +5,7 @@
 //! Packet header used in all packets
 typedef struct __attribute__((packed)) {
     uint32_t frame_num; //!< Frame number
-    uint32_t timestamp; //!< Timestamp when the packet was received
+    uint32_t timestamp; //!< time_us() when the packet was received
 } pkt_header_t;
 
 //! Raw accel packet definition
@@ -0,0 +1,205 @@
+/*!
+ * @file    broadcast.c
+ * @author  Tyler Holmes
+ *
+ * @date    18-Oct-2026
+ * @brief   Single producer, multi consumer broadcast ring.
+ *
+ * The writer keeps two free running sequence numbers. `claim_seq` is bumped before an item's slot
+ * is touched and `commit_seq` after the item is complete. A reader's item at `read_seq` is safe
+ * to use for as long as `claim_seq - read_seq <= num_items`, i.e. until the writer starts on the
+ * slot one full lap later. Readers check this again on release, so an item that was overwritten
+ * while being read in place is reported rather than silently used.
+ *
+ * Sequence numbers are unsigned and wrap, all comparisons are done on differences.
+ */
+#include "broadcast.h"
+#include "common.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+static broadcast_reader_t *priv_get_reader(broadcast_t *ring, uint8_t reader_id);
+
+/*! Initializes a broadcast ring on top of caller owned storage.
+ *
+ * @param ring (broadcast_t *): ring to initialize
+ * @param buff_ptr (void *): storage for at least `num_items * item_size` bytes
+ * @param num_items (uint32_t): number of items the ring can hold
+ * @param item_size (uint32_t): size (in bytes) of each item
+ * @retval RET_OK if initialized, RET_INVALID_ARGS_ERR if given an empty ring
+ */
+ret_t broadcast_init(broadcast_t *ring, void *buff_ptr, uint32_t num_items, uint32_t item_size)
+{
+    if (buff_ptr == NULL || num_items == 0 || item_size == 0) {
+        return RET_INVALID_ARGS_ERR;
+    }
+    ring->claim_seq = 0;
+    ring->commit_seq = 0;
+    ring->num_items = num_items;
+    ring->item_size = item_size;
+    ring->buff_ptr = (uint8_t *)buff_ptr;
+    for (uint8_t i = 0; i < BROADCAST_MAX_READERS; i++) {
+        ring->readers[i].active = false;
+        ring->readers[i].read_seq = 0;
+        ring->readers[i].overrun_count = 0;
+    }
+    return RET_OK;
+}
+
+/*! Adds a reader to the ring. New readers only see items published after they subscribe.
+ *
+ * @param ring (broadcast_t *): ring to read from
+ * @param reader_id_ptr (uint8_t *): set to the ID to use in all further reader calls
+ * @retval RET_OK if subscribed, RET_NOMEM_ERR if all reader slots are in use
+ */
+ret_t broadcast_subscribe(broadcast_t *ring, uint8_t *reader_id_ptr)
+{
+    for (uint8_t i = 0; i < BROADCAST_MAX_READERS; i++) {
+        if (!ring->readers[i].active) {
+            ring->readers[i].read_seq = __atomic_load_n(&ring->commit_seq, __ATOMIC_ACQUIRE);
+            ring->readers[i].overrun_count = 0;
+            ring->readers[i].active = true;
+            *reader_id_ptr = i;
+            return RET_OK;
+        }
+    }
+    return RET_NOMEM_ERR;
+}
+
+/*! Frees up a reader slot.
+ */
+ret_t broadcast_unsubscribe(broadcast_t *ring, uint8_t reader_id)
+{
+    broadcast_reader_t *reader = priv_get_reader(ring, reader_id);
+    if (reader == NULL) {
+        return RET_INVALID_ARGS_ERR;
+    }
+    reader->active = false;
+    return RET_OK;
+}
+
+/*! Returns the slot the next item should be written into. The writer fills it in place and then
+ *  calls broadcast_publish(). Only one item may be claimed at a time.
+ *
+ * @param ring (broadcast_t *): ring to write to
+ * @return pointer to `item_size` bytes of writable storage
+ */
+void *broadcast_claim(broadcast_t *ring)
+{
+    uint32_t seq = ring->claim_seq;
+    __atomic_store_n(&ring->claim_seq, seq + 1, __ATOMIC_RELAXED);
+    // readers must see the claim before any of the slot's bytes change
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return ring->buff_ptr + (seq % ring->num_items) * ring->item_size;
+}
+
+/*! Makes the most recently claimed item visible to all readers.
+ */
+void broadcast_publish(broadcast_t *ring)
+{
+    __atomic_store_n(&ring->commit_seq, ring->claim_seq, __ATOMIC_RELEASE);
+}
+
+/*! Copies an item into the ring and publishes it.
+ *
+ * @param ring (broadcast_t *): ring to write to
+ * @param item_ptr (const void *): item of `item_size` bytes
+ */
+void broadcast_push(broadcast_t *ring, const void *item_ptr)
+{
+    memcpy(broadcast_claim(ring), item_ptr, ring->item_size);
+    broadcast_publish(ring);
+}
+
+/*! Gets a pointer to the reader's oldest unread item, without consuming it.
+ *
+ * If the writer has lapped this reader, the reader is first moved forward to the oldest item still
+ * held in the ring and the skipped items are added to its overrun count.
+ *
+ * @param ring (broadcast_t *): ring to read from
+ * @param reader_id (uint8_t): ID given by broadcast_subscribe()
+ * @param item_pp (const void **): set to the item, valid until broadcast_release()
+ * @retval RET_OK if an item is available, RET_NODATA_ERR if the reader is caught up
+ */
+ret_t broadcast_peek(broadcast_t *ring, uint8_t reader_id, const void **item_pp)
+{
+    broadcast_reader_t *reader = priv_get_reader(ring, reader_id);
+    if (reader == NULL) {
+        return RET_INVALID_ARGS_ERR;
+    }
+
+    uint32_t claim = __atomic_load_n(&ring->claim_seq, __ATOMIC_ACQUIRE);
+    uint32_t commit = __atomic_load_n(&ring->commit_seq, __ATOMIC_ACQUIRE);
+    uint32_t read = reader->read_seq;
+
+    if (claim - read > ring->num_items) {
+        reader->overrun_count += claim - ring->num_items - read;
+        read = claim - ring->num_items;
+        reader->read_seq = read;
+    }
+    if (commit == read) {
+        return RET_NODATA_ERR;
+    }
+
+    *item_pp = ring->buff_ptr + (read % ring->num_items) * ring->item_size;
+    return RET_OK;
+}
+
+/*! Consumes the item returned by the last broadcast_peek().
+ *
+ * @param ring (broadcast_t *): ring to read from
+ * @param reader_id (uint8_t): ID given by broadcast_subscribe()
+ * @retval RET_OK if the item was intact for the whole time it was held,
+ *         RET_VAL_ERR if the writer started overwriting it (counted as an overrun)
+ */
+ret_t broadcast_release(broadcast_t *ring, uint8_t reader_id)
+{
+    broadcast_reader_t *reader = priv_get_reader(ring, reader_id);
+    if (reader == NULL) {
+        return RET_INVALID_ARGS_ERR;
+    }
+
+    // all reads of the item must be done before we look at the writer again
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    uint32_t claim = __atomic_load_n(&ring->claim_seq, __ATOMIC_RELAXED);
+    uint32_t read = reader->read_seq;
+
+    reader->read_seq = read + 1;
+    if (claim - read > ring->num_items) {
+        reader->overrun_count += 1;
+        return RET_VAL_ERR;
+    }
+    return RET_OK;
+}
+
+/*! Number of published items the reader has yet to consume. Anything larger than the ring size
+ *  will be reported as overruns on the next peek.
+ */
+uint32_t broadcast_lag(broadcast_t *ring, uint8_t reader_id)
+{
+    broadcast_reader_t *reader = priv_get_reader(ring, reader_id);
+    if (reader == NULL) {
+        return 0;
+    }
+    return __atomic_load_n(&ring->commit_seq, __ATOMIC_ACQUIRE) - reader->read_seq;
+}
+
+/*! Number of items this reader has lost to the writer lapping it.
+ */
+uint32_t broadcast_overruns(broadcast_t *ring, uint8_t reader_id)
+{
+    broadcast_reader_t *reader = priv_get_reader(ring, reader_id);
+    if (reader == NULL) {
+        return 0;
+    }
+    return reader->overrun_count;
+}
+
+static broadcast_reader_t *priv_get_reader(broadcast_t *ring, uint8_t reader_id)
+{
+    if (reader_id >= BROADCAST_MAX_READERS || !ring->readers[reader_id].active) {
+        return NULL;
+    }
+    return &ring->readers[reader_id];
+}
@@ -0,0 +1,66 @@
+/*!
+ * @file    broadcast.h
+ * @author  Tyler Holmes
+ *
+ * @date    18-Oct-2026
+ * @brief   Single producer, multi consumer broadcast ring.
+ *
+ * One writer pushes items into a fixed ring, and every subscribed reader walks the ring with its
+ * own cursor. Items are written once and read in place, so any number of consumers can share the
+ * same buffer without copies or stealing samples from each other.
+ *
+ * The writer never waits on readers. A reader that falls more than a full ring behind is skipped
+ * forward to the oldest item still in the ring, and the skipped items are added to its overrun
+ * count.
+ *
+ * Typical reader usage:
+ *
+ *      const accel_norm_t *pkt;
+ *      while (broadcast_peek(&ring, reader_id, (const void **)&pkt) == RET_OK) {
+ *          use(pkt);
+ *          if (broadcast_release(&ring, reader_id) != RET_OK) {
+ *              // writer lapped us while we were reading, discard what we used
+ *          }
+ *      }
+ */
+#pragma once
+
+#include "common.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef BROADCAST_MAX_READERS
+#define BROADCAST_MAX_READERS (4) //!< Maximum number of readers that can subscribe to one ring
+#endif
+
+//! Per reader state
+typedef struct {
+    volatile uint32_t read_seq;      //!< Sequence number of the next item this reader will see
+    volatile uint32_t overrun_count; //!< Number of items this reader lost to the writer lapping it
+    bool active;                     //!< Whether or not this reader slot is in use
+} broadcast_reader_t;
+
+//! Keeps track of all variables needed to track the broadcast ring.
+typedef struct {
+    volatile uint32_t claim_seq;  //!< Number of items the writer has started writing
+    volatile uint32_t commit_seq; //!< Number of items the writer has finished writing
+    uint32_t num_items;           //!< The number of items this ring can hold
+    uint32_t item_size;           //!< The size (in bytes) of each item
+    uint8_t *buff_ptr;            //!< Pointer to the (caller owned) item storage
+    broadcast_reader_t readers[BROADCAST_MAX_READERS]; //!< Reader cursors
+} broadcast_t;
+
+ret_t broadcast_init(broadcast_t *ring, void *buff_ptr, uint32_t num_items, uint32_t item_size);
+ret_t broadcast_subscribe(broadcast_t *ring, uint8_t *reader_id_ptr);
+ret_t broadcast_unsubscribe(broadcast_t *ring, uint8_t reader_id);
+
+// Writer side
+void *broadcast_claim(broadcast_t *ring);
+void broadcast_publish(broadcast_t *ring);
+void broadcast_push(broadcast_t *ring, const void *item_ptr);
+
+// Reader side
+ret_t broadcast_peek(broadcast_t *ring, uint8_t reader_id, const void **item_pp);
+ret_t broadcast_release(broadcast_t *ring, uint8_t reader_id);
+uint32_t broadcast_lag(broadcast_t *ring, uint8_t reader_id);
+uint32_t broadcast_overruns(broadcast_t *ring, uint8_t reader_id);
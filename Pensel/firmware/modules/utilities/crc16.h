@@ -0,0 +1,25 @@
+/*!
+ * @file    crc16.h
+ * @author  Tyler Holmes
+ *
+ * @date    18-Oct-2026
+ * @brief   Table driven CRC-16 (CCITT: polynomial 0x1021, starts at 0xFFFF, not reflected).
+ *
+ * Sent high byte first after the data it covers, the CRC of the data and the CRC together comes
+ * out as 0, so a receiver can run it over the whole frame without knowing where the data ends.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#define CRC16_INIT (0xFFFF) //!< What a CRC starts at
+
+extern const uint16_t gCrc16Table[256];
+
+//! Adds one byte to a running CRC
+static inline uint16_t crc16_byte(uint16_t crc, uint8_t byte)
+{
+    return (uint16_t)(crc << 8) ^ gCrc16Table[(uint8_t)(crc >> 8) ^ byte];
+}
+
+uint16_t crc16(uint16_t crc, const uint8_t *data_ptr, uint32_t num_bytes);
@@ -0,0 +1,100 @@
+/*!
+ * @file    events.c
+ * @author  Tyler Holmes
+ *
+ * @date    18-Oct-2026
+ * @brief   Lock-free deferred work from interrupt context to the main loop.
+ */
+#include "events.h"
+#include "common.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+ret_t events_init(events_t *events)
+{
+    events->pending = 0;
+    events->num_registered = 0;
+    events->handler_errors = 0;
+    for (uint8_t i = 0; i < EVENTS_MAX; i++) {
+        events->handlers[i] = NULL;
+        events->num_posts[i] = 0;
+    }
+    return RET_OK;
+}
+
+/*! Gets an event ID for a handler. Call at init, before anything can post the event.
+ *
+ * @param events (events_t *): events to register with
+ * @param handler (event_handler_t): run in main context when the event has been posted
+ * @param event_id_ptr (uint8_t *): set to the ID to pass to events_post()
+ * @retval RET_OK if registered, RET_NOMEM_ERR if all event IDs are used
+ */
+ret_t events_register(events_t *events, event_handler_t handler, uint8_t *event_id_ptr)
+{
+    if (handler == NULL) {
+        return RET_INVALID_ARGS_ERR;
+    }
+    if (events->num_registered >= EVENTS_MAX) {
+        return RET_NOMEM_ERR;
+    }
+    events->handlers[events->num_registered] = handler;
+    *event_id_ptr = events->num_registered;
+    events->num_registered += 1;
+    return RET_OK;
+}
+
+/*! Marks an event as pending and counts the post. Safe to call from any interrupt priority.
+ *
+ * @param events (events_t *): events to post to
+ * @param event_id (uint8_t): ID from events_register()
+ * @return true if the event was already pending (this post was merged with an earlier one)
+ */
+bool events_post(events_t *events, uint8_t event_id)
+{
+    uint8_t ind = event_id & (EVENTS_MAX - 1);
+    uint32_t mask = 1UL << ind;
+    uint32_t previous;
+
+    // count first, so the dispatch that sees the bit also sees the count
+    __atomic_fetch_add(&events->num_posts[ind], 1, __ATOMIC_RELAXED);
+    previous = __atomic_fetch_or(&events->pending, mask, __ATOMIC_RELEASE);
+    return (previous & mask) != 0;
+}
+
+/*! Whether or not any events are waiting to be dispatched.
+ */
+bool events_pending(events_t *events)
+{
+    return __atomic_load_n(&events->pending, __ATOMIC_RELAXED) != 0;
+}
+
+/*! Runs the handler of every pending event, lowest ID first. Main context only.
+ *
+ * Events posted while the handlers run (including by the handlers themselves) are left pending
+ * for the next call, so this always returns.
+ *
+ * @return number of handlers that were run
+ */
+uint8_t events_dispatch(events_t *events)
+{
+    uint8_t num_run = 0;
+    uint32_t pending;
+
+    if (!events_pending(events)) {
+        return 0;
+    }
+    pending = __atomic_exchange_n(&events->pending, 0, __ATOMIC_ACQUIRE);
+
+    while (pending != 0) {
+        uint8_t event_id = (uint8_t)__builtin_ctz(pending);
+        uint16_t num_posts = __atomic_exchange_n(&events->num_posts[event_id], 0, __ATOMIC_RELAXED);
+        pending &= pending - 1;
+        if (events->handlers[event_id] != NULL) {
+            if (events->handlers[event_id](num_posts) != RET_OK) {
+                events->handler_errors += 1;
+            }
+            num_run += 1;
+        }
+    }
+    return num_run;
+}
@@ -0,0 +1,41 @@
+/*!
+ * @file    events.h
+ * @author  Tyler Holmes
+ *
+ * @date    18-Oct-2026
+ * @brief   Lock-free deferred work from interrupt context to the main loop.
+ *
+ * Each event is one bit in a pending mask. ISRs post an event with a single atomic OR and the
+ * main loop swaps the whole mask out and runs the handler of every event that was set. Posting
+ * never fails and never touches anything but the mask, so ISRs can't race the scheduler tables.
+ *
+ * An event posted several times before the main loop gets to it runs its handler once, and the
+ * handler is told how many posts it covers. Handlers must therefore deal with all of the work that
+ * is available when they run (e.g. drain a FIFO) rather than assume one post == one unit of work.
+ */
+#pragma once
+
+#include "common.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define EVENTS_MAX (32) //!< One bit each in the pending mask
+
+/*! Runs in main context. `num_posts` is how many times the event was posted since the handler
+ *  last ran. It can be 0 if a post raced the previous dispatch, in which case the handler already
+ *  saw that work last time and should just check for anything new. */
+typedef ret_t (*event_handler_t)(uint16_t num_posts);
+
+typedef struct {
+    volatile uint32_t pending;               //!< Bit N set if event N has been posted
+    volatile uint16_t num_posts[EVENTS_MAX]; //!< Posts of each event since its handler last ran
+    event_handler_t handlers[EVENTS_MAX];    //!< What to run for each event
+    uint8_t num_registered;                  //!< Number of event IDs handed out
+    uint32_t handler_errors;                 //!< Number of times a handler didn't return RET_OK
+} events_t;
+
+ret_t events_init(events_t *events);
+ret_t events_register(events_t *events, event_handler_t handler, uint8_t *event_id_ptr);
+bool events_post(events_t *events, uint8_t event_id);
+bool events_pending(events_t *events);
+uint8_t events_dispatch(events_t *events);
@@ -0,0 +1,237 @@
+/*!
+ * @file    flightrec.c
+ * @author  Tyler Holmes
+ *
+ * @date    18-Oct-2026
+ * @brief   Post-mortem flight recorder that survives resets.
+ *
+ * Entries are written like the binary log ring: a writer claims an entry number with one atomic
+ * add and fills in the slot, checksum last, so interrupts can record too. The entry numbers aren't
+ * kept in `.noinit`, they're worked out again on boot from the newest valid entry.
+ */
+#include "flightrec.h"
+#include "common.h"
+#include <stddef.h>
+#include <string.h>
+
+#if (FLIGHTREC_LEN & (FLIGHTREC_LEN - 1)) != 0
+#error "FLIGHTREC_LEN must be a power of 2"
+#endif
+
+flightrec_t gFlightrec __attribute__((section(".noinit")));
+
+static volatile uint32_t gHead; //!< Next entry number
+static uint32_t (*gGetTime_ms)(void);
+
+static uint8_t priv_sum(const void *data_ptr, uint32_t length)
+{
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        sum += ((const uint8_t *)data_ptr)[i];
+    }
+    return sum;
+}
+
+static void priv_sealSummary(void)
+{
+    gFlightrec.checksum = 0;
+    gFlightrec.checksum = -priv_sum(&gFlightrec, offsetof(flightrec_t, checksum) + 1);
+}
+
+static bool priv_entryValid(const flightrec_entry_t *entry)
+{
+    return entry->type != kFlightrecNone && priv_sum(entry, sizeof(*entry)) == 0;
+}
+
+//! Entry number `seq` if it's still there and intact, otherwise NULL
+static const flightrec_entry_t *priv_entry(uint32_t seq)
+{
+    const flightrec_entry_t *entry = &gFlightrec.entries[seq & (FLIGHTREC_LEN - 1)];
+    return (entry->seq == seq && priv_entryValid(entry)) ? entry : NULL;
+}
+
+//! First entry number that could still be there
+static uint32_t priv_oldest(uint32_t head)
+{
+    return (head > FLIGHTREC_LEN) ? head - FLIGHTREC_LEN : 0;
+}
+
+/*! Checks what the last run left behind, and starts recording this one.
+ *
+ * @param get_curTime_ms_ptr (function pointer): timestamps for the entries
+ * @param reset_flags (uint32_t): why we reset (RCC->CSR), kept for the report
+ * @param watchdog_reset (bool): the watchdog reset us, i.e. the last run stalled
+ */
+ret_t flightrec_init(uint32_t (*get_curTime_ms_ptr)(void), uint32_t reset_flags,
+                     bool watchdog_reset)
+{
+    uint32_t head = 0;
+    bool found = false;
+    gGetTime_ms = get_curTime_ms_ptr;
+
+    if (gFlightrec.magic != FLIGHTREC_MAGIC ||
+        priv_sum(&gFlightrec, offsetof(flightrec_t, checksum) + 1) != 0) {
+        // power on (or garbage), start from scratch
+        memset(&gFlightrec, 0, sizeof(gFlightrec));
+        gFlightrec.magic = FLIGHTREC_MAGIC;
+        gFlightrec.summary.crash_task = FLIGHTREC_NO_TASK;
+    } else {
+        // pick up numbering after the newest entry that made it
+        for (uint32_t i = 0; i < FLIGHTREC_LEN; i++) {
+            flightrec_entry_t *entry = &gFlightrec.entries[i];
+            if (priv_entryValid(entry) && (!found || (int32_t)(entry->seq - head) >= 0)) {
+                head = entry->seq + 1;
+                found = true;
+            }
+        }
+        if (watchdog_reset && !gFlightrec.summary.crashed) {
+            // a stall: nothing got to record it, but we know what was running
+            gFlightrec.summary.crashed = 1;
+            gFlightrec.summary.crash_task = gFlightrec.task;
+        }
+    }
+    gHead = head;
+    gFlightrec.task = FLIGHTREC_NO_TASK;
+
+    gFlightrec.summary.boots += 1;
+    gFlightrec.summary.reset_flags = reset_flags;
+    priv_sealSummary();
+
+    flightrec_record(kFlightrecBoot, (uint16_t)gFlightrec.summary.boots, reset_flags);
+    return RET_OK;
+}
+
+//! Whether we're holding on to a crash from an earlier run
+bool flightrec_hasCrash(void) { return gFlightrec.summary.crashed != 0; }
+
+/*! Lets go of the crash (once it's been read out), and starts recording again. The entries are
+ *  kept.
+ */
+void flightrec_clear(void)
+{
+    gFlightrec.summary.crashed = 0;
+    gFlightrec.summary.crash_task = FLIGHTREC_NO_TASK;
+    memset(&gFlightrec.summary.fault, 0, sizeof(gFlightrec.summary.fault));
+    priv_sealSummary();
+}
+
+/*! Adds an entry, overwriting the oldest. Does nothing while a crash is being held. Safe from
+ *  interrupts.
+ *
+ * @param type (flightrec_type_t): what happened
+ * @param code, arg: details, see flightrec_type_t
+ */
+void flightrec_record(flightrec_type_t type, uint16_t code, uint32_t arg)
+{
+    uint32_t seq;
+    flightrec_entry_t *entry;
+
+    if (gFlightrec.summary.crashed) {
+        return;
+    }
+
+    seq = __atomic_fetch_add(&gHead, 1, __ATOMIC_RELAXED);
+    entry = &gFlightrec.entries[seq & (FLIGHTREC_LEN - 1)];
+    entry->checksum = 0;
+    entry->type = kFlightrecNone;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+    entry->seq = seq;
+    entry->timestamp_ms = (gGetTime_ms != NULL) ? gGetTime_ms() : 0;
+    entry->arg = arg;
+    entry->code = code;
+    entry->type = (uint8_t)type;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    entry->checksum = -priv_sum(entry, sizeof(*entry));
+}
+
+/*! Scheduler trace hook (scheduler_setTraceHook()): keeps track of the running task, and records
+ *  the ones that fail.
+ */
+void flightrec_taskTrace(uint8_t schedule_id, bool done, ret_t ret)
+{
+    if (!done) {
+        gFlightrec.task = schedule_id;
+        return;
+    }
+    gFlightrec.task = FLIGHTREC_NO_TASK;
+    if (ret != RET_OK) {
+        flightrec_record(kFlightrecTaskError, schedule_id, (uint32_t)ret);
+    }
+}
+
+/*! Log recorder hook (log_setRecorder()): records errors and warnings as they're logged, before
+ *  they've been sent anywhere.
+ */
+void flightrec_log(log_level_t level, uint16_t id, uint32_t arg)
+{
+    if (level == kLogLevelError) {
+        flightrec_record(kFlightrecLogError, id, arg);
+    } else if (level == kLogLevelWarning) {
+        flightrec_record(kFlightrecLogWarning, id, arg);
+    }
+}
+
+/*! Records a crash: the entry, the fault registers and the running task. Kept until
+ *  flightrec_clear(), so call this last thing before resetting / spinning. If a crash is already
+ *  held, the first one wins.
+ *
+ * @param type (flightrec_type_t): kFlightrecFatal or kFlightrecFault
+ * @param code, arg: details, see flightrec_type_t
+ * @param fault (const flightrec_fault_t *): registers, NULL if there aren't any
+ */
+void flightrec_crash(flightrec_type_t type, uint16_t code, uint32_t arg,
+                     const flightrec_fault_t *fault)
+{
+    if (gFlightrec.summary.crashed) {
+        return;
+    }
+    flightrec_record(type, code, arg);
+
+    gFlightrec.summary.crashed = 1;
+    gFlightrec.summary.crash_task = gFlightrec.task;
+    if (fault != NULL) {
+        memcpy(&gFlightrec.summary.fault, fault, sizeof(gFlightrec.summary.fault));
+    } else {
+        memset(&gFlightrec.summary.fault, 0, sizeof(gFlightrec.summary.fault));
+    }
+    priv_sealSummary();
+}
+
+//! Copies out the summary of the recorder
+void flightrec_getSummary(flightrec_summary_t *summary_ptr)
+{
+    uint32_t head = __atomic_load_n(&gHead, __ATOMIC_ACQUIRE);
+    uint8_t num_entries = 0;
+    for (uint32_t seq = priv_oldest(head); seq != head; seq++) {
+        if (priv_entry(seq) != NULL) {
+            num_entries += 1;
+        }
+    }
+    memcpy(summary_ptr, &gFlightrec.summary, sizeof(*summary_ptr));
+    summary_ptr->num_entries = num_entries;
+}
+
+/*! Gets a valid entry, oldest first.
+ *
+ * @param index (uint8_t): 0 for the oldest
+ * @param entry_ptr (flightrec_entry_t *): where to copy it
+ * @return RET_OK, or RET_NODATA_ERR if there aren't that many
+ */
+ret_t flightrec_getEntry(uint8_t index, flightrec_entry_t *entry_ptr)
+{
+    uint32_t head = __atomic_load_n(&gHead, __ATOMIC_ACQUIRE);
+
+    for (uint32_t seq = priv_oldest(head); seq != head; seq++) {
+        const flightrec_entry_t *entry = priv_entry(seq);
+        if (entry == NULL) {
+            continue;
+        }
+        if (index == 0) {
+            memcpy(entry_ptr, entry, sizeof(*entry_ptr));
+            return RET_OK;
+        }
+        index -= 1;
+    }
+    return RET_NODATA_ERR;
+}
@@ -0,0 +1,94 @@
+/*!
+ * @file    flightrec.h
+ * @author  Tyler Holmes
+ *
+ * @date    18-Oct-2026
+ * @brief   Post-mortem flight recorder that survives resets.
+ *
+ * Keeps the last FLIGHTREC_LEN events (boots, failed tasks, error / warning logs, fatal errors,
+ * faults), the scheduler task that's running, and the fault registers of the last crash in
+ * `.noinit` RAM, which the startup code doesn't clear. On the next boot flightrec_init() checks it
+ * with a magic number and checksums, and if the last run crashed (fault, fatal error, or a
+ * watchdog reset, i.e. a stall) it holds on to it until it's read out (see hid.c) and cleared.
+ *
+ * Each entry has its own checksum, so a reset in the middle of writing one only loses that one.
+ */
+#pragma once
+
+#include "common.h"
+#include "modules/utilities/logging.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef FLIGHTREC_LEN
+#define FLIGHTREC_LEN (32) //!< Entries kept (power of 2)
+#endif
+
+#define FLIGHTREC_MAGIC (0x464C5452) //!< "FLTR"
+#define FLIGHTREC_NO_TASK (0xFFFF)   //!< Task ID when no scheduler callback is running
+
+typedef enum {
+    kFlightrecNone,       //!< Unused entry
+    kFlightrecBoot,       //!< code: boot number (low 16 bits), arg: reset flags (RCC->CSR)
+    kFlightrecTaskError,  //!< code: schedule ID, arg: what the callback returned (ret_t)
+    kFlightrecLogError,   //!< code: log ID (binary logs) or line, arg: first arg
+    kFlightrecLogWarning, //!< code: log ID (binary logs) or line, arg: first arg
+    kFlightrecFatal,      //!< code: error code, arg: line (fault.pc is the caller)
+    kFlightrecFault,      //!< code: exception number, arg: faulting PC
+} flightrec_type_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t seq;          //!< Entry number, the order they were written in
+    uint32_t timestamp_ms; //!< When it happened
+    uint32_t arg;          //!< Depends on the type
+    uint16_t code;         //!< Depends on the type
+    uint8_t type;          //!< flightrec_type_t
+    uint8_t checksum;      //!< All the bytes of the entry sum to 0
+} flightrec_entry_t;
+
+//! What a fault (or fatal error) left behind
+typedef struct __attribute__((packed)) {
+    uint32_t cfsr;  //!< Configurable fault status (MemManage / BusFault / UsageFault)
+    uint32_t hfsr;  //!< HardFault status
+    uint32_t mmfar; //!< MemManage fault address
+    uint32_t bfar;  //!< BusFault address
+    uint32_t pc;    //!< Stacked PC, or where fatal_error_handler() was called from
+    uint32_t lr;    //!< Stacked LR
+    uint32_t psr;   //!< Stacked xPSR
+} flightrec_fault_t;
+
+//! State of the recorder, first thing in the report
+typedef struct __attribute__((packed)) {
+    uint32_t boots;          //!< Boots since the recorder was set up
+    uint32_t reset_flags;    //!< RCC->CSR at the last boot
+    uint16_t crash_task;     //!< Task that was running when it crashed (or FLIGHTREC_NO_TASK)
+    uint8_t crashed;         //!< The recorder is holding a crash, nothing new gets recorded
+    uint8_t num_entries;     //!< Valid entries
+    flightrec_fault_t fault; //!< Registers of the crash
+} flightrec_summary_t;
+
+//! Everything that survives a reset
+typedef struct {
+    uint32_t magic;              //!< FLIGHTREC_MAGIC once set up
+    flightrec_summary_t summary; //!< Only changes on boot / crash / clear
+    uint8_t checksum;            //!< magic and summary sum to 0 with this
+    volatile uint16_t task;      //!< Scheduler task running right now
+    flightrec_entry_t entries[FLIGHTREC_LEN];
+} flightrec_t;
+
+//! The recorder itself, in `.noinit`. Only for tests to poke at, use the functions below.
+extern flightrec_t gFlightrec;
+
+ret_t flightrec_init(uint32_t (*get_curTime_ms_ptr)(void), uint32_t reset_flags,
+                     bool watchdog_reset);
+bool flightrec_hasCrash(void);
+void flightrec_clear(void);
+
+void flightrec_record(flightrec_type_t type, uint16_t code, uint32_t arg);
+void flightrec_taskTrace(uint8_t schedule_id, bool done, ret_t ret);
+void flightrec_log(log_level_t level, uint16_t id, uint32_t arg);
+void flightrec_crash(flightrec_type_t type, uint16_t code, uint32_t arg,
+                     const flightrec_fault_t *fault);
+
+void flightrec_getSummary(flightrec_summary_t *summary_ptr);
+ret_t flightrec_getEntry(uint8_t index, flightrec_entry_t *entry_ptr);
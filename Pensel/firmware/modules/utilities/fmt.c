@@ -0,0 +1,159 @@
+/*!
+ * @file    fmt.c
+ * @author  Tyler Holmes
+ *
+ * @date    18-Oct-2026
+ * @brief   Number formatting into a caller's buffer, without printf.
+ */
+#include "fmt.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/*! Writes the digits of `value` (at least `min_digits` of them, zero padded) at buf[pos],
+ *  backwards from the end so nothing has to be reversed.
+ *
+ * @retval Where the next character goes, or 0 if it didn't fit before buf_len
+ */
+static uint32_t priv_putDigits(uint64_t value, uint8_t base, uint8_t min_digits, char *buf,
+                               uint32_t pos, uint32_t buf_len)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    uint8_t num_digits = 0;
+    uint64_t rest = value;
+
+    do {
+        num_digits += 1;
+        rest /= base;
+    } while (rest != 0);
+    if (num_digits < min_digits) {
+        num_digits = min_digits;
+    }
+    if (pos + num_digits >= buf_len) {
+        return 0;
+    }
+    for (uint8_t i = num_digits; i > 0; i--) {
+        buf[pos + i - 1] = digits[value % base];
+        value /= base;
+    }
+    return pos + num_digits;
+}
+
+//! Writes `str` at buf[pos]. Returns where the next character goes, or 0 if it didn't fit.
+static uint32_t priv_putString(const char *str, char *buf, uint32_t pos, uint32_t buf_len)
+{
+    for (; *str != '\0'; str++) {
+        if (pos + 1 >= buf_len) {
+            return 0;
+        }
+        buf[pos++] = *str;
+    }
+    return pos;
+}
+
+//! Magnitude of a signed value, INT64_MIN included
+static uint64_t priv_magnitude(int64_t value)
+{
+    return (value < 0) ? 0 - (uint64_t)value : (uint64_t)value;
+}
+
+//! Null terminates at pos if it's not 0 (a failure), and returns the length
+static uint32_t priv_finish(char *buf, uint32_t pos, uint32_t buf_len)
+{
+    if (pos == 0) {
+        if (buf_len != 0) {
+            buf[0] = '\0';
+        }
+        return 0;
+    }
+    buf[pos] = '\0';
+    return pos;
+}
+
+/*! Formats in hex, a whole number of bytes: -0x1F, 0x00, 0x0100
+ *
+ * @param value (int64_t): the number
+ * @param buf (char *): where it goes
+ * @param buf_len (uint32_t): room at buf, FMT_HEX_MAX always fits
+ * @retval Characters written, not counting the null. 0 if it didn't fit.
+ */
+uint32_t fmt_hex(int64_t value, char *buf, uint32_t buf_len)
+{
+    uint64_t magnitude = priv_magnitude(value);
+    uint8_t num_digits = 2;
+    uint32_t pos = priv_putString((value < 0) ? "-0x" : "0x", buf, 0, buf_len);
+
+    while (num_digits < 16 && (magnitude >> (4 * num_digits)) != 0) {
+        num_digits += 2;
+    }
+    if (pos != 0) {
+        pos = priv_putDigits(magnitude, 16, num_digits, buf, pos, buf_len);
+    }
+    return priv_finish(buf, pos, buf_len);
+}
+
+/*! Formats in decimal
+ *
+ * @param value (int64_t): the number
+ * @param buf (char *): where it goes
+ * @param buf_len (uint32_t): room at buf, FMT_INT_MAX always fits
+ * @retval Characters written, not counting the null. 0 if it didn't fit.
+ */
+uint32_t fmt_int(int64_t value, char *buf, uint32_t buf_len)
+{
+    uint32_t pos = (value < 0) ? priv_putString("-", buf, 0, buf_len) : 0;
+
+    if (value < 0 && pos == 0) {
+        return priv_finish(buf, 0, buf_len);
+    }
+    pos = priv_putDigits(priv_magnitude(value), 10, 1, buf, pos, buf_len);
+    return priv_finish(buf, pos, buf_len);
+}
+
+/*! Formats in decimal with `precision` fractional digits, rounded: -0.05, 3.142, 12
+ *
+ * @param value (float): the number. Has to be below 2^32 in magnitude, and not NaN.
+ * @param precision (uint8_t): fractional digits, up to FMT_FLOAT_MAX_PRECISION. 0 for none.
+ * @param buf (char *): where it goes
+ * @param buf_len (uint32_t): room at buf, FMT_FLOAT_MAX always fits
+ * @retval Characters written, not counting the null. 0 if it didn't fit, or it's out of range.
+ */
+uint32_t fmt_float(float value, uint8_t precision, char *buf, uint32_t buf_len)
+{
+    uint32_t scale = 1;
+    uint32_t whole, fraction;
+    uint32_t pos = 0;
+    bool negative = value < 0.0f;
+
+    if (negative) {
+        value = -value;
+    }
+    // NaN fails this too
+    if (!(value < 4294967296.0f) || precision > FMT_FLOAT_MAX_PRECISION) {
+        return priv_finish(buf, 0, buf_len);
+    }
+    for (uint8_t i = 0; i < precision; i++) {
+        scale *= 10;
+    }
+
+    whole = (uint32_t)value;
+    fraction = (uint32_t)((value - (float)whole) * (float)scale + 0.5f);
+    if (fraction >= scale) {
+        // rounded up into the next whole number
+        fraction -= scale;
+        whole += 1;
+    }
+    if (negative && (whole != 0 || fraction != 0)) {
+        pos = priv_putString("-", buf, pos, buf_len);
+        if (pos == 0) {
+            return priv_finish(buf, 0, buf_len);
+        }
+    }
+    pos = priv_putDigits(whole, 10, 1, buf, pos, buf_len);
+    if (pos != 0 && precision != 0) {
+        pos = priv_putString(".", buf, pos, buf_len);
+        if (pos != 0) {
+            pos = priv_putDigits(fraction, 10, precision, buf, pos, buf_len);
+        }
+    }
+    return priv_finish(buf, pos, buf_len);
+}
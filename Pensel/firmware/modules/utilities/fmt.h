@@ -0,0 +1,23 @@
+/*!
+ * @file    fmt.h
+ * @author  Tyler Holmes
+ *
+ * @date    18-Oct-2026
+ * @brief   Number formatting into a caller's buffer, without printf.
+ *
+ * Each function writes the number and a terminating null, and returns the number of characters
+ * (not counting the null), or 0 if it didn't fit (or can't be formatted). The *_MAX sizes always
+ * fit, null included.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#define FMT_HEX_MAX (20)            //!< "-0x" and 16 digits
+#define FMT_INT_MAX (21)            //!< "-" and 19 digits
+#define FMT_FLOAT_MAX_PRECISION (9) //!< Fractional digits fmt_float() does
+#define FMT_FLOAT_MAX (22)          //!< "-", 10 digits, ".", 9 digits
+
+uint32_t fmt_hex(int64_t value, char *buf, uint32_t buf_len);
+uint32_t fmt_int(int64_t value, char *buf, uint32_t buf_len);
+uint32_t fmt_float(float value, uint8_t precision, char *buf, uint32_t buf_len);
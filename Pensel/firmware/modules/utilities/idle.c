@@ -0,0 +1,110 @@
+/*!
+ * @file    idle.c
+ * @author  Tyler Holmes
+ *
+ * @date    18-Oct-2026
+ * @brief   Tickless idle for the main loop, with idle time accounting.
+ */
+#include "idle.h"
+#include "common.h"
+#include "modules/utilities/events.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef struct {
+    const idle_port_t *port;
+    events_t *events;        //!< Pending events end a sleep early
+    uint32_t last_time_us;   //!< When total_us was last brought up to date
+    idle_stats_t stats;
+} idle_admin_t;
+
+static idle_admin_t gIdleAdmin;
+
+/*! Brings total_us up to `now_us`. Done a piece at a time (at least every sleep) since the 32 bit
+ *  clock wraps long before anyone resets the stats.
+ */
+static void priv_updateTotal(uint32_t now_us)
+{
+    gIdleAdmin.stats.total_us += now_us - gIdleAdmin.last_time_us;
+    gIdleAdmin.last_time_us = now_us;
+}
+
+/*! Initializes the idle module.
+ *
+ * @param port (const idle_port_t *): hardware hooks to sleep with. Must outlive the module.
+ * @param events (events_t *): events that the ISRs waking us up post to
+ * @retval RET_OK, or RET_INVALID_ARGS_ERR if a hook is missing
+ */
+ret_t idle_init(const idle_port_t *port, events_t *events)
+{
+    if (port == NULL || events == NULL || port->get_time_us == NULL ||
+        port->irq_disable == NULL || port->irq_enable == NULL || port->sleep == NULL) {
+        return RET_INVALID_ARGS_ERR;
+    }
+    gIdleAdmin.port = port;
+    gIdleAdmin.events = events;
+    idle_resetStats();
+    return RET_OK;
+}
+
+/*! Sleeps until `wake_time_us` or until an interrupt posts an event, whichever is first.
+ *
+ * Interrupts that don't post an event (e.g. USB servicing itself) put us straight back to sleep.
+ * The check for pending events and the sleep happen with interrupts disabled, so an event posted
+ * just before we sleep can't be missed: its interrupt stays pending and wakes us immediately.
+ *
+ * @param wake_time_us (uint32_t): time to be awake by, on the port's clock
+ */
+void idle_sleepUntil(uint32_t wake_time_us)
+{
+    const idle_port_t *port = gIdleAdmin.port;
+
+    while (true) {
+        int32_t remaining_us;
+        uint32_t slept_us;
+        uint32_t now_us;
+
+        port->irq_disable();
+        now_us = port->get_time_us();
+        priv_updateTotal(now_us);
+        remaining_us = (int32_t)(wake_time_us - now_us);
+        if (remaining_us <= 0) {
+            port->irq_enable();
+            return;
+        }
+        if (events_pending(gIdleAdmin.events)) {
+            port->irq_enable();
+            gIdleAdmin.stats.num_early_wakeups += 1;
+            return;
+        }
+        if (remaining_us > (int32_t)IDLE_MAX_SLEEP_US) {
+            remaining_us = IDLE_MAX_SLEEP_US;
+        }
+        slept_us = port->sleep((uint32_t)remaining_us);
+        port->irq_enable(); // whatever woke us runs now
+
+        gIdleAdmin.stats.idle_us += slept_us;
+        gIdleAdmin.stats.num_sleeps += 1;
+    }
+}
+
+/*! Copies out the idle statistics, with the total brought up to now. Only reads, so it can be
+ *  called from interrupts (e.g. a USB report).
+ *
+ * @param stats_ptr (idle_stats_t *): where to put them
+ */
+void idle_getStats(idle_stats_t *stats_ptr)
+{
+    uint32_t now_us = gIdleAdmin.port->get_time_us();
+    *stats_ptr = gIdleAdmin.stats;
+    stats_ptr->total_us += now_us - gIdleAdmin.last_time_us;
+}
+
+/*! Clears the idle statistics, e.g. to measure the load of a specific workload.
+ */
+void idle_resetStats(void)
+{
+    memset(&gIdleAdmin.stats, 0, sizeof(gIdleAdmin.stats));
+    gIdleAdmin.last_time_us = gIdleAdmin.port->get_time_us();
+}
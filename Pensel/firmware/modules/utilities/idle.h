@@ -0,0 +1,47 @@
+/*!
+ * @file    idle.h
+ * @author  Tyler Holmes
+ *
+ * @date    18-Oct-2026
+ * @brief   Tickless idle for the main loop, with idle time accounting.
+ *
+ * When the scheduler has nothing due, the main loop sleeps until the next deadline instead of
+ * spinning. An interrupt that posts an event ends the sleep early so its handler runs right away.
+ *
+ * The hardware specific parts (clock, interrupt masking, sleeping) are behind idle_port_t so the
+ * same logic runs on host against a virtual clock.
+ */
+#pragma once
+
+#include "common.h"
+#include "modules/utilities/events.h"
+#include <stdint.h>
+
+#ifndef IDLE_MAX_SLEEP_MS
+#define IDLE_MAX_SLEEP_MS (250) //!< Longest single sleep. Bounds how stale the clock can get.
+#endif
+
+#define IDLE_MAX_SLEEP_US (IDLE_MAX_SLEEP_MS * 1000UL)
+
+//! What the idle loop needs from the hardware
+typedef struct {
+    uint32_t (*get_time_us)(void); //!< Same clock the scheduler runs on (time_us())
+    void (*irq_disable)(void);
+    void (*irq_enable)(void);
+    /*! Sleeps until an interrupt is pending or `max_sleep_us` has passed, and returns how long it
+     *  slept in us. Called with interrupts disabled: pending interrupts must still wake it, and
+     *  they run once irq_enable() is called. */
+    uint32_t (*sleep)(uint32_t max_sleep_us);
+} idle_port_t;
+
+typedef struct __attribute__((packed)) {
+    uint64_t idle_us;           //!< Total time spent asleep
+    uint64_t total_us;          //!< Total time since the stats were reset (for a load figure)
+    uint32_t num_sleeps;        //!< Number of times we went to sleep
+    uint32_t num_early_wakeups; //!< Sleeps cut short by an event before the deadline
+} idle_stats_t;
+
+ret_t idle_init(const idle_port_t *port, events_t *events);
+void idle_sleepUntil(uint32_t wake_time_us);
+void idle_getStats(idle_stats_t *stats_ptr);
+void idle_resetStats(void);
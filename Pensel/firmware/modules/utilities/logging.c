@@ -1,34 +1,224 @@
-/*
+/*!
+ * @file    logging.c
+ * @author  Tyler Holmes
  *
+ * @date    20-May-2017
+ * @brief   Leveled log messages, as text or as binary records.
  */
 #include "logging.h"
 #include "common.h"
+#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 
 #define MAX_LOG_LEN (512)
 
 typedef struct log_admin {
-    log_level_t log_level;
-    ret_t (*write_func)(char *);
+    log_level_t log_level; //!< Most verbose level of any sink
+    log_sink_t *sinks;     //!< List of sinks
+    log_limit_t *limits;   //!< List of limited call sites that have been hit
+    log_recorder_t recorder;
+    log_lock_t lock;       //!< NULL when only main context logs text
+    log_unlock_t unlock;
     uint32_t (*get_curTime_ms)(void);
 } log_admin_t;
 
 static log_admin_t gLogAdmin;
 static char gMessageBuffer[MAX_LOG_LEN];
+//! Where messages are put together before going to a sink. Only used by log_drain().
+static uint8_t gStaging[LOG_SINK_MAX_WRITE];
 
-/*! Initializes the logging module with some infoooo
+static void priv_resetQueue(void);
+static void priv_startSink(log_sink_t *sink);
+static ret_t priv_drainSink(log_sink_t *sink);
+static ret_t priv_queueText(log_level_t level, const char msg[], uint32_t len);
+static ret_t priv_formatText(log_level_t level, const char filename[], const char funcname[],
+                             uint32_t linenum, const char format[], va_list args);
+static void priv_reportRepeats(log_limit_t *limit, uint32_t repeats);
+static uint32_t priv_lock(void);
+static void priv_unlock(uint32_t state);
+
+/*! Initializes the logging module. Messages don't go anywhere until sinks are added.
+ *
+ * @param get_curTime_ms_ptr (function pointer): timestamps for the messages
  */
-ret_t log_init(log_level_t level, ret_t (*write_func_ptr)(char *),
-               uint32_t (*get_curTime_ms_ptr)(void))
+ret_t log_init(uint32_t (*get_curTime_ms_ptr)(void))
 {
-    gLogAdmin.log_level = level;
-    gLogAdmin.write_func = write_func_ptr;
+    gLogAdmin.log_level = kLogLevelError;
+    gLogAdmin.sinks = NULL;
+    // limited call sites start over (with full buckets) the next time they're hit
+    for (log_limit_t *limit = gLogAdmin.limits; limit != NULL; limit = limit->next) {
+        limit->listed = false;
+        limit->repeats = 0;
+    }
+    gLogAdmin.limits = NULL;
+    gLogAdmin.recorder = NULL;
+    gLogAdmin.lock = NULL;
+    gLogAdmin.unlock = NULL;
     gLogAdmin.get_curTime_ms = get_curTime_ms_ptr;
+    priv_resetQueue();
+
+    return RET_OK;
+}
+
+//! Sets the hook that sees errors and warnings as they're logged, NULL to stop
+void log_setRecorder(log_recorder_t recorder) { gLogAdmin.recorder = recorder; }
+
+/*! Sets the hooks that make text messages safe to log from interrupts. gMessageBuffer and the
+ *  text queue are shared, so formatting and queueing a message (and reading the queue in
+ *  log_drain()) happens with them held. NULL for both if only main context logs.
+ */
+void log_setLock(log_lock_t lock, log_unlock_t unlock)
+{
+    gLogAdmin.lock = lock;
+    gLogAdmin.unlock = unlock;
+}
+
+//! Recalculates the level messages are checked against: the most verbose sink's
+static void priv_updateLevel(void)
+{
+    log_level_t level = kLogLevelError;
+    for (log_sink_t *sink = gLogAdmin.sinks; sink != NULL; sink = sink->next) {
+        if (sink->level > level) {
+            level = sink->level;
+        }
+    }
+    gLogAdmin.log_level = level;
+}
+
+/*! Adds somewhere for log messages to go. The sink starts with the oldest message that's still
+ *  queued, so one added late still gets what was logged before it.
+ *
+ * @param sink (log_sink_t *): the sink to set up. Has to stay around (static).
+ * @param level (log_level_t): most verbose level the sink gets
+ * @param write_data (function pointer): sends bytes to the sink without blocking. Anything but
+ *      RET_OK and the same bytes are tried again on the next drain.
+ * @param max_write (uint32_t): most bytes write_data() can take at once. Capped to
+ *      LOG_SINK_MAX_WRITE, and has to be at least LOG_SINK_MIN_WRITE.
+ * @return RET_VAL_ERR if the sink is already added or max_write is too small
+ */
+ret_t log_addSink(log_sink_t *sink, log_level_t level,
+                  ret_t (*write_data)(uint8_t *data_ptr, uint32_t num_bytes), uint32_t max_write)
+{
+    if (sink == NULL || write_data == NULL || max_write < LOG_SINK_MIN_WRITE) {
+        return RET_VAL_ERR;
+    }
+    for (log_sink_t *other = gLogAdmin.sinks; other != NULL; other = other->next) {
+        if (other == sink) {
+            return RET_VAL_ERR;
+        }
+    }
 
+    sink->level = level;
+    sink->write_data = write_data;
+    sink->max_write = (max_write > LOG_SINK_MAX_WRITE) ? LOG_SINK_MAX_WRITE : max_write;
+    sink->lost = 0;
+    sink->total_lost = 0;
+    priv_startSink(sink);
+
+    sink->next = gLogAdmin.sinks;
+    gLogAdmin.sinks = sink;
+    priv_updateLevel();
     return RET_OK;
 }
 
+//! Changes the most verbose level `sink` gets (e.g. when the USB host connects)
+void log_setSinkLevel(log_sink_t *sink, log_level_t level)
+{
+    sink->level = level;
+    priv_updateLevel();
+}
+
+//! Number of messages `sink` lost because it fell too far behind, since it was added
+uint32_t log_lostMessages(const log_sink_t *sink) { return sink->total_lost; }
+
+/*! Whether messages at `level` are logged right now (by at least one sink)
+ */
+bool log_isEnabled(log_level_t level) { return level <= gLogAdmin.log_level; }
+
+/*! Takes a token from a limited call site's bucket. Use LOG_MSG_LIMITED() /
+ *  LOG_MSG_FMT_LIMITED() rather than calling this directly.
+ *
+ * A call site is only ever hit from one context, so the bucket itself needs no locking. The
+ * repeat count is shared with log_drain(), so it's only ever taken with an atomic exchange.
+ *
+ * @param limit (log_limit_t *): the call site's bucket
+ * @param level (log_level_t): level of the call site
+ * @return true if the message can go out (after the repeats it's been holding), false if it's
+ *      dropped
+ */
+bool log_limitAllow(log_limit_t *limit, log_level_t level)
+{
+    uint32_t now_ms = gLogAdmin.get_curTime_ms();
+    uint32_t refills;
+    uint32_t repeats;
+
+    if (!limit->listed) {
+        limit->level = level;
+        limit->tokens = LOG_LIMIT_BURST;
+        limit->refill_ms = now_ms;
+        limit->listed = true;
+        // an interrupt could be adding its own call site at the same time
+        limit->next = __atomic_load_n(&gLogAdmin.limits, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&gLogAdmin.limits, &limit->next, limit, true,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+    }
+    limit->last_ms = now_ms;
+
+    refills = (now_ms - limit->refill_ms) / LOG_LIMIT_INTERVAL_MS;
+    limit->refill_ms += refills * LOG_LIMIT_INTERVAL_MS;
+    if (limit->tokens + refills >= LOG_LIMIT_BURST) {
+        limit->tokens = LOG_LIMIT_BURST;
+        limit->refill_ms = now_ms;
+    } else {
+        limit->tokens += refills;
+    }
+
+    if (limit->tokens == 0) {
+        __atomic_fetch_add(&limit->repeats, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    limit->tokens -= 1;
+
+    repeats = __atomic_exchange_n(&limit->repeats, 0, __ATOMIC_RELAXED);
+    if (repeats != 0) {
+        priv_reportRepeats(limit, repeats);
+    }
+    return true;
+}
+
+/*! Sends what's queued to every sink, as much as each will take. Main context only.
+ *
+ * Limited call sites that have been quiet for LOG_LIMIT_INTERVAL_MS report what they dropped
+ * first, so the count isn't held until they're hit again.
+ *
+ * @return RET_OK if every sink is caught up, or what the last one that isn't returned
+ */
+ret_t log_drain(void)
+{
+    ret_t retval = RET_OK;
+    log_limit_t *limit = __atomic_load_n(&gLogAdmin.limits, __ATOMIC_ACQUIRE);
+
+    for (; limit != NULL; limit = limit->next) {
+        if (limit->repeats != 0 &&
+            gLogAdmin.get_curTime_ms() - limit->last_ms >= LOG_LIMIT_INTERVAL_MS) {
+            uint32_t repeats = __atomic_exchange_n(&limit->repeats, 0, __ATOMIC_RELAXED);
+            if (repeats != 0) {
+                priv_reportRepeats(limit, repeats);
+            }
+        }
+    }
+
+    for (log_sink_t *sink = gLogAdmin.sinks; sink != NULL; sink = sink->next) {
+        ret_t ret = priv_drainSink(sink);
+        if (ret != RET_OK) {
+            retval = ret;
+        }
+    }
+    return retval;
+}
+
 /*! Given a log level and string buffer to write into, write in the log level
  *    and current time. Return number of bytes this takes up.
  */
@@ -64,23 +254,465 @@ int populateLogLevel(log_level_t level, char buffer_ptr[])
 ret_t log_logMessage(log_level_t level, const char filename[], const char funcname[],
                      uint32_t linenum, const char msg_ptr[])
 {
-    int logLevelBytes;
-    int finalLogBytes;
-    if (level > gLogAdmin.log_level) {
+    return log_logMessageFmt(level, filename, funcname, linenum, "%s", msg_ptr);
+}
+
+/*! Log a printf style message at the given level and location in the code. Nothing is formatted
+ *  unless the level is enabled.
+ *
+ *  In binary builds the queue only takes records, so the text is written straight to the sinks
+ *  instead (best effort). That's left for the fatal error handler.
+ */
+ret_t log_logMessageFmt(log_level_t level, const char filename[], const char funcname[],
+                        uint32_t linenum, const char format[], ...)
+{
+    va_list args;
+    uint32_t lock_state;
+    ret_t ret;
+    if (!log_isEnabled(level)) {
         // Message more verbose than our set level. Don't do anything
         return RET_OK;
     }
+    if (gLogAdmin.recorder != NULL && level <= kLogLevelWarning) {
+        gLogAdmin.recorder(level, (uint16_t)linenum, 0);
+    }
+
+    lock_state = priv_lock();
+    va_start(args, format);
+    ret = priv_formatText(level, filename, funcname, linenum, format, args);
+    va_end(args);
+    priv_unlock(lock_state);
+    return ret;
+}
+
+//! Puts a message together in gMessageBuffer and queues it. Called with the lock held.
+static ret_t priv_formatText(log_level_t level, const char filename[], const char funcname[],
+                             uint32_t linenum, const char format[], va_list args)
+{
+    int logBytes;
+    int msgBytes;
 
-    logLevelBytes = populateLogLevel(level, gMessageBuffer);
-    if (logLevelBytes <= 0) {
+    logBytes = populateLogLevel(level, gMessageBuffer);
+    if (logBytes <= 0) {
         return RET_NOMEM_ERR;
     }
-    finalLogBytes = snprintf(gMessageBuffer + logLevelBytes, sizeof(gMessageBuffer) - logLevelBytes,
-                             "%s:%u (in %s): %s\n", filename, linenum, funcname, msg_ptr);
+    logBytes += snprintf(gMessageBuffer + logBytes, sizeof(gMessageBuffer) - logBytes,
+                         "%s:%u (in %s): ", filename, linenum, funcname);
+    if (logBytes >= (int)sizeof(gMessageBuffer) - 1) {
+        return RET_NOMEM_ERR;
+    }
+
+    msgBytes = vsnprintf(gMessageBuffer + logBytes, sizeof(gMessageBuffer) - logBytes, format, args);
 
-    if (finalLogBytes <= 0 || finalLogBytes + logLevelBytes >= (int)sizeof(gMessageBuffer)) {
+    // leave room for the newline
+    if (msgBytes < 0 || logBytes + msgBytes >= (int)sizeof(gMessageBuffer) - 1) {
         return RET_NOMEM_ERR;
     }
+    logBytes += msgBytes;
+    gMessageBuffer[logBytes] = '\n';
+    gMessageBuffer[logBytes + 1] = '\0';
+
+    return priv_queueText(level, gMessageBuffer, logBytes + 1);
+}
+
+static uint32_t priv_lock(void) { return (gLogAdmin.lock != NULL) ? gLogAdmin.lock() : 0; }
+
+static void priv_unlock(uint32_t state)
+{
+    if (gLogAdmin.unlock != NULL) {
+        gLogAdmin.unlock(state);
+    }
+}
+
+/* --- RAM ring sink --- */
 
-    return gLogAdmin.write_func(gMessageBuffer);
+#if (LOG_RAM_LEN & (LOG_RAM_LEN - 1)) != 0
+#error "LOG_RAM_LEN must be a power of 2"
+#endif
+
+//! The last LOG_RAM_LEN bytes that went to the RAM ring sink
+static struct {
+    uint32_t head; //!< Bytes written since boot
+    uint8_t data[LOG_RAM_LEN];
+} gLogRam;
+
+/*! write_data() of a sink that keeps the newest LOG_RAM_LEN bytes in RAM, to be read back with
+ *  log_ramRead(). Never busy.
+ */
+ret_t log_ramWrite(uint8_t *data_ptr, uint32_t num_bytes)
+{
+    for (uint32_t i = 0; i < num_bytes; i++) {
+        gLogRam.data[(gLogRam.head + i) & (LOG_RAM_LEN - 1)] = data_ptr[i];
+    }
+    gLogRam.head += num_bytes;
+    return RET_OK;
 }
+
+/*! Copies out the newest bytes of the RAM ring sink, oldest first.
+ *
+ * @param data_ptr (uint8_t *): where to copy them
+ * @param max_bytes (uint32_t): room at data_ptr
+ * @return number of bytes copied
+ */
+uint32_t log_ramRead(uint8_t *data_ptr, uint32_t max_bytes)
+{
+    uint32_t num_bytes = (gLogRam.head < LOG_RAM_LEN) ? gLogRam.head : LOG_RAM_LEN;
+    uint32_t start;
+    if (num_bytes > max_bytes) {
+        num_bytes = max_bytes;
+    }
+    start = gLogRam.head - num_bytes;
+    for (uint32_t i = 0; i < num_bytes; i++) {
+        data_ptr[i] = gLogRam.data[(start + i) & (LOG_RAM_LEN - 1)];
+    }
+    return num_bytes;
+}
+
+/* --- Text queue --- */
+
+#ifndef LOG_BINARY
+
+#if (LOG_TEXT_RING_LEN & (LOG_TEXT_RING_LEN - 1)) != 0
+#error "LOG_TEXT_RING_LEN must be a power of 2"
+#endif
+
+#define TEXT_HEADER_LEN (2)      //!< Each message starts with {level << 12 | length}
+#define TEXT_LEN_MASK (0x0FFF)
+
+_Static_assert(MAX_LOG_LEN + TEXT_HEADER_LEN <= LOG_TEXT_RING_LEN, "text ring can't hold a message");
+_Static_assert(MAX_LOG_LEN <= TEXT_LEN_MASK, "message length doesn't fit in the header");
+
+/*! Formatted messages waiting to go out. Positions only ever count up, and are masked to index
+ *  `data`. When a new message doesn't fit, the oldest ones are dropped to make room. Messages can
+ *  come from interrupts, so it's only touched with the log lock held.
+ */
+static struct {
+    uint32_t head;      //!< Where the next message goes
+    uint32_t first;     //!< Where the oldest message still here starts
+    uint32_t head_msg;  //!< Number of the next message
+    uint32_t first_msg; //!< Number of the oldest message still here
+    uint8_t data[LOG_TEXT_RING_LEN];
+} gLogText;
+
+static void priv_resetQueue(void) { memset(&gLogText, 0, sizeof(gLogText)); }
+
+static void priv_startSink(log_sink_t *sink)
+{
+    sink->tail = gLogText.first;
+    sink->tail_msg = gLogText.first_msg;
+    sink->sent = 0;
+}
+
+static void priv_copyIn(uint32_t pos, const void *src, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        gLogText.data[(pos + i) & (LOG_TEXT_RING_LEN - 1)] = ((const uint8_t *)src)[i];
+    }
+}
+
+static void priv_copyOut(uint32_t pos, uint8_t *dst, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        dst[i] = gLogText.data[(pos + i) & (LOG_TEXT_RING_LEN - 1)];
+    }
+}
+
+static uint16_t priv_header(uint32_t pos)
+{
+    uint16_t header;
+    priv_copyOut(pos, (uint8_t *)&header, sizeof(header));
+    return header;
+}
+
+static ret_t priv_queueText(log_level_t level, const char msg[], uint32_t len)
+{
+    uint16_t header = (uint16_t)((level << 12) | len);
+
+    // drop the oldest messages until this one fits
+    while (gLogText.head + TEXT_HEADER_LEN + len - gLogText.first > LOG_TEXT_RING_LEN) {
+        gLogText.first += TEXT_HEADER_LEN + (priv_header(gLogText.first) & TEXT_LEN_MASK);
+        gLogText.first_msg += 1;
+    }
+
+    priv_copyIn(gLogText.head, &header, TEXT_HEADER_LEN);
+    priv_copyIn(gLogText.head + TEXT_HEADER_LEN, msg, len);
+    gLogText.head += TEXT_HEADER_LEN + len;
+    gLogText.head_msg += 1;
+    return RET_OK;
+}
+
+//! "last message repeated N times", from the call site of `limit`
+static void priv_reportRepeats(log_limit_t *limit, uint32_t repeats)
+{
+    log_logMessageFmt(limit->level, limit->file, limit->func, limit->line,
+                      "last message repeated %u times", (unsigned int)repeats);
+}
+
+/*! Sends `sink` as much text as it takes, up to max_write bytes per write. Long messages go in
+ *  pieces, short ones are sent together.
+ */
+static ret_t priv_drainSink(log_sink_t *sink)
+{
+    ret_t ret;
+
+    while (true) {
+        uint32_t lock_state;
+        uint32_t tail, tail_msg, sent;
+        uint32_t len = 0;
+        bool caught_up;
+
+        // gather with the lock held, then write from gStaging without it
+        lock_state = priv_lock();
+        if ((int32_t)(gLogText.first_msg - sink->tail_msg) > 0) {
+            // fell behind, skip to the oldest message that's still here
+            sink->lost += gLogText.first_msg - sink->tail_msg;
+            sink->total_lost += gLogText.first_msg - sink->tail_msg;
+            sink->tail = gLogText.first;
+            sink->tail_msg = gLogText.first_msg;
+        }
+        tail = sink->tail;
+        tail_msg = sink->tail_msg;
+        sent = sink->sent;
+        caught_up = (tail == gLogText.head);
+
+        while (sink->lost == 0 && tail != gLogText.head && len < sink->max_write) {
+            uint16_t header = priv_header(tail);
+            uint32_t msg_len = header & TEXT_LEN_MASK;
+
+            if ((log_level_t)(header >> 12) <= sink->level) {
+                uint32_t chunk = msg_len - sent;
+                if (chunk > sink->max_write - len) {
+                    chunk = sink->max_write - len;
+                }
+                priv_copyOut(tail + TEXT_HEADER_LEN + sent, gStaging + len, chunk);
+                len += chunk;
+                sent += chunk;
+                if (sent != msg_len) {
+                    continue;
+                }
+            }
+            // done with this message (or it's too verbose for this sink)
+            tail += TEXT_HEADER_LEN + msg_len;
+            tail_msg += 1;
+            sent = 0;
+        }
+        priv_unlock(lock_state);
+
+        if (sink->lost != 0) {
+            // finish off the line that got cut short, if there is one
+            int lost_len = snprintf((char *)gStaging, sizeof(gStaging),
+                                    "%s--- %u log messages lost ---\n",
+                                    (sink->sent != 0) ? "\n" : "", sink->lost);
+            ret = sink->write_data(gStaging, (uint32_t)lost_len);
+            if (ret != RET_OK) {
+                return ret;
+            }
+            sink->lost = 0;
+            sink->sent = 0;
+            continue;
+        }
+        if (caught_up) {
+            break;
+        }
+
+        if (len != 0) {
+            ret = sink->write_data(gStaging, len);
+            if (ret != RET_OK) {
+                return ret;
+            }
+        }
+        sink->tail = tail;
+        sink->tail_msg = tail_msg;
+        sink->sent = sent;
+    }
+    return RET_OK;
+}
+
+#endif /* LOG_BINARY */
+
+/* --- Binary records --- */
+
+#ifdef LOG_BINARY
+
+#if (LOG_BINARY_RING_LEN & (LOG_BINARY_RING_LEN - 1)) != 0
+#error "LOG_BINARY_RING_LEN must be a power of 2"
+#endif
+
+_Static_assert(sizeof(log_record_t) <= LOG_SINK_MIN_WRITE, "sinks have to take a whole record");
+
+//! A record and the sequence number it was written with
+typedef struct {
+    volatile uint32_t seq; //!< seq while the record is being written, seq + 1 once it's done
+    log_record_t record;
+} log_slot_t;
+
+/*! Records go in from any context and come out in the main loop. Writers claim a sequence number
+ *  with one atomic add, so they never wait on each other or the reader. When a sink falls behind,
+ *  the oldest records are overwritten: the newest ones are the ones that explain a problem. Each
+ *  sink keeps its own tail.
+ */
+static struct {
+    volatile uint32_t head; //!< Next sequence number to hand out
+    log_slot_t slots[LOG_BINARY_RING_LEN];
+} gLogRing;
+
+static void priv_resetQueue(void) { memset(&gLogRing, 0, sizeof(gLogRing)); }
+
+static void priv_startSink(log_sink_t *sink)
+{
+    uint32_t head = __atomic_load_n(&gLogRing.head, __ATOMIC_ACQUIRE);
+    sink->tail = (head > LOG_BINARY_RING_LEN) ? head - LOG_BINARY_RING_LEN : 0;
+}
+
+/*! Writes text straight to every sink that wants it, in as many pieces as it takes. Gives up on a
+ *  sink the first time it's busy.
+ */
+static ret_t priv_queueText(log_level_t level, const char msg[], uint32_t len)
+{
+    ret_t retval = RET_OK;
+    for (log_sink_t *sink = gLogAdmin.sinks; sink != NULL; sink = sink->next) {
+        if (level > sink->level) {
+            continue;
+        }
+        for (uint32_t sent = 0; sent < len; sent += sink->max_write) {
+            uint32_t chunk = (len - sent > sink->max_write) ? sink->max_write : len - sent;
+            ret_t ret = sink->write_data((uint8_t *)msg + sent, chunk);
+            if (ret != RET_OK) {
+                retval = ret;
+                break;
+            }
+        }
+    }
+    return retval;
+}
+
+//! Claims the next slot of the ring and fills it in. Safe from interrupts.
+static void priv_queueRecord(log_level_t level, uint16_t id, uint8_t nargs, uint32_t arg0,
+                             uint32_t arg1, uint32_t arg2, uint32_t arg3)
+{
+    uint32_t seq = __atomic_fetch_add(&gLogRing.head, 1, __ATOMIC_RELAXED);
+    log_slot_t *slot = &gLogRing.slots[seq & (LOG_BINARY_RING_LEN - 1)];
+    __atomic_store_n(&slot->seq, seq, __ATOMIC_RELAXED);
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+    slot->record.sync = LOG_BINARY_SYNC;
+    slot->record.id = id;
+    slot->record.level_nargs = (uint8_t)((level << 4) | nargs);
+    slot->record.timestamp = gLogAdmin.get_curTime_ms();
+    slot->record.args[0] = arg0;
+    slot->record.args[1] = arg1;
+    slot->record.args[2] = arg2;
+    slot->record.args[3] = arg3;
+
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+/*! Queues a binary log record. Use LOG_MSG() / LOG_MSG_FMT() rather than calling this directly.
+ *
+ * Safe from interrupts.
+ *
+ * @param level (log_level_t): level of the message
+ * @param site (const char []): the call site's string in `.logstr`
+ * @param nargs (uint8_t): how many of the args are used
+ * @param arg0 - arg3 (uint32_t): raw args
+ */
+void log_binaryMessage(log_level_t level, const char site[], uint8_t nargs, uint32_t arg0,
+                       uint32_t arg1, uint32_t arg2, uint32_t arg3)
+{
+    if (!log_isEnabled(level)) {
+        return;
+    }
+    if (gLogAdmin.recorder != NULL && level <= kLogLevelWarning) {
+        gLogAdmin.recorder(level, (uint16_t)(uintptr_t)site, arg0);
+    }
+    priv_queueRecord(level, (uint16_t)(uintptr_t)site, nargs, arg0, arg1, arg2, arg3);
+}
+
+//! LOG_BINARY_ID_REPEATED record for the call site of `limit`
+static void priv_reportRepeats(log_limit_t *limit, uint32_t repeats)
+{
+    priv_queueRecord(limit->level, LOG_BINARY_ID_REPEATED, 2, (uint16_t)(uintptr_t)limit->file,
+                     repeats, 0, 0);
+}
+
+//! Bytes of `record` that go out on the wire
+static uint32_t priv_recordLen(const log_record_t *record)
+{
+    return LOG_RECORD_HEADER_LEN + (record->level_nargs & 0x0F) * sizeof(uint32_t);
+}
+
+/*! Sends `sink` every finished record it wants, as many per write as fit in max_write.
+ *
+ * Records are sent in order. Anything that was overwritten before it could be sent is reported
+ * with a LOG_BINARY_ID_LOST record in its place. A record that is still being written (an
+ * interrupt landed in the middle of it) is left for the next drain.
+ */
+static ret_t priv_drainSink(log_sink_t *sink)
+{
+    log_record_t record;
+    ret_t ret;
+
+    while (true) {
+        uint32_t head = __atomic_load_n(&gLogRing.head, __ATOMIC_ACQUIRE);
+        uint32_t tail = sink->tail;
+        uint32_t len = 0;
+
+        if (head - sink->tail > LOG_BINARY_RING_LEN) {
+            // lapped, skip to the oldest record that's still there
+            sink->lost += head - sink->tail - LOG_BINARY_RING_LEN;
+            sink->total_lost += head - sink->tail - LOG_BINARY_RING_LEN;
+            sink->tail = head - LOG_BINARY_RING_LEN;
+            continue;
+        }
+
+        if (sink->lost != 0) {
+            record.sync = LOG_BINARY_SYNC;
+            record.id = LOG_BINARY_ID_LOST;
+            record.level_nargs = (kLogLevelWarning << 4) | 1;
+            record.timestamp = gLogAdmin.get_curTime_ms();
+            record.args[0] = sink->lost;
+            ret = sink->write_data((uint8_t *)&record, priv_recordLen(&record));
+            if (ret != RET_OK) {
+                return ret;
+            }
+            sink->lost = 0;
+        }
+
+        // batch up as many finished records as fit
+        while (tail != head) {
+            log_slot_t *slot = &gLogRing.slots[tail & (LOG_BINARY_RING_LEN - 1)];
+            uint32_t record_len;
+
+            if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != tail + 1) {
+                break;
+            }
+            memcpy(&record, &slot->record, sizeof(record));
+            if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != tail + 1) {
+                break; // overwritten while we copied it, the lap check sorts it out
+            }
+
+            record_len = priv_recordLen(&record);
+            if ((log_level_t)(record.level_nargs >> 4) <= sink->level) {
+                if (len + record_len > sink->max_write) {
+                    break;
+                }
+                memcpy(gStaging + len, &record, record_len);
+                len += record_len;
+            }
+            tail += 1;
+        }
+
+        if (len != 0) {
+            ret = sink->write_data(gStaging, len);
+            if (ret != RET_OK) {
+                return ret;
+            }
+        }
+        if (tail == sink->tail) {
+            return RET_OK;
+        }
+        sink->tail = tail;
+    }
+}
+
+#endif /* LOG_BINARY */
@@ -1,6 +1,40 @@
-/*
+/*!
+ * @file    logging.h
+ * @author  Tyler Holmes
  *
+ * @date    20-May-2017
+ * @brief   Leveled log messages, as text or as binary records.
+ *
+ * Messages go out through sinks (UART, USB, a RAM ring, ...), each with its own level. Logging a
+ * message only queues it; log_drain() sends the queue out to every sink from the main loop, as fast
+ * as each sink will take it. Each sink has its own place in the queue, so a slow or disconnected
+ * one doesn't hold up the others. A sink that falls behind by more than the queue holds loses its
+ * oldest messages, and is told how many.
+ *
+ * By default every message is formatted on the device and queued as a line of text.
+ *
+ * Building with LOG_BINARY turns LOG_MSG() / LOG_MSG_FMT() into binary records instead: the
+ * format string (with the file and line) goes into the `.logstr` section, which isn't loaded onto
+ * the device, and its offset there is the message ID. At runtime only {ID, level, timestamp, up to
+ * 4 raw args} get queued. Formatting happens on the host (scripts/pensellog), from a dump of
+ * `.logstr` taken at build time.
+ *
+ * In binary mode the format has to be a string literal, and the args integers or floats (no %s,
+ * the string might be gone by the time the record is decoded).
+ *
+ * Messages more verbose than LOG_COMPILE_LEVEL compile to nothing. Those that are compiled in check
+ * the runtime level (the most verbose sink's) before doing anything else, formatting included. The macros are
+ * expressions, so they can go anywhere a function call can.
+ *
+ * Call sites on hot paths (every sample, every USB transfer) use LOG_MSG_LIMITED() /
+ * LOG_MSG_FMT_LIMITED() instead. Each of those call sites gets a token bucket: LOG_LIMIT_BURST
+ * messages straight away, then one every LOG_LIMIT_INTERVAL_MS. What's dropped is counted, and
+ * reported as one "last message repeated N times" from that call site, either before its next
+ * message that gets through or from log_drain() once it's been quiet for an interval.
  */
+#pragma once
+
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "common.h"
@@ -12,15 +46,203 @@ typedef enum {
     kLogLevelDebug    //!< Debug level (verbose debugging information)
 } log_level_t;
 
-#define LOG_MSG(__LVL__, __MSG__) log_logMessage(__LVL__, __FILE__, __func__, __LINE__, __MSG__)
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL (kLogLevelDebug) //!< Most verbose level that gets compiled in
+#endif
+
+//! Whether a message at `__LVL__` would be logged. Constant false below LOG_COMPILE_LEVEL.
+#define LOG_ENABLED(__LVL__) ((__LVL__) <= LOG_COMPILE_LEVEL && log_isEnabled(__LVL__))
+
+#ifdef LOG_BINARY
+
+#define LOG_MSG(__LVL__, __MSG__) LOG_BIN(__LVL__, __MSG__)
+#define LOG_MSG_FMT(__LVL__, __MSG__, ...) LOG_BIN(__LVL__, __MSG__, __VA_ARGS__)
+
+#else
+
+#define LOG_MSG(__LVL__, __MSG__)                                                                \
+    (LOG_ENABLED(__LVL__) ? (void)log_logMessage(__LVL__, __FILE__, __func__, __LINE__, __MSG__) \
+                          : (void)0)
+
+#define LOG_MSG_FMT(__LVL__, __MSG__, ...)                                                      \
+    (LOG_ENABLED(__LVL__)                                                                       \
+         ? (void)log_logMessageFmt(__LVL__, __FILE__, __func__, __LINE__, __MSG__, __VA_ARGS__) \
+         : (void)0)
+
+#endif /* LOG_BINARY */
+
+#ifndef LOG_LIMIT_BURST
+#define LOG_LIMIT_BURST (4) //!< Messages a limited call site can log back to back
+#endif
+
+#ifndef LOG_LIMIT_INTERVAL_MS
+#define LOG_LIMIT_INTERVAL_MS (250) //!< A limited call site gets a message back every this often
+#endif
+
+//! Token bucket of one limited call site. Set up by the LOG_*_LIMITED() macros.
+typedef struct log_limit {
+    const char *file;          //!< Call site (binary builds: its string in `.logstr`)
+    const char *func;          //!< Function of the call site (text)
+    uint32_t line;             //!< Line of the call site (text)
+    log_level_t level;         //!< Level of the call site, for the repeats
+    uint32_t tokens;           //!< Messages that can go out right now
+    uint32_t refill_ms;        //!< When `tokens` was last topped up
+    uint32_t last_ms;          //!< When the call site was last hit
+    volatile uint32_t repeats; //!< Messages dropped that haven't been reported yet
+    bool listed;               //!< In the list log_drain() checks for repeats
+    struct log_limit *next;    //!< Next one in that list
+} log_limit_t;
+
+#ifdef LOG_BINARY
+
+#define LOG_MSG_LIMITED(__LVL__, __MSG__) LOG_BIN_LIMITED(__LVL__, __MSG__)
+#define LOG_MSG_FMT_LIMITED(__LVL__, __MSG__, ...) LOG_BIN_LIMITED(__LVL__, __MSG__, __VA_ARGS__)
+
+#else
+
+#define LOG_MSG_LIMITED(__LVL__, __MSG__) LOG_MSG_FMT_LIMITED(__LVL__, "%s", __MSG__)
+
+#define LOG_MSG_FMT_LIMITED(__LVL__, __MSG__, ...)                                                 \
+    (LOG_ENABLED(__LVL__) ? ({                                                                     \
+        static log_limit_t log_limit = {.file = __FILE__, .func = __func__, .line = __LINE__};     \
+        log_limitAllow(&log_limit, __LVL__)                                                        \
+            ? (void)log_logMessageFmt(__LVL__, __FILE__, __func__, __LINE__, __MSG__, __VA_ARGS__) \
+            : (void)0;                                                                             \
+    }) : (void)0)
+
+#endif /* LOG_BINARY */
 
-#define LOG_MSG_FMT(__LVL__, __MSG__, ...)   \
-    char msg_buff[64];                       \
-    sprintf(msg_buff, __MSG__, __VA_ARGS__); \
-    LOG_MSG(__LVL__, msg_buff)
+#ifndef LOG_TEXT_RING_LEN
+#define LOG_TEXT_RING_LEN (1024) //!< Bytes of text messages queued between drains (power of 2)
+#endif
 
-ret_t log_init(log_level_t level, ret_t (*write_func_ptr)(char *),
-               uint32_t (*get_cur_time_ptr)(void));
+#ifndef LOG_RAM_LEN
+#define LOG_RAM_LEN (512) //!< Bytes kept by the RAM ring sink (log_ramWrite())
+#endif
+
+#define LOG_SINK_MIN_WRITE (48)  //!< Smallest max_write a sink can have
+#define LOG_SINK_MAX_WRITE (128) //!< Writes to a sink are never bigger than this
+
+//! Somewhere log messages go. Owned by the caller, set up with log_addSink().
+typedef struct log_sink {
+    log_level_t level; //!< Most verbose level this sink gets
+    //! Sends / stores `num_bytes`. Must not block: anything but RET_OK means try again later.
+    ret_t (*write_data)(uint8_t *data_ptr, uint32_t num_bytes);
+    uint32_t max_write;    //!< Most bytes write_data() is given at once
+    uint32_t tail;         //!< Next byte (text) / record (binary) of the queue to send
+    uint32_t tail_msg;     //!< Number of the message at `tail` (text)
+    uint32_t sent;         //!< Bytes of the message at `tail` already sent (text)
+    uint32_t lost;         //!< Messages lost that the sink hasn't been told about yet
+    uint32_t total_lost;   //!< Messages lost since the sink was added
+    struct log_sink *next; //!< Next sink in the list
+} log_sink_t;
+
+/*! Sees every error and warning as it's logged, before it's queued (e.g. flightrec_log()). `id`
+ *  is the log ID in binary builds and the line otherwise, `arg` the first arg (binary only). */
+typedef void (*log_recorder_t)(log_level_t level, uint16_t id, uint32_t arg);
+
+/*! Keeps interrupts out while text is formatted and queued (e.g. hw_irqSave()). Returns whatever
+ *  log_unlock_t needs to put things back the way they were, so it nests. */
+typedef uint32_t (*log_lock_t)(void);
+typedef void (*log_unlock_t)(uint32_t state);
+
+ret_t log_init(uint32_t (*get_cur_time_ptr)(void));
+void log_setRecorder(log_recorder_t recorder);
+void log_setLock(log_lock_t lock, log_unlock_t unlock);
+ret_t log_addSink(log_sink_t *sink, log_level_t level,
+                  ret_t (*write_data)(uint8_t *data_ptr, uint32_t num_bytes), uint32_t max_write);
+void log_setSinkLevel(log_sink_t *sink, log_level_t level);
+uint32_t log_lostMessages(const log_sink_t *sink);
+bool log_isEnabled(log_level_t level);
+bool log_limitAllow(log_limit_t *limit, log_level_t level);
+ret_t log_drain(void);
+
+ret_t log_ramWrite(uint8_t *data_ptr, uint32_t num_bytes);
+uint32_t log_ramRead(uint8_t *data_ptr, uint32_t max_bytes);
 
 ret_t log_logMessage(log_level_t level, const char filename[], const char funcname[],
                      uint32_t linenum, const char msg_ptr[]);
+ret_t log_logMessageFmt(log_level_t level, const char filename[], const char funcname[],
+                        uint32_t linenum, const char format[], ...)
+    __attribute__((format(printf, 5, 6)));
+
+/* --- Binary records --- */
+
+#ifdef LOG_BINARY
+
+#ifndef LOG_BINARY_RING_LEN
+#define LOG_BINARY_RING_LEN (32) //!< Records buffered between drains (power of 2)
+#endif
+
+#define LOG_BINARY_MAX_ARGS (4)
+#define LOG_BINARY_SYNC (0xA5)      //!< First byte of every record (never in the text logs)
+#define LOG_BINARY_ID_LOST (0xFFFF) //!< Record ID for "N records were overwritten before sending"
+//! Record ID for "the call site with ID args[0] dropped args[1] messages" (LOG_MSG_LIMITED())
+#define LOG_BINARY_ID_REPEATED (0xFFFE)
+
+//! One record, as it goes out on the wire (only the first `nargs` args are sent)
+typedef struct __attribute__((packed)) {
+    uint8_t sync;        //!< LOG_BINARY_SYNC
+    uint16_t id;         //!< Offset of the call site's string in `.logstr`
+    uint8_t level_nargs; //!< Level in the top nibble, number of args in the bottom one
+    uint32_t timestamp;  //!< Same clock as the text logs (ms)
+    uint32_t args[LOG_BINARY_MAX_ARGS];
+} log_record_t;
+
+#define LOG_RECORD_HEADER_LEN (sizeof(log_record_t) - LOG_BINARY_MAX_ARGS * sizeof(uint32_t))
+
+#define LOG_STR_(x) #x
+#define LOG_STR(x) LOG_STR_(x)
+#define LOG_CAT_(a, b) a##b
+#define LOG_CAT(a, b) LOG_CAT_(a, b)
+
+//! Number of args given (0 - 4)
+#define LOG_NARGS(...) LOG_NARGS_(_, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+#define LOG_NARGS_(_0, _1, _2, _3, _4, N, ...) N
+
+static inline uint32_t log_intArg(uint32_t val) { return val; }
+
+static inline uint32_t log_floatArg(float val)
+{
+    union {
+        float f;
+        uint32_t u;
+    } bits = {.f = val};
+    return bits.u;
+}
+
+static inline uint32_t log_doubleArg(double val) { return log_floatArg((float)val); }
+
+//! Raw 32 bit value of an arg. Floats keep their bit pattern, the decoder turns them back.
+#define LOG_ARG(x) _Generic((x), float: log_floatArg, double: log_doubleArg, default: log_intArg)(x)
+
+#define LOG_BIN_0(l, s) log_binaryMessage(l, s, 0, 0, 0, 0, 0)
+#define LOG_BIN_1(l, s, a) log_binaryMessage(l, s, 1, LOG_ARG(a), 0, 0, 0)
+#define LOG_BIN_2(l, s, a, b) log_binaryMessage(l, s, 2, LOG_ARG(a), LOG_ARG(b), 0, 0)
+#define LOG_BIN_3(l, s, a, b, c) log_binaryMessage(l, s, 3, LOG_ARG(a), LOG_ARG(b), LOG_ARG(c), 0)
+#define LOG_BIN_4(l, s, a, b, c, d)                                            \
+    log_binaryMessage(l, s, 4, LOG_ARG(a), LOG_ARG(b), LOG_ARG(c), LOG_ARG(d))
+
+//! Records a binary log message. `__FMT__` must be a string literal.
+#define LOG_BIN(__LVL__, __FMT__, ...)                                               \
+    (LOG_ENABLED(__LVL__) ? ({                                                       \
+        static const char __attribute__((section(".logstr"))) log_site[] =           \
+            __FILE__ ":" LOG_STR(__LINE__) ":" __FMT__;                              \
+        LOG_CAT(LOG_BIN_, LOG_NARGS(__VA_ARGS__))(__LVL__, log_site, ##__VA_ARGS__); \
+    }) : (void)0)
+
+//! LOG_BIN() through the call site's token bucket
+#define LOG_BIN_LIMITED(__LVL__, __FMT__, ...)                                            \
+    (LOG_ENABLED(__LVL__) ? ({                                                            \
+        static const char __attribute__((section(".logstr"))) log_site[] =                \
+            __FILE__ ":" LOG_STR(__LINE__) ":" __FMT__;                                   \
+        static log_limit_t log_limit = {.file = log_site};                                \
+        log_limitAllow(&log_limit, __LVL__)                                               \
+            ? LOG_CAT(LOG_BIN_, LOG_NARGS(__VA_ARGS__))(__LVL__, log_site, ##__VA_ARGS__) \
+            : (void)0;                                                                    \
+    }) : (void)0)
+
+void log_binaryMessage(log_level_t level, const char site[], uint8_t nargs, uint32_t arg0,
+                       uint32_t arg1, uint32_t arg2, uint32_t arg3);
+
+#endif /* LOG_BINARY */
@@ -20,13 +20,17 @@ void priv_increment_head(volatile newqueue_t *queue_ptr);
 /*!
  *
  */
-ret_t newqueue_init(volatile newqueue_t *newqueue, uint32_t num_elements, uint32_t item_size)
+ret_t newqueue_init(volatile newqueue_t *newqueue, uint32_t num_elements, uint32_t item_size,
+                    queue_overflow_policy_t overflow_policy)
 {
     uint32_t size = (num_elements * item_size);
     newqueue->head_ind = 0;
     newqueue->tail_ind = 0;
     newqueue->unread_items = 0;
     newqueue->overwrite_count = 0;
+    newqueue->dropped_count = 0;
+    newqueue->rejected_count = 0;
+    newqueue->overflow_policy = overflow_policy;
     newqueue->item_size = item_size;
     newqueue->num_items = num_elements;
     newqueue->buffer_size = size;
@@ -71,21 +75,53 @@ ret_t newqueue_pop(volatile newqueue_t *queue, void *data_ptr, uint32_t num_item
     return RET_OK;
 }
 
-/*!
- *
+/*! Pushes `num_items` onto the queue. If there isn't enough room, the queue's overflow policy
+ *  decides what happens:
+ *      kQueueOverwriteOldest: The oldest unread items are overwritten (`overwrite_count`)
+ *      kQueueDropNewest: As many items as fit are pushed, the rest are dropped (`dropped_count`)
+ *      kQueueReject: Nothing is pushed and RET_NOMEM_ERR is returned (`rejected_count`)
  */
 ret_t newqueue_push(volatile newqueue_t *queue, void *data_ptr, uint32_t num_items)
 {
+    uint32_t free_items = queue->num_items - queue->unread_items;
+
+    if (num_items > free_items) {
+        switch (queue->overflow_policy) {
+            case kQueueReject:
+                queue->rejected_count += num_items;
+                return RET_NOMEM_ERR;
+
+            case kQueueDropNewest:
+                queue->dropped_count += num_items - free_items;
+                num_items = free_items;
+                break;
+
+            case kQueueOverwriteOldest:
+            default:
+                break;
+        }
+    }
+
     // Cast the data as bytes and push it on byte by byte
     // while incrementing the head
     uint32_t i = 0;
     for (uint32_t item = 0; item < num_items; item += 1) {
+        if (queue->unread_items >= queue->num_items) {
+            // Oh no! we don't have any space. Oldest item gets dropped :'(
+            queue->overwrite_count += 1;
+            // move tail ahead a whole item since we're about to overwrite it
+            for (uint32_t sub_i = 0; sub_i < queue->item_size; sub_i += 1) {
+                priv_increment_tail(queue);
+            }
+        } else {
+            queue->unread_items += 1;
+        }
+
         for (uint32_t sub_i = 0; sub_i < queue->item_size; sub_i += 1) {
             ((uint8_t *)queue->buff_ptr)[queue->head_ind] = ((uint8_t *)data_ptr)[i];
             priv_increment_head(queue);
             i += 1;
         }
-        queue->unread_items += 1;
     }
     return RET_OK;
 }
@@ -124,16 +160,4 @@ void priv_increment_head(volatile newqueue_t *queue_ptr)
     } else {
         queue_ptr->head_ind = 0;
     }
-
-    // check if we're overwriting data...
-    if (!(queue_ptr->unread_items < queue_ptr->buffer_size)) {
-        // Oh no! we don't have any space. packet gets dropped :'(
-        queue_ptr->overwrite_count += 1;
-        // move tail ahead too since we've overwritten data
-        if (queue_ptr->tail_ind < queue_ptr->buffer_size - 1) {
-            queue_ptr->tail_ind += 1;
-        } else {
-            queue_ptr->tail_ind = 0;
-        }
-    }
 }
@@ -9,6 +9,7 @@
 #pragma once
 
 #include "common.h"
+#include "queue.h"
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -18,6 +19,9 @@ typedef struct {
     volatile uint32_t tail_ind;     //!< Tracks the back of the buffer (where data is read from)
     volatile uint32_t unread_items; //!< Number of un-popped items
     volatile uint32_t overwrite_count; //!< Number of items that were lost to overwrite
+    volatile uint32_t dropped_count;   //!< Number of new items dropped (kQueueDropNewest)
+    volatile uint32_t rejected_count;  //!< Number of new items refused (kQueueReject)
+    queue_overflow_policy_t overflow_policy; //!< What to do when pushing onto a full queue
     uint32_t num_items;                //!< The number of items this queue can hold
     uint32_t item_size;   //!< The size (in bytes) of the items to be stored (e.g. 4 for uint32_t)
     uint32_t buffer_size; //!< Length of the buffer that was instanciated at runtime
@@ -26,7 +30,8 @@ typedef struct {
 
 typedef enum { eNoPeak, ePeak } peak_t;
 
-ret_t newqueue_init(volatile newqueue_t *newqueue, uint32_t num_elements, uint32_t item_size);
+ret_t newqueue_init(volatile newqueue_t *newqueue, uint32_t num_elements, uint32_t item_size,
+                    queue_overflow_policy_t overflow_policy);
 ret_t newqueue_deinit(volatile newqueue_t *newqueue);
 ret_t newqueue_pop(volatile newqueue_t *queue, void *data_ptr, uint32_t num_items, peak_t peak);
 ret_t newqueue_push(volatile newqueue_t *queue, void *data_ptr, uint32_t num_items);
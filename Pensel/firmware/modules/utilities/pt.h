@@ -0,0 +1,99 @@
+/*!
+ * @file    pt.h
+ * @author  Tyler Holmes
+ *
+ * @date    18-Oct-2026
+ * @brief   Stackless coroutines (protothreads) that run as scheduler callbacks.
+ *
+ * A protothread is a function that can wait part way through: instead of spinning on a condition
+ * it returns to the scheduler, and the next call picks up where it left off. The scheduler gets to
+ * run everything else (or sleep) in the meantime.
+ *
+ *      static pt_t gPt;
+ *      static i2c_transaction_t gRead; // registers to read, .callback wakes the task up
+ *
+ *      static pt_state_t thread(pt_t *pt)
+ *      {
+ *          PT_BEGIN(pt);
+ *          PT_WAIT_UNTIL(pt, I2C_submit(&gRead) != RET_BUSY_ERR, 1);
+ *          PT_WAIT_UNTIL(pt, I2C_isDone(&gRead), 100);
+ *          ...
+ *          PT_END(pt);
+ *      }
+ *
+ *      ret_t task(int32_t *callback_time_ms)
+ *      {
+ *          *callback_time_ms = pt_callbackTime(&gPt, thread(&gPt));
+ *          return RET_OK;
+ *      }
+ *
+ * Waiting conditions are re-checked when the scheduler calls back, which is after the poll time
+ * given, or sooner if something calls scheduler_wake() on the task (e.g. an event handler run on
+ * the interrupt that completes the wait).
+ *
+ * The usual protothread rules apply: local variables don't survive a wait (keep state in statics or
+ * an admin struct), and the body can't use `switch` itself since the macros are built on one.
+ */
+#pragma once
+
+#include "common.h"
+#include "modules/utilities/scheduler.h"
+#include <stdint.h>
+
+typedef enum {
+    kPtWaiting, //!< Blocked on a condition
+    kPtYielded, //!< Gave up the CPU for a while, see PT_SLEEP()
+    kPtEnded,   //!< Ran off the end, the next call starts from the top again
+} pt_state_t;
+
+typedef struct {
+    uint16_t resume_line; //!< Where to pick up from, 0 for the top
+    int32_t wait_ms;      //!< How long until the thread wants to be called again
+} pt_t;
+
+#define PT_INIT(pt) ((pt)->resume_line = 0)
+
+#define PT_BEGIN(pt)             \
+    switch ((pt)->resume_line) { \
+        case 0:
+
+#define PT_END(pt)         \
+    }                      \
+    (pt)->resume_line = 0; \
+    (pt)->wait_ms = 0;     \
+    return kPtEnded
+
+//! Returns to the scheduler until `cond` is true, checking it again every `poll_ms`
+#define PT_WAIT_UNTIL(pt, cond, poll_ms)   \
+    do {                                   \
+        (pt)->resume_line = __LINE__;      \
+        __attribute__((fallthrough));      \
+        case __LINE__:                     \
+            if (!(cond)) {                 \
+                (pt)->wait_ms = (poll_ms); \
+                return kPtWaiting;         \
+            }                              \
+    } while (0)
+
+//! Gives up the CPU for `ms` (or until the task is woken with scheduler_wake())
+#define PT_SLEEP(pt, ms)              \
+    do {                              \
+        (pt)->resume_line = __LINE__; \
+        (pt)->wait_ms = (ms);         \
+        return kPtYielded;            \
+        case __LINE__:;               \
+    } while (0)
+
+//! Lets everything else that is due run before carrying on
+#define PT_YIELD(pt) PT_SLEEP(pt, 0)
+
+/*! How long a scheduler callback running a protothread should ask to be called back in.
+ *
+ * @param pt (const pt_t *): the thread that was just run
+ * @param state (pt_state_t): what running it returned
+ * @return the poll / sleep time the thread asked for, or SCHEDULER_FINISHED once it has ended
+ */
+static inline int32_t pt_callbackTime(const pt_t *pt, pt_state_t state)
+{
+    return (state == kPtEnded) ? SCHEDULER_FINISHED : pt->wait_ms;
+}
@@ -7,14 +7,30 @@
  *
  */
 #include "queue.h"
+#include "common.h"
+#include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
-void queue_init(volatile queue_t *queue_admin_ptr)
+void queue_init(volatile queue_t *queue_admin_ptr, queue_overflow_policy_t overflow_policy)
 {
     queue_admin_ptr->head_ind = 0;
     queue_admin_ptr->tail_ind = 0;
     queue_admin_ptr->unread_items = 0;
     queue_admin_ptr->overwrite_count = 0;
+    queue_admin_ptr->dropped_count = 0;
+    queue_admin_ptr->rejected_count = 0;
+    queue_admin_ptr->overflow_policy = overflow_policy;
+}
+
+/*! Checks if the queue has no more room.
+ *
+ * @note With `kQueueDropNewest` or `kQueueReject`, writers should check this before putting
+ *      data at `head_ind`. When full, `head_ind` is the same slot as `tail_ind`!
+ */
+bool queue_isFull(volatile queue_t *queue_admin_ptr, const uint8_t queue_size)
+{
+    return (queue_admin_ptr->unread_items >= queue_size);
 }
 
 void queue_increment_tail(volatile queue_t *queue_admin_ptr, const uint8_t queue_size)
@@ -28,8 +44,34 @@ void queue_increment_tail(volatile queue_t *queue_admin_ptr, const uint8_t queue
     }
 }
 
-void queue_increment_head(volatile queue_t *queue_admin_ptr, const uint8_t queue_size)
+/*! Commits the item at `head_ind` to the queue, following the queue's overflow policy if full.
+ *
+ * @note The item is already written by now. With `kQueueDropNewest` or `kQueueReject` on a full
+ *      queue that write went over the oldest unread item (see queue_isFull()). Use queue_push(),
+ *      which checks before writing, unless the queue is `kQueueOverwriteOldest`.
+ *
+ * @retval RET_OK if the item was queued (or dropped with `kQueueDropNewest`),
+ *      RET_NOMEM_ERR if the queue is full and the policy is `kQueueReject`.
+ */
+ret_t queue_increment_head(volatile queue_t *queue_admin_ptr, const uint8_t queue_size)
 {
+    if (queue_isFull(queue_admin_ptr, queue_size)) {
+        switch (queue_admin_ptr->overflow_policy) {
+            case kQueueDropNewest:
+                // Leave the head where it is. The new item never happened.
+                queue_admin_ptr->dropped_count += 1;
+                return RET_OK;
+
+            case kQueueReject:
+                queue_admin_ptr->rejected_count += 1;
+                return RET_NOMEM_ERR;
+
+            case kQueueOverwriteOldest:
+            default:
+                break;
+        }
+    }
+
     if (queue_admin_ptr->head_ind < queue_size - 1) {
         queue_admin_ptr->head_ind += 1;
     } else {
@@ -49,4 +91,27 @@ void queue_increment_head(volatile queue_t *queue_admin_ptr, const uint8_t queue
             queue_admin_ptr->tail_ind = 0;
         }
     }
+    return RET_OK;
+}
+
+/*! Copies an item onto the queue, following the queue's overflow policy if full. Unlike writing at
+ *  `head_ind` and calling queue_increment_head(), nothing is written unless the item is queued,
+ *  so `kQueueDropNewest` and `kQueueReject` keep the unread items intact.
+ *
+ * @param buffer_ptr (void *): the queue's storage, `queue_size` items of `item_size` bytes
+ * @param item_ptr (const void *): the item to copy in
+ * @param item_size (uint32_t): size of one item
+ * @retval RET_OK if the item was queued (or dropped with `kQueueDropNewest`),
+ *      RET_NOMEM_ERR if the queue is full and the policy is `kQueueReject`.
+ */
+ret_t queue_push(volatile queue_t *queue_admin_ptr, const uint8_t queue_size, void *buffer_ptr,
+                 const void *item_ptr, uint32_t item_size)
+{
+    if (queue_isFull(queue_admin_ptr, queue_size) &&
+        queue_admin_ptr->overflow_policy != kQueueOverwriteOldest) {
+        // let queue_increment_head() count it, the slot at the head is still unread
+        return queue_increment_head(queue_admin_ptr, queue_size);
+    }
+    memcpy((uint8_t *)buffer_ptr + queue_admin_ptr->head_ind * item_size, item_ptr, item_size);
+    return queue_increment_head(queue_admin_ptr, queue_size);
 }
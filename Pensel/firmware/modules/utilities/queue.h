@@ -7,16 +7,31 @@
  */
 #pragma once
 
+#include "common.h"
+#include <stdbool.h>
 #include <stdint.h>
 
+//! What a queue should do when something is pushed onto it while it's full
+typedef enum {
+    kQueueOverwriteOldest, //!< Overwrite the oldest unread item (freshest data wins)
+    kQueueDropNewest,      //!< Silently drop the new item and keep the unread items intact
+    kQueueReject,          //!< Refuse the new item and let the caller know with an error
+} queue_overflow_policy_t;
+
 //! The structure to track all pertinant variables for the circular buffer.
 typedef struct {
     volatile uint8_t head_ind;     //!< Tracks the front of the buffer (where new info gets pushed)
     volatile uint8_t tail_ind;     //!< Tracks the back of the buffer (where data is read from)
     volatile uint8_t unread_items; //!< Number of un-popped items
     volatile uint32_t overwrite_count; //!< Number of items that were lost to overwrite
+    volatile uint32_t dropped_count;   //!< Number of new items dropped (kQueueDropNewest)
+    volatile uint32_t rejected_count;  //!< Number of new items refused (kQueueReject)
+    queue_overflow_policy_t overflow_policy; //!< What to do when pushing onto a full queue
 } queue_t;
 
-void queue_init(volatile queue_t *queue_admin_ptr);
+void queue_init(volatile queue_t *queue_admin_ptr, queue_overflow_policy_t overflow_policy);
+bool queue_isFull(volatile queue_t *queue_admin_ptr, const uint8_t queue_size);
 void queue_increment_tail(volatile queue_t *queue_admin_ptr, const uint8_t queue_size);
-void queue_increment_head(volatile queue_t *queue_admin_ptr, const uint8_t queue_size);
+ret_t queue_increment_head(volatile queue_t *queue_admin_ptr, const uint8_t queue_size);
+ret_t queue_push(volatile queue_t *queue_admin_ptr, const uint8_t queue_size, void *buffer_ptr,
+                 const void *item_ptr, uint32_t item_size);
@@ -0,0 +1,296 @@
+/*!
+ * @file    report.c
+ * @author  Tyler Holmes
+ *
+ * @date    18-Oct-2026
+ * @brief   Incremental parser for the report protocol the host speaks (pensel_utils.py).
+ */
+#include "report.h"
+#include "common.h"
+#include "crc16.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if REPORT_MAX_PAYLOAD > 255
+#error "REPORT_MAX_PAYLOAD has to fit the length byte of version 1"
+#endif
+
+//! Start of every version 1 frame (the same one UART_sendReport() sends back)
+static const uint8_t gMagic[] = {0xDE, 0xAD, 0xBE, 0xEF};
+
+//! Writes a COBS frame a byte at a time
+typedef struct {
+    uint8_t *frame;    //!< Where it goes
+    uint32_t pos;      //!< Next byte of frame
+    uint32_t code_pos; //!< Where the code of the block being written goes
+    uint8_t code;      //!< Code of the block so far (1 + its non-zero bytes)
+} priv_cobs_writer_t;
+
+/*! Initializes a parser.
+ *
+ * @param parser (report_parser_t *): the parser
+ * @param table (const report_entry_t []): reports to handle. Must outlive the parser.
+ * @param table_len (uint8_t): number of entries in the table
+ * @param reply (report_reply_t): sends version 1 replies
+ * @param send (report_send_t): sends version 2 replies, NULL to only support version 1
+ * @retval RET_OK, or RET_INVALID_ARGS_ERR if anything's missing
+ */
+ret_t report_init(report_parser_t *parser, const report_entry_t table[], uint8_t table_len,
+                  report_reply_t reply, report_send_t send)
+{
+    if (table == NULL || reply == NULL) {
+        return RET_INVALID_ARGS_ERR;
+    }
+    memset(parser, 0, sizeof(*parser));
+    parser->table = table;
+    parser->table_len = table_len;
+    parser->reply = reply;
+    parser->send = send;
+    parser->protocol = kReportProtocolMagic;
+    report_reset(parser);
+    return RET_OK;
+}
+
+//! Drops any frame that's partway in, and goes back to looking for the start of the next one
+void report_reset(report_parser_t *parser)
+{
+    parser->state = kReportStateMagic;
+    parser->magic_found = 0;
+    parser->cobs_left = 0;
+    parser->cobs_code = 0xFF; // no zero in front of the first block
+    parser->num_bytes = 0;
+    parser->crc = CRC16_INIT;
+}
+
+static report_handler_t priv_findHandler(report_parser_t *parser, uint8_t id)
+{
+    for (uint8_t i = 0; i < parser->table_len; i++) {
+        if (parser->table[i].id == id) {
+            return parser->table[i].handler;
+        }
+    }
+    return NULL;
+}
+
+/*! The version report: with no payload, what's in use and the highest supported. With one byte,
+ *  the version to switch to after replying.
+ */
+static ret_t priv_version(report_parser_t *parser, uint32_t in_len, uint8_t *out_len_ptr,
+                          report_protocol_t *next_ptr)
+{
+    report_protocol_t highest = (parser->send != NULL) ? kReportProtocolCobs : kReportProtocolMagic;
+
+    if (in_len == 0) {
+        parser->out[0] = (uint8_t)parser->protocol;
+        parser->out[1] = (uint8_t)highest;
+        *out_len_ptr = 2;
+        return RET_OK;
+    }
+    if (in_len != 1 || parser->in[0] < kReportProtocolMagic || parser->in[0] > highest) {
+        return RET_VAL_ERR;
+    }
+    *next_ptr = (report_protocol_t)parser->in[0];
+    parser->out[0] = parser->in[0];
+    *out_len_ptr = 1;
+    return RET_OK;
+}
+
+static void priv_cobsPut(priv_cobs_writer_t *writer, uint8_t byte)
+{
+    if (byte != 0) {
+        writer->frame[writer->pos++] = byte;
+        writer->code += 1;
+    }
+    if (byte == 0 || writer->code == 0xFF) {
+        // end of the block: a zero, or as long as a block gets
+        writer->frame[writer->code_pos] = writer->code;
+        writer->code_pos = writer->pos++;
+        writer->code = 1;
+    }
+}
+
+//! Encodes a version 2 reply into parser->frame, and sends it
+static ret_t priv_sendCobs(report_parser_t *parser, uint8_t id, ret_t ret, uint8_t out_len)
+{
+    priv_cobs_writer_t writer = {.frame = parser->frame, .pos = 2, .code_pos = 1, .code = 1};
+    uint16_t crc = CRC16_INIT;
+    uint8_t header[] = {id, (uint8_t)ret};
+
+    parser->frame[0] = 0;
+    for (uint8_t i = 0; i < sizeof(header); i++) {
+        priv_cobsPut(&writer, header[i]);
+        crc = crc16_byte(crc, header[i]);
+    }
+    for (uint8_t i = 0; i < out_len; i++) {
+        priv_cobsPut(&writer, parser->out[i]);
+        crc = crc16_byte(crc, parser->out[i]);
+    }
+    priv_cobsPut(&writer, (uint8_t)(crc >> 8));
+    priv_cobsPut(&writer, (uint8_t)crc);
+    parser->frame[writer.code_pos] = writer.code;
+    parser->frame[writer.pos++] = 0;
+    return parser->send(parser->frame, writer.pos);
+}
+
+//! Runs the handler for the frame that just came in, and sends back what it returned
+static void priv_dispatch(report_parser_t *parser, uint32_t in_len)
+{
+    report_protocol_t protocol = parser->protocol;
+    report_handler_t handler = NULL;
+    uint8_t out_len = 0;
+    ret_t ret;
+
+    parser->stats.frames += 1;
+    if (parser->id == REPORT_ID_VERSION) {
+        ret = priv_version(parser, in_len, &out_len, &protocol);
+    } else if ((handler = priv_findHandler(parser, parser->id)) == NULL) {
+        parser->stats.unknown += 1;
+        ret = RET_NORPT_ERR;
+    } else if (in_len > REPORT_MAX_PAYLOAD) {
+        ret = RET_MAX_LEN_ERR;
+    } else {
+        ret = handler(parser->in, (uint8_t)in_len, parser->out, &out_len);
+        if (out_len > REPORT_MAX_PAYLOAD) {
+            // it's already written past the end of out, nothing to do but not send it
+            out_len = 0;
+            ret = RET_MAX_LEN_ERR;
+        }
+    }
+
+    if (parser->protocol == kReportProtocolCobs) {
+        ret = priv_sendCobs(parser, parser->id, ret, out_len);
+    } else {
+        ret = parser->reply(parser->id, ret, parser->out, out_len);
+    }
+    if (ret != RET_OK) {
+        parser->stats.reply_errors += 1;
+    }
+
+    if (protocol != parser->protocol) {
+        parser->protocol = protocol;
+        report_reset(parser);
+    }
+}
+
+//! Version 1: the magic number, ID, length, payload and checksum
+static void priv_parseMagic(report_parser_t *parser, uint8_t byte)
+{
+    switch (parser->state) {
+        case kReportStateMagic:
+            if (byte == gMagic[parser->magic_found]) {
+                parser->magic_found += 1;
+            } else {
+                // the first byte of the magic number doesn't show up again in it, so a mismatch
+                // can only be the start of a new one
+                parser->magic_found = (byte == gMagic[0]) ? 1 : 0;
+            }
+            if (parser->magic_found == sizeof(gMagic)) {
+                parser->magic_found = 0;
+                parser->sum = (uint8_t)(gMagic[0] + gMagic[1] + gMagic[2] + gMagic[3]);
+                parser->state = kReportStateID;
+            }
+            return;
+
+        case kReportStateID:
+            parser->id = byte;
+            parser->state = kReportStateLength;
+            break;
+
+        case kReportStateLength:
+            parser->len = byte;
+            parser->pos = 0;
+            parser->state = (byte == 0) ? kReportStateChecksum : kReportStatePayload;
+            break;
+
+        case kReportStatePayload:
+            // a payload that's too long is still summed, so the frame's handled (refused) as one
+            if (parser->pos < REPORT_MAX_PAYLOAD) {
+                parser->in[parser->pos] = byte;
+            }
+            parser->pos += 1;
+            if (parser->pos == parser->len) {
+                parser->state = kReportStateChecksum;
+            }
+            break;
+
+        case kReportStateChecksum:
+            parser->state = kReportStateMagic;
+            if ((uint8_t)(parser->sum + byte) != 0) {
+                // resync from the next byte, the ones before it aren't looked at again
+                parser->stats.bad_checksums += 1;
+                return;
+            }
+            priv_dispatch(parser, parser->len);
+            return;
+    }
+    parser->sum += byte;
+}
+
+//! Version 2: a decoded byte, the ID, then payload and CRC
+static void priv_cobsByte(report_parser_t *parser, uint8_t byte)
+{
+    if (parser->num_bytes == 0) {
+        parser->id = byte;
+    } else if (parser->num_bytes <= sizeof(parser->in)) {
+        parser->in[parser->num_bytes - 1] = byte;
+    }
+    if (parser->num_bytes != UINT16_MAX) {
+        parser->num_bytes += 1;
+    }
+    parser->crc = crc16_byte(parser->crc, byte);
+}
+
+//! Version 2: undoes the COBS encoding, and handles the frame at the zero after it
+static void priv_parseCobs(report_parser_t *parser, uint8_t byte)
+{
+    if (byte == 0) {
+        // The end of a frame. The CRC of a frame with its CRC on the end comes out as 0.
+        if (parser->cobs_left == 0 && parser->num_bytes >= 3 && parser->crc == 0) {
+            priv_dispatch(parser, parser->num_bytes - 3);
+        } else if (parser->num_bytes != 0 || parser->cobs_left != 0) {
+            parser->stats.bad_checksums += 1;
+        }
+        report_reset(parser);
+        return;
+    }
+    if (parser->cobs_left == 0) {
+        // the code of the next block, the one before it ended in a zero unless it was full length
+        if (parser->cobs_code != 0xFF) {
+            priv_cobsByte(parser, 0);
+        }
+        parser->cobs_code = byte;
+        parser->cobs_left = byte - 1;
+        return;
+    }
+    priv_cobsByte(parser, byte);
+    parser->cobs_left -= 1;
+}
+
+/*! Takes in the next byte. Constant time, except for the last byte of a frame, which runs its
+ *  handler.
+ *
+ * @param parser (report_parser_t *): the parser
+ * @param byte (uint8_t): the byte that came in
+ */
+void report_parseByte(report_parser_t *parser, uint8_t byte)
+{
+    if (parser->protocol == kReportProtocolCobs) {
+        priv_parseCobs(parser, byte);
+    } else {
+        priv_parseMagic(parser, byte);
+    }
+}
+
+/*! Takes in a run of bytes, e.g. whatever UART_read() had.
+ *
+ * @param parser (report_parser_t *): the parser
+ * @param data_ptr (const uint8_t *): the bytes
+ * @param num_bytes (uint32_t): how many
+ */
+void report_parse(report_parser_t *parser, const uint8_t *data_ptr, uint32_t num_bytes)
+{
+    for (uint32_t i = 0; i < num_bytes; i++) {
+        report_parseByte(parser, data_ptr[i]);
+    }
+}
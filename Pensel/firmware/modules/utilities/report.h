@@ -0,0 +1,125 @@
+/*!
+ * @file    report.h
+ * @author  Tyler Holmes
+ *
+ * @date    18-Oct-2026
+ * @brief   Incremental parser for the report protocol the host speaks (pensel_utils.py).
+ *
+ * Two framings, the protocol version (the host picks one with the version report):
+ *
+ * 1. A request is the 0xDEADBEEF magic number, the report ID, the payload length, the payload, and
+ *    a checksum byte that makes the whole frame sum to 0. The reply goes through the reply function,
+ *    e.g. UART_sendReport(), with the return value after the ID. A frame with a bad checksum is
+ *    dropped, and the parser goes straight back to looking for the magic number from the next
+ *    byte. It doesn't go back over the bytes of the frame it dropped, but a payload can still hold
+ *    something that looks like the magic number.
+ *
+ * 2. The report ID, (the return value, in replies,) the payload and a CRC-16 (crc16.h), COBS
+ *    encoded so there are no zero bytes in it, and a zero after it. The length is where the zero
+ *    is. A zero can't show up anywhere else, so whatever goes wrong the next frame starts after
+ *    the next zero. Replies are encoded into the parser and go out through the send function, e.g.
+ *    UART_sendData(), with a zero in front too, so any junk before them (e.g. UART logs) is its own
+ *    frame.
+ *
+ * Bytes are fed in as they come in, one state machine step each: only the payload is kept (the
+ * handler needs it in one piece), everything else is checked on the fly. Once the checksum / CRC
+ * matches, the report's handler is looked up in the table and run, and what it returns goes back
+ * in the same framing.
+ *
+ * The version report (REPORT_ID_VERSION) is handled here rather than in the table. Without a
+ * payload it returns {the version in use, the highest one supported}. With one byte it switches to
+ * that version once the reply (in the old one) has gone. Resets go back to version 1, so a host
+ * that doesn't get an answer in one should try the other.
+ */
+#pragma once
+
+#include "common.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef REPORT_MAX_PAYLOAD
+#define REPORT_MAX_PAYLOAD (64) //!< Longest payload kept, in and out. Longer ones get RET_MAX_LEN_ERR
+#endif
+
+#define REPORT_ID_VERSION (0x7D) //!< Gets / sets the protocol version
+
+//! Longest encoded reply: two delimiters, a COBS code per 254 bytes and the ID, ret, payload, CRC
+#define REPORT_FRAME_MAX (2 + 1 + (REPORT_MAX_PAYLOAD + 4) / 254 + REPORT_MAX_PAYLOAD + 4)
+
+/*! Handles a report. Runs in main context once the whole frame has come in.
+ *
+ * @param in_p (uint8_t *): the payload that came with the request
+ * @param in_len (uint8_t): its length
+ * @param out_p (uint8_t *): where to put the reply payload (REPORT_MAX_PAYLOAD bytes)
+ * @param out_len_ptr (uint8_t *): the reply payload's length (0 to start with)
+ * @retval Goes back to the host as the report's return value
+ */
+typedef ret_t (*report_handler_t)(uint8_t *in_p, uint8_t in_len, uint8_t *out_p,
+                                  uint8_t *out_len_ptr);
+
+//! Sends the reply to a report, e.g. UART_sendReport()
+typedef ret_t (*report_reply_t)(uint8_t report, ret_t retval, const uint8_t *payload_ptr,
+                                uint8_t payload_len);
+
+//! Sends an encoded frame, e.g. UART_sendData()
+typedef ret_t (*report_send_t)(uint8_t *data_ptr, uint32_t num_bytes);
+
+//! One report the parser knows about
+typedef struct {
+    uint8_t id;               //!< Report ID
+    report_handler_t handler; //!< What to run for it
+} report_entry_t;
+
+typedef enum {
+    kReportProtocolMagic = 1, //!< Magic number, length and 8 bit checksum
+    kReportProtocolCobs = 2,  //!< COBS with a zero after, and CRC-16
+} report_protocol_t;
+
+//! Where version 1 is in a frame
+typedef enum {
+    kReportStateMagic,    //!< Looking for the magic number
+    kReportStateID,       //!< Next byte is the report ID
+    kReportStateLength,   //!< Next byte is the payload length
+    kReportStatePayload,  //!< Taking in the payload
+    kReportStateChecksum, //!< Next byte is the checksum
+} report_state_t;
+
+typedef struct {
+    uint32_t frames;        //!< Frames that came in whole (the checksum / CRC matched)
+    uint32_t bad_checksums; //!< Frames dropped because the checksum / CRC didn't match
+    uint32_t unknown;       //!< Frames for reports that aren't in the table
+    uint32_t reply_errors;  //!< Replies that couldn't be sent
+} report_stats_t;
+
+typedef struct {
+    const report_entry_t *table; //!< Reports we handle
+    uint8_t table_len;           //!< Number of entries in table
+    report_reply_t reply;        //!< Where version 1 replies go
+    report_send_t send;          //!< Where version 2 replies go (NULL if it isn't supported)
+    report_protocol_t protocol;  //!< Version in use
+
+    // version 1
+    report_state_t state; //!< Where we are in the frame
+    uint8_t magic_found;  //!< Bytes of the magic number matched so far
+    uint8_t len;          //!< Payload length of the frame coming in
+    uint8_t pos;          //!< Payload bytes taken in so far
+    uint8_t sum;          //!< Sum of the frame so far
+
+    // version 2
+    uint8_t cobs_left;  //!< Bytes left in the COBS block, 0 if the next one's a code
+    uint8_t cobs_code;  //!< Code of the COBS block (0xFF ones don't end in a zero)
+    uint16_t num_bytes; //!< Decoded bytes of the frame so far (stops at 0xFFFF)
+    uint16_t crc;       //!< CRC of the frame so far
+
+    uint8_t id; //!< Report ID of the frame coming in
+    report_stats_t stats;
+    uint8_t in[REPORT_MAX_PAYLOAD + 2]; //!< Payload of the frame coming in (and the CRC)
+    uint8_t out[REPORT_MAX_PAYLOAD];    //!< Payload of the reply
+    uint8_t frame[REPORT_FRAME_MAX];    //!< Encoded version 2 reply
+} report_parser_t;
+
+ret_t report_init(report_parser_t *parser, const report_entry_t table[], uint8_t table_len,
+                  report_reply_t reply, report_send_t send);
+void report_reset(report_parser_t *parser);
+void report_parseByte(report_parser_t *parser, uint8_t byte);
+void report_parse(report_parser_t *parser, const uint8_t *data_ptr, uint32_t num_bytes);
@@ -4,109 +4,579 @@
  *
  * @date    28-April-2018
  * @brief   A rudamentary scheduler
+ *
+ * Each priority class has a binary min-heap of slots keyed on (deadline, insertion sequence).
+ * Deadlines are free running microsecond times, so they're always compared by signed difference to
+ * survive the timer wrapping. The sequence number keeps callbacks with the same deadline running in
+ * the order they were scheduled, so a period 0 callback can't starve the others.
  */
 
 #include "scheduler.h"
 #include "common.h"
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+
+#define NO_SLOT (0xFFFF) //!< Terminates the pending list / marks a slot as not in the heap
+
+//! Life cycle of a slot
+typedef enum {
+    kSlotFree,      //!< Unused
+    kSlotPending,   //!< Added, waiting for scheduler_run() to put it in the heap
+    kSlotQueued,    //!< In the heap
+    kSlotRunning,   //!< Callback is currently being called
+    kSlotCancelled, //!< Removed while pending / running, freed once it's safe to
+} slot_state_t;
 
-// TODO remove - debug
-// #include "peripherals/UART/UART.h"
+static uint32_t priv_delay_us(int32_t delay_ms);
+static void priv_free_slot(schedule_t *schedule, uint16_t slot_ind);
+static void priv_drain_pending(schedule_t *schedule);
+static uint16_t priv_next_due(schedule_t *schedule, uint32_t current_time_us);
+static void priv_heap_insert(schedule_t *schedule, uint16_t slot_ind, uint32_t deadline_us);
+static void priv_heap_remove_at(schedule_t *schedule, schedule_heap_t *heap, uint16_t heap_pos);
+static void priv_sift_up(schedule_t *schedule, schedule_heap_t *heap, uint16_t heap_pos);
+static void priv_sift_down(schedule_t *schedule, schedule_heap_t *heap, uint16_t heap_pos);
+#ifdef SCHEDULER_PROFILING
+static void priv_profile_reset(schedule_t *schedule, uint16_t slot_ind);
+static void priv_profile_record(schedule_t *schedule, uint16_t slot_ind, uint32_t start_cycles,
+                                uint32_t lateness_us, ret_t ret);
+#endif
 
 ret_t scheduler_init(schedule_t *schedule)
 {
     schedule->num_slots_used = 0;
-    for (uint8_t i = 0; i < NUM_SLOTS; i++) {
-        schedule->callbacks[i] = NULL;
-        schedule->callback_times_ms[i] = 0;
-        schedule->callback_last_run_ms[i] = 0;
+    schedule->pending_head = NO_SLOT;
+    schedule->pass = 0;
+    schedule->next_seq = 0;
+    schedule->current_time_us = 0;
+    schedule->between_callbacks = NULL;
+    schedule->trace = NULL;
+    for (uint16_t i = 0; i < SCHEDULER_NUM_SLOTS; i++) {
+        schedule->slots[i].callback = NULL;
+        schedule->slots[i].delay_ms = 0;
+        schedule->slots[i].heap_index = NO_SLOT;
+        schedule->slots[i].next_pending = NO_SLOT;
+        schedule->slots[i].last_pass = 0;
+        schedule->slots[i].priority = kSchedulerPriorityNormal;
+        schedule->slots[i].woken = false;
+        schedule->slots[i].state = kSlotFree;
+    }
+    for (uint8_t p = 0; p < kSchedulerNumPriorities; p++) {
+        schedule->heaps[p].len = 0;
+        for (uint16_t i = 0; i < SCHEDULER_NUM_SLOTS; i++) {
+            schedule->heaps[p].entries[i].deadline_us = 0;
+            schedule->heaps[p].entries[i].seq = 0;
+            schedule->heaps[p].entries[i].slot = NO_SLOT;
+        }
     }
+#ifdef SCHEDULER_PROFILING
+    schedule->get_cycles = NULL;
+    schedule->get_time_us = NULL;
+    memset(schedule->stats, 0, sizeof(schedule->stats));
+#endif
     return RET_OK;
 }
 
+/*! Schedules a normal priority callback to be run `callback_time_ms` after the next
+ *  scheduler_run(). Safe to call from interrupt context.
+ *
+ * @param schedule (schedule_t *): schedule to add to
+ * @param callback_time_ms (int32_t): how long to wait before running the callback
+ * @param callback (function pointer): callback to run. It sets how long until it should be run
+ *      again, or SCHEDULER_FINISHED to be removed.
+ * @param schedule_id (uint8_t *): set to the ID of the slot that was used
+ * @retval RET_OK if scheduled, RET_LEN_ERR / RET_NOMEM_ERR if all slots are used
+ */
 ret_t scheduler_add(schedule_t *schedule, int32_t callback_time_ms,
                     ret_t (*callback)(int32_t *callback_time_ms), uint8_t *schedule_id)
 {
-    bool slot_found = false;
-    if (schedule->num_slots_used >= NUM_SLOTS) {
+    return scheduler_addWithPriority(schedule, kSchedulerPriorityNormal, callback_time_ms, callback,
+                                     schedule_id);
+}
+
+/*! Same as scheduler_add(), but in the given priority class.
+ *
+ * @retval RET_OK if scheduled, RET_INVALID_ARGS_ERR for an unknown priority, RET_LEN_ERR /
+ *      RET_NOMEM_ERR if all slots are used
+ */
+ret_t scheduler_addWithPriority(schedule_t *schedule, scheduler_priority_t priority,
+                                int32_t callback_time_ms, scheduler_callback_t callback,
+                                uint8_t *schedule_id)
+{
+    if ((uint32_t)priority >= kSchedulerNumPriorities) {
+        return RET_INVALID_ARGS_ERR;
+    }
+    if (schedule->num_slots_used >= SCHEDULER_NUM_SLOTS) {
         return RET_LEN_ERR;
     }
-    // TODO: disable timer interrupt here
-    for (uint8_t i = 0; i < NUM_SLOTS; i++) {
-        if (schedule->callbacks[i] == NULL) {
-            schedule->callbacks[i] = callback;
-            schedule->callback_times_ms[i] = callback_time_ms;
-            slot_found = true;
-            schedule->num_slots_used += 1;
-            *schedule_id = i;
-            break;
+
+    for (uint16_t i = 0; i < SCHEDULER_NUM_SLOTS; i++) {
+        scheduler_callback_t expected = NULL;
+        // claiming the slot is atomic, an ISR may be adding at the same time as main
+        if (schedule->slots[i].callback == NULL &&
+            __atomic_compare_exchange_n(&schedule->slots[i].callback, &expected, callback, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            schedule_slot_t *slot = &schedule->slots[i];
+            slot->delay_ms = callback_time_ms;
+            slot->priority = (uint8_t)priority;
+            slot->woken = false;
+            slot->state = kSlotPending;
+            __atomic_fetch_add(&schedule->num_slots_used, 1, __ATOMIC_RELAXED);
+
+            // push onto the pending list for scheduler_run() to pick up
+            uint16_t head = __atomic_load_n(&schedule->pending_head, __ATOMIC_RELAXED);
+            do {
+                slot->next_pending = head;
+            } while (!__atomic_compare_exchange_n(&schedule->pending_head, &head, i, true,
+                                                  __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+            *schedule_id = (uint8_t)i;
+            return RET_OK;
         }
     }
-    // TODO: re-enable timer interrupt here
+    return RET_NOMEM_ERR;
+}
 
-    if (slot_found == true) {
-        return RET_OK;
-    } else {
-        return RET_NOMEM_ERR;
-    }
+/*! Sets a function to run after every callback, e.g. to service work posted by interrupts so it
+ *  doesn't have to wait for a whole pass of lower priority callbacks.
+ *
+ * @param schedule (schedule_t *): schedule to hook into
+ * @param hook (function pointer): run after every callback, NULL to stop
+ */
+void scheduler_setBetweenCallbacksHook(schedule_t *schedule, void (*hook)(void))
+{
+    schedule->between_callbacks = hook;
+}
+
+/*! Sets a function to run around every callback, e.g. to keep track of which one is running for a
+ *  post-mortem.
+ *
+ * @param schedule (schedule_t *): schedule to hook into
+ * @param hook (scheduler_trace_t): run before and after every callback, NULL to stop
+ */
+void scheduler_setTraceHook(schedule_t *schedule, scheduler_trace_t hook)
+{
+    schedule->trace = hook;
 }
 
+/*! Removes a callback from the schedule. Must be called from the scheduler_run() context (e.g.
+ *  from within a callback).
+ *
+ * @retval RET_OK if removed, RET_VAL_ERR if the ID isn't scheduled
+ */
 ret_t scheduler_remove(schedule_t *schedule, uint8_t schedule_id_to_remove)
 {
     ret_t err = RET_OK;
+    schedule_slot_t *slot;
+
+#if SCHEDULER_NUM_SLOTS < 256
+    if (schedule_id_to_remove >= SCHEDULER_NUM_SLOTS) {
+        return RET_VAL_ERR;
+    }
+#endif
+    slot = &schedule->slots[schedule_id_to_remove];
 
-    // TODO: disable timer interrupt here
-    // Check if the given schedule ID even exists in here
-    if (schedule->callbacks[schedule_id_to_remove] != NULL) {
-        schedule->callbacks[schedule_id_to_remove] = NULL;
-        schedule->callback_times_ms[schedule_id_to_remove] = 0;
-        schedule->num_slots_used -= 1;
-    } else {
-        err = RET_VAL_ERR;
+    switch (slot->state) {
+        case kSlotQueued:
+            priv_heap_remove_at(schedule, &schedule->heaps[slot->priority], slot->heap_index);
+            priv_free_slot(schedule, schedule_id_to_remove);
+            break;
+
+        case kSlotPending:
+        case kSlotRunning:
+            // Still linked into the pending list / being run, scheduler_run() frees it
+            slot->state = kSlotCancelled;
+            break;
+
+        default:
+            err = RET_VAL_ERR;
+            break;
     }
-    // TODO: reenable timer interrupt here
 
     return err;
 }
 
-int32_t scheduler_run(schedule_t *schedule, uint32_t current_time_ms)
+/*! Makes a scheduled callback due now, e.g. when whatever it's waiting on has happened. It runs
+ *  on the next scheduler_run() (or later in this one, if it hasn't run yet). Main context only:
+ *  interrupts should post an event and wake the callback from its handler.
+ *
+ * @param schedule (schedule_t *): schedule the callback is in
+ * @param schedule_id (uint8_t): ID given by scheduler_add()
+ * @retval RET_OK, or RET_VAL_ERR if nothing is scheduled there
+ */
+ret_t scheduler_wake(schedule_t *schedule, uint8_t schedule_id)
+{
+    schedule_slot_t *slot;
+
+#if SCHEDULER_NUM_SLOTS < 256
+    if (schedule_id >= SCHEDULER_NUM_SLOTS) {
+        return RET_VAL_ERR;
+    }
+#endif
+    slot = &schedule->slots[schedule_id];
+
+    switch (slot->state) {
+        case kSlotQueued: {
+            schedule_heap_t *heap = &schedule->heaps[slot->priority];
+            schedule_heap_entry_t *entry = &heap->entries[slot->heap_index];
+            if ((int32_t)(entry->deadline_us - schedule->current_time_us) > 0) {
+                entry->deadline_us = schedule->current_time_us;
+                priv_sift_up(schedule, heap, slot->heap_index);
+            }
+            break;
+        }
+
+        case kSlotPending:
+            slot->delay_ms = 0;
+            break;
+
+        case kSlotRunning:
+            // rescheduled for now when it returns
+            slot->woken = true;
+            break;
+
+        default:
+            return RET_VAL_ERR;
+    }
+    return RET_OK;
+}
+
+/*! Runs every callback that is due.
+ *
+ * Each callback runs at most once per call. After every callback, the highest priority callback
+ * that is due runs next. The next deadline of each class is always at the top of its heap, so the
+ * work here scales with the number of callbacks that are due, not the number scheduled.
+ *
+ * @param schedule (schedule_t *): schedule to run
+ * @param current_time_us (uint32_t): the current time_us()
+ * @return the number of us until the next callback is due (0 if there's more to do now)
+ */
+int32_t scheduler_run(schedule_t *schedule, uint32_t current_time_us)
 {
-    // uint8_t num_schedules_to_run = 0;
-    // int16_t this_schedule[NUM_SLOTS];
-    // TODO: smartly call the "most starved" callbacks first?
     int32_t new_callback_time = 0;
-    int32_t next_cb_time_ms = INT32_MAX; // default value is max possible
+    int32_t next_cb_time_us = INT32_MAX;
+    uint16_t slot_ind;
     ret_t ret;
 
-    // TODO: not sure if I need to disable timer interrupts here...
-    for (uint8_t i = 0; i < NUM_SLOTS; i++) {
-        if (schedule->callbacks[i] != NULL) {
-            // check if we need to run this guy
-            // set it to the period, then subtract the amount of ms since last called
-            int32_t time_until_next_run = schedule->callback_times_ms[i];
-            time_until_next_run -= (current_time_ms - schedule->callback_last_run_ms[i]);
-            // If zero or negative, we are due to run it
-            if (time_until_next_run <= 0) {
-                // TODO: check & log if we're missing the timing requirements of this callback
-                // Call the function
-                ret = schedule->callbacks[i](&new_callback_time);
-                // TODO: log if the callback returns non RET_OK
-                if (new_callback_time == SCHEDULER_FINISHED) {
-                    scheduler_remove(schedule, i);
-                } else {
-                    schedule->callback_last_run_ms[i] = current_time_ms;
-                    schedule->callback_times_ms[i] = new_callback_time;
-                    time_until_next_run = new_callback_time;
-                }
-            }
+    schedule->current_time_us = current_time_us;
+    schedule->pass += 1;
+    priv_drain_pending(schedule);
+
+    while ((slot_ind = priv_next_due(schedule, current_time_us)) != NO_SLOT) {
+        schedule_slot_t *slot = &schedule->slots[slot_ind];
+        schedule_heap_t *heap = &schedule->heaps[slot->priority];
+
+        // The slot stays in the heap while it runs. The callback is free to add / remove
+        // others, `heap_index` keeps track of where we end up.
+        slot->state = kSlotRunning;
+        slot->last_pass = schedule->pass;
+
+#ifdef SCHEDULER_PROFILING
+        // earlier callbacks in this pass eat into the later ones, so look at the clock now
+        uint32_t dispatch_us = schedule->get_time_us ? schedule->get_time_us() : current_time_us;
+        uint32_t lateness_us = dispatch_us - heap->entries[0].deadline_us;
+        uint32_t start_cycles = schedule->get_cycles ? schedule->get_cycles() : 0;
+#endif
+        new_callback_time = 0;
+        slot->woken = false;
+        if (schedule->trace != NULL) {
+            schedule->trace((uint8_t)slot_ind, false, RET_OK);
+        }
+        ret = slot->callback(&new_callback_time);
+        if (schedule->trace != NULL) {
+            schedule->trace((uint8_t)slot_ind, true, ret);
+        }
+#ifdef SCHEDULER_PROFILING
+        priv_profile_record(schedule, slot_ind, start_cycles, lateness_us, ret);
+#endif
+
+        if (slot->state == kSlotCancelled || new_callback_time == SCHEDULER_FINISHED) {
+            priv_heap_remove_at(schedule, heap, slot->heap_index);
+            priv_free_slot(schedule, slot_ind);
+        } else {
+            // The new deadline is never earlier than the old one, so it can only move down
+            schedule_heap_entry_t *entry = &heap->entries[slot->heap_index];
+            entry->deadline_us =
+                current_time_us + (slot->woken ? 0 : priv_delay_us(new_callback_time));
+            entry->seq = schedule->next_seq++;
+            slot->state = kSlotQueued;
+            priv_sift_down(schedule, heap, slot->heap_index);
+        }
+
+        if (schedule->between_callbacks != NULL) {
+            schedule->between_callbacks();
+        }
+    }
 
-            // Check if this will be the next callback we need to run next time
-            if (time_until_next_run < next_cb_time_ms) {
-                next_cb_time_ms = time_until_next_run;
+    if (__atomic_load_n(&schedule->pending_head, __ATOMIC_ACQUIRE) != NO_SLOT) {
+        // something got added while we were running
+        return 0;
+    }
+    for (uint8_t p = 0; p < kSchedulerNumPriorities; p++) {
+        schedule_heap_t *heap = &schedule->heaps[p];
+        if (heap->len > 0) {
+            int32_t until_us = (int32_t)(heap->entries[0].deadline_us - current_time_us);
+            if (until_us < next_cb_time_us) {
+                next_cb_time_us = until_us;
             }
         }
     }
+    return (next_cb_time_us > 0) ? next_cb_time_us : 0;
+}
+
+#ifdef SCHEDULER_PROFILING
+/*! Starts timing callbacks in cycles. Until this is called only counts and lateness are kept.
+ *
+ * @param schedule (schedule_t *): schedule to profile
+ * @param get_cycles (scheduler_cycle_counter_t): free running cycle counter
+ */
+void scheduler_setCycleCounter(schedule_t *schedule, scheduler_cycle_counter_t get_cycles)
+{
+    schedule->get_cycles = get_cycles;
+}
+
+/*! Measures lateness from when each callback actually starts. Until this is called lateness is
+ *  measured from the time given to scheduler_run(), which misses the time taken by the callbacks
+ *  that ran before it in the same pass.
+ *
+ * @param schedule (schedule_t *): schedule to profile
+ * @param get_time_us (scheduler_time_source_t): the clock scheduler_run() is given
+ */
+void scheduler_setTimeSource(schedule_t *schedule, scheduler_time_source_t get_time_us)
+{
+    schedule->get_time_us = get_time_us;
+}
+
+/*! Gets the runtime stats of a scheduled callback.
+ *
+ * @param schedule (schedule_t *): schedule the callback is in
+ * @param schedule_id (uint8_t): ID given by scheduler_add()
+ * @param stats_ptr (scheduler_slot_stats_t *): where to copy the stats to
+ * @retval RET_OK, RET_VAL_ERR if the ID is invalid, or RET_NODATA_ERR if nothing is scheduled there
+ */
+ret_t scheduler_getStats(schedule_t *schedule, uint8_t schedule_id,
+                         scheduler_slot_stats_t *stats_ptr)
+{
+#if SCHEDULER_NUM_SLOTS < 256
+    if (schedule_id >= SCHEDULER_NUM_SLOTS) {
+        return RET_VAL_ERR;
+    }
+#endif
+    if (schedule->slots[schedule_id].callback == NULL) {
+        return RET_NODATA_ERR;
+    }
+    *stats_ptr = schedule->stats[schedule_id];
+    return RET_OK;
+}
+
+/*! Clears the stats of every slot, e.g. before measuring a specific workload.
+ */
+void scheduler_resetStats(schedule_t *schedule)
+{
+    for (uint16_t i = 0; i < SCHEDULER_NUM_SLOTS; i++) {
+        priv_profile_reset(schedule, i);
+    }
+}
+#endif
+
+/* --- Private functions --- */
+
+//! Converts a callback's delay to a deadline offset, keeping it within the signed compare range
+static uint32_t priv_delay_us(int32_t delay_ms)
+{
+    if (delay_ms <= 0) {
+        return 0;
+    }
+    if (delay_ms > SCHEDULER_MAX_DELAY_MS) {
+        delay_ms = SCHEDULER_MAX_DELAY_MS;
+    }
+    return (uint32_t)delay_ms * 1000;
+}
+
+static void priv_free_slot(schedule_t *schedule, uint16_t slot_ind)
+{
+    schedule_slot_t *slot = &schedule->slots[slot_ind];
+    slot->heap_index = NO_SLOT;
+    slot->state = kSlotFree;
+    __atomic_fetch_sub(&schedule->num_slots_used, 1, __ATOMIC_RELAXED);
+    // last, so scheduler_add() can't claim it before it's cleaned up
+    __atomic_store_n(&slot->callback, NULL, __ATOMIC_RELEASE);
+}
+
+/*! Moves everything added since the last run into the heap, in the order it was added.
+ */
+static void priv_drain_pending(schedule_t *schedule)
+{
+    uint16_t list;
+    uint16_t reversed = NO_SLOT;
+
+    // cheap check first, the exchange is an exclusive access loop
+    if (__atomic_load_n(&schedule->pending_head, __ATOMIC_RELAXED) == NO_SLOT) {
+        return;
+    }
+    list = __atomic_exchange_n(&schedule->pending_head, NO_SLOT, __ATOMIC_ACQUIRE);
+
+    // the list is LIFO, flip it so that equal deadlines keep the order they were added in
+    while (list != NO_SLOT) {
+        uint16_t next = schedule->slots[list].next_pending;
+        schedule->slots[list].next_pending = reversed;
+        reversed = list;
+        list = next;
+    }
+
+    while (reversed != NO_SLOT) {
+        uint16_t slot_ind = reversed;
+        schedule_slot_t *slot = &schedule->slots[slot_ind];
+        reversed = slot->next_pending;
+        slot->next_pending = NO_SLOT;
+
+        if (slot->state == kSlotCancelled) {
+            priv_free_slot(schedule, slot_ind);
+            continue;
+        }
+        slot->last_pass = schedule->pass - 1;
+#ifdef SCHEDULER_PROFILING
+        priv_profile_reset(schedule, slot_ind);
+#endif
+        priv_heap_insert(schedule, slot_ind,
+                         schedule->current_time_us + priv_delay_us(slot->delay_ms));
+    }
+}
+
+/*! Finds the callback to run next: the top of the highest priority heap that is due and hasn't run
+ *  yet this pass.
+ *
+ * @return the slot to run, or NO_SLOT if nothing else is due this pass
+ */
+static uint16_t priv_next_due(schedule_t *schedule, uint32_t current_time_us)
+{
+    for (uint8_t p = 0; p < kSchedulerNumPriorities; p++) {
+        schedule_heap_t *heap = &schedule->heaps[p];
+        if (heap->len == 0 || (int32_t)(heap->entries[0].deadline_us - current_time_us) > 0) {
+            // nothing due in this class
+            continue;
+        }
+        uint16_t slot_ind = heap->entries[0].slot;
+        if (schedule->slots[slot_ind].last_pass == schedule->pass) {
+            // Everything due in this class has run once already. Ties are broken by insertion
+            // order, so anything due that hasn't run would have been ahead of this one.
+            continue;
+        }
+        return slot_ind;
+    }
+    return NO_SLOT;
+}
+
+//! Whether heap entry `a` should run before heap entry `b`
+static inline bool priv_runs_before(const schedule_heap_entry_t *a, const schedule_heap_entry_t *b)
+{
+    int32_t diff = (int32_t)(a->deadline_us - b->deadline_us);
+    if (diff != 0) {
+        return diff < 0;
+    }
+    return (int32_t)(a->seq - b->seq) < 0;
+}
+
+static inline void priv_heap_set(schedule_t *schedule, schedule_heap_t *heap, uint16_t heap_pos,
+                                 const schedule_heap_entry_t *entry)
+{
+    heap->entries[heap_pos] = *entry;
+    schedule->slots[entry->slot].heap_index = heap_pos;
+}
+
+static void priv_heap_insert(schedule_t *schedule, uint16_t slot_ind, uint32_t deadline_us)
+{
+    schedule_heap_t *heap = &schedule->heaps[schedule->slots[slot_ind].priority];
+    schedule_heap_entry_t *entry = &heap->entries[heap->len];
+    entry->deadline_us = deadline_us;
+    entry->seq = schedule->next_seq++;
+    entry->slot = slot_ind;
+    schedule->slots[slot_ind].heap_index = heap->len;
+    schedule->slots[slot_ind].state = kSlotQueued;
+    heap->len += 1;
+    priv_sift_up(schedule, heap, heap->len - 1);
+}
+
+static void priv_heap_remove_at(schedule_t *schedule, schedule_heap_t *heap, uint16_t heap_pos)
+{
+    uint16_t removed = heap->entries[heap_pos].slot;
+    heap->len -= 1;
+    if (heap_pos != heap->len) {
+        // fill the hole with the last entry and fix up the ordering from there
+        priv_heap_set(schedule, heap, heap_pos, &heap->entries[heap->len]);
+        if (heap_pos > 0 &&
+            priv_runs_before(&heap->entries[heap_pos], &heap->entries[(heap_pos - 1) / 2])) {
+            priv_sift_up(schedule, heap, heap_pos);
+        } else {
+            priv_sift_down(schedule, heap, heap_pos);
+        }
+    }
+    heap->entries[heap->len].slot = NO_SLOT;
+    schedule->slots[removed].heap_index = NO_SLOT;
+}
+
+static void priv_sift_up(schedule_t *schedule, schedule_heap_t *heap, uint16_t heap_pos)
+{
+    schedule_heap_entry_t entry = heap->entries[heap_pos];
+    while (heap_pos > 0) {
+        uint16_t parent = (heap_pos - 1) / 2;
+        if (!priv_runs_before(&entry, &heap->entries[parent])) {
+            break;
+        }
+        priv_heap_set(schedule, heap, heap_pos, &heap->entries[parent]);
+        heap_pos = parent;
+    }
+    priv_heap_set(schedule, heap, heap_pos, &entry);
+}
+
+static void priv_sift_down(schedule_t *schedule, schedule_heap_t *heap, uint16_t heap_pos)
+{
+    schedule_heap_entry_t entry = heap->entries[heap_pos];
+    while (true) {
+        uint16_t child = 2 * heap_pos + 1;
+        if (child >= heap->len) {
+            break;
+        }
+        if (child + 1 < heap->len &&
+            priv_runs_before(&heap->entries[child + 1], &heap->entries[child])) {
+            child += 1;
+        }
+        if (!priv_runs_before(&heap->entries[child], &entry)) {
+            break;
+        }
+        priv_heap_set(schedule, heap, heap_pos, &heap->entries[child]);
+        heap_pos = child;
+    }
+    priv_heap_set(schedule, heap, heap_pos, &entry);
+}
+
+#ifdef SCHEDULER_PROFILING
+static void priv_profile_reset(schedule_t *schedule, uint16_t slot_ind)
+{
+    scheduler_slot_stats_t *stats = &schedule->stats[slot_ind];
+    memset(stats, 0, sizeof(*stats));
+    stats->callback_addr = (uint32_t)(uintptr_t)schedule->slots[slot_ind].callback;
+}
+
+static void priv_profile_record(schedule_t *schedule, uint16_t slot_ind, uint32_t start_cycles,
+                                uint32_t lateness_us, ret_t ret)
+{
+    scheduler_slot_stats_t *stats = &schedule->stats[slot_ind];
+    uint32_t cycles = schedule->get_cycles ? schedule->get_cycles() - start_cycles : 0;
 
-    return next_cb_time_ms;
+    stats->calls += 1;
+    stats->total_cycles += cycles;
+    if (cycles > stats->max_cycles) {
+        stats->max_cycles = cycles;
+    }
+    if (lateness_us >= SCHEDULER_MISSED_DEADLINE_US) {
+        stats->missed_deadlines += 1;
+    }
+    if (lateness_us > stats->max_lateness_us) {
+        stats->max_lateness_us = lateness_us;
+    }
+    if (ret != RET_OK) {
+        stats->errors += 1;
+        stats->last_error = (int8_t)ret;
+    }
 }
+#endif
@@ -4,25 +4,136 @@
  *
  * @date    28-April-2018
  * @brief   A rudamentary scheduler
+ *
+ * Callbacks are kept in a min-heap ordered by their next deadline, so finding the next callback to
+ * run is O(1) and rescheduling one is O(log n). There is one heap per priority class. Whenever
+ * more than one callback is due, the highest priority one runs first, and the choice is made again
+ * after every callback, so a due high priority callback never waits behind more than the one
+ * callback that was already running.
+ *
+ * Deadlines are kept in microseconds on the time_us() timebase, so callbacks due in the same ms
+ * still run in deadline order. Callbacks ask for their delays in ms.
+ *
+ * scheduler_add() may be called from interrupt context. New callbacks are put on a lock-free
+ * pending list and moved into the heap by the next scheduler_run(). Everything else must be called
+ * from the same (main) context as scheduler_run().
+ *
+ * Building with SCHEDULER_PROFILING keeps runtime, lateness and error stats for every slot. Without
+ * it, none of the profiling code or storage exists.
  */
 
 #pragma once
 
 #include "common.h"
+#include <stdbool.h>
 #include <stdint.h>
 
-#define NUM_SLOTS (16)
+#ifndef SCHEDULER_NUM_SLOTS
+#define SCHEDULER_NUM_SLOTS (16) //!< Max number of callbacks that can be scheduled (up to 256)
+#endif
+
+#if SCHEDULER_NUM_SLOTS > 256
+#error "SCHEDULER_NUM_SLOTS must fit in the uint8_t schedule IDs"
+#endif
+
 #define SCHEDULER_FINISHED (-1)
+#define SCHEDULER_MAX_DELAY_MS (INT32_MAX / 1000) //!< Longer delays are cut to this (~35 minutes)
+
+//! Priority classes, highest first. Within a class, callbacks run in deadline order.
+typedef enum {
+    kSchedulerPriorityHigh,   //!< Latency sensitive work (e.g. sensor handling)
+    kSchedulerPriorityNormal, //!< Default for scheduler_add()
+    kSchedulerPriorityLow,    //!< Housekeeping that can wait
+    kSchedulerNumPriorities,
+} scheduler_priority_t;
+
+typedef ret_t (*scheduler_callback_t)(int32_t *callback_time_ms);
+
+//! Called before (done = false) and after (done = true, with what it returned) every callback
+typedef void (*scheduler_trace_t)(uint8_t schedule_id, bool done, ret_t ret);
+
+#ifdef SCHEDULER_PROFILING
+#ifndef SCHEDULER_MISSED_DEADLINE_US
+#define SCHEDULER_MISSED_DEADLINE_US (1000) //!< How late a call has to be to count as missed
+#endif
 
+//! Returns a free running cycle count (e.g. DWT->CYCCNT)
+typedef uint32_t (*scheduler_cycle_counter_t)(void);
+
+//! Returns the current time in us, same clock as the one given to scheduler_run() (e.g. time_us)
+typedef uint32_t (*scheduler_time_source_t)(void);
+
+//! Runtime stats of one slot, since it was last added
+typedef struct __attribute__((packed)) {
+    uint32_t callback_addr;    //!< Which callback this is, to look up in the map file
+    uint32_t calls;            //!< Number of times the callback ran
+    uint64_t total_cycles;     //!< Cycles spent in the callback, over all calls
+    uint32_t max_cycles;       //!< Longest single call
+    uint32_t max_lateness_us;  //!< Worst time between the deadline and the callback running
+    uint32_t missed_deadlines; //!< Calls that ran SCHEDULER_MISSED_DEADLINE_US or more late
+    uint32_t errors;           //!< Calls that didn't return RET_OK
+    int8_t last_error;         //!< What the last failing call returned
+} scheduler_slot_stats_t;
+#endif
+
+//! Everything tracked for one scheduled callback.
+typedef struct {
+    scheduler_callback_t callback; //!< NULL when the slot is free
+    int32_t delay_ms;              //!< Requested delay, until the slot makes it into the heap
+    uint16_t heap_index;           //!< Where this slot is in its heap
+    uint16_t next_pending;         //!< Next slot in the pending list
+    uint16_t last_pass;            //!< Last scheduler_run() pass this callback ran in
+    uint8_t priority;              //!< Which heap this slot goes in (scheduler_priority_t)
+    bool woken;                    //!< scheduler_wake() was called while the callback ran
+    volatile uint8_t state;        //!< Slot state (free, pending, queued, running)
+} schedule_slot_t;
+
+//! Heap entries carry their own sort keys, so sifting doesn't have to chase slot pointers.
 typedef struct {
-    uint8_t num_slots_used;
-    ret_t (*callbacks[NUM_SLOTS])(int32_t *callback_time_ms);
-    int32_t callback_times_ms[NUM_SLOTS];
-    int32_t callback_last_run_ms[NUM_SLOTS];
+    uint32_t deadline_us; //!< When the callback is next due
+    uint32_t seq;         //!< Insertion order, breaks ties between equal deadlines
+    uint16_t slot;        //!< Which slot this is
+} schedule_heap_entry_t;
+
+//! The callbacks of one priority class, ordered by deadline
+typedef struct {
+    uint16_t len;
+    schedule_heap_entry_t entries[SCHEDULER_NUM_SLOTS];
+} schedule_heap_t;
+
+typedef struct {
+    volatile uint16_t num_slots_used;
+    volatile uint16_t pending_head;  //!< Slots added but not yet in the heap (lock-free list)
+    uint16_t pass;                   //!< Incremented every scheduler_run()
+    uint32_t next_seq;               //!< Next insertion sequence number
+    uint32_t current_time_us;        //!< Time given to the last scheduler_run()
+    void (*between_callbacks)(void); //!< Optional hook run after every callback
+    scheduler_trace_t trace;         //!< Optional hook run around every callback
+    schedule_heap_t heaps[kSchedulerNumPriorities];
+    schedule_slot_t slots[SCHEDULER_NUM_SLOTS];
+#ifdef SCHEDULER_PROFILING
+    scheduler_cycle_counter_t get_cycles;              //!< NULL until profiling is started
+    scheduler_time_source_t get_time_us;               //!< Clock sampled at dispatch, for lateness
+    scheduler_slot_stats_t stats[SCHEDULER_NUM_SLOTS]; //!< Indexed by slot / schedule ID
+#endif
 } schedule_t;
 
 ret_t scheduler_init(schedule_t *schedule);
 ret_t scheduler_add(schedule_t *schedule, int32_t callback_time_ms,
                     ret_t (*callback)(int32_t *callback_time_ms), uint8_t *schedule_id);
+ret_t scheduler_addWithPriority(schedule_t *schedule, scheduler_priority_t priority,
+                                int32_t callback_time_ms, scheduler_callback_t callback,
+                                uint8_t *schedule_id);
+void scheduler_setBetweenCallbacksHook(schedule_t *schedule, void (*hook)(void));
+void scheduler_setTraceHook(schedule_t *schedule, scheduler_trace_t hook);
 ret_t scheduler_remove(schedule_t *schedule, uint8_t schedule_id_to_remove);
-int32_t scheduler_run(schedule_t *schedule, uint32_t current_time_ms);
+ret_t scheduler_wake(schedule_t *schedule, uint8_t schedule_id);
+int32_t scheduler_run(schedule_t *schedule, uint32_t current_time_us);
+
+#ifdef SCHEDULER_PROFILING
+void scheduler_setCycleCounter(schedule_t *schedule, scheduler_cycle_counter_t get_cycles);
+void scheduler_setTimeSource(schedule_t *schedule, scheduler_time_source_t get_time_us);
+ret_t scheduler_getStats(schedule_t *schedule, uint8_t schedule_id,
+                         scheduler_slot_stats_t *stats_ptr);
+void scheduler_resetStats(schedule_t *schedule);
+#endif
@@ -0,0 +1,17 @@
+/*!
+ * @file    timebase.h
+ * @author  Tyler Holmes
+ *
+ * @date    18-Oct-2026
+ * @brief   Free running microsecond timebase for scheduling and sample timestamps.
+ *
+ * time_us() counts up at 1 MHz and wraps every ~71.6 minutes, so times must always be compared by
+ * signed difference, e.g. `(int32_t)(a - b) > 0`, never with a plain `<`.
+ *
+ * On target it's TIM2 (see hw_timebase_init()). Host builds link a clock_gettime() version instead.
+ */
+#pragma once
+
+#include <stdint.h>
+
+uint32_t time_us(void);
@@ -8,6 +8,7 @@
 
 #include "I2C.h"
 #include "common.h"
+#include "modules/utilities/events.h"
 #include "peripherals/stm32f3/stm32f3xx_hal.h"
 #include "peripherals/stm32f3/stm32f3xx_hal_def.h"
 #include "peripherals/stm32f3/stm32f3xx_hal_i2c.h"
@@ -18,7 +19,10 @@
 
 /* Size of Transmission buffers */
 #define TX_BUFFER_SIZE (10)
-#define RX_BUFFER_SIZE TX_BUFFER_SIZE
+
+#if (I2C_QUEUE_SIZE & (I2C_QUEUE_SIZE - 1)) != 0
+#error "I2C_QUEUE_SIZE must be a power of 2"
+#endif
 
 // Our I2C address
 #define I2C_ADDRESS (0x3F)
@@ -45,13 +49,31 @@ tSCLDEL   5 x 250 ns = 1250 ns
 /* I2C handler declaration */
 I2C_HandleTypeDef I2cHandle;
 
-// Buffers used for transmission
+extern events_t gMainEvents;
+
+//! Transaction queue. Main context submits and runs the callbacks, the ISRs run the transfers.
+typedef struct {
+    i2c_transaction_t *queue[I2C_QUEUE_SIZE]; //!< Submitted transactions, oldest first
+    volatile uint32_t head;                   //!< Submitted since init (only main context)
+    volatile uint32_t next;                   //!< Finished since init (only the ISRs, once running)
+    uint32_t done;                            //!< Callbacks run since init (only main context)
+    volatile bool active;                     //!< A transfer's in flight, or about to be started
+    bool data_phase;                          //!< The register address is out, on to the data
+    uint8_t done_event;                       //!< Posted when a transaction finishes
+    i2c_transaction_t write;                  //!< I2C_writeData() without blocking
+} I2C_admin_t;
+
+static I2C_admin_t gI2C;
+
+// Buffer used for writes that don't block
 uint8_t TX_buffer[TX_BUFFER_SIZE];
-uint8_t RX_buffer[RX_BUFFER_SIZE];
+
+static ret_t priv_doneHandler(uint16_t num_posts);
 
 ret_t I2C_init(void)
 {
     HAL_StatusTypeDef retval;
+    ret_t ret;
 
     // Configure the I2C HAL
     I2cHandle.Instance = I2C1;
@@ -74,112 +96,254 @@ ret_t I2C_init(void)
         fatal_error_handler(__FILE__, __LINE__, retval);
     }
 
+    memset(&gI2C, 0, sizeof(gI2C));
+    gI2C.write.ret = RET_OK;
+    ret = events_register(&gMainEvents, priv_doneHandler, &gI2C.done_event);
+    if (ret != RET_OK) {
+        return ret;
+    }
+
     return RET_OK;
 }
 
-ret_t I2C_writeData(uint8_t dev_address, uint8_t mem_address, uint8_t *data_ptr, uint8_t data_len,
-                    bool blocking)
+/*! Starts a transaction with its register address frame. Writes carry on with the data in the
+ *  same frame (no restart), reads leave it open for a repeated start.
+ */
+static HAL_StatusTypeDef priv_startTransfer(i2c_transaction_t *transaction)
 {
-    // check if we're available to send data
-    if (I2C_isBusy()) {
-        return RET_BUSY_ERR;
+    gI2C.data_phase = false;
+    return HAL_I2C_Master_Sequential_Transmit_IT(
+        &I2cHandle, (uint16_t)transaction->address, &transaction->mem_address, 1,
+        transaction->write ? I2C_FIRST_AND_NEXT_FRAME : I2C_FIRST_FRAME);
+}
+
+//! The register address is out: moves the data, ending with a stop
+static HAL_StatusTypeDef priv_startData(i2c_transaction_t *transaction)
+{
+    gI2C.data_phase = true;
+    if (transaction->write) {
+        return HAL_I2C_Master_Sequential_Transmit_IT(&I2cHandle, (uint16_t)transaction->address,
+                                                     transaction->data_ptr, transaction->data_len,
+                                                     I2C_LAST_FRAME);
     }
+    return HAL_I2C_Master_Sequential_Receive_IT(&I2cHandle, (uint16_t)transaction->address,
+                                                transaction->data_ptr, transaction->data_len,
+                                                I2C_LAST_FRAME);
+}
 
-    // make sure the length is possible
-    if (data_len > TX_BUFFER_SIZE) {
-        return RET_LEN_ERR;
+//! The oldest unfinished transaction is done: hands it over to main context for its callback
+static void priv_finish(ret_t ret)
+{
+    uint32_t next = gI2C.next;
+
+    __atomic_store_n(&gI2C.queue[next & (I2C_QUEUE_SIZE - 1)]->ret, ret, __ATOMIC_RELEASE);
+    __atomic_store_n(&gI2C.next, next + 1, __ATOMIC_RELEASE);
+    events_post(&gMainEvents, gI2C.done_event);
+}
+
+/*! Starts the next transaction, if there is one, or goes idle (active = false). Any that can't be
+ *  started are finished with RET_COM_ERR there and then.
+ *
+ * Runs from the completion / error ISRs to chain the next transfer, or from I2C_submit() when the
+ * queue was idle. Never both at once: main context only starts it while it's idle, when no
+ * interrupt is coming. Starting a transfer doesn't wait on the bus, so it's fine in an ISR.
+ */
+static void priv_startNext(void)
+{
+    while (gI2C.next != __atomic_load_n(&gI2C.head, __ATOMIC_ACQUIRE)) {
+        if (priv_startTransfer(gI2C.queue[gI2C.next & (I2C_QUEUE_SIZE - 1)]) == HAL_OK) {
+            return;
+        }
+        priv_finish(RET_COM_ERR);
     }
-    // copy the data into the TX buffer and send it!
-    memcpy(TX_buffer, data_ptr, data_len);
-    if (HAL_I2C_Mem_Write_IT(&I2cHandle, (uint16_t)dev_address, (uint16_t)mem_address,
-                             I2C_MEMADD_SIZE_8BIT, (uint8_t *)TX_buffer, data_len) != HAL_OK) {
-        return RET_COM_ERR;
+    __atomic_store_n(&gI2C.active, false, __ATOMIC_RELEASE);
+}
+
+//! The transaction in flight is over: hands it to main context and chains the next one
+static void priv_finishAndChain(ret_t ret)
+{
+    priv_finish(ret);
+    priv_startNext();
+}
+
+/*! Runs the callbacks of the transactions that have finished, oldest first, freeing up their
+ *  places in the queue. Main context only.
+ *
+ * @retval RET_OK, or the first error a callback returned
+ */
+static ret_t priv_runCallbacks(void)
+{
+    i2c_transaction_t *transaction;
+    ret_t ret = RET_OK;
+    ret_t callback_ret;
+
+    // the ISRs can finish more while this runs, and a callback can run this again (blocking calls)
+    while (gI2C.done != __atomic_load_n(&gI2C.next, __ATOMIC_ACQUIRE)) {
+        transaction = gI2C.queue[gI2C.done & (I2C_QUEUE_SIZE - 1)];
+        // free its place first, so the callback can submit it again
+        gI2C.done += 1;
+        if (transaction->callback == NULL) {
+            continue;
+        }
+        callback_ret = transaction->callback(transaction);
+        if (callback_ret != RET_OK && ret == RET_OK) {
+            ret = callback_ret;
+        }
     }
+    return ret;
+}
 
-    // if we're supposed to block, wait here
-    if (blocking == true) {
-        while (I2C_isBusy())
-            ;
+//! Transactions finished, run their callbacks
+static ret_t priv_doneHandler(uint16_t UNUSED_PARAM(num_posts)) { return priv_runCallbacks(); }
+
+/*! Queues a register read / write. It starts straight away if the bus is idle, otherwise once the
+ *  ones in front of it are done. Main context only.
+ *
+ * @param transaction (i2c_transaction_t *): what to do. Mustn't be touched until it's done (its
+ *      callback runs, or I2C_isDone()).
+ * @retval RET_OK if queued, RET_INVALID_ARGS_ERR if there's nothing to transfer, RET_BUSY_ERR if
+ *      the queue's full
+ */
+ret_t I2C_submit(i2c_transaction_t *transaction)
+{
+    uint32_t head = gI2C.head;
+
+    if (transaction == NULL || transaction->data_ptr == NULL || transaction->data_len == 0) {
+        return RET_INVALID_ARGS_ERR;
     }
+    if (head - gI2C.done >= I2C_QUEUE_SIZE) {
+        // Full, or finished ones are still waiting on their callbacks. Try again later.
+        return RET_BUSY_ERR;
+    }
+
+    transaction->ret = RET_BUSY_ERR;
+    gI2C.queue[head & (I2C_QUEUE_SIZE - 1)] = transaction;
+    // only now does the ISR get to see it
+    __atomic_store_n(&gI2C.head, head + 1, __ATOMIC_RELEASE);
 
+    /* If a transfer is in flight, its completion interrupt picks this one up. Otherwise nothing is
+     * coming, so start it here. (The interrupt only goes idle after seeing the head it was given,
+     * and the head was moved before checking.)
+     */
+    if (!__atomic_load_n(&gI2C.active, __ATOMIC_ACQUIRE)) {
+        gI2C.active = true;
+        priv_startNext();
+    }
     return RET_OK;
 }
 
-ret_t I2C_writeByte(uint8_t dev_address, uint8_t mem_address, uint8_t data, bool blocking)
+/*! Whether or not a submitted transaction's transfer is over (its callback may not have run yet).
+ *
+ * @retval true once it's done, with how it went in transaction->ret
+ */
+bool I2C_isDone(const i2c_transaction_t *transaction)
 {
-    return I2C_writeData(dev_address, mem_address, &data, 1, blocking);
+    return __atomic_load_n(&transaction->ret, __ATOMIC_ACQUIRE) != RET_BUSY_ERR;
 }
 
-ret_t I2C_readData(uint8_t address, uint8_t mem_address, uint8_t *data_ptr, uint8_t data_len)
+/*! Queues a transaction and spins until it's done. Waits for room in the queue too.
+ *
+ * @retval How the transfer went
+ */
+static ret_t priv_transact(i2c_transaction_t *transaction)
+{
+    ret_t ret;
+
+    while ((ret = I2C_submit(transaction)) == RET_BUSY_ERR) {
+        // finished ones only leave the queue once their callbacks have run
+        priv_runCallbacks();
+    }
+    if (ret != RET_OK) {
+        return ret;
+    }
+    while (!I2C_isDone(transaction))
+        ;
+
+    // It's probably on the caller's stack, so it has to leave the queue before returning
+    priv_runCallbacks();
+    return transaction->ret;
+}
+
+ret_t I2C_writeData(uint8_t dev_address, uint8_t mem_address, uint8_t *data_ptr, uint8_t data_len,
+                    bool blocking)
 {
+    i2c_transaction_t transaction = {.address = dev_address,
+                                     .mem_address = mem_address,
+                                     .write = true,
+                                     .data_ptr = data_ptr,
+                                     .data_len = data_len};
+
+    if (blocking == true) {
+        return priv_transact(&transaction);
+    }
+
     // check if we're available to send data
-    if (I2C_isBusy()) {
+    if (!I2C_isDone(&gI2C.write)) {
         return RET_BUSY_ERR;
     }
-
     // make sure the length is possible
-    if (data_len > RX_BUFFER_SIZE) {
+    if (data_len > TX_BUFFER_SIZE) {
         return RET_LEN_ERR;
     }
+    // copy the data into the TX buffer and send it!
+    memcpy(TX_buffer, data_ptr, data_len);
+    gI2C.write = transaction;
+    gI2C.write.data_ptr = TX_buffer;
+    return I2C_submit(&gI2C.write);
+}
 
-    // receive that data!
-    if (HAL_I2C_Mem_Read_IT(&I2cHandle, (uint16_t)address, (uint16_t)mem_address,
-                            I2C_MEMADD_SIZE_8BIT, (uint8_t *)data_ptr, data_len) != HAL_OK) {
-        return RET_COM_ERR;
-    }
+ret_t I2C_writeByte(uint8_t dev_address, uint8_t mem_address, uint8_t data, bool blocking)
+{
+    return I2C_writeData(dev_address, mem_address, &data, 1, blocking);
+}
 
-    // Wait here until the data is read in completely
-    while (I2C_isBusy())
-        ;
+ret_t I2C_readData(uint8_t address, uint8_t mem_address, uint8_t *data_ptr, uint8_t data_len)
+{
+    i2c_transaction_t transaction = {.address = address,
+                                     .mem_address = mem_address,
+                                     .write = false,
+                                     .data_ptr = data_ptr,
+                                     .data_len = data_len};
 
-    return RET_OK;
+    // Wait here until the data is read in completely
+    return priv_transact(&transaction);
 }
 
+//! Whether or not there are transactions queued / in progress
 bool I2C_isBusy(void)
 {
-    HAL_I2C_StateTypeDef state = HAL_I2C_GetState(&I2cHandle);
-    if (state == HAL_I2C_STATE_ABORT || state == HAL_I2C_STATE_TIMEOUT ||
-        state == HAL_I2C_STATE_ERROR || state == HAL_I2C_STATE_RESET) {
-        // major error! (TODO: is reset state that bad?)
-        fatal_error_handler(__FILE__, __LINE__, state);
-    }
-    return (state != HAL_I2C_STATE_READY);
+    return __atomic_load_n(&gI2C.active, __ATOMIC_ACQUIRE) ||
+           __atomic_load_n(&gI2C.next, __ATOMIC_ACQUIRE) != gI2C.head;
 }
 
-/**
- * @brief  Tx Transfer completed callback.
- * @param  I2cHandle: I2C handle.
- * @note   This example shows a simple way to report end of IT Tx transfer, and
- *         you can add your own implementation.
- * @retval None
+/*! A frame went out: either the register address (on to the data), or a write's data (done).
  */
-void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *I2cHandle)
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *UNUSED_PARAM(I2cHandle))
 {
-    // Can put LED blinkies here for debug. Otherwise, don't need as we have the
-    //     I2C_isBusy() function
+    i2c_transaction_t *transaction = gI2C.queue[gI2C.next & (I2C_QUEUE_SIZE - 1)];
+
+    if (gI2C.data_phase) {
+        priv_finishAndChain(RET_OK);
+    } else if (priv_startData(transaction) != HAL_OK) {
+        priv_finishAndChain(RET_COM_ERR);
+    }
 }
 
-/**
- * @brief  Rx Transfer completed callback.
- * @param  I2cHandle: I2C handle
- * @note   This example shows a simple way to report end of IT Rx transfer, and
- *         you can add your own implementation.
- * @retval None
+/*! A read's data is in. Chains the next transaction.
  */
-void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *I2cHandle)
+void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *UNUSED_PARAM(I2cHandle))
 {
-    // Can put LED blinkies here for debug. Otherwise, don't need as we have the
-    //     I2C_isBusy() function
+    priv_finishAndChain(RET_OK);
 }
 
-/**
- * @brief  I2C error callbacks.
- * @param  I2cHandle: I2C handle
- * @note   This example shows a simple way to report transfer error, and you can
- *         add your own implementation.
- * @retval None
+/*! I2C error (e.g. the device didn't ACK). The transaction fails with RET_COM_ERR rather than
+ *  taking everything down, and the queue carries on with the next one.
  */
-void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *I2cHandle)
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *UNUSED_PARAM(I2cHandle))
 {
-    fatal_error_handler(__FILE__, __LINE__, HAL_I2C_GetError(I2cHandle));
+    if (!__atomic_load_n(&gI2C.active, __ATOMIC_ACQUIRE)) {
+        // nothing of ours in flight
+        return;
+    }
+    priv_finishAndChain(RET_COM_ERR);
 }
@@ -5,6 +5,19 @@
  * @date    20-May-2017
  * @brief   Wrapper functions around the stm32f3xx HAL I2C functions.
  *
+ * Transfers go through a queue of transactions (I2C_submit()): each one is a register read or
+ * write, described by whoever submits it. They run back to back, the next one started from the
+ * completion interrupt of the last, so the bus doesn't wait on main context. Once one's done its
+ * callback runs in main context (from an event), and I2C_isDone() is true.
+ *
+ * The blocking functions queue a transaction and spin until it's done, so they're for init only.
+ * Once the scheduler is running, submit a transaction and carry on, or wait on I2C_isDone() from a
+ * protothread (see modules/utilities/pt.h).
+ *
+ * Each register transfer is two sequential frames: the register address, then the data (after a
+ * repeated start for reads), each started from the interrupt that ends the one before. Nothing
+ * polls the bus, so starting a transfer from the I2C interrupt never waits on HAL_GetTick(), which
+ * can't move there (SysTick can't preempt it).
  */
 #pragma once
 
@@ -12,8 +25,35 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#ifndef I2C_QUEUE_SIZE
+#define I2C_QUEUE_SIZE (8) //!< Transactions that can be queued at once (power of 2)
+#endif
+
+struct i2c_transaction;
+
+/*! Runs in main context once a transaction is done. The transaction can be submitted again
+ *  straight from its callback.
+ *
+ * @param transaction (struct i2c_transaction *): the transaction, with how it went in `ret`
+ * @retval Goes back to the event dispatcher
+ */
+typedef ret_t (*i2c_callback_t)(struct i2c_transaction *transaction);
+
+//! One register read / write. Belongs to whoever submits it, and has to stay put until it's done.
+typedef struct i2c_transaction {
+    uint8_t address;         //!< Device address
+    uint8_t mem_address;     //!< First register
+    bool write;              //!< Write data_ptr to the registers, rather than read them into it
+    uint8_t *data_ptr;       //!< What to write / where to read to
+    uint8_t data_len;        //!< Number of bytes
+    i2c_callback_t callback; //!< Run once it's done, NULL for none
+    volatile ret_t ret;      //!< RET_BUSY_ERR while it's queued, then RET_OK or RET_COM_ERR
+} i2c_transaction_t;
+
 ret_t I2C_init(void);
 bool I2C_isBusy(void);
+ret_t I2C_submit(i2c_transaction_t *transaction);
+bool I2C_isDone(const i2c_transaction_t *transaction);
 ret_t I2C_readData(uint8_t address, uint8_t mem_address, uint8_t *data_ptr, uint8_t data_len);
 ret_t I2C_writeData(uint8_t dev_address, uint8_t mem_address, uint8_t *data_ptr, uint8_t data_len,
                     bool blocking);
@@ -5,11 +5,22 @@
  * @date    20-May-2017
  * @brief   Wrapper functions around the stm32f3xx HAL UART functions.
  *
+ * Transmit goes through a ring that DMA sends straight out of. Each transfer is the contiguous
+ * span from the tail up to the head, or to the end of the ring if the data wraps, in which case
+ * the rest goes as a second transfer chained from the TX complete interrupt. Main context only
+ * ever moves the head, the interrupt only ever moves the tail.
+ *
+ * Receive is circular DMA into another ring, which never stops. Nothing happens per byte: the
+ * DMA half / full transfer interrupts and the USART idle line interrupt (the end of a burst) work
+ * out how far DMA got, and post the RX event once for everything that came in.
+ *
+ * The baud rate can be changed from the host (rpt_UART_baudrate()). It changes between messages,
+ * once TX has drained, and goes back by itself if the host doesn't confirm it at the new rate.
  */
 #include "UART.h"
 #include "common.h"
-#include "modules/utilities/newqueue.h"
-#include "modules/utilities/queue.h"
+#include "modules/utilities/events.h"
+#include "modules/utilities/fmt.h"
 #include "modules/utilities/scheduler.h"
 #include "peripherals/stm32f3-configuration/stm32f3xx.h"
 #include "peripherals/stm32f3/stm32f3xx_hal.h"
@@ -20,10 +31,18 @@
 #include <string.h>
 
 extern critical_errors_t gCriticalErrors;
+extern events_t gMainEvents;
 extern schedule_t gMainSchedule;
 
-//! We will have 3x UART TX buffers in a circular buffer
-#define UART_NUM_TX_BUFFER (10)
+#if (UART_TX_RING_SIZE & (UART_TX_RING_SIZE - 1)) != 0
+#error "UART_TX_RING_SIZE must be a power of 2"
+#endif
+#if (UART_RX_RING_SIZE & (UART_RX_RING_SIZE - 1)) != 0
+#error "UART_RX_RING_SIZE must be a power of 2"
+#endif
+
+//! Receive errors we count and carry on from (overrun detection is off, see UART_init())
+#define UART_RX_ERROR_FLAGS (USART_ISR_PE | USART_ISR_FE | USART_ISR_NE | USART_ISR_ORE)
 
 // HAL UART handler declaration
 UART_HandleTypeDef HAL_UART_handle;
@@ -31,17 +50,33 @@ UART_HandleTypeDef HAL_UART_handle;
 //! UART structure to track RX / TX buffers
 typedef struct {
     // define buffers to be used by the STM drivers
-    uint8_t tx_buffer[UART_TX_BUFFER_SIZE]; //!< transmit buffer
-    uint8_t rx_buffer[UART_RX_BUFFER_SIZE]; //!< receive buffer
-    volatile bool tx_being_modified;
-    volatile queue_t rx_buffer_admin;    //!< queue_t admin to track RX circular buffer
-    volatile newqueue_t tx_buffer_admin; //!< queue_t admin to track RX circular buffer
+    uint8_t tx_ring[UART_TX_RING_SIZE]; //!< transmit ring, DMA reads straight out of it
+    uint8_t rx_ring[UART_RX_RING_SIZE]; //!< receive ring, circular DMA writes straight into it
+    volatile uint32_t tx_head;          //!< Bytes queued since init (only main context moves it)
+    volatile uint32_t tx_tail;          //!< Bytes sent since init (only the TX ISR moves it)
+    volatile uint32_t tx_dma_len;       //!< Bytes of the transfer in flight, 0 when TX is idle
+    volatile uint32_t rx_head;          //!< Bytes received since init (only the RX ISRs move it)
+    uint32_t rx_tail;                   //!< Bytes read since init (only main context moves it)
+    uint32_t rx_dma_pos;                //!< Where DMA was in rx_ring when rx_head last moved
+    uint32_t rx_lost;                   //!< Bytes overwritten before they were read
+    volatile uint32_t rx_errors;        //!< Bursts that had framing / noise / parity errors
+    uint8_t rx_event;                   //!< Posted when bytes come in
+    bool rx_event_registered;           //!< Someone wants rx_event (UART_setRxHandler())
+    volatile uint32_t baudrate;         //!< Baud rate in use
+    volatile uint32_t next_baudrate;    //!< Switched to once TX drains, 0 if there's no switch
+    uint32_t confirmed_baudrate;        //!< Gone back to if a switch isn't confirmed in time
+    bool revert_scheduled;              //!< The revert timeout (revert_id) is running
+    uint8_t revert_id;                  //!< Schedule ID of the revert timeout
 
 } UART_admin_t;
 
 //! UART admin
 UART_admin_t UART_admin;
 
+static void transmitMoreData(void);
+static void priv_rxUpdate(void);
+static void priv_applyBaudrate(void);
+
 /*! UART initialization function
  *
  * @param  baudrate (uint32_t): Speed of transactions
@@ -57,7 +92,10 @@ ret_t UART_init(uint32_t baudrate)
     HAL_UART_handle.Init.Parity = UART_PARITY_NONE;
     HAL_UART_handle.Init.HwFlowCtl = UART_HWCONTROL_NONE;
     HAL_UART_handle.Init.Mode = UART_MODE_TX_RX;
-    HAL_UART_handle.AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_NO_INIT;
+    // An overrun would stop reception (and the HAL would abort the DMA). Let the newest byte win
+    // instead, DMA keeps up anyway.
+    HAL_UART_handle.AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_RXOVERRUNDISABLE_INIT;
+    HAL_UART_handle.AdvancedInit.OverrunDisable = UART_ADVFEATURE_OVERRUN_DISABLE;
 
     // configure our own admin
     // UART_admin.sending_data = 0;
@@ -66,228 +104,405 @@ ret_t UART_init(uint32_t baudrate)
         return RET_COM_ERR;
     }
 
-    UART_admin.tx_being_modified = false;
+    UART_admin.tx_head = 0;
+    UART_admin.tx_tail = 0;
+    UART_admin.tx_dma_len = 0;
+    UART_admin.rx_head = 0;
+    UART_admin.rx_tail = 0;
+    UART_admin.rx_dma_pos = 0;
+    UART_admin.rx_lost = 0;
+    UART_admin.rx_errors = 0;
+    UART_admin.baudrate = baudrate;
+    UART_admin.next_baudrate = 0;
+    UART_admin.confirmed_baudrate = baudrate;
+
     // Start receiving data!
-    queue_init(&UART_admin.rx_buffer_admin);
-    newqueue_init(&UART_admin.tx_buffer_admin, UART_TX_BUFFER_SIZE * UART_NUM_TX_BUFFER, 1);
-    HAL_UART_Receive_IT(&HAL_UART_handle, UART_admin.rx_buffer, 1);
+    // RX keeps the freshest bytes, TX would rather refuse a message than corrupt one
+    if (HAL_UART_Receive_DMA(&HAL_UART_handle, UART_admin.rx_ring, UART_RX_RING_SIZE) != HAL_OK) {
+        return RET_COM_ERR;
+    }
+    // A bad byte is counted (at the next idle line) rather than stopping the DMA: the HAL aborts
+    // reception on any error interrupt while RX DMA is on.
+    CLEAR_BIT(HAL_UART_handle.Instance->CR3, USART_CR3_EIE);
+    CLEAR_BIT(HAL_UART_handle.Instance->CR1, USART_CR1_PEIE);
+    __HAL_UART_CLEAR_IDLEFLAG(&HAL_UART_handle);
+    __HAL_UART_ENABLE_IT(&HAL_UART_handle, UART_IT_IDLE);
 
     // yay we're done!
     return RET_OK;
 }
 
+//! Baud rate in use
+uint32_t UART_getBaudrate(void) { return UART_admin.baudrate; }
+
 /*! Checks if the UART TX line is busy sending things
  *
- * @retval Boolean indicating if UART TX is ready to send
+ * @retval Boolean indicating if UART TX is idle, with nothing queued
+ */
+bool UART_TXisReady(void) { return __atomic_load_n(&UART_admin.tx_dma_len, __ATOMIC_ACQUIRE) == 0; }
+
+/*! Copies `num_bytes` into the TX ring at `head`, wrapping round the end, and adds them to the
+ *  running checksum (if there is one). Doesn't publish them, that's up to the caller.
+ *
+ * @retval Where the next fragment goes
  */
-bool UART_TXisReady(void)
+static uint32_t priv_txCopy(uint32_t head, const uint8_t *data_ptr, uint32_t num_bytes,
+                            uint8_t *sum_ptr)
 {
-    HAL_UART_StateTypeDef state;
-    state = HAL_UART_GetState(&HAL_UART_handle);
+    uint32_t start = head & (UART_TX_RING_SIZE - 1);
+    uint32_t first = UART_TX_RING_SIZE - start;
 
-    if (state != HAL_UART_STATE_BUSY_TX_RX && state != HAL_UART_STATE_BUSY_TX) {
-        return true;
-    } else {
-        return false;
+    // up to the end of the ring, then the rest from the start
+    if (first > num_bytes) {
+        first = num_bytes;
+    }
+    memcpy(&UART_admin.tx_ring[start], data_ptr, first);
+    memcpy(UART_admin.tx_ring, data_ptr + first, num_bytes - first);
+    if (sum_ptr != NULL) {
+        for (uint32_t i = 0; i < num_bytes; i++) {
+            *sum_ptr += data_ptr[i];
+        }
     }
+    return head + num_bytes;
 }
 
-/*! Function that waits on the UART driver to be ready with a `UART_TIMEOUT_MS` ms
- * timeout.
+/*! Sends several fragments (e.g. header, payload) over UART as one message, copying each straight
+ *  into the TX ring. Main context only.
  *
- * @retval Return code indicating success / failure of the start of the transmit
+ * @param iov (const uart_iovec_t []): the fragments, in order. Zero length ones are fine.
+ * @param num_iov (uint32_t): number of fragments
+ * @param append_checksum (bool): follow them with the byte that makes everything sum to 0 (the
+ *      report protocol's checksum), worked out while copying
+ * @retval RET_OK once it's queued, RET_BUSY_ERR if there isn't room for all of it (nothing is
+ *      queued, a message is never half sent, nor interleaved with another)
  */
-ret_t UART_waitForReady_withTimeout(void)
+ret_t UART_sendv(const uart_iovec_t iov[], uint32_t num_iov, bool append_checksum)
 {
-    uint32_t timeout = HAL_GetTick() + UART_TIMEOUT_MS;
-    while (UART_TXisReady() == false) {
-        if (HAL_GetTick() > timeout) {
-            return RET_BUSY_ERR;
-        }
+    uint32_t head = UART_admin.tx_head;
+    uint32_t num_bytes = append_checksum ? 1 : 0;
+    uint8_t sum = 0;
+
+    for (uint32_t i = 0; i < num_iov; i++) {
+        num_bytes += iov[i].len;
+    }
+    if (num_bytes > UART_TX_RING_SIZE - (head - __atomic_load_n(&UART_admin.tx_tail,
+                                                                 __ATOMIC_ACQUIRE))) {
+        // No room. Try again later.
+        gCriticalErrors.UART_droppedBytes += num_bytes;
+        return RET_BUSY_ERR;
+    }
+
+    for (uint32_t i = 0; i < num_iov; i++) {
+        head = priv_txCopy(head, iov[i].data, iov[i].len, append_checksum ? &sum : NULL);
+    }
+    if (append_checksum) {
+        sum = -sum;
+        head = priv_txCopy(head, &sum, 1, NULL);
+    }
+    // only now does the ISR get to see any of it
+    __atomic_store_n(&UART_admin.tx_head, head, __ATOMIC_RELEASE);
+    gCriticalErrors.UART_queuedBytes += num_bytes;
+
+    /* If a transfer is in flight, its complete interrupt picks up the new head. Otherwise TX is
+     * idle and no interrupt is coming, so start it here. (The interrupt only goes idle after
+     * seeing the head it was given, and the head was moved before checking.)
+     */
+    if (UART_TXisReady()) {
+        transmitMoreData();
     }
     return RET_OK;
 }
 
-/*! Sends a buffer of data over UART
+/*! Sends a buffer of data over UART. Main context only.
  *
  * @param data_ptr (uint8_t *): pointer to the data you want to transmit
  * @param num_bytes (uint8_t): amount of bytes you want to send
- * @retval Return code indicating success / failure of the start of the transmit
+ * @retval RET_OK once it's queued, RET_BUSY_ERR if there isn't room for all of it (nothing is
+ *      queued, a message is never half sent)
  *
- * @Note Can only send a maximum of `UART_TX_BUFFER_SIZE`
+ * @Note The data is copied into the TX ring, and goes out by DMA from there.
  */
 ret_t UART_sendData(uint8_t *data_ptr, uint32_t num_bytes)
 {
-    ret_t ret = RET_OK;
-
-    // next, transmit the data if we aren't already busy and don't have a backlog
-    if (UART_TXisReady() && UART_admin.tx_buffer_admin.unread_items == 0) {
-
-        // first, make sure we have enough room!
-        if (num_bytes > UART_TX_BUFFER_SIZE) {
-            // Transmit the bit we can, queue up the rest.
-            memcpy(UART_admin.tx_buffer, data_ptr, UART_TX_BUFFER_SIZE);
-            if (HAL_UART_Transmit_IT(&HAL_UART_handle, UART_admin.tx_buffer, UART_TX_BUFFER_SIZE) !=
-                HAL_OK) {
-                return RET_COM_ERR;
-            }
-
-            // queue the rest
-            UART_admin.tx_being_modified = true;
-            gCriticalErrors.UART_queuedBytes += num_bytes - UART_TX_BUFFER_SIZE;
-            ret = newqueue_push(&UART_admin.tx_buffer_admin, data_ptr + UART_TX_BUFFER_SIZE,
-                                num_bytes - UART_TX_BUFFER_SIZE);
-
-            UART_admin.tx_being_modified = false;
-            return ret;
-        } else {
-            // We can transmit all of it in one go
-            memcpy(UART_admin.tx_buffer, data_ptr, num_bytes);
-            if (HAL_UART_Transmit_IT(&HAL_UART_handle, UART_admin.tx_buffer, num_bytes) != HAL_OK) {
-                return RET_COM_ERR;
-            }
-        }
-    } else {
+    uart_iovec_t iov = {.data = data_ptr, .len = num_bytes};
+    return UART_sendv(&iov, 1, false);
+}
 
-        // queue it up for later transmission
-        UART_admin.tx_being_modified = true;
-        if (UART_admin.tx_buffer_admin.num_items - UART_admin.tx_buffer_admin.unread_items >=
-            num_bytes) {
-            // We have enough space to queue this data up.
-            gCriticalErrors.UART_queuedBytes += num_bytes;
-            ret = newqueue_push(&UART_admin.tx_buffer_admin, data_ptr, num_bytes);
-        } else {
-            // No room. Try again later.
-            gCriticalErrors.UART_droppedBytes += num_bytes;
-            ret = RET_BUSY_ERR;
-        }
-        UART_admin.tx_being_modified = false;
-    }
-    return ret;
+/*! Sends a report reply / input report the way the host (pensel_utils.py) reads them: magic
+ *  number, report ID, return value, payload length, payload, checksum. The payload is copied
+ *  straight from where it is.
+ *
+ * @param report (uint8_t): report ID
+ * @param retval (ret_t): what the report returned
+ * @param payload_ptr (const uint8_t *): the payload (can be NULL if there isn't one)
+ * @param payload_len (uint8_t): its length
+ * @retval RET_OK once it's queued, RET_BUSY_ERR if there's no room (see UART_sendv())
+ */
+ret_t UART_sendReport(uint8_t report, ret_t retval, const uint8_t *payload_ptr,
+                      uint8_t payload_len)
+{
+    uint8_t header[] = {UART_REPORT_MAGIC_0, UART_REPORT_MAGIC_1, UART_REPORT_MAGIC_2,
+                        UART_REPORT_MAGIC_3, report, (uint8_t)retval, payload_len};
+    uart_iovec_t iov[] = {
+        {.data = header, .len = sizeof(header)},
+        {.data = payload_ptr, .len = payload_len},
+    };
+    return UART_sendv(iov, 2, true);
 }
 
-/*! Sends a single byte of data over UART (Blocking)
+/*! Sends a single byte of data over UART
  *
  * @param data (uint8_t): Byte to send
  * @retval Return code indicating success / failure of the start of the transmit
  *
- * @note this function will timeout after `UART_TIMEOUT_MS` miliseconds of the
- *      HAL UART driver being busy.
+ * @note Doesn't wait on the driver. If a transmit is in progress the byte is queued behind it.
  */
-ret_t UART_sendChar(uint8_t data)
-{
-    ret_t ready_result = UART_waitForReady_withTimeout();
-    if (ready_result != RET_OK) {
-        return ready_result;
-    }
-    return UART_sendData(&data, 1);
-}
+ret_t UART_sendChar(uint8_t data) { return UART_sendData(&data, 1); }
 
 /*! Send a string via UART
  *
  * @param string_ptr (char[]): Pointer to the string to be sent
  * @retval Return code indicating success / failure of the start of the transmit
  *
- * @Note This function expects a null terminated string.
+ * @Note This function expects a null terminated string. All or nothing, like UART_sendData().
  */
 ret_t UART_sendString(char string_ptr[])
 {
-    ret_t retval;
-    uint32_t string_len = strlen(string_ptr);
-
-    while (string_len != 0) {
-        // send the character
-        if (string_len > UART_TX_BUFFER_SIZE) {
-            retval = UART_sendData((uint8_t *)string_ptr, UART_TX_BUFFER_SIZE);
-            if (retval != RET_OK) {
-                return retval;
-            }
-            string_len -= UART_TX_BUFFER_SIZE;
-            string_ptr += UART_TX_BUFFER_SIZE;
-        } else {
-            retval = UART_sendData((uint8_t *)string_ptr, string_len);
-            if (retval != RET_OK) {
-                return retval;
-            }
-            string_len -= string_len;
-            string_ptr += string_len;
-        }
-    }
-    return RET_OK;
+    return UART_sendData((uint8_t *)string_ptr, strlen(string_ptr));
 }
 
-/*! Sends an integer via UART encoded in ascii hexadecimal
+/*! Sends an integer via UART encoded in ascii hexadecimal (fmt_hex(), e.g. "-0x1F")
  *
  * @param data (int64_t): Data to be sent. Must be cast to `int64_t`
  * @retval Return code indicating success / failure of the start of the transmit
+ *
+ * @Note Formatted on the stack and queued as one message, like UART_sendData().
  */
 ret_t UART_sendint(int64_t data)
 {
-    ret_t retval;
-    int8_t shift_val = 48;
-    uint8_t val = 0;
-    uint8_t chr = 0;
-    if (data < 0) {
-        UART_sendChar(0x2d); // "-"
-        data = -data;
-    }
-    UART_sendString("0x");
-
-    while (shift_val >= 0) {
-        // send the character
-        val = (data >> shift_val) & 0xff;
-        if (val != 0 || shift_val == 0) {
-            chr = (val & 0xF0) >> 4;
-            if (chr >= 0xA) {
-                chr += 0x37; // into A-F
-            } else {
-                chr += 0x30; // into 0-9
-            }
-            retval = UART_sendChar(chr);
-            if (retval != RET_OK) {
-                return retval;
-            }
-
-            chr = val & 0xF;
-            if (chr >= 0xA) {
-                chr += 0x37; // into A-F
-            } else {
-                chr += 0x30; // into 0-9
-            }
-            retval = UART_sendChar(chr);
-            if (retval != RET_OK) {
-                return retval;
-            }
+    char char_buff[FMT_HEX_MAX];
+    uint32_t num_chars = fmt_hex(data, char_buff, sizeof(char_buff));
+    return UART_sendData((uint8_t *)char_buff, num_chars);
+}
+
+/*! Sends a float value via UART encoded in ascii decimal (fmt_float(), e.g. "-0.25")
+ *
+ * @param data (float): The value to be printed. Has to be below 2^32 in magnitude.
+ * @param percision (uint8_t): number of fractional places to print, up to FMT_FLOAT_MAX_PRECISION
+ * @retval Return code indicating success / failure of the start of the transmit, RET_VAL_ERR if
+ *      the value / percision can't be formatted
+ *
+ * @Note Formatted on the stack and queued as one message, like UART_sendData().
+ */
+ret_t UART_sendfloat(float data, uint8_t percision)
+{
+    char char_buff[FMT_FLOAT_MAX];
+    uint32_t num_chars = fmt_float(data, percision, char_buff, sizeof(char_buff));
+    if (num_chars == 0) {
+        return RET_VAL_ERR;
+    }
+    return UART_sendData((uint8_t *)char_buff, num_chars);
+}
+
+/*! Works out the divider (BRR) for a baud rate, with 16x oversampling.
+ *
+ * @retval The divider, or 0 if the USART clock can't get within UART_BAUDRATE_MAX_ERROR_PERMILLE of
+ *      the baud rate (up to a 16th of the clock)
+ */
+static uint32_t priv_baudrateDivider(uint32_t baudrate)
+{
+    uint32_t clock = HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_USART1);
+    uint32_t divider;
+    uint32_t error;
+
+    if (baudrate == 0 || baudrate > clock / 16) {
+        return 0;
+    }
+    divider = UART_DIV_SAMPLING16(clock, baudrate);
+    if (divider > 0xFFFF) {
+        return 0;
+    }
+    error = clock / divider;
+    error = (error > baudrate) ? error - baudrate : baudrate - error;
+    if (error * 1000 > baudrate * UART_BAUDRATE_MAX_ERROR_PERMILLE) {
+        return 0;
+    }
+    return divider;
+}
+
+/*! Switches to next_baudrate, if there is one. TX has to be idle: runs from transmitMoreData()
+ *  when there's nothing left to send, or from main context while TX is idle.
+ */
+static void priv_applyBaudrate(void)
+{
+    // whichever of the two gets it first
+    uint32_t baudrate = __atomic_exchange_n(&UART_admin.next_baudrate, 0, __ATOMIC_ACQ_REL);
+
+    if (baudrate == 0) {
+        return;
+    }
+    // BRR can only be written with the USART disabled. RX DMA carries on from where it was.
+    __HAL_UART_DISABLE(&HAL_UART_handle);
+    HAL_UART_handle.Instance->BRR = priv_baudrateDivider(baudrate);
+    __HAL_UART_ENABLE(&HAL_UART_handle);
+    HAL_UART_handle.Init.BaudRate = baudrate;
+    UART_admin.baudrate = baudrate;
+}
+
+//! Goes back to the confirmed baud rate if the host never confirmed the new one at that rate
+static ret_t priv_baudrateRevert(int32_t *callback_time_ms)
+{
+    UART_admin.revert_scheduled = false;
+    *callback_time_ms = SCHEDULER_FINISHED;
+
+    if (UART_admin.baudrate != UART_admin.confirmed_baudrate ||
+        __atomic_load_n(&UART_admin.next_baudrate, __ATOMIC_ACQUIRE) != 0) {
+        __atomic_store_n(&UART_admin.next_baudrate, UART_admin.confirmed_baudrate,
+                         __ATOMIC_RELEASE);
+        // nothing's coming from the TX interrupt if it's idle
+        if (UART_TXisReady()) {
+            priv_applyBaudrate();
         }
-        shift_val -= 8;
     }
     return RET_OK;
 }
 
-/*! Sends an float value via UART encoded in ascii using `sprintf`
+/*! The baud rate report. Changing it is a handshake, so that a rate that doesn't work at either
+ *  end doesn't leave the link dead:
  *
- * @param data (float): The value to be printed
- * @param percision (uint8_t): number of fractional places to print
- * @retval Return code indicating success / failure of the start of the transmit
+ *  1. The host asks for the new rate. The reply goes back at the old rate, and we switch once
+ *     it's out (along with anything queued behind it).
+ *  2. The host switches too, and asks for the same rate again, at that rate. That's the
+ *     confirmation (asking for the rate in use always is).
+ *  3. If no confirmation comes in within UART_BAUDRATE_CONFIRM_MS, we go back to the last confirmed
+ *     rate. So should the host, if it doesn't get a reply to it.
  *
- * @Note This function does not use the %f specifier, but rather does "%ld.%ld"
- *      and calculates the whole and fractional part
+ * @param in_p (uint8_t *): nothing to get {baud rate in use, highest baud rate} (uint32_t each),
+ *      or the baud rate to switch to (uint32_t) to set it
+ * @param out_p (uint8_t *): the baud rate, when setting it
+ * @retval RET_OK, RET_LEN_ERR if the payload isn't either of those, RET_VAL_ERR if the clock can't
+ *      get close enough to the baud rate, or RET_NOMEM_ERR if the revert can't be scheduled
  */
-ret_t UART_sendfloat(float data, uint8_t percision)
+ret_t rpt_UART_baudrate(uint8_t *in_p, uint8_t in_len, uint8_t *out_p, uint8_t *out_len_ptr)
 {
-    // TODO: Is 40 bytes too much / little?
-    char char_buff[40];
-    int32_t significand;
-    int32_t fractional;
+    uint32_t baudrate = UART_admin.baudrate;
+    uint32_t clock;
+    ret_t ret;
+
+    if (in_len == 0) {
+        clock = HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_USART1) / 16;
+        memcpy(out_p, &baudrate, sizeof(baudrate));
+        memcpy(out_p + sizeof(baudrate), &clock, sizeof(clock));
+        *out_len_ptr = sizeof(baudrate) + sizeof(clock);
+        return RET_OK;
+    }
+    if (in_len != sizeof(baudrate)) {
+        return RET_LEN_ERR;
+    }
+    memcpy(&baudrate, in_p, sizeof(baudrate));
+    memcpy(out_p, &baudrate, sizeof(baudrate));
+    *out_len_ptr = sizeof(baudrate);
+
+    if (baudrate == UART_admin.baudrate) {
+        // confirmed: it came in at this rate. Drop any switch that's still waiting for TX.
+        __atomic_store_n(&UART_admin.next_baudrate, 0, __ATOMIC_RELEASE);
+        UART_admin.confirmed_baudrate = baudrate;
+        if (UART_admin.revert_scheduled) {
+            scheduler_remove(&gMainSchedule, UART_admin.revert_id);
+            UART_admin.revert_scheduled = false;
+        }
+        return RET_OK;
+    }
+    if (priv_baudrateDivider(baudrate) == 0) {
+        return RET_VAL_ERR;
+    }
 
-    significand = (int32_t)data;
-    fractional = (int32_t)((data - (int32_t)data) * (10.0f * (float)percision));
-    sprintf(char_buff, "%d.%d", significand, fractional);
+    // the timeout starts again from this request
+    if (UART_admin.revert_scheduled) {
+        scheduler_remove(&gMainSchedule, UART_admin.revert_id);
+    }
+    ret = scheduler_add(&gMainSchedule, UART_BAUDRATE_CONFIRM_MS, priv_baudrateRevert,
+                        &UART_admin.revert_id);
+    UART_admin.revert_scheduled = (ret == RET_OK);
+    if (ret != RET_OK) {
+        return RET_NOMEM_ERR;
+    }
+    // The reply is queued after this returns, so TX isn't going to be idle until it's out
+    __atomic_store_n(&UART_admin.next_baudrate, baudrate, __ATOMIC_RELEASE);
+    return RET_OK;
+}
 
-    UART_sendString(char_buff);
+/*! Sends the payload straight back, for loopback / throughput tests.
+ *
+ * @param in_p (uint8_t *): anything, up to REPORT_MAX_PAYLOAD bytes
+ * @param out_p (uint8_t *): the same
+ * @retval RET_OK
+ */
+ret_t rpt_UART_echo(uint8_t *in_p, uint8_t in_len, uint8_t *out_p, uint8_t *out_len_ptr)
+{
+    memcpy(out_p, in_p, in_len);
+    *out_len_ptr = in_len;
     return RET_OK;
 }
 
+/*! Runs `handler` in main context whenever bytes come in: once per burst (idle line), or every
+ *  half ring during a long one. Its `num_posts` is how many of those there were, not bytes.
+ *
+ * @param handler (event_handler_t): what to run
+ * @retval RET_NOMEM_ERR if there are no events left, RET_VAL_ERR if there's already a handler
+ */
+ret_t UART_setRxHandler(event_handler_t handler)
+{
+    ret_t ret;
+    if (UART_admin.rx_event_registered) {
+        return RET_VAL_ERR;
+    }
+    ret = events_register(&gMainEvents, handler, &UART_admin.rx_event);
+    if (ret != RET_OK) {
+        return ret;
+    }
+    __atomic_store_n(&UART_admin.rx_event_registered, true, __ATOMIC_RELEASE);
+    return RET_OK;
+}
+
+/*! Bytes waiting in the RX ring. If DMA has lapped the reader, skips to the oldest byte that's
+ *  still there and counts the rest as lost.
+ */
+static uint32_t priv_rxAvailable(void)
+{
+    uint32_t available = __atomic_load_n(&UART_admin.rx_head, __ATOMIC_ACQUIRE) - UART_admin.rx_tail;
+    if (available > UART_RX_RING_SIZE) {
+        UART_admin.rx_lost += available - UART_RX_RING_SIZE;
+        UART_admin.rx_tail += available - UART_RX_RING_SIZE;
+        available = UART_RX_RING_SIZE;
+    }
+    return available;
+}
+
+/*! Copies out as many received bytes as there are (up to max_bytes), oldest first.
+ *
+ * @param data_ptr (uint8_t *): where to put them
+ * @param max_bytes (uint32_t): room at data_ptr
+ * @retval Number of bytes copied
+ */
+uint32_t UART_read(uint8_t *data_ptr, uint32_t max_bytes)
+{
+    uint32_t num_bytes = priv_rxAvailable();
+    uint32_t start = UART_admin.rx_tail & (UART_RX_RING_SIZE - 1);
+    uint32_t first = UART_RX_RING_SIZE - start;
+
+    if (num_bytes > max_bytes) {
+        num_bytes = max_bytes;
+    }
+    if (first > num_bytes) {
+        first = num_bytes;
+    }
+    memcpy(data_ptr, &UART_admin.rx_ring[start], first);
+    memcpy(data_ptr + first, UART_admin.rx_ring, num_bytes - first);
+    UART_admin.rx_tail += num_bytes;
+    return num_bytes;
+}
+
 /*! Gets a byte from the recieved data buffer.
  *
  * @param data_ptr (uint8_t *): Place to store the retreived byte
@@ -295,11 +510,7 @@ ret_t UART_sendfloat(float data, uint8_t percision)
  */
 ret_t UART_getChar(uint8_t *data_ptr)
 {
-    // check if we have any data to give
-    if (UART_dataAvailable()) {
-        // copy the data into the given pointer!
-        *data_ptr = UART_admin.rx_buffer[UART_admin.rx_buffer_admin.tail_ind];
-        queue_increment_tail(&UART_admin.rx_buffer_admin, UART_RX_BUFFER_SIZE);
+    if (UART_read(data_ptr, 1) == 1) {
         return RET_OK;
     } else {
         return RET_NODATA_ERR;
@@ -314,10 +525,9 @@ ret_t UART_getChar(uint8_t *data_ptr)
 ret_t UART_peakChar(uint8_t *data_ptr)
 {
     // check if we have any data to give
-    if (UART_dataAvailable()) {
-        // copy the data into the given pointer!
-        *data_ptr = UART_admin.rx_buffer[UART_admin.rx_buffer_admin.tail_ind];
+    if (priv_rxAvailable() != 0) {
         // don't mess with the tail index
+        *data_ptr = UART_admin.rx_ring[UART_admin.rx_tail & (UART_RX_RING_SIZE - 1)];
         return RET_OK;
     } else {
         return RET_NODATA_ERR;
@@ -328,92 +538,114 @@ ret_t UART_peakChar(uint8_t *data_ptr)
  *
  * @retval Boolean as to whether or not there is unread data in the buffer.
  */
-bool UART_dataAvailable(void)
-{
-    if (UART_admin.rx_buffer_admin.unread_items != 0) {
-        return true;
-    } else {
-        return false;
-    }
-}
+bool UART_dataAvailable(void) { return priv_rxAvailable() != 0; }
 
-/*! Returns how many bytes have been overwritten in the RX buffer.
+/*! Returns how many received bytes were overwritten before they were read.
  *
- * @uint8_t Number of dropped/overwritten bytes
+ * @uint32_t Number of dropped/overwritten bytes
  */
-uint8_t UART_droppedPackets(void) { return UART_admin.rx_buffer_admin.overwrite_count; }
+uint32_t UART_droppedPackets(void) { return UART_admin.rx_lost; }
 
-ret_t transmitMoreData(int32_t *next_callback_ms)
+//! Number of bursts that had a byte with a framing / noise / parity error
+uint32_t UART_rxErrors(void) { return UART_admin.rx_errors; }
+
+/*! Starts DMA on the next contiguous span of the TX ring: from the tail to the head, or to the
+ *  end of the ring if it wraps. Goes idle (tx_dma_len = 0) if there's nothing left.
+ *
+ * Runs from UART_sendv() when TX is idle, or from the TX complete ISR to chain the next span.
+ * Never both at once: main context only starts it while it's idle, when no interrupt is coming.
+ */
+static void transmitMoreData(void)
 {
-    uint32_t num_bytes;
+    uint32_t tail = UART_admin.tx_tail;
+    uint32_t start = tail & (UART_TX_RING_SIZE - 1);
+    uint32_t num_bytes = __atomic_load_n(&UART_admin.tx_head, __ATOMIC_ACQUIRE) - tail;
     HAL_StatusTypeDef hal_retval;
 
-    if (UART_TXisReady()) {
-        // This doesn't run continually
-        *next_callback_ms = SCHEDULER_FINISHED;
+    if (num_bytes > UART_TX_RING_SIZE - start) {
+        num_bytes = UART_TX_RING_SIZE - start;
+    }
+    __atomic_store_n(&UART_admin.tx_dma_len, num_bytes, __ATOMIC_RELEASE);
+    if (num_bytes == 0) {
+        // the line's idle, a good time to change the baud rate
+        priv_applyBaudrate();
+        return;
+    }
 
-        if (UART_admin.tx_buffer_admin.unread_items <= UART_TX_BUFFER_SIZE) {
-            num_bytes = UART_admin.tx_buffer_admin.unread_items;
-        } else {
-            num_bytes = UART_TX_BUFFER_SIZE;
-        }
+    gCriticalErrors.UART_dequeuedBytes += num_bytes;
+    hal_retval = HAL_UART_Transmit_DMA(&HAL_UART_handle, &UART_admin.tx_ring[start], num_bytes);
+    if (hal_retval != HAL_OK) {
+        fatal_error_handler(__FILE__, __LINE__, hal_retval);
+    }
+}
 
-        if (num_bytes == 0) {
-            *next_callback_ms = SCHEDULER_FINISHED;
-            return RET_OK;
-        }
+/*! Moves rx_head up to where DMA has got to, and lets main context know if there's anything new.
+ *
+ * Runs from the RX DMA and USART interrupts, which have the same preempt priority, so it never
+ * interrupts itself. Those come at least every half ring, so DMA can't have gone all the way
+ * around since the last time.
+ */
+static void priv_rxUpdate(void)
+{
+    uint32_t dma_pos = UART_RX_RING_SIZE - __HAL_DMA_GET_COUNTER(HAL_UART_handle.hdmarx);
+    uint32_t num_bytes = (dma_pos - UART_admin.rx_dma_pos) & (UART_RX_RING_SIZE - 1);
 
-        UART_admin.tx_being_modified = true;
-        gCriticalErrors.UART_dequeuedBytes += num_bytes;
-        newqueue_pop(&UART_admin.tx_buffer_admin, UART_admin.tx_buffer, num_bytes, eNoPeak);
-        hal_retval = HAL_UART_Transmit_IT(&HAL_UART_handle, UART_admin.tx_buffer, num_bytes);
-        UART_admin.tx_being_modified = false;
-        if (hal_retval != HAL_OK) {
-            fatal_error_handler(__FILE__, __LINE__, hal_retval);
-        }
-    } else {
-        // We need to try again
-        *next_callback_ms = 1;
+    if (num_bytes == 0) {
+        return;
+    }
+    UART_admin.rx_dma_pos = dma_pos & (UART_RX_RING_SIZE - 1);
+    __atomic_store_n(&UART_admin.rx_head, UART_admin.rx_head + num_bytes, __ATOMIC_RELEASE);
+    if (__atomic_load_n(&UART_admin.rx_event_registered, __ATOMIC_ACQUIRE)) {
+        events_post(&gMainEvents, UART_admin.rx_event);
     }
+}
 
-    // TODO: switch from fatal error handler to returning error?
-    return RET_OK;
+/*! USART interrupt, before the HAL gets it: the end of a burst (idle line), and any receive
+ *  errors that happened during it.
+ */
+void UART_IRQHandler(void)
+{
+    uint32_t isr = HAL_UART_handle.Instance->ISR;
+
+    if (isr & UART_RX_ERROR_FLAGS) {
+        UART_admin.rx_errors += 1;
+        __HAL_UART_CLEAR_IT(&HAL_UART_handle,
+                            UART_CLEAR_PEF | UART_CLEAR_FEF | UART_CLEAR_NEF | UART_CLEAR_OREF);
+    }
+    if ((isr & USART_ISR_IDLE) && __HAL_UART_GET_IT_SOURCE(&HAL_UART_handle, UART_IT_IDLE)) {
+        __HAL_UART_CLEAR_IDLEFLAG(&HAL_UART_handle);
+        priv_rxUpdate();
+    }
+    HAL_UART_IRQHandler(&HAL_UART_handle);
 }
 
-/*! Rx Transfer completed callback. Push onto the rx buffer!
+/*! Rx half transfer callback: DMA is halfway round the ring.
  *
  * @param  HAL_UART_handle_ptr: UART handle
  */
-void HAL_UART_RxCpltCallback(UART_HandleTypeDef *HAL_UART_handle_ptr)
+void HAL_UART_RxHalfCpltCallback(UART_HandleTypeDef *UNUSED_PARAM(HAL_UART_handle_ptr))
 {
+    priv_rxUpdate();
+}
 
-    // New data was put onto the buffer by the ISR!
-    // move the head of the buffer forward
-    queue_increment_head(&UART_admin.rx_buffer_admin, UART_RX_BUFFER_SIZE);
-
-    // start recieving data again @ the head index
-    HAL_UART_Receive_IT(HAL_UART_handle_ptr,
-                        &UART_admin.rx_buffer[UART_admin.rx_buffer_admin.head_ind], 1);
+/*! Rx transfer completed callback: DMA got to the end of the ring, and carries on from the start.
+ *
+ * @param  HAL_UART_handle_ptr: UART handle
+ */
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *UNUSED_PARAM(HAL_UART_handle_ptr))
+{
+    priv_rxUpdate();
 }
 
-/*! Tx Transfer completed callback. Pop from the tx buffer if available!
+/*! Tx Transfer completed callback. The span is out, free it up and chain the next one.
  *
  * @param  HAL_UART_handle_ptr: UART handle
  */
 void HAL_UART_TxCpltCallback(UART_HandleTypeDef *UNUSED_PARAM(HAL_UART_handle_ptr))
 {
-    if (UART_admin.tx_buffer_admin.unread_items != 0) {
-        if (UART_admin.tx_being_modified) {
-            // Main context is modifying TX-y things. Queue up main context!
-            uint8_t sch_id;
-            // As soon as possible in the main context, service UART!
-            scheduler_add(&gMainSchedule, 0, transmitMoreData, &sch_id);
-        } else {
-            // Main context is doing other things. Queue up the next transmission now!
-            int32_t i;
-            transmitMoreData(&i);
-        }
-    }
+    __atomic_store_n(&UART_admin.tx_tail, UART_admin.tx_tail + UART_admin.tx_dma_len,
+                     __ATOMIC_RELEASE);
+    transmitMoreData();
 }
 
 /*! UART error callback. Call `fatal_error_handler` and go into infinite loop
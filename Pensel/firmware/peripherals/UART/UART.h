@@ -8,24 +8,59 @@
 #pragma once
 
 #include "common.h"
+#include "modules/utilities/events.h"
 #include <stdbool.h>
 #include <stdint.h>
 
-//! Timeout time for UART
-#define UART_TIMEOUT_MS (50)      // can send 1150/2 chars in 50 miliseconds
-#define UART_RX_BUFFER_SIZE (32)  //!< The max size of the recieve buffer
-#define UART_TX_BUFFER_SIZE (128) //!< The max size of the transmit buffer
+#ifndef UART_RX_RING_SIZE
+#define UART_RX_RING_SIZE (256) //!< Bytes received before the oldest get overwritten (power of 2)
+#endif
+
+#ifndef UART_TX_RING_SIZE
+#define UART_TX_RING_SIZE (1024) //!< Bytes that can be queued to transmit (power of 2)
+#endif
+
+#ifndef UART_BAUDRATE_CONFIRM_MS
+#define UART_BAUDRATE_CONFIRM_MS (1000) //!< How long a new baud rate has to be confirmed in
+#endif
+
+#ifndef UART_BAUDRATE_MAX_ERROR_PERMILLE
+#define UART_BAUDRATE_MAX_ERROR_PERMILLE (20) //!< Furthest the divider can be off, in 1/1000ths
+#endif
+
+//! Start of every report frame, both ways (0xDEADBEEF)
+#define UART_REPORT_MAGIC_0 (0xDE)
+#define UART_REPORT_MAGIC_1 (0xAD)
+#define UART_REPORT_MAGIC_2 (0xBE)
+#define UART_REPORT_MAGIC_3 (0xEF)
+
+//! One fragment of a message for UART_sendv()
+typedef struct {
+    const uint8_t *data; //!< Where it is (only read while it's being queued)
+    uint32_t len;        //!< How many bytes
+} uart_iovec_t;
 
 ret_t UART_init(uint32_t baudrate);
+uint32_t UART_getBaudrate(void);
 bool UART_dataAvailable(void);
 bool UART_TXisReady(void);
-uint8_t UART_droppedPackets(void);
+uint32_t UART_droppedPackets(void);
+uint32_t UART_rxErrors(void);
+ret_t UART_setRxHandler(event_handler_t handler);
+void UART_IRQHandler(void);
 
 ret_t UART_sendData(uint8_t *data_ptr, uint32_t num_bytes);
+ret_t UART_sendv(const uart_iovec_t iov[], uint32_t num_iov, bool append_checksum);
+ret_t UART_sendReport(uint8_t report, ret_t retval, const uint8_t *payload_ptr,
+                      uint8_t payload_len);
 ret_t UART_sendString(char string_ptr[]);
 ret_t UART_sendint(int64_t data);
 ret_t UART_sendfloat(float data, uint8_t percision);
 
+ret_t rpt_UART_baudrate(uint8_t *in_p, uint8_t in_len, uint8_t *out_p, uint8_t *out_len_ptr);
+ret_t rpt_UART_echo(uint8_t *in_p, uint8_t in_len, uint8_t *out_p, uint8_t *out_len_ptr);
+
+uint32_t UART_read(uint8_t *data_ptr, uint32_t max_bytes);
 ret_t UART_getChar(uint8_t *data_ptr);
 ret_t UART_sendChar(uint8_t data);
 ret_t UART_peakChar(uint8_t *data_ptr);
@@ -35,11 +35,11 @@
 
 void EP1_IN_Callback(void)
 {
-    LOG_MSG(kLogLevelDebug, "EP1 IN");
+    LOG_MSG_LIMITED(kLogLevelDebug, "EP1 IN");
     cdc_inTransfer_completeCB();
 }
 
-void EP2_IN_Callback(void) { LOG_MSG(kLogLevelDebug, "EP2 IN"); }
+void EP2_IN_Callback(void) { LOG_MSG_LIMITED(kLogLevelDebug, "EP2 IN"); }
 
 /*******************************************************************************
  * Function Name  : EP3_OUT_Callback
@@ -50,7 +50,7 @@ void EP2_IN_Callback(void) { LOG_MSG(kLogLevelDebug, "EP2 IN"); }
  *******************************************************************************/
 void EP3_OUT_Callback(void)
 {
-    LOG_MSG(kLogLevelDebug, "EP3 OUT");
+    LOG_MSG_LIMITED(kLogLevelDebug, "EP3 OUT");
     uint32_t receive_length = GetEPRxCount(ENDP3);
     cdc_outTransfer_receive(ENDP3_RXADDR, receive_length);
 }
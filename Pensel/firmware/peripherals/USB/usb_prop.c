@@ -209,7 +209,7 @@ void penselUSB_statusIn(void)
         LOG_MSG(kLogLevelDebug, "Status IN - SET_LINE_CODING");
         Request = 0;
     } else if (Request == GET_REPORT) {
-        LOG_MSG(kLogLevelDebug, "Status IN - GET_REPORT");
+        LOG_MSG_LIMITED(kLogLevelDebug, "Status IN - GET_REPORT");
         Request = 0;
     } else if (Request == SET_REPORT) {
         LOG_MSG(kLogLevelDebug, "Status IN - SET_REPORT");
@@ -222,22 +222,19 @@ void penselUSB_statusIn(void)
         LOG_MSG_FMT(kLogLevelInfo, "Set Report: 0x%02X (len: %i) - Retval: %i", report_id,
                     payload_len, ret);
 
+#ifndef LOG_BINARY // a binary record can't carry a string built at runtime
+        if (LOG_ENABLED(kLogLevelDebug)) {
 #define TMP_ARR_MSG_LEN (256)
-        char TmpArrMsg[TMP_ARR_MSG_LEN];
-        int num_bytes = 0;
-        int num_chars = sprintf(TmpArrMsg, "Payload: ");
-        while (1) {
-            num_chars += sprintf(TmpArrMsg + num_chars, "%02X ", report_buffer[num_bytes]);
-            if (num_chars >= TMP_ARR_MSG_LEN) {
-                TmpArrMsg[TMP_ARR_MSG_LEN - 1] = 0;
-                break;
-            }
-            num_bytes += 1;
-            if (num_bytes >= payload_len) {
-                break;
+            char TmpArrMsg[TMP_ARR_MSG_LEN];
+            int num_chars = sprintf(TmpArrMsg, "Payload: ");
+            // 3 chars a byte, stop while there's still room for the terminator
+            for (int num_bytes = 0;
+                 num_bytes < payload_len && num_chars + 3 < TMP_ARR_MSG_LEN; num_bytes++) {
+                num_chars += sprintf(TmpArrMsg + num_chars, "%02X ", report_buffer[num_bytes]);
             }
+            LOG_MSG(kLogLevelDebug, TmpArrMsg);
         }
-        LOG_MSG(kLogLevelDebug, TmpArrMsg);
+#endif
     }
 }
 
@@ -251,7 +248,7 @@ void penselUSB_statusIn(void)
 void penselUSB_statusOut(void)
 {
     // TODO: what does this do?
-    LOG_MSG(kLogLevelDebug, "Status OUT");
+    LOG_MSG_LIMITED(kLogLevelDebug, "Status OUT");
 }
 
 uint8_t *penselHID_setReport(uint16_t Length)
@@ -10,12 +10,14 @@
 #include "hardware.h"
 #include "common.h"
 #include "modules/LSM9DS1/LSM9DS1.h"
+#include "modules/utilities/timebase.h"
 #include "peripherals/stm32f3-configuration/stm32f3xx.h"
 #include "peripherals/stm32f3/stm32f3xx_hal.h"
 #include "peripherals/stm32f3/stm32f3xx_hal_def.h"
 #include "peripherals/stm32f3/stm32f3xx_hal_flash.h"
 #include "peripherals/stm32f3/stm32f3xx_hal_gpio.h"
 #include "peripherals/stm32f3/stm32f3xx_hal_iwdg.h"
+#include "peripherals/stm32f3/stm32f3xx_hal_pwr.h"
 #include "peripherals/stm32f3/stm32f3xx_hal_rcc.h"
 #include "peripherals/stm32f3/stm32f3xx_ll_bus.h"
 #include <stdbool.h>
@@ -26,6 +28,9 @@
 
 static GPIO_InitTypeDef GPIO_InitStruct;
 
+//! HAL millisecond tick, topped up by hw_sleep() for the ticks SysTick sleeps through
+extern __IO uint32_t uwTick;
+
 #ifdef WATCHDOG_ENABLE
 
 #define WDG_COUNT (161u)
@@ -109,7 +114,8 @@ void SystemClock_Config(void)
 
     PeriphClkInit.PeriphClockSelection =
         RCC_PERIPHCLK_USB | RCC_PERIPHCLK_USART1 | RCC_PERIPHCLK_I2C1;
-    PeriphClkInit.Usart1ClockSelection = RCC_USART1CLKSOURCE_PCLK1;
+    // SYSCLK rather than PCLK1 (32 MHz): 16x oversampling goes up to 4 Mbaud (rpt_UART_baudrate())
+    PeriphClkInit.Usart1ClockSelection = RCC_USART1CLKSOURCE_SYSCLK;
     PeriphClkInit.I2c1ClockSelection = RCC_I2C1CLKSOURCE_HSI;
     PeriphClkInit.USBClockSelection = RCC_USBCLKSOURCE_PLL_DIV1_5;
     retval = HAL_RCCEx_PeriphCLKConfig(&PeriphClkInit);
@@ -412,3 +418,110 @@ void TimingPin_set(uint8_t value) { HAL_GPIO_WritePin(LED_PORT, EXTRA_GPIO, valu
 // GPIO_PinState     HAL_GPIO_ReadPin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin);
 // void              HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState
 // PinState); void              HAL_GPIO_TogglePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin);
+
+/* --- Timebase and tickless idle. TIM2 runs free at 1 MHz, and is both time_us() and the wakeup
+ * timer: a compare match on channel 1 ends a sleep. */
+
+/*! Starts TIM2 as a free running 1 MHz, 32 bit counter. time_us() reads 0 until this is called.
+ */
+void hw_timebase_init(void)
+{
+    uint32_t timer_clk = HAL_RCC_GetPCLK1Freq();
+
+    // Timers on a prescaled APB1 run at twice the bus clock
+    if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1) {
+        timer_clk *= 2;
+    }
+
+    __HAL_RCC_TIM2_CLK_ENABLE();
+    TIM2->CR1 = 0;
+    TIM2->PSC = (timer_clk / 1000000) - 1;
+    TIM2->ARR = 0xFFFFFFFF;
+    TIM2->DIER = 0;
+    TIM2->EGR = TIM_EGR_UG; // load the prescaler now
+    TIM2->SR = 0;
+    TIM2->CR1 = TIM_CR1_CEN;
+
+    HAL_NVIC_SetPriority(TIM2_IRQn, TIM2_INT_PREEMPT_PRI, TIM2_INT_SUB_PRI);
+    HAL_NVIC_EnableIRQ(TIM2_IRQn);
+}
+
+uint32_t time_us(void) { return TIM2->CNT; }
+
+void hw_irqDisable(void) { __disable_irq(); }
+
+void hw_irqEnable(void) { __enable_irq(); }
+
+//! Disables interrupts, returning whether they already were, for hw_irqRestore()
+uint32_t hw_irqSave(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    return primask;
+}
+
+void hw_irqRestore(uint32_t primask) { __set_PRIMASK(primask); }
+
+//! True when running from an exception or interrupt handler, not thread mode
+bool hw_inInterrupt(void) { return (SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk) != 0; }
+
+/*! Sleeps (WFI) with SysTick off until an interrupt is pending or `max_sleep_us` has passed.
+ *  Must be called with interrupts disabled. Whatever woke us up runs once they're re-enabled.
+ *
+ * @param max_sleep_us (uint32_t): longest to sleep for. Must be under ~35 minutes.
+ * @return how long we slept, in us
+ */
+uint32_t hw_sleep(uint32_t max_sleep_us)
+{
+    uint32_t start_us, slept_us, tick_phase_us;
+    uint32_t tick_load = SysTick->LOAD + 1;
+
+    // How far we are into the current ms, to work out how many ticks we sleep through
+    tick_phase_us = ((tick_load - SysTick->VAL) * 1000) / tick_load;
+    HAL_SuspendTick();
+
+    start_us = TIM2->CNT;
+    TIM2->CCR1 = start_us + max_sleep_us;
+    TIM2->SR = ~TIM_SR_CC1IF;
+    TIM2->DIER |= TIM_DIER_CC1IE;
+
+    // Don't sleep if the compare is already behind us, it wouldn't fire for another 71 minutes
+    if ((int32_t)(TIM2->CCR1 - TIM2->CNT) > 0) {
+        __WFI();
+    }
+
+    TIM2->DIER &= ~TIM_DIER_CC1IE;
+    slept_us = TIM2->CNT - start_us;
+
+    // Count the ticks SysTick missed. Its counter kept running, so the phase is unchanged.
+    uwTick += (tick_phase_us + slept_us) / 1000;
+    HAL_ResumeTick();
+    return slept_us;
+}
+
+/*! Wakes us up from hw_sleep(). There's nothing else to do, hw_sleep() does the bookkeeping.
+ */
+void TIM2_IRQHandler(void) { TIM2->SR = ~TIM_SR_CC1IF; }
+
+/* --- Profiling */
+
+/*! Starts the DWT cycle counter. It only counts while the core is clocked, so not while asleep.
+ */
+void hw_cycleCounter_init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+uint32_t hw_getCycles(void) { return DWT->CYCCNT; }
+
+/*! Why we last reset (RCC->CSR). Read it before wdg_isSet(), which clears the flags.
+ */
+uint32_t hw_getResetFlags(void) { return RCC->CSR; }
+
+//! Whether `reset_flags` (hw_getResetFlags()) say one of the watchdogs reset us
+bool hw_resetByWatchdog(uint32_t reset_flags)
+{
+    return (reset_flags & (RCC_CSR_IWDGRSTF | RCC_CSR_WWDGRSTF)) != 0;
+}
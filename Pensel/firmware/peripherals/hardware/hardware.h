@@ -69,6 +69,11 @@
 #define I2C_EV_INT_SUB_PRI (1)
 #define USART_INT_PREMPT_PRI (2)
 #define USART_INT_SUB_PRI (2)
+#define USART_DMA_TX_INT_PREMPT_PRI (2)
+#define USART_DMA_TX_INT_SUB_PRI (3)
+// RX DMA has to share the USART's preempt priority, they both update the RX ring
+#define USART_DMA_RX_INT_PREMPT_PRI (USART_INT_PREMPT_PRI)
+#define USART_DMA_RX_INT_SUB_PRI (1)
 
 // 3 - External pin interrupts
 #define EXTI0_INT_PREEMPT_PRI (3)
@@ -80,6 +85,10 @@
 #define EXTI3_INT_PREEMPT_PRI (3)
 #define EXTI3_INT_SUB_PRI (4)
 
+// 4 - Idle wakeup timer. It only wakes the CPU, everything else can go first
+#define TIM2_INT_PREEMPT_PRI (4)
+#define TIM2_INT_SUB_PRI (0)
+
 // Public function definitions
 void SystemClock_Config(void);
 void configure_pins(void);
@@ -101,3 +110,20 @@ void LED_set(uint16_t LED, uint8_t value);
 
 void TimingPin_toggle(void);
 void TimingPin_set(uint8_t value);
+
+// Timebase (time_us() in modules/utilities/timebase.h) and tickless idle support
+void hw_timebase_init(void);
+void hw_irqDisable(void);
+void hw_irqEnable(void);
+uint32_t hw_irqSave(void);
+void hw_irqRestore(uint32_t primask);
+bool hw_inInterrupt(void);
+uint32_t hw_sleep(uint32_t max_sleep_us);
+
+// Profiling support
+void hw_cycleCounter_init(void);
+uint32_t hw_getCycles(void);
+
+// Post-mortem support
+uint32_t hw_getResetFlags(void);
+bool hw_resetByWatchdog(uint32_t reset_flags);
@@ -96,6 +96,13 @@
 #define USARTx_IRQn USART1_IRQn
 // #define USARTx_IRQHandler                USART1_IRQHandler
 
+/* Definition for USARTx's DMA (TX is DMA1 channel 4, RX channel 5 on the F302) */
+#define USARTx_DMA_CLK_ENABLE() __HAL_RCC_DMA1_CLK_ENABLE()
+#define USARTx_TX_DMA_CHANNEL DMA1_Channel4
+#define USARTx_RX_DMA_CHANNEL DMA1_Channel5
+#define USARTx_DMA_TX_IRQn DMA1_Channel4_IRQn
+#define USARTx_DMA_RX_IRQn DMA1_Channel5_IRQn
+
 // ADC crap! :D
 /* Definition for ADCx clock resources */
 #define ADCx_CLK_ENABLE() __HAL_RCC_ADC1_CLK_ENABLE()
@@ -197,12 +204,15 @@ void HAL_I2C_MspDeInit(I2C_HandleTypeDef *hi2c)
  *        This function configures the hardware resources used in this example:
  *           - Peripheral's clock enable
  *           - Peripheral's GPIO Configuration
- *           - NVIC configuration for UART interrupt request enable
+ *           - DMA configuration for transmission
+ *           - NVIC configuration for UART and DMA interrupt request enable
  * @param huart: UART handle pointer
  * @retval None
  */
 void HAL_UART_MspInit(UART_HandleTypeDef *huart)
 {
+    static DMA_HandleTypeDef hdma_tx;
+    static DMA_HandleTypeDef hdma_rx;
     GPIO_InitTypeDef GPIO_InitStruct;
     if (huart->Instance == USART1) {
         /*##-1- Enable peripherals and GPIO Clocks #################################*/
@@ -212,6 +222,8 @@ void HAL_UART_MspInit(UART_HandleTypeDef *huart)
 
         /* Enable USARTx clock */
         USARTx_CLK_ENABLE();
+        /* Enable DMA clock */
+        USARTx_DMA_CLK_ENABLE();
 
         /*##-2- Configure peripheral GPIO ##########################################*/
         /* UART TX GPIO pin configuration  */
@@ -229,12 +241,47 @@ void HAL_UART_MspInit(UART_HandleTypeDef *huart)
 
         HAL_GPIO_Init(USARTx_RX_GPIO_PORT, &GPIO_InitStruct);
 
-        /*##-3- Configure the NVIC for UART ########################################*/
+        /*##-3- Configure the DMA ##################################################*/
+        /* TX: one span of the TX ring per transfer */
+        hdma_tx.Instance = USARTx_TX_DMA_CHANNEL;
+        hdma_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+        hdma_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+        hdma_tx.Init.MemInc = DMA_MINC_ENABLE;
+        hdma_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+        hdma_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+        hdma_tx.Init.Mode = DMA_NORMAL;
+        hdma_tx.Init.Priority = DMA_PRIORITY_LOW;
+
+        HAL_DMA_Init(&hdma_tx);
+        __HAL_LINKDMA(huart, hdmatx, hdma_tx);
+
+        /* RX: round and round the RX ring, never stops */
+        hdma_rx.Instance = USARTx_RX_DMA_CHANNEL;
+        hdma_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+        hdma_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+        hdma_rx.Init.MemInc = DMA_MINC_ENABLE;
+        hdma_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+        hdma_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+        hdma_rx.Init.Mode = DMA_CIRCULAR;
+        hdma_rx.Init.Priority = DMA_PRIORITY_HIGH;
+
+        HAL_DMA_Init(&hdma_rx);
+        __HAL_LINKDMA(huart, hdmarx, hdma_rx);
+
+        /*##-4- Configure the NVIC for UART ########################################*/
         /* NVIC for USART */
         HAL_NVIC_SetPriority(
             USARTx_IRQn, USART_INT_PREMPT_PRI,
             USART_INT_SUB_PRI); // 2nd Highest Preempt Priority, 3rd highest Sub Priority
         HAL_NVIC_EnableIRQ(USARTx_IRQn);
+        /* NVIC for the TX DMA, just under the USART itself */
+        HAL_NVIC_SetPriority(USARTx_DMA_TX_IRQn, USART_DMA_TX_INT_PREMPT_PRI,
+                             USART_DMA_TX_INT_SUB_PRI);
+        HAL_NVIC_EnableIRQ(USARTx_DMA_TX_IRQn);
+        /* NVIC for the RX DMA, same preempt priority as the USART */
+        HAL_NVIC_SetPriority(USARTx_DMA_RX_IRQn, USART_DMA_RX_INT_PREMPT_PRI,
+                             USART_DMA_RX_INT_SUB_PRI);
+        HAL_NVIC_EnableIRQ(USARTx_DMA_RX_IRQn);
     } else {
         fatal_error_handler(__FILE__, __LINE__, -1);
     }
@@ -244,7 +291,7 @@ void HAL_UART_MspInit(UART_HandleTypeDef *huart)
  * @brief UART MSP De-Initialization
  *        This function frees the hardware resources used in this example:
  *          - Disable the Peripheral's clock
- *          - Revert GPIO and NVIC configuration to their default state
+ *          - Revert GPIO, DMA and NVIC configuration to their default state
  * @param huart: UART handle pointer
  * @retval None
  */
@@ -261,8 +308,18 @@ void HAL_UART_MspDeInit(UART_HandleTypeDef *huart)
         /* Configure UART Rx as alternate function  */
         HAL_GPIO_DeInit(USARTx_RX_GPIO_PORT, USARTx_RX_PIN);
 
-        /*##-3- Disable the NVIC for UART ##########################################*/
+        /*##-3- Disable the DMA ####################################################*/
+        if (huart->hdmatx != NULL) {
+            HAL_DMA_DeInit(huart->hdmatx);
+        }
+        if (huart->hdmarx != NULL) {
+            HAL_DMA_DeInit(huart->hdmarx);
+        }
+
+        /*##-4- Disable the NVIC for UART ##########################################*/
         HAL_NVIC_DisableIRQ(USARTx_IRQn);
+        HAL_NVIC_DisableIRQ(USARTx_DMA_TX_IRQn);
+        HAL_NVIC_DisableIRQ(USARTx_DMA_RX_IRQn);
     } else {
         fatal_error_handler(__FILE__, __LINE__, -1);
     }
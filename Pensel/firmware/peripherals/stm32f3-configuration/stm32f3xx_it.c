@@ -40,11 +40,13 @@
 #include "stm32f3xx_it.h"
 #include "stm32f3xx.h"
 
+#include "modules/utilities/flightrec.h"
 #include "peripherals/hardware/hardware.h"
 #include "peripherals/stm32f3/stm32f3xx_hal.h"
 #include "peripherals/stm32f3/stm32f3xx_hal_def.h"
 
 // Peripherals used
+#include "peripherals/UART/UART.h"
 #include "peripherals/USB/usb_istr.h"
 #include "peripherals/stm32f3/stm32f3xx_hal_i2c.h"
 #include "peripherals/stm32f3/stm32f3xx_hal_uart.h"
@@ -57,54 +59,70 @@ extern UART_HandleTypeDef HAL_UART_handle;
  *            Cortex-M4 Processor Exceptions Handlers                         *
  ******************************************************************************/
 
-/**
- * @brief  This function handles NMI exception.
+/*! Saves the fault status registers and the stacked PC / LR / xPSR in the flight recorder, then
+ *  waits for the watchdog (or the debugger).
+ *
+ * @param stack_frame (uint32_t []): what the exception stacked: r0-r3, r12, lr, pc, xpsr
+ * @param exception (uint32_t): exception number (IPSR)
  */
-void NMI_Handler(void)
+void __attribute__((used)) fault_record(uint32_t stack_frame[], uint32_t exception)
 {
+    flightrec_fault_t fault = {
+        .cfsr = SCB->CFSR,
+        .hfsr = SCB->HFSR,
+        .mmfar = SCB->MMFAR,
+        .bfar = SCB->BFAR,
+        .pc = stack_frame[6],
+        .lr = stack_frame[5],
+        .psr = stack_frame[7],
+    };
+    flightrec_crash(kFlightrecFault, (uint16_t)exception, fault.pc, &fault);
     while (1)
         ;
 }
 
+/*! Fault handler entry: finds the stack the exception frame went on (bit 2 of EXC_RETURN) and
+ *  hands it to fault_record(). Naked, so the frame is exactly where the exception left it.
+ */
+#define FAULT_HANDLER(__NAME__)                 \
+    void __attribute__((naked)) __NAME__(void)  \
+    {                                           \
+        __asm volatile("tst lr, #4        \n"   \
+                       "ite eq            \n"   \
+                       "mrseq r0, msp     \n"   \
+                       "mrsne r0, psp     \n"   \
+                       "mrs r1, ipsr      \n"   \
+                       "b fault_record    \n"); \
+    }
+
 /**
- * @brief  This function handles Hard Fault exception.
+ * @brief  This function handles NMI exception.
  */
-void HardFault_Handler(void)
+void NMI_Handler(void)
 {
-    /* Go to infinite loop when Hard Fault exception occurs */
     while (1)
         ;
 }
 
+/**
+ * @brief  This function handles Hard Fault exception.
+ */
+FAULT_HANDLER(HardFault_Handler)
+
 /**
  * @brief  This function handles Memory Manage exception.
  */
-void MemManage_Handler(void)
-{
-    /* Go to infinite loop when Memory Manage exception occurs */
-    while (1)
-        ;
-}
+FAULT_HANDLER(MemManage_Handler)
 
 /**
  * @brief  This function handles Bus Fault exception.
  */
-void BusFault_Handler(void)
-{
-    /* Go to infinite loop when Bus Fault exception occurs */
-    while (1)
-        ;
-}
+FAULT_HANDLER(BusFault_Handler)
 
 /**
  * @brief  This function handles Usage Fault exception.
  */
-void UsageFault_Handler(void)
-{
-    /* Go to infinite loop when Usage Fault exception occurs */
-    while (1)
-        ;
-}
+FAULT_HANDLER(UsageFault_Handler)
 
 /**
  * @brief  This function handles SVCall exception.
@@ -161,9 +179,19 @@ void I2C1_ER_IRQHandler(void) { HAL_I2C_ER_IRQHandler(&I2cHandle); }
 void USART1_IRQHandler(void)
 {
     // LED_toggle(LED_1);
-    HAL_UART_IRQHandler(&HAL_UART_handle);
+    UART_IRQHandler();
 }
 
+/**
+ * @brief  This function handles the UART TX DMA interrupt request.
+ */
+void DMA1_Channel4_IRQHandler(void) { HAL_DMA_IRQHandler(HAL_UART_handle.hdmatx); }
+
+/**
+ * @brief  This function handles the UART RX DMA interrupt request.
+ */
+void DMA1_Channel5_IRQHandler(void) { HAL_DMA_IRQHandler(HAL_UART_handle.hdmarx); }
+
 /**
  * @brief  This function handles the pin 1 external interrupt.
  */
@@ -63,6 +63,8 @@ void SysTick_Handler(void);
 void I2Cx_EV_IRQHandler(void);
 void I2Cx_ER_IRQHandler(void);
 void USARTx_IRQHandler(void);
+void DMA1_Channel4_IRQHandler(void);
+void DMA1_Channel5_IRQHandler(void);
 
 void USB_LP_CAN_RX0_IRQHandler(void);
 void USBWakeUp_IRQHandler(void);
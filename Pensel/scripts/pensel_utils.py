@@ -51,6 +51,20 @@ class bcolors:
 
 # Pensel comms object
 
+def _crc16_table():
+    """ CRC-16 (CCITT, polynomial 0x1021) of each value of the top byte, like firmware crc16.c """
+    table = []
+    for i in range(256):
+        crc = i << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+        table.append(crc & 0xFFFF)
+    return table
+
+
+_CRC16_TABLE = _crc16_table()
+
+
 class PenselError(RuntimeError):
     pass
 
@@ -83,6 +97,45 @@ class BasePensel(object, metaclass=abc.ABCMeta):
         checksum = (256 - checksum) & 0xff  # twos complement of a byte
         return checksum
 
+    @staticmethod
+    def generate_crc16(list_of_data, crc=0xFFFF):
+        for b in list_of_data:
+            crc = ((crc << 8) & 0xFFFF) ^ _CRC16_TABLE[(crc >> 8) ^ b]
+        return crc
+
+    @staticmethod
+    def cobs_encode(list_of_data):
+        """ COBS encodes the data, so there are no zeros in it. Doesn't add the zero after. """
+        out = [0]
+        code_pos = 0
+        for b in list_of_data:
+            if b != 0:
+                out.append(b)
+                out[code_pos] += 1
+            if b == 0 or out[code_pos] == 0xFE:
+                # end of the block: a zero, or as long as a block gets
+                out[code_pos] += 1
+                code_pos = len(out)
+                out.append(0)
+        out[code_pos] += 1
+        return out
+
+    @staticmethod
+    def cobs_decode(list_of_data):
+        """ Undoes cobs_encode(), without the zero after. Returns None if it's broken. """
+        out = []
+        pos = 0
+        while pos < len(list_of_data):
+            code = list_of_data[pos]
+            block = list_of_data[pos + 1:pos + code]
+            if code == 0 or len(block) != code - 1 or 0 in block:
+                return None
+            out.extend(block)
+            pos += code
+            if code != 0xFF and pos < len(list_of_data):
+                out.append(0)
+        return out
+
     def parse_report(self, reportID, payload, verbose=True):
         # Pack the data to be used in some of the parsing functions
         packed_data = struct.pack("B" * len(payload), *payload)
@@ -300,10 +353,20 @@ class Pensel(BasePensel):
     MAGIC_NUM_3 = 0xEF
     MAGIC_HEADER = [MAGIC_NUM_0, MAGIC_NUM_1, MAGIC_NUM_2, MAGIC_NUM_3]
 
+    # Protocol versions, see firmware report.h
+    PROTOCOL_MAGIC = 1  # magic number, length and 8 bit checksum
+    PROTOCOL_COBS = 2  # COBS with a zero either side, and CRC-16
+    VERSION_REPORT_ID = 0x7D
+    ECHO_REPORT_ID = 0x7B
+    BAUDRATE_REPORT_ID = 0x7C
+    BAUDRATE_CONFIRM_S = 1.0  # firmware UART_BAUDRATE_CONFIRM_MS
+
     _default_baud = 250000
 
-    def __init__(self, serialport, baudrate, *args, timeout=1, **kwargs):
+    def __init__(self, serialport, baudrate, *args, timeout=1, protocol=None, **kwargs):
         super().__init__(*args, **kwargs)
+        self.protocol = self.PROTOCOL_MAGIC
+        self._cobs_bytes = []
         self.serialport = serialport
         self.TIMEOUT = timeout
         self.baudrate = baudrate or self._default_baud
@@ -321,35 +384,157 @@ class Pensel(BasePensel):
         self._start_listener()
         self._clear_serial = False
 
+        if protocol is not None and protocol != self.PROTOCOL_MAGIC:
+            self.set_protocol(protocol)
+
     # ----- Public Methods ----- #
 
     def send_report(self, report_ID, payload=None):
         """
         Sends a report to the pensel and reads back the result
         """
+        self._send_request(report_ID, payload)
+        return self._wait_for_reply(report_ID)
+
+    def set_protocol(self, protocol):
+        """
+        Switches to another protocol version with the version report. Pensel goes back to
+        PROTOCOL_MAGIC when it resets, but it could still be on another one from last time, so if
+        there's no answer in the one we think it's on, try the others.
+        """
+        current = self.protocol
+        for version in [current] + [v for v in (self.PROTOCOL_MAGIC, self.PROTOCOL_COBS)
+                                    if v != current]:
+            self.protocol = version
+            if version == self.PROTOCOL_COBS:
+                # end whatever came before
+                self._serial_write(0)
+            retval, payload = self.send_report(self.VERSION_REPORT_ID, [protocol])
+            if retval is not None:
+                break
+        else:
+            self.protocol = current
+            raise PenselError("Pensel didn't answer the version report")
+
+        if retval != 0:
+            raise PenselError("Pensel doesn't support protocol version {}".format(protocol))
+        # it switches once the reply's gone
+        self.protocol = protocol
+        if self.verbose:
+            self.log("Using protocol version {}".format(protocol))
+
+    def set_baudrate(self, baudrate):
+        """
+        Switches both ends to another baud rate with the baud rate report: ask at the old rate,
+        switch the port once the reply's in, then ask again at the new rate to confirm it. Pensel
+        goes back to the old rate by itself if the confirmation doesn't make it, and so do we.
+        """
+        old_baudrate = self.baudrate
+        payload = list(struct.pack("<I", baudrate))
+
+        start_time = time.time()
+        retval, reply = self.send_report(self.BAUDRATE_REPORT_ID, payload)
+        if retval is None:
+            raise PenselError("Pensel didn't answer the baud rate report")
+        if retval != 0:
+            raise PenselError("Pensel can't do {} baud (error {})".format(baudrate, retval))
+
+        # it switches once the reply's gone out, give it a moment to get to the end of it
+        time.sleep(0.01)
+        self._set_port_baudrate(baudrate)
+        retval, reply = self.send_report(self.BAUDRATE_REPORT_ID, payload)
+        if retval == 0:
+            if self.verbose:
+                self.log("Switched to {} baud".format(baudrate))
+            return
+
+        # Wait for Pensel to go back. If only the reply to the confirmation got lost, it's still on
+        # the new rate, so check both.
+        time.sleep(max(0, start_time + self.BAUDRATE_CONFIRM_S + 0.1 - time.time()))
+        for rate in (old_baudrate, baudrate):
+            self._set_port_baudrate(rate)
+            retval, reply = self.send_report(self.BAUDRATE_REPORT_ID)
+            if retval == 0:
+                break
+        else:
+            self._set_port_baudrate(old_baudrate)
+            raise PenselError("Lost Pensel switching to {} baud".format(baudrate))
+        if self.baudrate != baudrate:
+            raise PenselError("Pensel didn't confirm {} baud, back to {}".format(
+                baudrate, old_baudrate))
+
+    def benchmark_throughput(self, duration=2.0, payload_len=64, window=2):
+        """
+        Loopback benchmark: keeps `window` echo reports of `payload_len` bytes in flight for
+        `duration` seconds, and works out how much came back intact. `window` times the frame
+        size has to fit Pensel's RX ring (UART_RX_RING_SIZE).
+        """
+        payload = [(i * 37 + 11) & 0xFF for i in range(payload_len)]
+        sent = received = bad = 0
+        in_flight = 0
+
+        self.clear_queue()
+        start_time = time.time()
+        while True:
+            if time.time() - start_time < duration:
+                while in_flight < window:
+                    self._send_request(self.ECHO_REPORT_ID, payload)
+                    in_flight += 1
+                    sent += 1
+            elif in_flight == 0:
+                break
+            pkt = self.get_packet_withreportID(self.ECHO_REPORT_ID, timeout=self.TIMEOUT)
+            if pkt is None:
+                # the rest got lost
+                break
+            in_flight -= 1
+            report, retval, reply = pkt
+            if retval == 0 and list(reply) == payload:
+                received += 1
+            else:
+                bad += 1
+        elapsed = time.time() - start_time
+
+        return SimpleNamespace(
+            baudrate=self.baudrate, seconds=elapsed, sent=sent, received=received, bad=bad,
+            lost=sent - received - bad, bytes_per_second=received * payload_len / elapsed)
+
+    def _send_request(self, report_ID, payload=None):
+        """ Sends a request in the protocol in use, without waiting for the reply """
         if report_ID < 0 or report_ID > 127:
             raise ValueError("Report ID {} is out of the valid range!".format(report_ID))
 
-        self._serial_write(self.MAGIC_NUM_0)
-        self._serial_write(self.MAGIC_NUM_1)
-        self._serial_write(self.MAGIC_NUM_2)
-        self._serial_write(self.MAGIC_NUM_3)
-        self._serial_write(report_ID)
-        _bytes = [self.MAGIC_NUM_0, self.MAGIC_NUM_1, self.MAGIC_NUM_2, self.MAGIC_NUM_3, report_ID]
-        if payload is None:
-            _bytes.append(0)
-            self._serial_write(0)
-        else:
-            _bytes.append(len(payload))
-            self._serial_write(len(payload))
-            for b in payload:
-                if b < 0 or b > 255:
-                    raise ValueError("Value in payload out of valid range!")
-                _bytes.append(b)
-                self._serial_write(b)
+        if self.protocol == self.PROTOCOL_COBS:
+            self._send_cobs(report_ID, payload)
+            return
+
+        payload = list(payload or [])
+        for b in payload:
+            if b < 0 or b > 255:
+                raise ValueError("Value in payload out of valid range!")
+        _bytes = self.MAGIC_HEADER + [report_ID, len(payload)] + payload
         # Checksum time!
-        self._serial_write(self.generate_checksum(_bytes))
+        _bytes.append(self.generate_checksum(_bytes))
+        self._serial_write(_bytes)
 
+    def _set_port_baudrate(self, baudrate):
+        """ Changes our end of the link, dropping anything half received at the old rate """
+        self.serial.baudrate = baudrate
+        self.baudrate = baudrate
+        self._check_for_start_bytes = []
+        self._cobs_bytes = []
+
+    def _send_cobs(self, report_ID, payload):
+        """ Sends a PROTOCOL_COBS request: the ID, payload and CRC, with a zero either side """
+        data = [report_ID] + list(payload or [])
+        for b in data:
+            if b < 0 or b > 255:
+                raise ValueError("Value in payload out of valid range!")
+        crc = self.generate_crc16(data)
+        data += [crc >> 8, crc & 0xFF]
+        self._serial_write([0] + self.cobs_encode(data) + [0])
+
+    def _wait_for_reply(self, report_ID):
         # Try to get the response
         retval = None
         payload = None
@@ -388,7 +573,11 @@ class Pensel(BasePensel):
         Writes `values_to_write` to the serial port.
         """
         if self.verbose:
-            self.log("Writing 0x{:x} to serial port...".format(values_to_write))
+            if type(values_to_write) is not list:
+                self.log("Writing 0x{:x} to serial port...".format(values_to_write))
+            else:
+                self.log("Writing {} to serial port...".format(
+                    " ".join(["{:0>2X}".format(b) for b in values_to_write])))
         if type(values_to_write) is not list:
             self.serial.write(bytearray([values_to_write]))
         else:
@@ -429,7 +618,9 @@ class Pensel(BasePensel):
     def _listener(self):
         """ The threaded listener that looks for packets from Pensel. """
         while self.thread_run.is_set():
-            if self._serial_bytes_available() >= len(self.MAGIC_HEADER) and \
+            if self.protocol == self.PROTOCOL_COBS:
+                self._receive_cobs()
+            elif self._serial_bytes_available() >= len(self.MAGIC_HEADER) and \
                     self._check_for_start():
                 report, retval, payload = self._receive_packet()
                 if report >= 0:
@@ -515,6 +706,33 @@ class Pensel(BasePensel):
         return report, retval, return_payload
 
 
+    def _receive_cobs(self):
+        """
+        Takes in PROTOCOL_COBS bytes up to the next zero, and queues the packet if it decodes and
+        the CRC matches. Anything else between zeros (e.g. UART logs) is dropped.
+        """
+        num_bytes = self._serial_bytes_available()
+        if num_bytes == 0:
+            time.sleep(0.001)
+            return
+        for b in self._serial_read(num_bytes):
+            if b != 0:
+                self._cobs_bytes.append(b)
+                continue
+            encoded, self._cobs_bytes = self._cobs_bytes, []
+            if not encoded:
+                continue
+            data = self.cobs_decode(encoded)
+            if data is None or len(data) < 4 or self.generate_crc16(data) != 0:
+                if self.verbose:
+                    self.log("Dropped a frame that didn't decode / match its CRC")
+                continue
+            report, retval, payload = data[0], data[1], data[2:-2]
+            self.queue.put((report, retval, payload))
+            if self.verbose:
+                self.log("Put report {} on queue".format(report))
+
+
 class PenselPlayback(BasePensel):
 
     def __init__(self, playback_file, *args, **kwargs):
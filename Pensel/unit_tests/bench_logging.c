@@ -0,0 +1,84 @@
+/*!
+ * @file    bench_logging.c
+ * @author  Tyler Holmes
+ *
+ * @date    18-Oct-2026
+ * @brief   Host side benchmark of text vs. binary log messages.
+ *
+ * Logs the same message both ways and reports the cost per message and the bytes each sends. The
+ * text path formats the message, then formats it again with the level, time and location, as
+ * LOG_MSG_FMT() does without LOG_BINARY (here it's written straight to the sink rather than
+ * queued); the binary one queues a record, and draining is timed separately since it runs later
+ * from the main loop. Absolute numbers are for the host, the ratio is what
+ * carries over.
+ */
+#include "logging.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NUM_MSGS (1000000)
+
+static uint64_t gBytes;
+static uint32_t gFakeTime;
+static log_sink_t gSink;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t get_time(void) { return gFakeTime++; }
+
+static ret_t count_data(uint8_t *data_ptr, uint32_t num_bytes)
+{
+    gBytes += num_bytes;
+    return RET_OK;
+}
+
+int main(void)
+{
+    uint64_t start, text_ns, binary_ns, drain_ns = 0;
+    uint64_t text_bytes, binary_bytes;
+
+    log_init(get_time);
+    log_addSink(&gSink, kLogLevelDebug, count_data, LOG_SINK_MAX_WRITE);
+
+    gBytes = 0;
+    start = now_ns();
+    for (uint32_t i = 0; i < NUM_MSGS; i++) {
+        char msg_buff[64];
+        sprintf(msg_buff, "Set Report: 0x%02X (len: %i) ret: %i", i & 0xFF, 12, 0);
+        log_logMessage(kLogLevelInfo, __FILE__, __func__, __LINE__, msg_buff);
+    }
+    text_ns = now_ns() - start;
+    text_bytes = gBytes;
+
+    gBytes = 0;
+    binary_ns = 0;
+    for (uint32_t i = 0; i < NUM_MSGS; i += LOG_BINARY_RING_LEN) {
+        start = now_ns();
+        for (uint32_t j = i; j < i + LOG_BINARY_RING_LEN; j++) {
+            LOG_MSG_FMT(kLogLevelInfo, "Set Report: 0x%02X (len: %i) ret: %i", j & 0xFF, 12, 0);
+        }
+        binary_ns += now_ns() - start;
+        start = now_ns();
+        log_drain();
+        drain_ns += now_ns() - start;
+    }
+    binary_bytes = gBytes;
+
+    printf("%u messages\n", NUM_MSGS);
+    printf("  text:   %6.1f ns / msg, %5.1f bytes / msg\n", (double)text_ns / NUM_MSGS,
+           (double)text_bytes / NUM_MSGS);
+    printf("  binary: %6.1f ns / msg (+ %.1f ns to drain), %5.1f bytes / msg\n",
+           (double)binary_ns / NUM_MSGS, (double)drain_ns / NUM_MSGS,
+           (double)binary_bytes / NUM_MSGS);
+    printf("  binary is %.1fx cheaper to log and %.1fx smaller\n", (double)text_ns / binary_ns,
+           (double)text_bytes / binary_bytes);
+    printf("  %u records lost\n", log_lostMessages(&gSink));
+    return 0;
+}
@@ -0,0 +1,424 @@
+/*!
+ * @file    bench_queues.c
+ * @author  Tyler Holmes
+ *
+ * @date    18-Oct-2026
+ * @brief   Host side concurrency stress test and benchmark for the queue primitives.
+ *
+ * A producer thread plays the part of an ISR, pushing bursts of sequence numbered, timestamped
+ * records with idle gaps between bursts. Consumer threads play the part of the main loop, popping
+ * as fast as they can. At the end we report throughput, lost / duplicated / corrupt records and
+ * the push -> pop latency percentiles for each queue type.
+ *
+ * Lost records are compared against the queue's own drop counters. Anything the queue didn't
+ * account for, and any duplicate or corrupt record, means the queue isn't safe between the
+ * producer and consumer contexts.
+ *
+ * Note: on the target the "ISR" can't be interrupted by the main loop. On a host the threads run
+ * in parallel (multi-core) or preempt each other at arbitrary points (single core), in both
+ * directions. This is a harsher test than the real system, which is the point.
+ */
+#include "broadcast.h"
+#include "newqueue.h"
+#include "queue.h"
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_NUM_ITEMS (2000000)
+#define DEFAULT_BURST_LEN (8)
+#define DEFAULT_GAP_NS (2000)
+#define QUEUE_BENCH_SIZE (64)  //!< queue_t indexes are uint8_t, keep it small
+#define BROADCAST_BENCH_READERS (2)
+
+//! What the "ISR" pushes.
+typedef struct {
+    uint32_t seq;  //!< Sequence number, 0 .. num_items - 1
+    uint32_t tag;  //!< ~seq, so torn records can be spotted
+    uint64_t t_ns; //!< Time the record was pushed
+} bench_record_t;
+
+//! Benchmark settings
+typedef struct {
+    uint32_t num_items;
+    uint32_t burst_len;
+    uint32_t gap_ns;
+} bench_config_t;
+
+//! What each consumer saw
+typedef struct {
+    uint8_t *seen;        //!< One byte per sequence number
+    uint32_t *latency_ns; //!< Latency of each unique record received
+    uint32_t received;    //!< Unique records received
+    uint32_t duplicated;  //!< Records received more than once
+    uint32_t corrupt;     //!< Records with bad sequence numbers or tags
+    uint32_t reordered;   //!< Records older than one already received
+    uint32_t last_seq;
+    bool any;
+} bench_stats_t;
+
+//! Everything the threads share
+typedef struct {
+    bench_config_t cfg;
+    volatile bool producer_done;
+    double elapsed_s;
+
+    // queue under test
+    volatile queue_t queue;
+    bench_record_t queue_buff[QUEUE_BENCH_SIZE];
+    volatile newqueue_t newqueue;
+    broadcast_t ring;
+    bench_record_t ring_buff[QUEUE_BENCH_SIZE];
+    uint8_t readers[BROADCAST_BENCH_READERS];
+
+    bench_stats_t stats[BROADCAST_BENCH_READERS];
+} bench_t;
+
+//! Passed to each consumer thread
+typedef struct {
+    bench_t *bench;
+    uint8_t index;
+} consumer_arg_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+//! Idles for `ns`, letting the consumers run if they share our CPU.
+static void idle_ns(uint32_t ns)
+{
+    uint64_t until = now_ns() + ns;
+    while (now_ns() < until) {
+        sched_yield();
+    }
+}
+
+/* --- Record bookkeeping --- */
+
+static void stats_init(bench_stats_t *stats, uint32_t num_items)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->seen = calloc(num_items, 1);
+    stats->latency_ns = calloc(num_items, sizeof(uint32_t));
+    if (stats->seen == NULL || stats->latency_ns == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(2);
+    }
+}
+
+static void stats_deinit(bench_stats_t *stats)
+{
+    free(stats->seen);
+    free(stats->latency_ns);
+}
+
+static void stats_record(bench_stats_t *stats, const bench_record_t *rec, uint32_t num_items)
+{
+    uint64_t t = now_ns();
+    if (rec->seq >= num_items || rec->tag != ~rec->seq) {
+        stats->corrupt += 1;
+        return;
+    }
+    if (stats->seen[rec->seq]) {
+        stats->duplicated += 1;
+        return;
+    }
+    if (stats->any && rec->seq < stats->last_seq) {
+        stats->reordered += 1;
+    }
+    stats->seen[rec->seq] = 1;
+    stats->latency_ns[stats->received++] = (uint32_t)(t - rec->t_ns);
+    stats->last_seq = rec->seq;
+    stats->any = true;
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(const uint32_t *sorted, uint32_t len, double pct)
+{
+    if (len == 0) {
+        return 0;
+    }
+    uint32_t ind = (uint32_t)(pct / 100.0 * (double)(len - 1) + 0.5);
+    return sorted[ind];
+}
+
+/*! Prints one line of results.
+ *
+ * @retval true if every lost record was accounted for by the queue and nothing was duplicated
+ *      or corrupted
+ */
+static bool report(const char *name, bench_t *bench, bench_stats_t *stats, uint32_t counted_drops)
+{
+    uint32_t n = bench->cfg.num_items;
+    uint32_t lost = n - stats->received;
+    qsort(stats->latency_ns, stats->received, sizeof(uint32_t), compare_u32);
+
+    printf("%-12s %8.2f Mitem/s  lost %7u (counted %7u)  dup %5u  corrupt %5u  reorder %5u"
+           "  lat ns p50 %6u p90 %6u p99 %7u p99.9 %7u max %8u\n",
+           name, (double)n / bench->elapsed_s / 1e6, lost, counted_drops, stats->duplicated,
+           stats->corrupt, stats->reordered, percentile(stats->latency_ns, stats->received, 50.0),
+           percentile(stats->latency_ns, stats->received, 90.0),
+           percentile(stats->latency_ns, stats->received, 99.0),
+           percentile(stats->latency_ns, stats->received, 99.9),
+           percentile(stats->latency_ns, stats->received, 100.0));
+
+    return (lost == counted_drops) && stats->duplicated == 0 && stats->corrupt == 0 &&
+           stats->reordered == 0;
+}
+
+/* --- Producers ("ISRs") --- */
+
+typedef void (*push_func_t)(bench_t *bench, const bench_record_t *rec);
+
+static void push_queue(bench_t *bench, const bench_record_t *rec)
+{
+    if (!queue_isFull(&bench->queue, QUEUE_BENCH_SIZE)) {
+        bench->queue_buff[bench->queue.head_ind] = *rec;
+    }
+    queue_increment_head(&bench->queue, QUEUE_BENCH_SIZE);
+}
+
+static void push_newqueue(bench_t *bench, const bench_record_t *rec)
+{
+    newqueue_push(&bench->newqueue, (void *)rec, 1);
+}
+
+static void push_broadcast(bench_t *bench, const bench_record_t *rec)
+{
+    broadcast_push(&bench->ring, rec);
+}
+
+static void run_producer(bench_t *bench, push_func_t push)
+{
+    bench_record_t rec;
+    for (uint32_t seq = 0; seq < bench->cfg.num_items; seq++) {
+        if (seq % bench->cfg.burst_len == 0 && bench->cfg.gap_ns > 0) {
+            idle_ns(bench->cfg.gap_ns);
+        }
+        rec.seq = seq;
+        rec.tag = ~seq;
+        rec.t_ns = now_ns();
+        push(bench, &rec);
+    }
+    __atomic_store_n(&bench->producer_done, true, __ATOMIC_RELEASE);
+}
+
+/* --- Consumers ("main loop") --- */
+
+//! Once the producer is done, give up after this many extra pops. A racy queue can end up with a
+//! garbage unread count and would otherwise be drained forever.
+#define MAX_POPS_AFTER_DONE (QUEUE_BENCH_SIZE * 2)
+
+static void *consume_queue(void *arg)
+{
+    bench_t *bench = ((consumer_arg_t *)arg)->bench;
+    bench_stats_t *stats = &bench->stats[0];
+    uint32_t pops_after_done = 0;
+    bench_record_t rec;
+
+    while (pops_after_done < MAX_POPS_AFTER_DONE) {
+        bool done = __atomic_load_n(&bench->producer_done, __ATOMIC_ACQUIRE);
+        if (bench->queue.unread_items > 0) {
+            rec = bench->queue_buff[bench->queue.tail_ind];
+            queue_increment_tail(&bench->queue, QUEUE_BENCH_SIZE);
+            stats_record(stats, &rec, bench->cfg.num_items);
+            pops_after_done += done;
+        } else if (done) {
+            break;
+        } else {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *consume_newqueue(void *arg)
+{
+    bench_t *bench = ((consumer_arg_t *)arg)->bench;
+    bench_stats_t *stats = &bench->stats[0];
+    uint32_t pops_after_done = 0;
+    bench_record_t rec;
+
+    while (pops_after_done < MAX_POPS_AFTER_DONE) {
+        bool done = __atomic_load_n(&bench->producer_done, __ATOMIC_ACQUIRE);
+        if (bench->newqueue.unread_items > 0) {
+            newqueue_pop(&bench->newqueue, &rec, 1, eNoPeak);
+            stats_record(stats, &rec, bench->cfg.num_items);
+            pops_after_done += done;
+        } else if (done) {
+            break;
+        } else {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *consume_broadcast(void *arg)
+{
+    bench_t *bench = ((consumer_arg_t *)arg)->bench;
+    uint8_t index = ((consumer_arg_t *)arg)->index;
+    uint8_t reader = bench->readers[index];
+    bench_stats_t *stats = &bench->stats[index];
+    const bench_record_t *rec_ptr;
+    bench_record_t rec;
+
+    while (true) {
+        bool done = __atomic_load_n(&bench->producer_done, __ATOMIC_ACQUIRE);
+        if (broadcast_peek(&bench->ring, reader, (const void **)&rec_ptr) == RET_OK) {
+            rec = *rec_ptr;
+            // an item that got overwritten while we held it is counted as an overrun
+            if (broadcast_release(&bench->ring, reader) == RET_OK) {
+                stats_record(stats, &rec, bench->cfg.num_items);
+            }
+        } else if (done) {
+            break;
+        } else {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/* --- Benchmarks --- */
+
+static void run_threads(bench_t *bench, push_func_t push, void *(*consume)(void *),
+                        uint8_t num_consumers)
+{
+    pthread_t threads[BROADCAST_BENCH_READERS];
+    consumer_arg_t args[BROADCAST_BENCH_READERS];
+
+    bench->producer_done = false;
+    for (uint8_t i = 0; i < num_consumers; i++) {
+        stats_init(&bench->stats[i], bench->cfg.num_items);
+    }
+
+    uint64_t start = now_ns();
+    for (uint8_t i = 0; i < num_consumers; i++) {
+        args[i].bench = bench;
+        args[i].index = i;
+        pthread_create(&threads[i], NULL, consume, &args[i]);
+    }
+    run_producer(bench, push);
+    for (uint8_t i = 0; i < num_consumers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    bench->elapsed_s = (double)(now_ns() - start) / 1e9;
+}
+
+static bool bench_queue(bench_t *bench)
+{
+    queue_init(&bench->queue, kQueueDropNewest);
+    run_threads(bench, push_queue, consume_queue, 1);
+    bool ok = report("queue", bench, &bench->stats[0], bench->queue.dropped_count);
+    stats_deinit(&bench->stats[0]);
+    return ok;
+}
+
+static bool bench_newqueue(bench_t *bench)
+{
+    newqueue_init(&bench->newqueue, QUEUE_BENCH_SIZE, sizeof(bench_record_t), kQueueDropNewest);
+    run_threads(bench, push_newqueue, consume_newqueue, 1);
+    bool ok = report("newqueue", bench, &bench->stats[0], bench->newqueue.dropped_count);
+    stats_deinit(&bench->stats[0]);
+    newqueue_deinit(&bench->newqueue);
+    return ok;
+}
+
+static bool bench_broadcast(bench_t *bench)
+{
+    bool ok = true;
+    char name[16];
+
+    broadcast_init(&bench->ring, bench->ring_buff, QUEUE_BENCH_SIZE, sizeof(bench_record_t));
+    for (uint8_t i = 0; i < BROADCAST_BENCH_READERS; i++) {
+        broadcast_subscribe(&bench->ring, &bench->readers[i]);
+    }
+    run_threads(bench, push_broadcast, consume_broadcast, BROADCAST_BENCH_READERS);
+    for (uint8_t i = 0; i < BROADCAST_BENCH_READERS; i++) {
+        snprintf(name, sizeof(name), "broadcast/%u", i);
+        ok &= report(name, bench, &bench->stats[i],
+                     broadcast_overruns(&bench->ring, bench->readers[i]));
+        stats_deinit(&bench->stats[i]);
+    }
+    return ok;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [-n items] [-b burst_len] [-g gap_ns] [-q queue|newqueue|broadcast] [-s]\n",
+           prog);
+    printf("  -n  number of records to push (default %u)\n", DEFAULT_NUM_ITEMS);
+    printf("  -b  records pushed back to back per simulated ISR (default %u)\n",
+           DEFAULT_BURST_LEN);
+    printf("  -g  idle time between bursts in ns (default %u)\n", DEFAULT_GAP_NS);
+    printf("  -q  only run one queue type (default: all)\n");
+    printf("  -s  strict, exit non-zero on unaccounted loss, duplicates or corruption\n");
+}
+
+int main(int argc, char *argv[])
+{
+    static bench_t bench;
+    const char *only = NULL;
+    bool strict = false, ok = true;
+    int opt;
+
+    bench.cfg.num_items = DEFAULT_NUM_ITEMS;
+    bench.cfg.burst_len = DEFAULT_BURST_LEN;
+    bench.cfg.gap_ns = DEFAULT_GAP_NS;
+
+    while ((opt = getopt(argc, argv, "n:b:g:q:sh")) != -1) {
+        switch (opt) {
+            case 'n':
+                bench.cfg.num_items = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'b':
+                bench.cfg.burst_len = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'g':
+                bench.cfg.gap_ns = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'q':
+                only = optarg;
+                break;
+            case 's':
+                strict = true;
+                break;
+            default:
+                usage(argv[0]);
+                return (opt == 'h') ? 0 : 2;
+        }
+    }
+    if (bench.cfg.burst_len == 0) {
+        bench.cfg.burst_len = 1;
+    }
+
+    printf("%u records, bursts of %u, %u ns between bursts, %u item queues\n",
+           bench.cfg.num_items, bench.cfg.burst_len, bench.cfg.gap_ns, QUEUE_BENCH_SIZE);
+
+    if (only == NULL || strcmp(only, "queue") == 0) {
+        ok &= bench_queue(&bench);
+    }
+    if (only == NULL || strcmp(only, "newqueue") == 0) {
+        ok &= bench_newqueue(&bench);
+    }
+    if (only == NULL || strcmp(only, "broadcast") == 0) {
+        ok &= bench_broadcast(&bench);
+    }
+
+    return (strict && !ok) ? 1 : 0;
+}
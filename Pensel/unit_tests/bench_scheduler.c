@@ -0,0 +1,164 @@
+/*!
+ * @file    bench_scheduler.c
+ * @author  Tyler Holmes
+ *
+ * @date    18-Oct-2026
+ * @brief   Host side benchmark of scheduler overhead vs. the number of scheduled tasks.
+ *
+ * Build once per task count, e.g. `-DSCHEDULER_NUM_SLOTS=64`. All slots get filled with tasks
+ * that pick a new pseudo random period (1 - 100 ms) every time they run, plus one period 0 task
+ * like `workloop_flash`. We then simulate a few seconds of main loop two ways:
+ *
+ *  - spin: the main loop keeps calling scheduler_run(), as it does with a period 0 task
+ *  - sleep: the main loop jumps straight to the next deadline (no period 0 task)
+ *
+ * and report the cost of each scheduler_run() call and of each dispatched callback. The old
+ * linear scan scheduler is run against the same load as a baseline.
+ */
+#include "scheduler.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define SIM_TIME_MS (5000)
+#define SLEEP_SIM_REPEATS (200) //!< Sleep mode has few runs per sim, repeat it for stable numbers
+#define SPIN_CALLS_PER_MS (200) //!< How many times the spinning main loop runs in a ms
+
+static uint32_t gRand = 1;
+static uint32_t gDispatched;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static ret_t random_period_task(int32_t *callback_time_ms)
+{
+    gRand = gRand * 1103515245u + 12345u;
+    *callback_time_ms = 1 + (int32_t)((gRand >> 16) % 100);
+    gDispatched++;
+    return RET_OK;
+}
+
+static ret_t spin_task(int32_t *callback_time_ms)
+{
+    *callback_time_ms = 0;
+    gDispatched++;
+    return RET_OK;
+}
+
+/* --- The original linear scan scheduler, as a baseline --- */
+
+typedef struct {
+    ret_t (*callbacks[SCHEDULER_NUM_SLOTS])(int32_t *callback_time_ms);
+    int32_t callback_times_ms[SCHEDULER_NUM_SLOTS];
+    int32_t callback_last_run_ms[SCHEDULER_NUM_SLOTS];
+} linear_schedule_t;
+
+static int32_t linear_run(linear_schedule_t *schedule, uint32_t current_time_ms)
+{
+    int32_t new_callback_time = 0;
+    int32_t next_cb_time_ms = INT32_MAX;
+
+    for (uint16_t i = 0; i < SCHEDULER_NUM_SLOTS; i++) {
+        if (schedule->callbacks[i] != NULL) {
+            int32_t time_until_next_run = schedule->callback_times_ms[i];
+            time_until_next_run -= (current_time_ms - schedule->callback_last_run_ms[i]);
+            if (time_until_next_run <= 0) {
+                schedule->callbacks[i](&new_callback_time);
+                if (new_callback_time == SCHEDULER_FINISHED) {
+                    schedule->callbacks[i] = NULL;
+                } else {
+                    schedule->callback_last_run_ms[i] = current_time_ms;
+                    schedule->callback_times_ms[i] = new_callback_time;
+                    time_until_next_run = new_callback_time;
+                }
+            }
+            if (time_until_next_run < next_cb_time_ms) {
+                next_cb_time_ms = time_until_next_run;
+            }
+        }
+    }
+    return next_cb_time_ms;
+}
+
+/* --- Load generation --- */
+
+static schedule_t gSchedule;
+static linear_schedule_t gLinear;
+
+static void setup(bool with_spin_task)
+{
+    uint8_t id;
+    gRand = 1;
+    scheduler_init(&gSchedule);
+    for (uint16_t i = 0; i < SCHEDULER_NUM_SLOTS; i++) {
+        bool spin = with_spin_task && i == 0;
+        scheduler_add(&gSchedule, 0, spin ? spin_task : random_period_task, &id);
+        gLinear.callbacks[i] = spin ? spin_task : random_period_task;
+        gLinear.callback_times_ms[i] = 0;
+        gLinear.callback_last_run_ms[i] = 0;
+    }
+}
+
+typedef int32_t (*run_func_t)(uint32_t current_time_ms);
+
+static int32_t run_heap(uint32_t current_time_ms)
+{
+    // the scheduler runs on us, round up so a sleeping loop never wakes early
+    int32_t next_us = scheduler_run(&gSchedule, current_time_ms * 1000);
+    return (next_us == INT32_MAX) ? INT32_MAX : (next_us + 999) / 1000;
+}
+
+static int32_t run_linear(uint32_t current_time_ms)
+{
+    return linear_run(&gLinear, current_time_ms);
+}
+
+static void bench(const char *name, run_func_t run, bool spin)
+{
+    uint64_t calls = 0;
+    uint64_t dispatched = 0;
+    double elapsed_ns = 0.0;
+    uint32_t repeats = spin ? 1 : SLEEP_SIM_REPEATS;
+
+    for (uint32_t rep = 0; rep < repeats; rep++) {
+        uint32_t time_ms = 0;
+        setup(spin);
+        gDispatched = 0;
+        uint64_t start = now_ns();
+        while (time_ms < SIM_TIME_MS) {
+            if (spin) {
+                for (uint32_t i = 0; i < SPIN_CALLS_PER_MS; i++) {
+                    run(time_ms);
+                    calls++;
+                }
+                time_ms += 1;
+            } else {
+                int32_t next = run(time_ms);
+                calls++;
+                time_ms += (next > 0) ? (uint32_t)next : 1;
+            }
+        }
+        elapsed_ns += (double)(now_ns() - start);
+        dispatched += gDispatched;
+    }
+
+    printf("%4u tasks  %-6s  %-5s  %9llu runs  %9llu dispatches  %8.1f ns/run  %8.1f ns/dispatch\n",
+           SCHEDULER_NUM_SLOTS, name, spin ? "spin" : "sleep", (unsigned long long)calls,
+           (unsigned long long)dispatched, elapsed_ns / (double)calls,
+           elapsed_ns / (double)dispatched);
+}
+
+int main(void)
+{
+    bench("heap", run_heap, true);
+    bench("linear", run_linear, true);
+    bench("heap", run_heap, false);
+    bench("linear", run_linear, false);
+    return 0;
+}
@@ -4,32 +4,59 @@ import subprocess
 import os
 import sys
 from threading import Thread
-from Queue import Queue, Empty
+try:
+    from Queue import Queue, Empty
+except ImportError:
+    from queue import Queue, Empty
 import time
 
 
-def run_utest(source_code_list, output_name, unity_path,
-              include_paths=None, verbose=False, debug=False):
-    print("\n\n Running Test {}!\n\n".format(output_name))
-    # build up include paths...
+FIRMWARE_PATH = "../firmware/"
+INCLUDE_PATHS = [FIRMWARE_PATH,
+                 FIRMWARE_PATH + "modules/utilities/",
+                 FIRMWARE_PATH + "modules/orientation/"]
+UTILITIES_PATH = FIRMWARE_PATH + "modules/utilities/"
+ORIENTATION_PATH = FIRMWARE_PATH + "modules/orientation/"
+
+# Compiler to use for the host side tests
+CC = "gcc"
+
+# Limits the default main loop simulation has to stay within: p99 dispatch latency in us and
+# interrupts lost
+SIM_CHECK_ARGS = "-l 250 -m 0"
+
+
+def build_include_str(include_paths):
     include_paths_str = ""
     if type(include_paths) is list:
         for i in include_paths:
             include_paths_str += " -I{}".format(i)
+    return include_paths_str
+
+
+def run_utest(source_code_list, output_name, unity_path,
+              include_paths=None, defines=None, verbose=False, debug=False):
+    print("\n\n Running Test {}!\n\n".format(output_name))
+    # build up include paths...
+    include_paths_str = build_include_str(include_paths)
 
     # compile with gcc
-    BASE_CMD_START = "gcc-7 {0} -I{1} {1}unity.c ".format(include_paths_str, unity_path)
+    BASE_CMD_START = "{0} {1} -I{2} {2}unity.c ".format(CC, include_paths_str, unity_path)
     # build up the command with the source and output name
     abs_path_list = [os.path.abspath(src_file) for src_file in source_code_list]
     cmd = BASE_CMD_START + " -o {} {}".format(output_name, " ".join(abs_path_list))
     if verbose:
         cmd += " -D VERBOSE_OUTPUT"
+    for define in (defines or []):
+        cmd += " -D {}".format(define)
     if debug:
         cmd += " -v"
     cmd += " -D UNIT_TEST"
 
     # run the program!!
     stdout, stderr, retval = run_command(cmd)
+    if retval != 0:
+        return retval
 
     # run the output program
     cmd = "./{}".format(output_name)
@@ -40,22 +67,103 @@ def run_utest(source_code_list, output_name, unity_path,
     return retval
 
 
-def main(unity_path, debug=False, verbose=False):
+def run_bench(source_code_list, output_name, args="", include_paths=None, defines=None,
+              debug=False):
+    """
+    Builds a host side benchmark with optimization and threads, and runs it.
+    """
+    print("\n\n Running Benchmark {}!\n\n".format(output_name))
+    abs_path_list = [os.path.abspath(src_file) for src_file in source_code_list]
+    cmd = "{} -O2 -pthread {} -o {} {}".format(CC, build_include_str(include_paths), output_name,
+                                              " ".join(abs_path_list))
+    for define in (defines or []):
+        cmd += " -D {}".format(define)
+    if debug:
+        cmd += " -v"
+    stdout, stderr, retval = run_command(cmd)
+    if retval != 0:
+        return retval
+
+    stdout, stderr, retval = run_command("./{} {}".format(output_name, args))
+    run_command("rm {}".format(output_name), print_output=False)
+    return retval
+
+
+def main(unity_path, debug=False, verbose=False, bench=False, bench_args=""):
     retval = 0
-    inc_paths = ["../firmware/include/"]
+    inc_paths = INCLUDE_PATHS
     # run all tests!
-    retval += run_utest(["../firmware/source/queue.c", "test_queue.c"],
+    retval += run_utest([UTILITIES_PATH + "queue.c", "test_queue.c"],
                         "test_queue", unity_path, include_paths=inc_paths,
                         verbose=verbose, debug=debug)
-    retval += run_utest(["../firmware/source/newqueue.c", "test_newqueue.c"],
+    retval += run_utest([UTILITIES_PATH + "newqueue.c", "test_newqueue.c"],
                         "test_newqueue", unity_path, include_paths=inc_paths,
                         verbose=verbose, debug=debug)
-    retval += run_utest(["../firmware/source/FIR.c", "test_FIR.c"],
+    retval += run_utest([UTILITIES_PATH + "broadcast.c", "test_broadcast.c"],
+                        "test_broadcast", unity_path, include_paths=inc_paths,
+                        verbose=verbose, debug=debug)
+    retval += run_utest([UTILITIES_PATH + "events.c", "test_events.c"],
+                        "test_events", unity_path, include_paths=inc_paths,
+                        verbose=verbose, debug=debug)
+    retval += run_utest([UTILITIES_PATH + "logging.c", "test_logging.c"],
+                        "test_logging", unity_path, include_paths=inc_paths,
+                        verbose=verbose, debug=debug)
+    retval += run_utest([UTILITIES_PATH + "logging.c", "test_logging.c"],
+                        "test_logging_binary", unity_path, include_paths=inc_paths,
+                        defines=["LOG_BINARY"], verbose=verbose, debug=debug)
+    retval += run_utest([UTILITIES_PATH + "logging.c", "test_logging.c"],
+                        "test_logging_compile_level", unity_path, include_paths=inc_paths,
+                        defines=["LOG_COMPILE_LEVEL=kLogLevelInfo"], verbose=verbose, debug=debug)
+    retval += run_utest([UTILITIES_PATH + "flightrec.c", "test_flightrec.c"],
+                        "test_flightrec", unity_path, include_paths=inc_paths,
+                        verbose=verbose, debug=debug)
+    retval += run_utest([UTILITIES_PATH + "report.c", UTILITIES_PATH + "crc16.c", "test_report.c"],
+                        "test_report", unity_path, include_paths=inc_paths,
+                        verbose=verbose, debug=debug)
+    retval += run_utest([UTILITIES_PATH + "fmt.c", "test_fmt.c"],
+                        "test_fmt", unity_path, include_paths=inc_paths,
+                        verbose=verbose, debug=debug)
+    retval += run_utest(["timebase_host.c", "test_timebase.c"],
+                        "test_timebase", unity_path, include_paths=inc_paths,
+                        verbose=verbose, debug=debug)
+    retval += run_utest([UTILITIES_PATH + "idle.c", UTILITIES_PATH + "events.c",
+                         UTILITIES_PATH + "scheduler.c", "virtual_clock.c", "test_idle.c"],
+                        "test_idle", unity_path, include_paths=inc_paths,
+                        verbose=verbose, debug=debug)
+    retval += run_utest([UTILITIES_PATH + "scheduler.c", "test_scheduler.c"],
+                        "test_scheduler", unity_path, include_paths=inc_paths,
+                        verbose=verbose, debug=debug)
+    retval += run_utest([UTILITIES_PATH + "scheduler.c", "test_scheduler.c"],
+                        "test_scheduler_profiling", unity_path, include_paths=inc_paths,
+                        defines=["SCHEDULER_PROFILING"], verbose=verbose, debug=debug)
+    retval += run_utest([UTILITIES_PATH + "scheduler.c", "test_pt.c"],
+                        "test_pt", unity_path, include_paths=inc_paths,
+                        verbose=verbose, debug=debug)
+    retval += run_utest([UTILITIES_PATH + "FIR.c", "FIR_sine_array.c", "test_FIR.c"],
                         "test_FIR", unity_path, include_paths=inc_paths,
                         verbose=verbose, debug=debug)
-    retval += run_utest(["../firmware/source/matrixmath.c", "test_matrixmath.c"],
+    retval += run_utest([ORIENTATION_PATH + "matrixmath.c", "test_matrixmath.c"],
                         "test_matrixmath", unity_path, include_paths=inc_paths,
                         verbose=verbose, debug=debug)
+
+    # the main loop simulation is deterministic and quick, so it runs as a regression check too
+    retval += run_bench([UTILITIES_PATH + "scheduler.c", UTILITIES_PATH + "events.c",
+                         UTILITIES_PATH + "idle.c", "virtual_clock.c", "sim_scheduler.c"],
+                        "sim_scheduler", args=SIM_CHECK_ARGS, include_paths=inc_paths,
+                        debug=debug)
+
+    if bench:
+        retval += run_bench([UTILITIES_PATH + "queue.c", UTILITIES_PATH + "newqueue.c",
+                             UTILITIES_PATH + "broadcast.c", "bench_queues.c"],
+                            "bench_queues", args=bench_args, include_paths=inc_paths,
+                            debug=debug)
+        retval += run_bench([UTILITIES_PATH + "logging.c", "bench_logging.c"],
+                            "bench_logging", include_paths=inc_paths, defines=["LOG_BINARY"],
+                            debug=debug)
+        for num_tasks in [16, 64, 256]:
+            retval += run_bench([UTILITIES_PATH + "scheduler.c", "bench_scheduler.c"],
+                                "bench_scheduler", include_paths=inc_paths,
+                                defines=["SCHEDULER_NUM_SLOTS={}".format(num_tasks)], debug=debug)
     sys.exit(retval)
 
 
@@ -66,7 +174,7 @@ def run_command(cmd, print_output=True):
 
     # function we can use to queue up the stdout/err output
     def enqueue_output(out, queue):
-        for line in iter(out.readline, b''):
+        for line in iter(out.readline, ''):
             queue.put(line)
         out.close()
 
@@ -75,7 +183,7 @@ def run_command(cmd, print_output=True):
 
     # ge the process and stdout/err queues put together
     proc = subprocess.Popen(cmd, shell=True, stdout=subprocess.PIPE,
-                            stderr=subprocess.PIPE)
+                            stderr=subprocess.PIPE, universal_newlines=True)
     q_stdout = Queue()
     q_stderr = Queue()
     t_stdout = Thread(target=enqueue_output, args=(proc.stdout, q_stdout))
@@ -120,6 +228,9 @@ def run_command(cmd, print_output=True):
             finished = True
             # give stdout and stderr time
             time.sleep(0.25)
+        else:
+            # don't steal CPU from the process (benchmarks care)
+            time.sleep(0.01)
 
 
 if __name__ == '__main__':
@@ -133,7 +244,15 @@ if __name__ == '__main__':
                         help="Verbose output.")
     parser.add_argument("--debug", action="store_true",
                         help="Debug compiler output.")
+    parser.add_argument("--cc", type=str, default=CC,
+                        help="Host compiler to build the tests with.")
+    parser.add_argument("-b", "--bench", action="store_true",
+                        help="Also build and run the host side benchmarks.")
+    parser.add_argument("--bench-args", type=str, default="",
+                        help="Arguments passed to the benchmarks (e.g. \"-n 5000000 -s\").")
 
     args = parser.parse_args()
+    CC = args.cc
 
-    main(args.unity_path, verbose=args.verbose, debug=args.debug)
+    main(args.unity_path, verbose=args.verbose, debug=args.debug, bench=args.bench,
+         bench_args=args.bench_args)
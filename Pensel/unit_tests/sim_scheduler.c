@@ -0,0 +1,648 @@
+/*!
+ * @file    sim_scheduler.c
+ * @author  Tyler Holmes
+ *
+ * @date    18-Oct-2026
+ * @brief   Deterministic host simulation of the main loop against replayed interrupt traces.
+ *
+ * Runs the real scheduler, events and idle modules on the virtual clock, with stand-ins for the
+ * firmware tasks that mirror pensel_v2.c: the LSM9DS1 sensor task (a protothread doing async I2C
+ * reads), the heartbeat, LED flash and button tasks, a UART RX handler and a USB report handler.
+ * Each of them spends a fixed amount of virtual CPU time when it runs (see gCosts), during which
+ * interrupts still come in.
+ *
+ * The interrupts come from a trace, either generated (accel / gyro DRDY at their ODR with jitter,
+ * UART bytes in bursts, USB reports at the polling interval) or read from a file with `-t`. A trace
+ * file is one interrupt per line, `<time_us> <xl|g|uart|usb>`, in time order; `#` starts a comment.
+ * `-w` writes the generated trace out, to keep as a regression case or to edit.
+ *
+ * Reports, per interrupt source, how long posts waited for their handler (dispatch latency) and
+ * how many were lost, how long sensor samples took from DRDY to published, how many scheduler
+ * slots and heap entries were in use, and how busy the CPU was. Everything runs on virtual time,
+ * so the same trace always gives the same numbers. `-l` / `-m` turn it into a pass / fail check.
+ *
+ * Interrupt handlers themselves take no time here, and there's one of each bus (no contention with
+ * other I2C users), so the numbers are a lower bound for the real thing.
+ */
+#include "events.h"
+#include "idle.h"
+#include "pt.h"
+#include "scheduler.h"
+#include "virtual_clock.h"
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_DURATION_MS (10000)
+#define DEFAULT_ACCEL_HZ (476)
+#define DEFAULT_GYRO_HZ (476)
+#define DEFAULT_UART_PERIOD_MS (100) //!< Time between UART bursts
+#define DEFAULT_UART_BURST (16)      //!< Bytes per UART burst
+#define DEFAULT_USB_PERIOD_MS (10)   //!< Time between USB reports
+#define DEFAULT_JITTER_US (20)
+#define UART_BYTE_US (22)        //!< One byte at 460800 baud
+#define UART_RX_CAPACITY (256)   //!< Bytes that fit in the RX ring (UART_RX_RING_SIZE)
+#define USB_RX_CAPACITY (1)      //!< Reports the OUT endpoint holds
+#define SENSOR_I2C_READ_US (200) //!< 6 byte register read at 400 kHz
+#define SENSOR_POLL_MS (100)     //!< LSM9DS1_IDLE_POLL_MS
+#define SENSOR_I2C_POLL_MS (1)   //!< LSM9DS1_I2C_POLL_MS
+
+typedef enum {
+    kSrcAccel,
+    kSrcGyro,
+    kSrcUart,
+    kSrcUsb,
+    kSrcI2c, //!< Not in traces, the sensor task's own transfers
+    kNumSrcs,
+} sim_src_t;
+
+static const char *gSrcNames[kNumSrcs] = {"xl", "g", "uart", "usb", "i2c"};
+
+//! Virtual CPU time each piece of firmware takes when it runs
+static const struct {
+    uint32_t publish_us;    //!< Normalizing and publishing a sensor sample
+    uint32_t heartbeat_us;  //!< Status read kick off and a couple of log lines
+    uint32_t flash_us;      //!< LED toggle
+    uint32_t button_us;     //!< Button debounce
+    uint32_t uart_byte_us;  //!< Pulling one byte out of the RX buffer
+    uint32_t usb_report_us; //!< Parsing and answering one report
+} gCosts = {
+    .publish_us = 40,
+    .heartbeat_us = 60,
+    .flash_us = 2,
+    .button_us = 5,
+    .uart_byte_us = 1,
+    .usb_report_us = 80,
+};
+
+typedef struct {
+    uint64_t at_us;
+    uint8_t src;
+} trace_rec_t;
+
+//! Growable list of latencies, for percentiles
+typedef struct {
+    uint32_t *vals;
+    uint32_t len;
+    uint32_t cap;
+} samples_t;
+
+typedef struct {
+    uint8_t event;          //!< Event ID the ISR posts
+    uint32_t irqs;          //!< Interrupts from the trace
+    uint32_t missed;        //!< Posts whose data was overwritten before it was handled
+    uint64_t first_post_us; //!< When the oldest unhandled post came in
+    samples_t dispatch;     //!< Oldest post -> handler running
+} src_stats_t;
+
+static schedule_t gSchedule;
+static events_t gEvents;
+static src_stats_t gSrcs[kNumSrcs];
+
+static trace_rec_t *gTrace;
+static uint32_t gTraceLen;
+static uint32_t gTracePos;
+
+// The sensor task, like the LSM9DS1 driver
+static struct {
+    uint8_t task_id;
+    pt_t pt;
+    uint32_t samples_waiting[2];
+    uint64_t drdy_us[2];
+    uint8_t read_stream;
+    bool i2c_busy;
+    samples_t e2e[2]; //!< DRDY -> sample published
+} gSensor;
+
+static struct {
+    uint32_t runs;
+    uint16_t max_slots;
+    uint16_t max_heap[kSchedulerNumPriorities];
+    uint64_t heap_sum[kSchedulerNumPriorities];
+} gOccupancy;
+
+/* --- Stats --- */
+
+static void samples_add(samples_t *samples, uint32_t val)
+{
+    if (samples->len == samples->cap) {
+        samples->cap = samples->cap ? samples->cap * 2 : 1024;
+        samples->vals = realloc(samples->vals, samples->cap * sizeof(samples->vals[0]));
+        if (samples->vals == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(2);
+        }
+    }
+    samples->vals[samples->len++] = val;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+//! Sorts the samples and returns the `pct` percentile (100 for the max)
+static uint32_t samples_pct(samples_t *samples, uint32_t pct)
+{
+    uint32_t i;
+    if (samples->len == 0) {
+        return 0;
+    }
+    qsort(samples->vals, samples->len, sizeof(samples->vals[0]), cmp_u32);
+    i = (uint32_t)(((uint64_t)samples->len * pct) / 100);
+    return samples->vals[(i >= samples->len) ? samples->len - 1 : i];
+}
+
+//! Called at the top of every handler: how long the oldest post waited, and how much was lost
+static void handled(sim_src_t src, uint16_t num_posts, uint16_t capacity)
+{
+    src_stats_t *stats = &gSrcs[src];
+    if (num_posts == 0) {
+        return;
+    }
+    samples_add(&stats->dispatch, (uint32_t)(vclock_now_us() - stats->first_post_us));
+    if (capacity != 0 && num_posts > capacity) {
+        stats->missed += num_posts - capacity;
+    }
+}
+
+static void post(sim_src_t src)
+{
+    src_stats_t *stats = &gSrcs[src];
+    if (gEvents.num_posts[stats->event] == 0) {
+        stats->first_post_us = vclock_now_us();
+    }
+    events_post(&gEvents, stats->event);
+}
+
+/* --- Firmware stand-ins --- */
+
+static bool sensor_nextSample(void)
+{
+    for (uint8_t stream = 0; stream < 2; stream++) {
+        if (gSensor.samples_waiting[stream] != 0) {
+            // the sensor only holds the latest sample, the rest were overwritten
+            gSrcs[stream].missed += gSensor.samples_waiting[stream] - 1;
+            gSensor.samples_waiting[stream] = 0;
+            gSensor.read_stream = stream;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void i2c_done_isr(void)
+{
+    gSensor.i2c_busy = false;
+    post(kSrcI2c);
+}
+
+static pt_state_t sensor_thread(pt_t *pt)
+{
+    PT_BEGIN(pt);
+    while (true) {
+        PT_WAIT_UNTIL(pt, sensor_nextSample(), SENSOR_POLL_MS);
+
+        gSensor.i2c_busy = true;
+        vclock_injectIrq(vclock_now_us() + SENSOR_I2C_READ_US, i2c_done_isr);
+        PT_WAIT_UNTIL(pt, !gSensor.i2c_busy, SENSOR_I2C_POLL_MS);
+
+        vclock_advance_us(gCosts.publish_us);
+        samples_add(&gSensor.e2e[gSensor.read_stream],
+                    (uint32_t)(vclock_now_us() - gSensor.drdy_us[gSensor.read_stream]));
+    }
+    PT_END(pt);
+}
+
+static ret_t sensor_task(int32_t *callback_time_ms)
+{
+    *callback_time_ms = pt_callbackTime(&gSensor.pt, sensor_thread(&gSensor.pt));
+    return RET_OK;
+}
+
+static ret_t drdy_handler(sim_src_t src, uint16_t num_posts)
+{
+    handled(src, num_posts, 0);
+    if (num_posts != 0) {
+        gSensor.samples_waiting[src] += num_posts;
+        scheduler_wake(&gSchedule, gSensor.task_id);
+    }
+    return RET_OK;
+}
+
+static ret_t accel_handler(uint16_t num_posts) { return drdy_handler(kSrcAccel, num_posts); }
+
+static ret_t gyro_handler(uint16_t num_posts) { return drdy_handler(kSrcGyro, num_posts); }
+
+static ret_t i2c_handler(uint16_t num_posts)
+{
+    handled(kSrcI2c, num_posts, 0);
+    return scheduler_wake(&gSchedule, gSensor.task_id);
+}
+
+static ret_t uart_handler(uint16_t num_posts)
+{
+    handled(kSrcUart, num_posts, UART_RX_CAPACITY);
+    vclock_advance_us((uint64_t)gCosts.uart_byte_us * num_posts);
+    return RET_OK;
+}
+
+static ret_t usb_handler(uint16_t num_posts)
+{
+    uint16_t reports = (num_posts > USB_RX_CAPACITY) ? USB_RX_CAPACITY : num_posts;
+    handled(kSrcUsb, num_posts, USB_RX_CAPACITY);
+    vclock_advance_us((uint64_t)gCosts.usb_report_us * reports);
+    return RET_OK;
+}
+
+static ret_t heartbeat(int32_t *callback_time_ms)
+{
+    vclock_advance_us(gCosts.heartbeat_us);
+    *callback_time_ms = 1000;
+    return RET_OK;
+}
+
+static ret_t workloop_flash(int32_t *callback_time_ms)
+{
+    vclock_advance_us(gCosts.flash_us);
+    *callback_time_ms = 250;
+    return RET_OK;
+}
+
+static ret_t button_handler(int32_t *callback_time_ms)
+{
+    vclock_advance_us(gCosts.button_us);
+    *callback_time_ms = 10;
+    return RET_OK;
+}
+
+static void service_events(void) { events_dispatch(&gEvents); }
+
+/* --- Traces --- */
+
+//! Plays back every trace record that is due, then queues itself up for the next one
+static void trace_isr(void)
+{
+    while (gTracePos < gTraceLen && gTrace[gTracePos].at_us <= vclock_now_us()) {
+        sim_src_t src = (sim_src_t)gTrace[gTracePos++].src;
+        gSrcs[src].irqs += 1;
+        if (src == kSrcAccel || src == kSrcGyro) {
+            gSensor.drdy_us[src] = vclock_now_us();
+        }
+        post(src);
+    }
+    if (gTracePos < gTraceLen) {
+        vclock_injectIrq(gTrace[gTracePos].at_us, trace_isr);
+    }
+}
+
+static void trace_add(uint64_t at_us, sim_src_t src)
+{
+    static uint32_t cap;
+    if (gTraceLen == cap) {
+        cap = cap ? cap * 2 : 4096;
+        gTrace = realloc(gTrace, cap * sizeof(gTrace[0]));
+        if (gTrace == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(2);
+        }
+    }
+    gTrace[gTraceLen].at_us = at_us;
+    gTrace[gTraceLen].src = (uint8_t)src;
+    gTraceLen += 1;
+}
+
+static int cmp_rec(const void *a, const void *b)
+{
+    const trace_rec_t *x = a, *y = b;
+    if (x->at_us != y->at_us) {
+        return (x->at_us > y->at_us) - (x->at_us < y->at_us);
+    }
+    return (int)x->src - (int)y->src;
+}
+
+static uint32_t gRand;
+
+//! Uniform jitter in [0, jitter_us], from a fixed seed so traces are reproducible
+static uint32_t jitter(uint32_t jitter_us)
+{
+    gRand = gRand * 1103515245u + 12345u;
+    return jitter_us ? (gRand >> 8) % (jitter_us + 1) : 0;
+}
+
+typedef struct {
+    uint32_t duration_ms;
+    uint32_t accel_hz;
+    uint32_t gyro_hz;
+    uint32_t uart_period_ms;
+    uint32_t uart_burst;
+    uint32_t usb_period_ms;
+    uint32_t jitter_us;
+    uint32_t seed;
+} trace_cfg_t;
+
+static void trace_generate(const trace_cfg_t *cfg)
+{
+    uint64_t end_us = (uint64_t)cfg->duration_ms * 1000;
+    gRand = cfg->seed;
+
+    // free running sensors: the ODR period plus a little jitter, which doesn't accumulate
+    for (uint32_t n = 1; cfg->accel_hz && n * 1000000ull / cfg->accel_hz < end_us; n++) {
+        trace_add(n * 1000000ull / cfg->accel_hz + jitter(cfg->jitter_us), kSrcAccel);
+    }
+    for (uint32_t n = 1; cfg->gyro_hz && n * 1000000ull / cfg->gyro_hz < end_us; n++) {
+        trace_add(n * 1000000ull / cfg->gyro_hz + jitter(cfg->jitter_us), kSrcGyro);
+    }
+    // bursts of back to back bytes
+    for (uint64_t t = cfg->uart_period_ms * 1000ull; cfg->uart_period_ms && t < end_us;
+         t += cfg->uart_period_ms * 1000ull) {
+        uint64_t start = t + jitter(cfg->jitter_us);
+        for (uint32_t i = 0; i < cfg->uart_burst; i++) {
+            trace_add(start + i * UART_BYTE_US, kSrcUart);
+        }
+    }
+    // the host polls on its own frame clock
+    for (uint64_t t = cfg->usb_period_ms * 1000ull; cfg->usb_period_ms && t < end_us;
+         t += cfg->usb_period_ms * 1000ull) {
+        trace_add(t, kSrcUsb);
+    }
+    qsort(gTrace, gTraceLen, sizeof(gTrace[0]), cmp_rec);
+}
+
+static bool trace_read(const char *path)
+{
+    char line[128], name[16];
+    unsigned long long at_us;
+    uint32_t lineno = 0;
+    uint64_t last_us = 0;
+    FILE *f = fopen(path, "r");
+
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char *comment = strchr(line, '#');
+        uint8_t src;
+        lineno += 1;
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        if (sscanf(line, "%llu %15s", &at_us, name) != 2) {
+            continue;
+        }
+        for (src = 0; src < kSrcI2c; src++) {
+            if (strcmp(name, gSrcNames[src]) == 0) {
+                break;
+            }
+        }
+        if (src == kSrcI2c || at_us < last_us) {
+            fprintf(stderr, "%s:%u: bad record (unknown source or out of order)\n", path, lineno);
+            fclose(f);
+            return false;
+        }
+        last_us = at_us;
+        trace_add(at_us, (sim_src_t)src);
+    }
+    fclose(f);
+    return true;
+}
+
+static bool trace_write(const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+    fprintf(f, "# time_us source\n");
+    for (uint32_t i = 0; i < gTraceLen; i++) {
+        fprintf(f, "%llu %s\n", (unsigned long long)gTrace[i].at_us, gSrcNames[gTrace[i].src]);
+    }
+    fclose(f);
+    return true;
+}
+
+/* --- The simulation --- */
+
+static void sample_occupancy(void)
+{
+    gOccupancy.runs += 1;
+    if (gSchedule.num_slots_used > gOccupancy.max_slots) {
+        gOccupancy.max_slots = gSchedule.num_slots_used;
+    }
+    for (uint8_t p = 0; p < kSchedulerNumPriorities; p++) {
+        gOccupancy.heap_sum[p] += gSchedule.heaps[p].len;
+        if (gSchedule.heaps[p].len > gOccupancy.max_heap[p]) {
+            gOccupancy.max_heap[p] = gSchedule.heaps[p].len;
+        }
+    }
+}
+
+static void sim_init(void)
+{
+    static const event_handler_t handlers[kNumSrcs] = {accel_handler, gyro_handler, uart_handler,
+                                                       usb_handler, i2c_handler};
+    uint8_t id;
+
+    vclock_reset();
+    events_init(&gEvents);
+    for (uint8_t src = 0; src < kNumSrcs; src++) {
+        events_register(&gEvents, handlers[src], &gSrcs[src].event);
+    }
+    idle_init(&gVclockIdlePort, &gEvents);
+
+    // same setup as pensel_v2.c
+    scheduler_init(&gSchedule);
+    scheduler_setBetweenCallbacksHook(&gSchedule, service_events);
+    PT_INIT(&gSensor.pt);
+    scheduler_addWithPriority(&gSchedule, kSchedulerPriorityHigh, 0, sensor_task,
+                              &gSensor.task_id);
+    scheduler_addWithPriority(&gSchedule, kSchedulerPriorityLow, 0, heartbeat, &id);
+    scheduler_addWithPriority(&gSchedule, kSchedulerPriorityLow, 0, workloop_flash, &id);
+    scheduler_add(&gSchedule, 0, button_handler, &id);
+
+    if (gTraceLen > 0) {
+        vclock_injectIrq(gTrace[0].at_us, trace_isr);
+    }
+}
+
+//! The pensel_v2.c main loop, until `end_us`
+static void sim_run(uint64_t end_us)
+{
+    while (vclock_now_us() < end_us) {
+        uint32_t now_us;
+        int32_t next_us;
+
+        events_dispatch(&gEvents);
+
+        now_us = vclock_time_us();
+        sample_occupancy();
+        next_us = scheduler_run(&gSchedule, now_us);
+        if (next_us > 0) {
+            idle_sleepUntil(now_us + next_us);
+        }
+    }
+}
+
+static void report(uint64_t duration_us, uint32_t *worst_p99_ptr, uint32_t *total_missed_ptr)
+{
+    idle_stats_t idle;
+    uint32_t worst_p99 = 0, total_missed = 0;
+
+    printf("\n%-8s %8s %8s   %-27s\n", "source", "irqs", "missed", "dispatch us p50/p99/max");
+    for (uint8_t src = 0; src < kNumSrcs; src++) {
+        src_stats_t *stats = &gSrcs[src];
+        uint32_t p99 = samples_pct(&stats->dispatch, 99);
+        printf("%-8s %8u %8u   %8u %8u %8u\n", gSrcNames[src],
+               src == kSrcI2c ? stats->dispatch.len : stats->irqs, stats->missed,
+               samples_pct(&stats->dispatch, 50), p99, samples_pct(&stats->dispatch, 100));
+        worst_p99 = (p99 > worst_p99) ? p99 : worst_p99;
+        total_missed += stats->missed;
+    }
+
+    printf("\n%-8s %8s   %-27s\n", "sensor", "samples", "DRDY -> published us p50/p99/max");
+    for (uint8_t stream = 0; stream < 2; stream++) {
+        samples_t *e2e = &gSensor.e2e[stream];
+        printf("%-8s %8u   %8u %8u %8u\n", gSrcNames[stream], e2e->len, samples_pct(e2e, 50),
+               samples_pct(e2e, 99), samples_pct(e2e, 100));
+    }
+
+    printf("\nscheduler: %u runs, at most %u / %u slots used\n", gOccupancy.runs,
+           gOccupancy.max_slots, SCHEDULER_NUM_SLOTS);
+    for (uint8_t p = 0; p < kSchedulerNumPriorities; p++) {
+        static const char *names[kSchedulerNumPriorities] = {"high", "normal", "low"};
+        printf("  %-6s heap: max %u, mean %.2f\n", names[p], gOccupancy.max_heap[p],
+               gOccupancy.runs ? (double)gOccupancy.heap_sum[p] / gOccupancy.runs : 0.0);
+    }
+
+    idle_getStats(&idle);
+    printf("cpu: %.1f %% busy over %llu ms, %u sleeps (%u woken early)\n",
+           100.0 * (double)(idle.total_us - idle.idle_us) / (double)(idle.total_us ? idle.total_us
+                                                                                  : 1),
+           (unsigned long long)(duration_us / 1000), idle.num_sleeps, idle.num_early_wakeups);
+
+    *worst_p99_ptr = worst_p99;
+    *total_missed_ptr = total_missed;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [-d ms] [-a hz] [-g hz] [-u ms] [-b bytes] [-U ms] [-j us] [-s seed]\n"
+           "          [-t trace] [-w trace] [-l us] [-m missed]\n",
+           prog);
+    printf("  -d  simulated time in ms (default %u)\n", DEFAULT_DURATION_MS);
+    printf("  -a  accel ODR in Hz, 0 for none (default %u)\n", DEFAULT_ACCEL_HZ);
+    printf("  -g  gyro ODR in Hz, 0 for none (default %u)\n", DEFAULT_GYRO_HZ);
+    printf("  -u  ms between UART RX bursts, 0 for none (default %u)\n", DEFAULT_UART_PERIOD_MS);
+    printf("  -b  bytes per UART RX burst (default %u)\n", DEFAULT_UART_BURST);
+    printf("  -U  ms between USB reports, 0 for none (default %u)\n", DEFAULT_USB_PERIOD_MS);
+    printf("  -j  max interrupt jitter in us (default %u)\n", DEFAULT_JITTER_US);
+    printf("  -s  jitter seed (default 1)\n");
+    printf("  -t  replay a trace file instead of generating one\n");
+    printf("  -w  write the trace to a file\n");
+    printf("  -l  fail if any source's p99 dispatch latency is over this many us\n");
+    printf("  -m  fail if more than this many interrupts' data was lost\n");
+}
+
+int main(int argc, char *argv[])
+{
+    trace_cfg_t cfg = {
+        .duration_ms = DEFAULT_DURATION_MS,
+        .accel_hz = DEFAULT_ACCEL_HZ,
+        .gyro_hz = DEFAULT_GYRO_HZ,
+        .uart_period_ms = DEFAULT_UART_PERIOD_MS,
+        .uart_burst = DEFAULT_UART_BURST,
+        .usb_period_ms = DEFAULT_USB_PERIOD_MS,
+        .jitter_us = DEFAULT_JITTER_US,
+        .seed = 1,
+    };
+    const char *read_path = NULL, *write_path = NULL;
+    int64_t max_p99_us = -1, max_missed = -1;
+    uint32_t worst_p99, total_missed;
+    uint64_t duration_us;
+    bool ok = true;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:a:g:u:b:U:j:s:t:w:l:m:h")) != -1) {
+        switch (opt) {
+            case 'd':
+                cfg.duration_ms = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'a':
+                cfg.accel_hz = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'g':
+                cfg.gyro_hz = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'u':
+                cfg.uart_period_ms = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'b':
+                cfg.uart_burst = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'U':
+                cfg.usb_period_ms = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'j':
+                cfg.jitter_us = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                cfg.seed = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 't':
+                read_path = optarg;
+                break;
+            case 'w':
+                write_path = optarg;
+                break;
+            case 'l':
+                max_p99_us = strtoll(optarg, NULL, 0);
+                break;
+            case 'm':
+                max_missed = strtoll(optarg, NULL, 0);
+                break;
+            default:
+                usage(argv[0]);
+                return (opt == 'h') ? 0 : 2;
+        }
+    }
+
+    if (read_path != NULL) {
+        if (!trace_read(read_path)) {
+            return 2;
+        }
+        // run until the trace is done, plus a bit to drain
+        duration_us = (gTraceLen ? gTrace[gTraceLen - 1].at_us : 0) + 10000;
+        printf("Replaying %u interrupts from %s\n", gTraceLen, read_path);
+    } else {
+        trace_generate(&cfg);
+        duration_us = (uint64_t)cfg.duration_ms * 1000;
+        printf("%u ms: accel %u Hz, gyro %u Hz, %u UART bytes every %u ms, USB every %u ms, "
+               "%u us jitter\n",
+               cfg.duration_ms, cfg.accel_hz, cfg.gyro_hz, cfg.uart_burst, cfg.uart_period_ms,
+               cfg.usb_period_ms, cfg.jitter_us);
+    }
+    if (write_path != NULL && !trace_write(write_path)) {
+        return 2;
+    }
+
+    sim_init();
+    sim_run(duration_us);
+    report(duration_us, &worst_p99, &total_missed);
+
+    if (max_p99_us >= 0 && worst_p99 > max_p99_us) {
+        printf("FAIL: p99 dispatch latency %u us is over %lld us\n", worst_p99,
+               (long long)max_p99_us);
+        ok = false;
+    }
+    if (max_missed >= 0 && total_missed > max_missed) {
+        printf("FAIL: %u interrupts lost, allowed %lld\n", total_missed, (long long)max_missed);
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}
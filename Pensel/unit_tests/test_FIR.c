@@ -1,7 +1,7 @@
 #include "unity.h"
 #include <stdio.h>
-#include "../firmware/include/FIR.h"
-#include "../firmware/include/FIR_coefficients.h"
+#include "FIR.h"
+#include "FIR_coefficients.h"
 
 #define QUEUE_SIZE (20)
 
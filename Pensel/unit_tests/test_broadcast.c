@@ -0,0 +1,239 @@
+#include "unity.h"
+#include <stdio.h>
+#include "broadcast.h"
+
+#define RING_SIZE (8)
+
+broadcast_t ring;
+uint32_t ring_buffer[RING_SIZE];
+
+
+void setup_ring(void)
+{
+    broadcast_init(&ring, ring_buffer, RING_SIZE, sizeof(uint32_t));
+}
+
+
+void push_values(uint32_t start, uint32_t count)
+{
+    for (uint32_t i = start; i < start + count; i++) {
+        broadcast_push(&ring, &i);
+    }
+}
+
+
+void test_basicSetGet(void)
+{
+    uint8_t reader;
+    const uint32_t *val_ptr = NULL;
+    uint32_t val = 42;
+    setup_ring();
+    broadcast_subscribe(&ring, &reader);
+    broadcast_push(&ring, &val);
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, broadcast_peek(&ring, reader, (const void **)&val_ptr));
+    // do some output if we've defined verbose output
+    #ifdef VERBOSE_OUTPUT
+        printf("\nFunction: %s\n", __func__);
+        printf("\tPut %d onto ring\n", 42);
+        printf("\tGot %d back\n", *val_ptr);
+        printf("\n");
+    #endif
+
+    TEST_ASSERT_EQUAL_HEX32(42, *val_ptr);
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, broadcast_release(&ring, reader));
+    TEST_ASSERT_EQUAL_HEX8(RET_NODATA_ERR, broadcast_peek(&ring, reader, (const void **)&val_ptr));
+}
+
+
+void test_readsInPlace(void)
+{
+    uint8_t reader;
+    const void *item_ptr = NULL;
+    setup_ring();
+    broadcast_subscribe(&ring, &reader);
+    push_values(0, 3);
+    broadcast_peek(&ring, reader, &item_ptr);
+
+    TEST_ASSERT_TRUE(item_ptr == (const void *)&ring_buffer[0]);
+}
+
+
+void test_claimPublish(void)
+{
+    uint8_t reader;
+    const uint32_t *val_ptr = NULL;
+    setup_ring();
+    broadcast_subscribe(&ring, &reader);
+    uint32_t *slot_ptr = broadcast_claim(&ring);
+    *slot_ptr = 1234;
+    // not visible until published
+    TEST_ASSERT_EQUAL_HEX8(RET_NODATA_ERR, broadcast_peek(&ring, reader, (const void **)&val_ptr));
+    broadcast_publish(&ring);
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, broadcast_peek(&ring, reader, (const void **)&val_ptr));
+    TEST_ASSERT_EQUAL_HEX32(1234, *val_ptr);
+}
+
+
+void test_allReadersSeeAllItems(void)
+{
+    uint8_t reader_a, reader_b;
+    const uint32_t *val_ptr;
+    uint32_t count_a = 0, count_b = 0;
+    setup_ring();
+    broadcast_subscribe(&ring, &reader_a);
+    broadcast_subscribe(&ring, &reader_b);
+    push_values(100, RING_SIZE);
+
+    while (broadcast_peek(&ring, reader_a, (const void **)&val_ptr) == RET_OK) {
+        TEST_ASSERT_EQUAL_HEX32(100 + count_a, *val_ptr);
+        broadcast_release(&ring, reader_a);
+        count_a++;
+    }
+    while (broadcast_peek(&ring, reader_b, (const void **)&val_ptr) == RET_OK) {
+        TEST_ASSERT_EQUAL_HEX32(100 + count_b, *val_ptr);
+        broadcast_release(&ring, reader_b);
+        count_b++;
+    }
+    // do some output if we've defined verbose output
+    #ifdef VERBOSE_OUTPUT
+        printf("\nFunction: %s\n", __func__);
+        printf("\t%d values onto ring\n", RING_SIZE);
+        printf("\treader a got %d, reader b got %d\n", count_a, count_b);
+        printf("\n");
+    #endif
+
+    TEST_ASSERT_EQUAL_HEX32(RING_SIZE, count_a);
+    TEST_ASSERT_EQUAL_HEX32(RING_SIZE, count_b);
+}
+
+
+void test_lagIsPerReader(void)
+{
+    uint8_t reader_a, reader_b;
+    const void *item_ptr;
+    setup_ring();
+    broadcast_subscribe(&ring, &reader_a);
+    broadcast_subscribe(&ring, &reader_b);
+    push_values(0, 5);
+    broadcast_peek(&ring, reader_a, &item_ptr);
+    broadcast_release(&ring, reader_a);
+    broadcast_peek(&ring, reader_a, &item_ptr);
+    broadcast_release(&ring, reader_a);
+
+    TEST_ASSERT_EQUAL_HEX32(3, broadcast_lag(&ring, reader_a));
+    TEST_ASSERT_EQUAL_HEX32(5, broadcast_lag(&ring, reader_b));
+}
+
+
+void test_lateSubscriberOnlySeesNewItems(void)
+{
+    uint8_t reader;
+    const uint32_t *val_ptr;
+    setup_ring();
+    push_values(0, 3);
+    broadcast_subscribe(&ring, &reader);
+    TEST_ASSERT_EQUAL_HEX8(RET_NODATA_ERR, broadcast_peek(&ring, reader, (const void **)&val_ptr));
+    push_values(7, 1);
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, broadcast_peek(&ring, reader, (const void **)&val_ptr));
+    TEST_ASSERT_EQUAL_HEX32(7, *val_ptr);
+}
+
+
+void test_overrunSkipsToOldest(void)
+{
+    uint8_t slow_reader, fast_reader;
+    const uint32_t *val_ptr;
+    setup_ring();
+    broadcast_subscribe(&ring, &slow_reader);
+    broadcast_subscribe(&ring, &fast_reader);
+    push_values(0, RING_SIZE + 3);
+    broadcast_peek(&ring, slow_reader, (const void **)&val_ptr);
+    // do some output if we've defined verbose output
+    #ifdef VERBOSE_OUTPUT
+        printf("\nFunction: %s\n", __func__);
+        printf("\t%d + 3 values onto ring of size %d\n", RING_SIZE, RING_SIZE);
+        printf("\t%d overruns, oldest value == %d\n", broadcast_overruns(&ring, slow_reader),
+               *val_ptr);
+        printf("\n");
+    #endif
+
+    // only the reader that fell behind pays for it
+    TEST_ASSERT_EQUAL_HEX32(3, *val_ptr);
+    TEST_ASSERT_EQUAL_HEX32(3, broadcast_overruns(&ring, slow_reader));
+    TEST_ASSERT_EQUAL_HEX32(0, broadcast_overruns(&ring, fast_reader));
+    TEST_ASSERT_EQUAL_HEX32(RING_SIZE, broadcast_lag(&ring, slow_reader));
+}
+
+
+void test_releaseDetectsLappedItem(void)
+{
+    uint8_t reader;
+    const uint32_t *val_ptr;
+    setup_ring();
+    broadcast_subscribe(&ring, &reader);
+    push_values(0, 1);
+    broadcast_peek(&ring, reader, (const void **)&val_ptr);
+    // writer wraps all the way around onto the item we're holding
+    push_values(1, RING_SIZE);
+
+    TEST_ASSERT_EQUAL_HEX8(RET_VAL_ERR, broadcast_release(&ring, reader));
+    TEST_ASSERT_EQUAL_HEX32(1, broadcast_overruns(&ring, reader));
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, broadcast_peek(&ring, reader, (const void **)&val_ptr));
+    TEST_ASSERT_EQUAL_HEX32(1, *val_ptr);
+}
+
+
+void test_subscribeRunsOutOfReaders(void)
+{
+    uint8_t reader;
+    setup_ring();
+    for (uint8_t i = 0; i < BROADCAST_MAX_READERS; i++) {
+        TEST_ASSERT_EQUAL_HEX8(RET_OK, broadcast_subscribe(&ring, &reader));
+    }
+    TEST_ASSERT_EQUAL_HEX8(RET_NOMEM_ERR, broadcast_subscribe(&ring, &reader));
+    broadcast_unsubscribe(&ring, 1);
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, broadcast_subscribe(&ring, &reader));
+    TEST_ASSERT_EQUAL_HEX8(1, reader);
+}
+
+
+void test_sequenceWrap(void)
+{
+    uint8_t reader;
+    const uint32_t *val_ptr;
+    setup_ring();
+    ring.claim_seq = 0xFFFFFFFE;
+    ring.commit_seq = 0xFFFFFFFE;
+    broadcast_subscribe(&ring, &reader);
+    push_values(0, 4);
+
+    TEST_ASSERT_EQUAL_HEX32(4, broadcast_lag(&ring, reader));
+    for (uint32_t i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL_HEX8(RET_OK, broadcast_peek(&ring, reader, (const void **)&val_ptr));
+        TEST_ASSERT_EQUAL_HEX32(i, *val_ptr);
+        TEST_ASSERT_EQUAL_HEX8(RET_OK, broadcast_release(&ring, reader));
+    }
+    TEST_ASSERT_EQUAL_HEX32(0, broadcast_overruns(&ring, reader));
+}
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_basicSetGet);
+    RUN_TEST(test_readsInPlace);
+    RUN_TEST(test_claimPublish);
+
+    RUN_TEST(test_allReadersSeeAllItems);
+    RUN_TEST(test_lagIsPerReader);
+    RUN_TEST(test_lateSubscriberOnlySeesNewItems);
+
+    RUN_TEST(test_overrunSkipsToOldest);
+    RUN_TEST(test_releaseDetectsLappedItem);
+
+    RUN_TEST(test_subscribeRunsOutOfReaders);
+    RUN_TEST(test_sequenceWrap);
+
+    return UNITY_END();
+}
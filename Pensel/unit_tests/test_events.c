@@ -0,0 +1,203 @@
+#include "unity.h"
+#include <stdio.h>
+#include "events.h"
+
+events_t events;
+
+// Log of which handlers ran, in order
+char run_log[64];
+uint8_t run_log_len;
+
+uint8_t id_a, id_b, id_c;
+uint8_t repost_count;
+uint16_t last_num_posts;
+
+
+void reset(void)
+{
+    events_init(&events);
+    run_log_len = 0;
+    run_log[0] = '\0';
+    repost_count = 0;
+    last_num_posts = 0;
+}
+
+void log_run(char name)
+{
+    if (run_log_len < sizeof(run_log) - 1) {
+        run_log[run_log_len++] = name;
+        run_log[run_log_len] = '\0';
+    }
+}
+
+ret_t handler_a(uint16_t num_posts)
+{
+    log_run('a');
+    last_num_posts = num_posts;
+    return RET_OK;
+}
+
+ret_t handler_b(uint16_t num_posts)
+{
+    log_run('b');
+    return RET_OK;
+}
+
+ret_t handler_c(uint16_t num_posts)
+{
+    log_run('c');
+    return RET_GEN_ERR;
+}
+
+ret_t handler_reposts(uint16_t num_posts)
+{
+    // like an ISR firing while the handler runs
+    log_run('r');
+    if (repost_count < 2) {
+        repost_count += 1;
+        events_post(&events, id_a);
+    }
+    return RET_OK;
+}
+
+void register_abc(void)
+{
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, events_register(&events, handler_a, &id_a));
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, events_register(&events, handler_b, &id_b));
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, events_register(&events, handler_c, &id_c));
+}
+
+
+void test_nothingPendingRunsNothing(void)
+{
+    reset();
+    register_abc();
+    TEST_ASSERT_FALSE(events_pending(&events));
+    TEST_ASSERT_EQUAL_UINT8(0, events_dispatch(&events));
+    TEST_ASSERT_EQUAL_STRING("", run_log);
+}
+
+void test_postRunsHandlerOnce(void)
+{
+    reset();
+    register_abc();
+    TEST_ASSERT_FALSE(events_post(&events, id_b));
+    TEST_ASSERT_TRUE(events_pending(&events));
+    TEST_ASSERT_EQUAL_UINT8(1, events_dispatch(&events));
+    TEST_ASSERT_EQUAL_STRING("b", run_log);
+
+    // consumed
+    TEST_ASSERT_FALSE(events_pending(&events));
+    TEST_ASSERT_EQUAL_UINT8(0, events_dispatch(&events));
+    TEST_ASSERT_EQUAL_STRING("b", run_log);
+}
+
+void test_repeatedPostsCoalesce(void)
+{
+    reset();
+    register_abc();
+    TEST_ASSERT_FALSE(events_post(&events, id_a));
+    TEST_ASSERT_TRUE(events_post(&events, id_a));
+    TEST_ASSERT_TRUE(events_post(&events, id_a));
+    events_dispatch(&events);
+    TEST_ASSERT_EQUAL_STRING("a", run_log);
+    TEST_ASSERT_EQUAL_UINT16(3, last_num_posts);
+
+    // once dispatched, the next post is a fresh one
+    TEST_ASSERT_FALSE(events_post(&events, id_a));
+    events_dispatch(&events);
+    TEST_ASSERT_EQUAL_UINT16(1, last_num_posts);
+}
+
+void test_dispatchesInIdOrder(void)
+{
+    reset();
+    register_abc();
+    events_post(&events, id_c);
+    events_post(&events, id_a);
+    events_post(&events, id_b);
+    TEST_ASSERT_EQUAL_UINT8(3, events_dispatch(&events));
+    TEST_ASSERT_EQUAL_STRING("abc", run_log);
+}
+
+void test_postDuringDispatchRunsNextTime(void)
+{
+    uint8_t id_r;
+    reset();
+    register_abc();
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, events_register(&events, handler_reposts, &id_r));
+
+    // a is posted after its bit was already taken, so it has to wait for the next dispatch
+    events_post(&events, id_r);
+    events_dispatch(&events);
+    TEST_ASSERT_EQUAL_STRING("r", run_log);
+    TEST_ASSERT_TRUE(events_pending(&events));
+    events_dispatch(&events);
+    TEST_ASSERT_EQUAL_STRING("ra", run_log);
+    TEST_ASSERT_EQUAL_UINT16(1, last_num_posts);
+}
+
+void test_postRacingDispatchCountsOnce(void)
+{
+    reset();
+    register_abc();
+
+    // An ISR posting after dispatch took the bit but before it took the count. The handler sees
+    // the post in its count, and the bit the ISR set again runs it once more with nothing new.
+    events_post(&events, id_a);
+    events.pending = 0; // dispatch takes the bit
+    events_post(&events, id_a);
+    TEST_ASSERT_EQUAL_UINT8(1, events_dispatch(&events));
+    TEST_ASSERT_EQUAL_UINT16(2, last_num_posts);
+    events.pending = 1UL << id_a; // the bit the ISR set
+    events_dispatch(&events);
+    TEST_ASSERT_EQUAL_STRING("aa", run_log);
+    TEST_ASSERT_EQUAL_UINT16(0, last_num_posts);
+}
+
+void test_handlerErrorsCounted(void)
+{
+    reset();
+    register_abc();
+    events_post(&events, id_c);
+    events_post(&events, id_a);
+    events_dispatch(&events);
+    events_post(&events, id_c);
+    events_dispatch(&events);
+    TEST_ASSERT_EQUAL_STRING("acc", run_log);
+    TEST_ASSERT_EQUAL_UINT32(2, events.handler_errors);
+}
+
+void test_registerLimits(void)
+{
+    uint8_t id;
+    reset();
+    TEST_ASSERT_EQUAL_HEX8(RET_INVALID_ARGS_ERR, events_register(&events, NULL, &id));
+    for (uint8_t i = 0; i < EVENTS_MAX; i++) {
+        TEST_ASSERT_EQUAL_HEX8(RET_OK, events_register(&events, handler_a, &id));
+        TEST_ASSERT_EQUAL_UINT8(i, id);
+    }
+    TEST_ASSERT_EQUAL_HEX8(RET_NOMEM_ERR, events_register(&events, handler_b, &id));
+
+    // the top event ID works like any other
+    events_post(&events, EVENTS_MAX - 1);
+    TEST_ASSERT_EQUAL_UINT8(1, events_dispatch(&events));
+    TEST_ASSERT_EQUAL_STRING("a", run_log);
+}
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_nothingPendingRunsNothing);
+    RUN_TEST(test_postRunsHandlerOnce);
+    RUN_TEST(test_repeatedPostsCoalesce);
+    RUN_TEST(test_dispatchesInIdOrder);
+    RUN_TEST(test_postDuringDispatchRunsNextTime);
+    RUN_TEST(test_postRacingDispatchCountsOnce);
+    RUN_TEST(test_handlerErrorsCounted);
+    RUN_TEST(test_registerLimits);
+
+    return UNITY_END();
+}
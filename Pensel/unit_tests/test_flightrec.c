@@ -0,0 +1,198 @@
+#include "unity.h"
+#include <stdio.h>
+#include <string.h>
+#include "flightrec.h"
+
+uint32_t fake_time_ms;
+
+uint32_t get_time(void) { return fake_time_ms; }
+
+// Power on: RAM comes up as garbage
+void power_on(void)
+{
+    memset(&gFlightrec, 0xA5, sizeof(gFlightrec));
+    flightrec_init(get_time, 0, false);
+}
+
+void reboot(bool watchdog_reset) { flightrec_init(get_time, 0x1234, watchdog_reset); }
+
+flightrec_summary_t summary(void)
+{
+    flightrec_summary_t summary;
+    flightrec_getSummary(&summary);
+    return summary;
+}
+
+flightrec_entry_t entry(uint8_t index)
+{
+    flightrec_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, flightrec_getEntry(index, &entry));
+    return entry;
+}
+
+
+void test_powerOnStartsClean(void)
+{
+    power_on();
+    TEST_ASSERT_EQUAL_UINT32(1, summary().boots);
+    TEST_ASSERT_EQUAL_UINT8(0, summary().crashed);
+    TEST_ASSERT_EQUAL_UINT8(1, summary().num_entries);
+    TEST_ASSERT_EQUAL_UINT8(kFlightrecBoot, entry(0).type);
+    TEST_ASSERT_FALSE(flightrec_hasCrash());
+}
+
+
+void test_survivesReset(void)
+{
+    power_on();
+    fake_time_ms = 50;
+    flightrec_record(kFlightrecLogWarning, 12, 34);
+    reboot(false);
+
+    TEST_ASSERT_EQUAL_UINT32(2, summary().boots);
+    TEST_ASSERT_EQUAL_HEX32(0x1234, summary().reset_flags);
+    TEST_ASSERT_EQUAL_UINT8(3, summary().num_entries);
+    TEST_ASSERT_EQUAL_UINT8(kFlightrecBoot, entry(0).type);
+    TEST_ASSERT_EQUAL_UINT8(kFlightrecLogWarning, entry(1).type);
+    TEST_ASSERT_EQUAL_UINT16(12, entry(1).code);
+    TEST_ASSERT_EQUAL_UINT32(34, entry(1).arg);
+    TEST_ASSERT_EQUAL_UINT32(50, entry(1).timestamp_ms);
+    TEST_ASSERT_EQUAL_UINT8(kFlightrecBoot, entry(2).type);
+    TEST_ASSERT_EQUAL_UINT16(2, entry(2).code);
+    TEST_ASSERT_EQUAL_UINT32(entry(1).seq + 1, entry(2).seq);
+}
+
+
+void test_wrapKeepsNewest(void)
+{
+    flightrec_entry_t unused;
+    power_on();
+    for (uint32_t i = 0; i < FLIGHTREC_LEN + 5; i++) {
+        flightrec_record(kFlightrecLogError, 0, i);
+    }
+    TEST_ASSERT_EQUAL_UINT8(FLIGHTREC_LEN, summary().num_entries);
+    for (uint8_t i = 0; i < FLIGHTREC_LEN; i++) {
+        TEST_ASSERT_EQUAL_UINT32(5 + i, entry(i).arg);
+    }
+    TEST_ASSERT_EQUAL_HEX8(RET_NODATA_ERR, flightrec_getEntry(FLIGHTREC_LEN, &unused));
+
+    // and picks up where it left off after a reset
+    reboot(false);
+    TEST_ASSERT_EQUAL_UINT32(entry(FLIGHTREC_LEN - 2).seq + 1, entry(FLIGHTREC_LEN - 1).seq);
+    TEST_ASSERT_EQUAL_UINT8(kFlightrecBoot, entry(FLIGHTREC_LEN - 1).type);
+}
+
+
+void test_tasksAndErrorsRecorded(void)
+{
+    power_on();
+    flightrec_taskTrace(2, false, RET_OK);
+    TEST_ASSERT_EQUAL_UINT16(2, gFlightrec.task);
+    flightrec_taskTrace(2, true, RET_OK);
+    TEST_ASSERT_EQUAL_UINT16(FLIGHTREC_NO_TASK, gFlightrec.task);
+    flightrec_taskTrace(3, false, RET_OK);
+    flightrec_taskTrace(3, true, RET_BUSY_ERR);
+    flightrec_log(kLogLevelInfo, 7, 0);
+    flightrec_log(kLogLevelError, 8, 9);
+
+    TEST_ASSERT_EQUAL_UINT8(3, summary().num_entries);
+    TEST_ASSERT_EQUAL_UINT8(kFlightrecTaskError, entry(1).type);
+    TEST_ASSERT_EQUAL_UINT16(3, entry(1).code);
+    TEST_ASSERT_EQUAL_UINT32(RET_BUSY_ERR, entry(1).arg);
+    TEST_ASSERT_EQUAL_UINT8(kFlightrecLogError, entry(2).type);
+    TEST_ASSERT_EQUAL_UINT16(8, entry(2).code);
+}
+
+
+void test_watchdogResetHoldsRunningTask(void)
+{
+    power_on();
+    flightrec_taskTrace(5, false, RET_OK);
+    // stalls in task 5...
+    reboot(true);
+
+    TEST_ASSERT_TRUE(flightrec_hasCrash());
+    TEST_ASSERT_EQUAL_UINT16(5, summary().crash_task);
+    // nothing new goes in until it's read out, not even the boot
+    TEST_ASSERT_EQUAL_UINT8(1, summary().num_entries);
+    flightrec_record(kFlightrecLogError, 1, 1);
+    TEST_ASSERT_EQUAL_UINT8(1, summary().num_entries);
+
+    flightrec_clear();
+    TEST_ASSERT_FALSE(flightrec_hasCrash());
+    TEST_ASSERT_EQUAL_UINT16(FLIGHTREC_NO_TASK, summary().crash_task);
+    flightrec_record(kFlightrecLogError, 1, 1);
+    TEST_ASSERT_EQUAL_UINT8(2, summary().num_entries);
+}
+
+
+void test_crashKeepsTheFirst(void)
+{
+    flightrec_fault_t fault = {.cfsr = 0x100, .pc = 0x08001234};
+    flightrec_fault_t other = {.pc = 0x08005678};
+    power_on();
+    flightrec_taskTrace(1, false, RET_OK);
+    flightrec_crash(kFlightrecFault, 3, fault.pc, &fault);
+    flightrec_crash(kFlightrecFatal, 1, 99, &other);
+    // the watchdog gets us out of the fault handler
+    reboot(true);
+
+    TEST_ASSERT_TRUE(flightrec_hasCrash());
+    TEST_ASSERT_EQUAL_UINT16(1, summary().crash_task);
+    TEST_ASSERT_EQUAL_HEX32(0x100, summary().fault.cfsr);
+    TEST_ASSERT_EQUAL_HEX32(0x08001234, summary().fault.pc);
+    TEST_ASSERT_EQUAL_UINT8(2, summary().num_entries);
+    TEST_ASSERT_EQUAL_UINT8(kFlightrecFault, entry(1).type);
+    TEST_ASSERT_EQUAL_UINT16(3, entry(1).code);
+}
+
+
+void test_corruptEntryDropped(void)
+{
+    power_on();
+    flightrec_record(kFlightrecLogError, 1, 10);
+    flightrec_record(kFlightrecLogError, 2, 20);
+    flightrec_record(kFlightrecLogError, 3, 30);
+    // reset in the middle of writing the newest one
+    gFlightrec.entries[3].checksum += 1;
+    reboot(false);
+
+    TEST_ASSERT_EQUAL_UINT8(4, summary().num_entries);
+    TEST_ASSERT_EQUAL_UINT32(10, entry(1).arg);
+    TEST_ASSERT_EQUAL_UINT32(20, entry(2).arg);
+    // the boot goes where the broken one was
+    TEST_ASSERT_EQUAL_UINT8(kFlightrecBoot, entry(3).type);
+    TEST_ASSERT_EQUAL_UINT32(3, entry(3).seq);
+}
+
+
+void test_corruptSummaryStartsOver(void)
+{
+    power_on();
+    flightrec_record(kFlightrecLogError, 1, 10);
+    reboot(false);
+    TEST_ASSERT_EQUAL_UINT32(2, summary().boots);
+
+    gFlightrec.summary.boots += 1;
+    reboot(false);
+    TEST_ASSERT_EQUAL_UINT32(1, summary().boots);
+    TEST_ASSERT_EQUAL_UINT8(1, summary().num_entries);
+}
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_powerOnStartsClean);
+    RUN_TEST(test_survivesReset);
+    RUN_TEST(test_wrapKeepsNewest);
+    RUN_TEST(test_tasksAndErrorsRecorded);
+    RUN_TEST(test_watchdogResetHoldsRunningTask);
+    RUN_TEST(test_crashKeepsTheFirst);
+    RUN_TEST(test_corruptEntryDropped);
+    RUN_TEST(test_corruptSummaryStartsOver);
+
+    return UNITY_END();
+}
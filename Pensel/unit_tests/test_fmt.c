@@ -0,0 +1,93 @@
+#include "unity.h"
+#include <stdio.h>
+#include <string.h>
+#include "fmt.h"
+
+char buf[32];
+
+void test_hex(void)
+{
+    TEST_ASSERT_EQUAL_UINT32(4, fmt_hex(0, buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL_STRING("0x00", buf);
+    fmt_hex(0x1F, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_STRING("0x1F", buf);
+    // zero bytes in the middle (and the top byte) are still there
+    fmt_hex(0x10000, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_STRING("0x010000", buf);
+    fmt_hex(0x7F00000000000001, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_STRING("0x7F00000000000001", buf);
+    fmt_hex(-0xAB, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_STRING("-0xAB", buf);
+    TEST_ASSERT_EQUAL_UINT32(FMT_HEX_MAX - 1, fmt_hex(INT64_MIN, buf, FMT_HEX_MAX));
+    TEST_ASSERT_EQUAL_STRING("-0x8000000000000000", buf);
+}
+
+
+void test_int(void)
+{
+    TEST_ASSERT_EQUAL_UINT32(1, fmt_int(0, buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL_STRING("0", buf);
+    fmt_int(1234567, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_STRING("1234567", buf);
+    fmt_int(-42, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_STRING("-42", buf);
+    TEST_ASSERT_EQUAL_UINT32(FMT_INT_MAX - 1, fmt_int(INT64_MIN, buf, FMT_INT_MAX));
+    TEST_ASSERT_EQUAL_STRING("-9223372036854775808", buf);
+}
+
+
+void test_float(void)
+{
+    fmt_float(3.14159f, 3, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_STRING("3.142", buf);
+    // the fraction keeps its leading zeros
+    fmt_float(1.05f, 2, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_STRING("1.05", buf);
+    // and small negative numbers their sign
+    fmt_float(-0.25f, 2, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_STRING("-0.25", buf);
+    fmt_float(9.996f, 2, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_STRING("10.00", buf);
+    fmt_float(-0.001f, 2, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_STRING("0.00", buf);
+    fmt_float(12.7f, 0, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_STRING("13", buf);
+    TEST_ASSERT_TRUE(fmt_float(-4294967040.0f, FMT_FLOAT_MAX_PRECISION, buf, FMT_FLOAT_MAX) != 0);
+}
+
+
+void test_floatOutOfRange(void)
+{
+    TEST_ASSERT_EQUAL_UINT32(0, fmt_float(5e9f, 2, buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL_STRING("", buf);
+    TEST_ASSERT_EQUAL_UINT32(0, fmt_float(0.0f / 0.0f, 2, buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL_UINT32(0, fmt_float(1.0f, FMT_FLOAT_MAX_PRECISION + 1, buf, sizeof(buf)));
+}
+
+
+void test_tooSmallBuffer(void)
+{
+    memset(buf, 'x', sizeof(buf));
+    // room for "1234" but not the null
+    TEST_ASSERT_EQUAL_UINT32(0, fmt_int(1234, buf, 4));
+    TEST_ASSERT_EQUAL_STRING("", buf);
+    TEST_ASSERT_EQUAL_UINT32(4, fmt_int(1234, buf, 5));
+    TEST_ASSERT_EQUAL_UINT32(0, fmt_hex(-1, buf, 5));
+    TEST_ASSERT_EQUAL_UINT32(0, fmt_float(1.5f, 1, buf, 3));
+    TEST_ASSERT_EQUAL_UINT32(3, fmt_float(1.5f, 1, buf, 4));
+    TEST_ASSERT_EQUAL_STRING("1.5", buf);
+}
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_hex);
+    RUN_TEST(test_int);
+    RUN_TEST(test_float);
+    RUN_TEST(test_floatOutOfRange);
+    RUN_TEST(test_tooSmallBuffer);
+
+    return UNITY_END();
+}
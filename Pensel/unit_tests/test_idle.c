@@ -0,0 +1,213 @@
+#include "unity.h"
+#include <stdio.h>
+#include "events.h"
+#include "idle.h"
+#include "scheduler.h"
+#include "virtual_clock.h"
+
+events_t events;
+uint8_t drdy_event;
+uint32_t drdy_handled;
+uint32_t drdy_handled_at_us;
+uint32_t other_irqs;
+
+
+ret_t drdy_handler(uint16_t num_posts)
+{
+    drdy_handled += 1;
+    drdy_handled_at_us = (uint32_t)vclock_now_us();
+    return RET_OK;
+}
+
+// An ISR that defers work to main, like the LSM9DS1 DRDY ISRs
+void drdy_isr(void)
+{
+    events_post(&events, drdy_event);
+}
+
+// An ISR that handles everything itself, like USB
+void other_isr(void)
+{
+    other_irqs += 1;
+}
+
+void reset(void)
+{
+    vclock_reset();
+    events_init(&events);
+    events_register(&events, drdy_handler, &drdy_event);
+    drdy_handled = 0;
+    other_irqs = 0;
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, idle_init(&gVclockIdlePort, &events));
+}
+
+
+void test_sleepsUntilDeadline(void)
+{
+    idle_stats_t stats;
+    reset();
+    idle_sleepUntil(10000);
+    TEST_ASSERT_EQUAL_UINT32(10, vclock_now_ms());
+
+    idle_getStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(10000, (uint32_t)stats.idle_us);
+    TEST_ASSERT_EQUAL_UINT32(10000, (uint32_t)stats.total_us);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.num_sleeps);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.num_early_wakeups);
+}
+
+void test_pastDeadlineDoesNotSleep(void)
+{
+    idle_stats_t stats;
+    reset();
+    vclock_advance_us(5000);
+    idle_sleepUntil(5000);
+    idle_sleepUntil(3000);
+    TEST_ASSERT_EQUAL_UINT32(5000, (uint32_t)vclock_now_us());
+    idle_getStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.num_sleeps);
+}
+
+void test_eventWakesEarly(void)
+{
+    idle_stats_t stats;
+    reset();
+    vclock_injectIrq(3500, drdy_isr);
+    idle_sleepUntil(10000);
+
+    // woke up when the ISR posted, and main can handle it right away
+    TEST_ASSERT_EQUAL_UINT32(3500, (uint32_t)vclock_now_us());
+    TEST_ASSERT_TRUE(events_pending(&events));
+    events_dispatch(&events);
+    TEST_ASSERT_EQUAL_UINT32(1, drdy_handled);
+
+    idle_getStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(3500, (uint32_t)stats.idle_us);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.num_early_wakeups);
+}
+
+void test_otherInterruptsSleepAgain(void)
+{
+    idle_stats_t stats;
+    reset();
+    vclock_injectIrq(2000, other_isr);
+    vclock_injectIrq(4000, other_isr);
+    idle_sleepUntil(10000);
+
+    TEST_ASSERT_EQUAL_UINT32(2, other_irqs);
+    TEST_ASSERT_EQUAL_UINT32(10, vclock_now_ms());
+    idle_getStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(10000, (uint32_t)stats.idle_us);
+    TEST_ASSERT_EQUAL_UINT32(3, stats.num_sleeps);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.num_early_wakeups);
+}
+
+void test_pendingEventSkipsSleep(void)
+{
+    idle_stats_t stats;
+    reset();
+    events_post(&events, drdy_event);
+    idle_sleepUntil(10000);
+    TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)vclock_now_us());
+    idle_getStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.num_sleeps);
+}
+
+void test_longSleepsAreSplit(void)
+{
+    idle_stats_t stats;
+    reset();
+    idle_sleepUntil(IDLE_MAX_SLEEP_US * 3 + 1000);
+    TEST_ASSERT_EQUAL_UINT32(IDLE_MAX_SLEEP_US * 3 + 1000, (uint32_t)vclock_now_us());
+    idle_getStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(4, stats.num_sleeps);
+}
+
+void test_statsReset(void)
+{
+    idle_stats_t stats;
+    reset();
+    idle_sleepUntil(10000);
+    vclock_advance_us(10000); // busy
+    idle_resetStats();
+    vclock_advance_us(5000); // busy
+    idle_sleepUntil(40000);
+
+    idle_getStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(15000, (uint32_t)stats.idle_us);
+    TEST_ASSERT_EQUAL_UINT32(20000, (uint32_t)stats.total_us);
+}
+
+void test_initChecksPort(void)
+{
+    idle_port_t port = gVclockIdlePort;
+    port.sleep = NULL;
+    TEST_ASSERT_EQUAL_HEX8(RET_INVALID_ARGS_ERR, idle_init(&port, &events));
+    TEST_ASSERT_EQUAL_HEX8(RET_INVALID_ARGS_ERR, idle_init(&gVclockIdlePort, NULL));
+}
+
+
+/* --- The whole main loop: events, scheduler and idle together --- */
+
+schedule_t schedule;
+uint32_t periodic_runs;
+
+ret_t periodic_task(int32_t *callback_time_ms)
+{
+    periodic_runs += 1;
+    vclock_advance_us(200); // pretend this takes some time
+    *callback_time_ms = 100;
+    return RET_OK;
+}
+
+void test_mainLoopMostlyIdle(void)
+{
+    idle_stats_t stats;
+    uint8_t id;
+    reset();
+    scheduler_init(&schedule);
+    periodic_runs = 0;
+    scheduler_add(&schedule, 0, periodic_task, &id);
+
+    // DRDY every 10 ms, part way between scheduler deadlines
+    for (uint32_t i = 0; i < 50; i++) {
+        vclock_injectIrq(5300 + i * 10000, drdy_isr);
+    }
+
+    while (vclock_now_ms() < 500) {
+        events_dispatch(&events);
+        uint32_t now = vclock_time_us();
+        int32_t time_until = scheduler_run(&schedule, now);
+        if (time_until > 0) {
+            idle_sleepUntil(now + (uint32_t)time_until);
+        }
+    }
+
+    // every DRDY handled straight away, every deadline met
+    TEST_ASSERT_EQUAL_UINT32(50, drdy_handled);
+    TEST_ASSERT_EQUAL_UINT32(495300, drdy_handled_at_us);
+    TEST_ASSERT_EQUAL_UINT32(5, periodic_runs);
+
+    // and we slept through everything else
+    idle_getStats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(500000 - 5 * 200, (uint32_t)stats.idle_us);
+    TEST_ASSERT_EQUAL_UINT32(50, stats.num_early_wakeups);
+}
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_sleepsUntilDeadline);
+    RUN_TEST(test_pastDeadlineDoesNotSleep);
+    RUN_TEST(test_eventWakesEarly);
+    RUN_TEST(test_otherInterruptsSleepAgain);
+    RUN_TEST(test_pendingEventSkipsSleep);
+    RUN_TEST(test_longSleepsAreSplit);
+    RUN_TEST(test_statsReset);
+    RUN_TEST(test_initChecksPort);
+    RUN_TEST(test_mainLoopMostlyIdle);
+
+    return UNITY_END();
+}
@@ -0,0 +1,549 @@
+#include "unity.h"
+#include <stdio.h>
+#include <string.h>
+#include "logging.h"
+
+#define OUT_LEN (2048)
+
+uint8_t out[OUT_LEN];
+uint32_t out_len;
+uint32_t fake_time_ms;
+ret_t write_ret;
+uint32_t num_evals;
+uint32_t biggest_write;
+log_sink_t sink;
+
+// A second sink, to check they don't get in each other's way
+uint8_t out_b[OUT_LEN];
+uint32_t out_b_len;
+ret_t write_b_ret;
+log_sink_t sink_b;
+
+uint32_t get_time(void) { return fake_time_ms; }
+
+// An arg with a side effect, to see whether it was evaluated
+int32_t evaluated(int32_t val)
+{
+    num_evals += 1;
+    return val;
+}
+
+ret_t write_data(uint8_t *data_ptr, uint32_t num_bytes)
+{
+    if (write_ret != RET_OK) {
+        return write_ret;
+    }
+    memcpy(out + out_len, data_ptr, num_bytes);
+    out_len += num_bytes;
+    out[out_len] = '\0';
+    if (num_bytes > biggest_write) {
+        biggest_write = num_bytes;
+    }
+    return RET_OK;
+}
+
+ret_t write_data_b(uint8_t *data_ptr, uint32_t num_bytes)
+{
+    if (write_b_ret != RET_OK) {
+        return write_b_ret;
+    }
+    memcpy(out_b + out_b_len, data_ptr, num_bytes);
+    out_b_len += num_bytes;
+    out_b[out_b_len] = '\0';
+    return RET_OK;
+}
+
+void reset(log_level_t level)
+{
+    log_init(get_time);
+    log_addSink(&sink, level, write_data, LOG_SINK_MAX_WRITE);
+    write_ret = RET_OK;
+    write_b_ret = RET_OK;
+    out_len = 0;
+    out_b_len = 0;
+    out[0] = '\0';
+    out_b[0] = '\0';
+    biggest_write = 0;
+    num_evals = 0;
+}
+
+
+// One limited call site, hit `count` times
+void log_limited(uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        LOG_MSG_FMT_LIMITED(kLogLevelInfo, "hot %u", i);
+    }
+}
+
+
+void test_filteredArgsNotEvaluated(void)
+{
+    reset(kLogLevelWarning);
+    LOG_MSG_FMT(kLogLevelInfo, "%i", evaluated(1));
+    TEST_ASSERT_EQUAL_UINT32(0, num_evals);
+    LOG_MSG_FMT(kLogLevelWarning, "%i", evaluated(1));
+    TEST_ASSERT_EQUAL_UINT32(1, num_evals);
+}
+
+
+void test_compileLevelRemovesMessages(void)
+{
+    reset(kLogLevelDebug);
+    LOG_MSG_FMT(kLogLevelDebug, "%i", evaluated(1));
+    TEST_ASSERT_EQUAL_UINT32((LOG_COMPILE_LEVEL >= kLogLevelDebug) ? 1 : 0, num_evals);
+    TEST_ASSERT_EQUAL(LOG_COMPILE_LEVEL >= kLogLevelDebug, LOG_ENABLED(kLogLevelDebug));
+}
+
+
+void test_macrosAreExpressions(void)
+{
+    int val = 0;
+    reset(kLogLevelDebug);
+    if (val == 0)
+        LOG_MSG(kLogLevelError, "one");
+    else
+        LOG_MSG_FMT(kLogLevelError, "two %i", val);
+    val = (LOG_MSG_FMT(kLogLevelError, "%i", val), 5);
+    TEST_ASSERT_EQUAL_INT32(5, val);
+}
+
+
+#ifdef LOG_BINARY
+
+// Pulls the next record out of `out`
+log_record_t next_record(uint32_t *pos)
+{
+    log_record_t record;
+    memset(&record, 0, sizeof(record));
+    memcpy(&record, out + *pos, LOG_RECORD_HEADER_LEN);
+    memcpy(record.args, out + *pos + LOG_RECORD_HEADER_LEN,
+           (record.level_nargs & 0x0F) * sizeof(uint32_t));
+    *pos += LOG_RECORD_HEADER_LEN + (record.level_nargs & 0x0F) * sizeof(uint32_t);
+    return record;
+}
+
+
+void test_recordLayout(void)
+{
+    uint32_t pos = 0;
+    log_record_t record;
+    reset(kLogLevelDebug);
+    fake_time_ms = 1234;
+    LOG_MSG_FMT(kLogLevelWarning, "%i %u %f", -2, 7, 1.5f);
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, log_drain());
+
+    TEST_ASSERT_EQUAL_UINT32(LOG_RECORD_HEADER_LEN + 3 * 4, out_len);
+    record = next_record(&pos);
+    TEST_ASSERT_EQUAL_HEX8(LOG_BINARY_SYNC, record.sync);
+    TEST_ASSERT_EQUAL_HEX8((kLogLevelWarning << 4) | 3, record.level_nargs);
+    TEST_ASSERT_EQUAL_UINT32(1234, record.timestamp);
+    TEST_ASSERT_EQUAL_HEX32(0xFFFFFFFE, record.args[0]);
+    TEST_ASSERT_EQUAL_HEX32(7, record.args[1]);
+    TEST_ASSERT_EQUAL_HEX32(0x3FC00000, record.args[2]);
+}
+
+
+void test_callSitesHaveTheirOwnIds(void)
+{
+    uint32_t pos = 0;
+    uint16_t ids[3];
+    reset(kLogLevelDebug);
+    for (uint8_t i = 0; i < 2; i++) {
+        LOG_MSG(kLogLevelInfo, "same site");
+    }
+    LOG_MSG(kLogLevelInfo, "same site");
+    log_drain();
+
+    for (uint8_t i = 0; i < 3; i++) {
+        log_record_t record = next_record(&pos);
+        TEST_ASSERT_EQUAL_HEX8(kLogLevelInfo << 4, record.level_nargs);
+        ids[i] = record.id;
+    }
+    TEST_ASSERT_EQUAL_HEX16(ids[0], ids[1]);
+    TEST_ASSERT_TRUE(ids[0] != ids[2]);
+}
+
+
+void test_levelFiltered(void)
+{
+    reset(kLogLevelInfo);
+    LOG_MSG(kLogLevelDebug, "too verbose");
+    log_drain();
+    TEST_ASSERT_EQUAL_UINT32(0, out_len);
+}
+
+
+void test_overwritesOldestAndReportsLoss(void)
+{
+    uint32_t pos = 0;
+    log_record_t record;
+    uint32_t lost_before;
+    reset(kLogLevelDebug);
+    lost_before = log_lostMessages(&sink);
+
+    for (uint32_t i = 0; i < LOG_BINARY_RING_LEN + 5; i++) {
+        LOG_MSG_FMT(kLogLevelDebug, "%u", i);
+    }
+    log_drain();
+
+    record = next_record(&pos);
+    TEST_ASSERT_EQUAL_HEX16(LOG_BINARY_ID_LOST, record.id);
+    TEST_ASSERT_EQUAL_UINT32(5, record.args[0]);
+    TEST_ASSERT_EQUAL_UINT32(5, log_lostMessages(&sink) - lost_before);
+    // sent several to a write, never more than the sink takes
+    TEST_ASSERT_TRUE(biggest_write > LOG_RECORD_HEADER_LEN + sizeof(uint32_t));
+    TEST_ASSERT_TRUE(biggest_write <= LOG_SINK_MAX_WRITE);
+
+    // the newest ones made it, in order
+    for (uint32_t i = 5; i < LOG_BINARY_RING_LEN + 5; i++) {
+        record = next_record(&pos);
+        TEST_ASSERT_EQUAL_UINT32(i, record.args[0]);
+    }
+    TEST_ASSERT_EQUAL_UINT32(out_len, pos);
+}
+
+
+void test_limitedReportsRepeats(void)
+{
+    uint32_t pos = 0;
+    uint16_t id;
+    log_record_t record;
+    reset(kLogLevelDebug);
+    log_limited(LOG_LIMIT_BURST + 3);
+    log_drain();
+    TEST_ASSERT_EQUAL_UINT32(LOG_LIMIT_BURST * (LOG_RECORD_HEADER_LEN + 4), out_len);
+    for (uint32_t i = 0; i < LOG_LIMIT_BURST; i++) {
+        record = next_record(&pos);
+        TEST_ASSERT_EQUAL_UINT32(i, record.args[0]);
+    }
+    id = record.id;
+
+    // once it's been quiet for an interval, the drain reports what was dropped
+    fake_time_ms += LOG_LIMIT_INTERVAL_MS;
+    log_drain();
+    record = next_record(&pos);
+    TEST_ASSERT_EQUAL_HEX16(LOG_BINARY_ID_REPEATED, record.id);
+    TEST_ASSERT_EQUAL_HEX8((kLogLevelInfo << 4) | 2, record.level_nargs);
+    TEST_ASSERT_EQUAL_HEX16(id, record.args[0]);
+    TEST_ASSERT_EQUAL_UINT32(3, record.args[1]);
+    TEST_ASSERT_EQUAL_UINT32(out_len, pos);
+}
+
+
+void test_failedWriteIsRetried(void)
+{
+    uint32_t pos = 0;
+    reset(kLogLevelDebug);
+    LOG_MSG_FMT(kLogLevelDebug, "%u", 1);
+    LOG_MSG_FMT(kLogLevelDebug, "%u", 2);
+
+    write_ret = RET_BUSY_ERR;
+    TEST_ASSERT_EQUAL_HEX8(RET_BUSY_ERR, log_drain());
+    write_ret = RET_OK;
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, log_drain());
+
+    TEST_ASSERT_EQUAL_UINT32(1, next_record(&pos).args[0]);
+    TEST_ASSERT_EQUAL_UINT32(2, next_record(&pos).args[0]);
+    TEST_ASSERT_EQUAL_UINT32(out_len, pos);
+}
+
+
+#else
+
+void test_textFormatted(void)
+{
+    reset(kLogLevelDebug);
+    fake_time_ms = 42;
+    LOG_MSG_FMT(kLogLevelWarning, "Set Report: 0x%02X ret: %i", 0x51, -3);
+    // only queued until the drain
+    TEST_ASSERT_EQUAL_UINT32(0, out_len);
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, log_drain());
+    TEST_ASSERT_NOT_NULL(strstr((char *)out, "00000042ms - WARNING"));
+    TEST_ASSERT_NOT_NULL(strstr((char *)out, "(in test_textFormatted): Set Report: 0x51 ret: -3\n"));
+}
+
+
+// Number of times `str` shows up in `out`
+uint32_t count_out(const char str[])
+{
+    uint32_t count = 0;
+    for (char *pos = strstr((char *)out, str); pos != NULL; pos = strstr(pos + 1, str)) {
+        count += 1;
+    }
+    return count;
+}
+
+
+void test_textLimitedReportsRepeats(void)
+{
+    reset(kLogLevelDebug);
+    log_limited(LOG_LIMIT_BURST + 3);
+    log_drain();
+    TEST_ASSERT_EQUAL_UINT32(LOG_LIMIT_BURST, count_out(": hot "));
+    TEST_ASSERT_EQUAL_UINT32(0, count_out("repeated"));
+
+    // once it's been quiet for an interval, the drain reports what was dropped
+    fake_time_ms += LOG_LIMIT_INTERVAL_MS - 1;
+    log_drain();
+    TEST_ASSERT_EQUAL_UINT32(0, count_out("repeated"));
+    fake_time_ms += 1;
+    log_drain();
+    TEST_ASSERT_NOT_NULL(strstr((char *)out, "(in log_limited): last message repeated 3 times\n"));
+
+    // and the bucket has refilled
+    fake_time_ms += LOG_LIMIT_INTERVAL_MS * LOG_LIMIT_BURST;
+    log_limited(LOG_LIMIT_BURST + 1);
+    log_drain();
+    TEST_ASSERT_EQUAL_UINT32(2 * LOG_LIMIT_BURST, count_out(": hot "));
+}
+
+
+void test_textLimitedRefillsOneAtATime(void)
+{
+    char *repeated;
+    reset(kLogLevelDebug);
+    log_limited(LOG_LIMIT_BURST + 2);
+    fake_time_ms += LOG_LIMIT_INTERVAL_MS;
+    log_limited(2);
+    log_drain();
+
+    // one token back: the repeats so far, then the message that got it
+    TEST_ASSERT_EQUAL_UINT32(LOG_LIMIT_BURST + 1, count_out(": hot "));
+    repeated = strstr((char *)out, "last message repeated 2 times\n");
+    TEST_ASSERT_NOT_NULL(repeated);
+    TEST_ASSERT_NOT_NULL(strstr(repeated, ": hot 0\n"));
+    // the one after it is held until the call site goes quiet
+    TEST_ASSERT_EQUAL_UINT32(1, count_out("repeated"));
+}
+
+
+void test_textTooLong(void)
+{
+    char msg[600];
+    reset(kLogLevelDebug);
+    memset(msg, 'a', sizeof(msg) - 1);
+    msg[sizeof(msg) - 1] = '\0';
+    TEST_ASSERT_EQUAL_HEX8(RET_NOMEM_ERR,
+                           log_logMessage(kLogLevelError, __FILE__, __func__, __LINE__, msg));
+    log_drain();
+    TEST_ASSERT_EQUAL_UINT32(0, out_len);
+}
+
+
+void test_textLongMessageSentInPieces(void)
+{
+    char msg[300];
+    reset(kLogLevelDebug);
+    memset(msg, 'a', sizeof(msg) - 1);
+    msg[sizeof(msg) - 1] = '\0';
+    LOG_MSG(kLogLevelInfo, msg);
+    LOG_MSG(kLogLevelInfo, "short");
+    log_drain();
+
+    TEST_ASSERT_TRUE(biggest_write <= LOG_SINK_MAX_WRITE);
+    TEST_ASSERT_NOT_NULL(strstr((char *)out, msg));
+    TEST_ASSERT_NOT_NULL(strstr((char *)out, "short\n"));
+}
+
+
+// Fake interrupt masking, to check the text queue is only touched with it held
+uint32_t lock_depth;
+uint32_t num_locks;
+uint32_t writes_locked;
+
+uint32_t fake_lock(void)
+{
+    num_locks += 1;
+    return lock_depth++;
+}
+
+void fake_unlock(uint32_t state)
+{
+    TEST_ASSERT_EQUAL_UINT32(lock_depth - 1, state);
+    lock_depth = state;
+}
+
+ret_t write_data_check_lock(uint8_t *data_ptr, uint32_t num_bytes)
+{
+    if (lock_depth != 0) {
+        writes_locked += 1;
+    }
+    return write_data(data_ptr, num_bytes);
+}
+
+void test_textLockedWhileQueuedNotWhileWritten(void)
+{
+    reset(kLogLevelDebug);
+    log_init(get_time);
+    log_addSink(&sink, kLogLevelDebug, write_data_check_lock, LOG_SINK_MAX_WRITE);
+    log_setLock(fake_lock, fake_unlock);
+    lock_depth = 0;
+    num_locks = 0;
+    writes_locked = 0;
+
+    LOG_MSG(kLogLevelInfo, "one");
+    TEST_ASSERT_EQUAL_UINT32(1, num_locks);
+    LOG_MSG(kLogLevelInfo, "two");
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, log_drain());
+
+    TEST_ASSERT_TRUE(num_locks > 2);
+    TEST_ASSERT_EQUAL_UINT32(0, lock_depth);
+    TEST_ASSERT_EQUAL_UINT32(0, writes_locked);
+    TEST_ASSERT_NOT_NULL(strstr((char *)out, ": one\n"));
+    TEST_ASSERT_NOT_NULL(strstr((char *)out, ": two\n"));
+}
+
+
+void test_textOverflowKeepsNewest(void)
+{
+    char *last_line;
+    reset(kLogLevelDebug);
+    write_ret = RET_BUSY_ERR;
+    for (int32_t i = 0; i < 100; i++) {
+        LOG_MSG_FMT(kLogLevelInfo, "message %i", i);
+    }
+    TEST_ASSERT_EQUAL_HEX8(RET_BUSY_ERR, log_drain());
+    write_ret = RET_OK;
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, log_drain());
+
+    TEST_ASSERT_TRUE(log_lostMessages(&sink) > 0);
+    TEST_ASSERT_EQUAL_INT(0, strncmp((char *)out, "--- ", 4));
+    TEST_ASSERT_NOT_NULL(strstr((char *)out, " log messages lost ---\n"));
+    last_line = strrchr((char *)out, ':');
+    TEST_ASSERT_EQUAL_STRING(": message 99\n", last_line);
+}
+
+#endif /* LOG_BINARY */
+
+
+void test_sinksHaveTheirOwnLevels(void)
+{
+    reset(kLogLevelInfo);
+    log_addSink(&sink_b, kLogLevelError, write_data_b, LOG_SINK_MAX_WRITE);
+    TEST_ASSERT_TRUE(log_isEnabled(kLogLevelInfo));
+    TEST_ASSERT_FALSE(log_isEnabled(kLogLevelDebug));
+
+    LOG_MSG(kLogLevelInfo, "info");
+    LOG_MSG(kLogLevelError, "error");
+    log_drain();
+    TEST_ASSERT_TRUE(out_len > out_b_len);
+    TEST_ASSERT_TRUE(out_b_len > 0);
+
+    log_setSinkLevel(&sink_b, kLogLevelDebug);
+    TEST_ASSERT_TRUE(log_isEnabled(kLogLevelDebug));
+}
+
+
+void test_limitedFilteredLeavesBudget(void)
+{
+    reset(kLogLevelWarning);
+    log_limited(LOG_LIMIT_BURST + 3);
+    log_drain();
+    TEST_ASSERT_EQUAL_UINT32(0, out_len);
+
+    log_setSinkLevel(&sink, kLogLevelInfo);
+    log_limited(LOG_LIMIT_BURST);
+    fake_time_ms += LOG_LIMIT_INTERVAL_MS;
+    log_drain();
+    TEST_ASSERT_TRUE(out_len > 0);
+#ifndef LOG_BINARY
+    TEST_ASSERT_EQUAL_UINT32(LOG_LIMIT_BURST, count_out(": hot "));
+    TEST_ASSERT_EQUAL_UINT32(0, count_out("repeated"));
+#endif
+}
+
+
+void test_busySinkDoesNotHoldUpOthers(void)
+{
+    uint32_t len;
+    reset(kLogLevelDebug);
+    log_addSink(&sink_b, kLogLevelDebug, write_data_b, LOG_SINK_MAX_WRITE);
+    write_ret = RET_BUSY_ERR;
+
+    LOG_MSG_FMT(kLogLevelInfo, "%i", 1);
+    TEST_ASSERT_EQUAL_HEX8(RET_BUSY_ERR, log_drain());
+    TEST_ASSERT_EQUAL_UINT32(0, out_len);
+    TEST_ASSERT_TRUE(out_b_len > 0);
+
+    // catches up once it's free, without the other getting it twice
+    len = out_b_len;
+    write_ret = RET_OK;
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, log_drain());
+    TEST_ASSERT_EQUAL_UINT32(len, out_len);
+    TEST_ASSERT_EQUAL_UINT32(len, out_b_len);
+    TEST_ASSERT_EQUAL_MEMORY(out_b, out, len);
+}
+
+
+void test_lateSinkGetsWhatsQueued(void)
+{
+    reset(kLogLevelDebug);
+    LOG_MSG(kLogLevelInfo, "before");
+    log_drain();
+    log_addSink(&sink_b, kLogLevelDebug, write_data_b, LOG_SINK_MAX_WRITE);
+    log_drain();
+    TEST_ASSERT_EQUAL_UINT32(out_len, out_b_len);
+}
+
+
+void test_addSinkChecks(void)
+{
+    reset(kLogLevelDebug);
+    TEST_ASSERT_EQUAL_HEX8(RET_VAL_ERR, log_addSink(&sink, kLogLevelDebug, write_data, 64));
+    TEST_ASSERT_EQUAL_HEX8(RET_VAL_ERR, log_addSink(&sink_b, kLogLevelDebug, write_data_b,
+                                                    LOG_SINK_MIN_WRITE - 1));
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, log_addSink(&sink_b, kLogLevelDebug, write_data_b, 1000));
+    TEST_ASSERT_EQUAL_UINT32(LOG_SINK_MAX_WRITE, sink_b.max_write);
+}
+
+
+void test_ramSinkKeepsNewest(void)
+{
+    uint8_t data[LOG_RAM_LEN + 10];
+    uint8_t read[LOG_RAM_LEN + 10];
+    for (uint32_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)i;
+    }
+    log_ramWrite(data, 5);
+    TEST_ASSERT_EQUAL_UINT32(3, log_ramRead(read, 3));
+    TEST_ASSERT_EQUAL_MEMORY(data + 2, read, 3);
+
+    log_ramWrite(data, sizeof(data));
+    TEST_ASSERT_EQUAL_UINT32(LOG_RAM_LEN, log_ramRead(read, sizeof(read)));
+    TEST_ASSERT_EQUAL_MEMORY(data + 10, read, LOG_RAM_LEN);
+}
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_filteredArgsNotEvaluated);
+    RUN_TEST(test_compileLevelRemovesMessages);
+    RUN_TEST(test_macrosAreExpressions);
+    RUN_TEST(test_sinksHaveTheirOwnLevels);
+    RUN_TEST(test_busySinkDoesNotHoldUpOthers);
+    RUN_TEST(test_lateSinkGetsWhatsQueued);
+    RUN_TEST(test_addSinkChecks);
+    RUN_TEST(test_ramSinkKeepsNewest);
+    RUN_TEST(test_limitedFilteredLeavesBudget);
+#ifdef LOG_BINARY
+    RUN_TEST(test_recordLayout);
+    RUN_TEST(test_callSitesHaveTheirOwnIds);
+    RUN_TEST(test_levelFiltered);
+    RUN_TEST(test_overwritesOldestAndReportsLoss);
+    RUN_TEST(test_failedWriteIsRetried);
+    RUN_TEST(test_limitedReportsRepeats);
+#else
+    RUN_TEST(test_textFormatted);
+    RUN_TEST(test_textLimitedReportsRepeats);
+    RUN_TEST(test_textLimitedRefillsOneAtATime);
+    RUN_TEST(test_textTooLong);
+    RUN_TEST(test_textLongMessageSentInPieces);
+    RUN_TEST(test_textOverflowKeepsNewest);
+    RUN_TEST(test_textLockedWhileQueuedNotWhileWritten);
+#endif
+
+    return UNITY_END();
+}
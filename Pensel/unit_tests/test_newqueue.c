@@ -8,16 +8,16 @@
 newqueue_t queue;
 
 
-void queue_init(uint8_t num_elements, uint8_t val_size)
+void setup_queue(uint8_t num_elements, uint8_t val_size)
 {
-    newqueue_init(&queue, num_elements, val_size);
+    newqueue_init(&queue, num_elements, val_size, kQueueOverwriteOldest);
 }
 
 
 void test_basicSetGet(void)
 {
     uint8_t val;
-    queue_init(QUEUE_SIZE, 1);
+    setup_queue(QUEUE_SIZE, 1);
     val = 42;
     newqueue_push(&queue, (void *)&val, 1);
     val = 0;
@@ -38,7 +38,7 @@ void test_basicSetGet(void)
 void test_basicSetGet_peak(void)
 {
     uint8_t val;
-    queue_init(QUEUE_SIZE, 1);
+    setup_queue(QUEUE_SIZE, 1);
     val = 42;
     newqueue_push(&queue, (void *)&val, 1);
     val = 0;
@@ -61,7 +61,7 @@ void test_basicSetGet_peak(void)
 void test_basicSetIncrementsUnreadCount(void)
 {
     uint32_t val;
-    queue_init(QUEUE_SIZE, 4);
+    setup_queue(QUEUE_SIZE, 4);
     val = 42;
     newqueue_push(&queue, (void *)&val, 1);
     // do some output if we've defined verbose output
@@ -80,7 +80,7 @@ void test_basicSetIncrementsUnreadCount(void)
 void test_basicGetDecrementsUnreadCount(void)
 {
     uint8_t val;
-    queue_init(QUEUE_SIZE, 1);
+    setup_queue(QUEUE_SIZE, 1);
 
     // push some vals onto the queue
     val = 42; newqueue_push(&queue, (void *)&val, 1);
@@ -107,7 +107,7 @@ void test_basicGetDecrementsUnreadCount(void)
 void test_uint32GetDecrementsUnreadCount(void)
 {
     uint8_t val;
-    queue_init(QUEUE_SIZE, 1);
+    setup_queue(QUEUE_SIZE, 1);
 
     // push some vals onto the queue
     val = 42; newqueue_push(&queue, (void *)&val, 1);
@@ -134,7 +134,7 @@ void test_uint32GetDecrementsUnreadCount(void)
 void test_multipleGetDecrementsUnreadCount(void)
 {
     uint8_t vals[2];
-    queue_init(QUEUE_SIZE, 1);
+    setup_queue(QUEUE_SIZE, 1);
 
     // push some vals onto the queue
     vals[0] = 42; newqueue_push(&queue, (void *)&vals[0], 1);
@@ -164,7 +164,7 @@ void test_multipleGetDecrementsUnreadCount(void)
 void test_fullQueue_pushPop(void)
 {
     uint8_t val;
-    queue_init(QUEUE_SIZE, 1);
+    setup_queue(QUEUE_SIZE, 1);
     for (uint8_t i = 0; i < QUEUE_SIZE; i++) {
         newqueue_push(&queue, (void *)&i, 1);
     }
@@ -187,7 +187,7 @@ void test_fullQueue_pushPop(void)
 
 void test_overwriteCountIncreases(void)
 {
-    queue_init(QUEUE_SIZE, 1);
+    setup_queue(QUEUE_SIZE, 1);
     for (uint8_t i = 0; i <= QUEUE_SIZE; i++) {
         newqueue_push(&queue, (void *)&i, 1);
     }
@@ -207,7 +207,7 @@ void test_overwriteCountIncreases(void)
 void test_overwrite_getExpectedValue(void)
 {
     uint8_t val;
-    queue_init(QUEUE_SIZE, 1);
+    setup_queue(QUEUE_SIZE, 1);
     for (uint8_t i = 0; i <= QUEUE_SIZE; i++) {
         newqueue_push(&queue, (void *)&i, 1);
     }
@@ -225,13 +225,92 @@ void test_overwrite_getExpectedValue(void)
 }
 
 
+void test_overwrite_multiByteItems(void)
+{
+    int32_t val;
+    setup_queue(QUEUE_SIZE, 4);
+    for (int32_t i = 0; i <= QUEUE_SIZE; i++) {
+        val = LARGE_NUMBER + i;
+        newqueue_push(&queue, (void *)&val, 1);
+    }
+    newqueue_pop(&queue, (void *)&val, 1, false);
+    // do some output if we've defined verbose output
+    #ifdef VERBOSE_OUTPUT
+        printf("\nFunction: %s\n", __func__);
+        printf("\t%d + 1 values onto buffer of size %d\n", QUEUE_SIZE, QUEUE_SIZE);
+        printf("\t%d overwritten values\n", queue.overwrite_count);
+        printf("\tgot 1 value back == %i\n", val);
+        printf("\n");
+    #endif
+
+    TEST_ASSERT_EQUAL_HEX32(1, queue.overwrite_count);
+    TEST_ASSERT_EQUAL_HEX32(LARGE_NUMBER + 1, val);
+    TEST_ASSERT_EQUAL_HEX32(QUEUE_SIZE - 1, queue.unread_items);
+    newqueue_deinit(&queue);
+}
+
+
+void test_dropNewest_pushesWhatFits(void)
+{
+    uint8_t vals[4] = {1, 2, 3, 4};
+    uint8_t val;
+    newqueue_init(&queue, QUEUE_SIZE, 1, kQueueDropNewest);
+    for (uint8_t i = 0; i < QUEUE_SIZE - 2; i++) {
+        newqueue_push(&queue, (void *)&i, 1);
+    }
+    newqueue_push(&queue, (void *)vals, 4);
+    newqueue_pop(&queue, (void *)&val, 1, false);
+    // do some output if we've defined verbose output
+    #ifdef VERBOSE_OUTPUT
+        printf("\nFunction: %s\n", __func__);
+        printf("\t%d dropped, %d overwritten\n", queue.dropped_count, queue.overwrite_count);
+        printf("\tgot 1 value back == %d\n", val);
+        printf("\n");
+    #endif
+
+    TEST_ASSERT_EQUAL_HEX8(0, val);
+    TEST_ASSERT_EQUAL_HEX32(2, queue.dropped_count);
+    TEST_ASSERT_EQUAL_HEX32(0, queue.overwrite_count);
+    TEST_ASSERT_EQUAL_HEX32(QUEUE_SIZE - 1, queue.unread_items);
+    newqueue_deinit(&queue);
+}
+
+
+void test_reject_pushesNothing(void)
+{
+    uint8_t vals[4] = {1, 2, 3, 4};
+    ret_t retval;
+    newqueue_init(&queue, QUEUE_SIZE, 1, kQueueReject);
+    for (uint8_t i = 0; i < QUEUE_SIZE - 2; i++) {
+        newqueue_push(&queue, (void *)&i, 1);
+    }
+    retval = newqueue_push(&queue, (void *)vals, 4);
+    // do some output if we've defined verbose output
+    #ifdef VERBOSE_OUTPUT
+        printf("\nFunction: %s\n", __func__);
+        printf("\tretval: %d, %d rejected\n", retval, queue.rejected_count);
+        printf("\n");
+    #endif
+
+    TEST_ASSERT_EQUAL_HEX8(RET_NOMEM_ERR, retval);
+    TEST_ASSERT_EQUAL_HEX32(4, queue.rejected_count);
+    TEST_ASSERT_EQUAL_HEX32(QUEUE_SIZE - 2, queue.unread_items);
+
+    // still room for 2 more
+    retval = newqueue_push(&queue, (void *)vals, 2);
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, retval);
+    TEST_ASSERT_EQUAL_HEX32(QUEUE_SIZE, queue.unread_items);
+    newqueue_deinit(&queue);
+}
+
+
 /************* Large number tests! *****************/
 
 
 void test_fullQueue_pushPop_int32(void)
 {
     int32_t val;
-    queue_init(QUEUE_SIZE, 4);
+    setup_queue(QUEUE_SIZE, 4);
 
     #ifdef VERBOSE_OUTPUT
         printf("\nFunction: %s\n", __func__);
@@ -262,7 +341,7 @@ void test_fullQueue_pushPop_int32(void)
 void test_fullQueue_pushPop_int32neg(void)
 {
     int32_t val;
-    queue_init(QUEUE_SIZE, 4);
+    setup_queue(QUEUE_SIZE, 4);
 
     #ifdef VERBOSE_OUTPUT
         printf("\nFunction: %s\n", __func__);
@@ -304,6 +383,10 @@ int main(void)
 
     RUN_TEST(test_overwriteCountIncreases);
     RUN_TEST(test_overwrite_getExpectedValue);
+    RUN_TEST(test_overwrite_multiByteItems);
+
+    RUN_TEST(test_dropNewest_pushesWhatFits);
+    RUN_TEST(test_reject_pushesNothing);
 
     RUN_TEST(test_fullQueue_pushPop_int32);
     RUN_TEST(test_fullQueue_pushPop_int32neg);
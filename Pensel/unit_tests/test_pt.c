@@ -0,0 +1,124 @@
+#include "unity.h"
+#include <stdio.h>
+#include "pt.h"
+
+schedule_t schedule;
+uint8_t task_id;
+
+pt_t pt;
+bool ready;
+char run_log[32];
+uint16_t run_log_len;
+
+void log_run(char name)
+{
+    if (run_log_len < sizeof(run_log) - 1) {
+        run_log[run_log_len++] = name;
+        run_log[run_log_len] = '\0';
+    }
+}
+
+// Waits for `ready`, sleeps for 20 ms, then ends
+pt_state_t thread(pt_t *pt)
+{
+    PT_BEGIN(pt);
+    log_run('b');
+    PT_WAIT_UNTIL(pt, ready, 5);
+    log_run('r');
+    PT_SLEEP(pt, 20);
+    log_run('s');
+    PT_YIELD(pt);
+    log_run('e');
+    PT_END(pt);
+}
+
+ret_t task(int32_t *callback_time_ms)
+{
+    *callback_time_ms = pt_callbackTime(&pt, thread(&pt));
+    return RET_OK;
+}
+
+int32_t run_ms(uint32_t current_time_ms)
+{
+    int32_t next_us = scheduler_run(&schedule, current_time_ms * 1000);
+    return (next_us == INT32_MAX) ? INT32_MAX : next_us / 1000;
+}
+
+void reset(void)
+{
+    scheduler_init(&schedule);
+    PT_INIT(&pt);
+    ready = false;
+    run_log_len = 0;
+    run_log[0] = '\0';
+    scheduler_add(&schedule, 0, task, &task_id);
+}
+
+
+void test_waitPolls(void)
+{
+    reset();
+    TEST_ASSERT_EQUAL_INT32(5, run_ms(0));
+    TEST_ASSERT_EQUAL_INT32(5, run_ms(5));
+    TEST_ASSERT_EQUAL_STRING("b", run_log);
+
+    ready = true;
+    TEST_ASSERT_EQUAL_INT32(20, run_ms(10));
+    TEST_ASSERT_EQUAL_STRING("br", run_log);
+}
+
+
+void test_sleepYieldAndEnd(void)
+{
+    reset();
+    ready = true;
+    TEST_ASSERT_EQUAL_INT32(20, run_ms(0));
+    TEST_ASSERT_EQUAL_INT32(19, run_ms(1));
+    TEST_ASSERT_EQUAL_STRING("br", run_log);
+
+    TEST_ASSERT_EQUAL_INT32(0, run_ms(20));
+    TEST_ASSERT_EQUAL_STRING("brs", run_log);
+
+    // runs off the end, which takes it off the schedule
+    TEST_ASSERT_EQUAL_INT32(INT32_MAX, run_ms(20));
+    TEST_ASSERT_EQUAL_STRING("brse", run_log);
+    TEST_ASSERT_EQUAL_HEX16(0, schedule.num_slots_used);
+    TEST_ASSERT_EQUAL_HEX16(0, pt.resume_line);
+}
+
+
+void test_wakeEndsWaitEarly(void)
+{
+    reset();
+    TEST_ASSERT_EQUAL_INT32(5, run_ms(0));
+
+    // e.g. a completion event: the condition is rechecked on the next run, not after the poll time
+    ready = true;
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, scheduler_wake(&schedule, task_id));
+    TEST_ASSERT_EQUAL_INT32(20, run_ms(1));
+    TEST_ASSERT_EQUAL_STRING("br", run_log);
+}
+
+
+void test_wakeEndsSleepEarly(void)
+{
+    reset();
+    ready = true;
+    run_ms(0);
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, scheduler_wake(&schedule, task_id));
+    run_ms(2);
+    TEST_ASSERT_EQUAL_STRING("brs", run_log);
+}
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_waitPolls);
+    RUN_TEST(test_sleepYieldAndEnd);
+    RUN_TEST(test_wakeEndsWaitEarly);
+    RUN_TEST(test_wakeEndsSleepEarly);
+
+    return UNITY_END();
+}
@@ -1,6 +1,6 @@
 #include "unity.h"
 #include <stdio.h>
-#include "../firmware/include/queue.h"
+#include "queue.h"
 
 #define QUEUE_SIZE (20)
 
@@ -11,7 +11,7 @@ queue_t queue_admin;
 void test_basicSetGet(void)
 {
     uint8_t val;
-    queue_init(&queue_admin);
+    queue_init(&queue_admin, kQueueOverwriteOldest);
     queue_buffer[queue_admin.head_ind] = 42;
     queue_increment_head(&queue_admin, QUEUE_SIZE);
     val = queue_buffer[queue_admin.tail_ind];
@@ -30,7 +30,7 @@ void test_basicSetGet(void)
 
 void test_basicSetIncrementsUnreadCount(void)
 {
-    queue_init(&queue_admin);
+    queue_init(&queue_admin, kQueueOverwriteOldest);
     queue_buffer[queue_admin.head_ind] = 42;
     queue_increment_head(&queue_admin, QUEUE_SIZE);
     // do some output if we've defined verbose output
@@ -48,7 +48,7 @@ void test_basicSetIncrementsUnreadCount(void)
 void test_basicGetDecrementsUnreadCount(void)
 {
     uint8_t val;
-    queue_init(&queue_admin);
+    queue_init(&queue_admin, kQueueOverwriteOldest);
     queue_buffer[queue_admin.head_ind] = 42;
     queue_increment_head(&queue_admin, QUEUE_SIZE);
     queue_buffer[queue_admin.head_ind] = 24;
@@ -72,7 +72,7 @@ void test_basicGetDecrementsUnreadCount(void)
 
 void test_overwriteCountIncreases(void)
 {
-    queue_init(&queue_admin);
+    queue_init(&queue_admin, kQueueOverwriteOldest);
     for (uint8_t i = 0; i <= QUEUE_SIZE; i++) {
         queue_buffer[queue_admin.head_ind] = i;
         queue_increment_head(&queue_admin, QUEUE_SIZE);
@@ -92,7 +92,7 @@ void test_overwriteCountIncreases(void)
 void test_overwrite_getExpectedValue(void)
 {
     uint8_t val;
-    queue_init(&queue_admin);
+    queue_init(&queue_admin, kQueueOverwriteOldest);
     for (uint8_t i = 0; i <= QUEUE_SIZE; i++) {
         queue_buffer[queue_admin.head_ind] = i;
         queue_increment_head(&queue_admin, QUEUE_SIZE);
@@ -112,6 +112,99 @@ void test_overwrite_getExpectedValue(void)
 
 
 
+void test_dropNewest_keepsOldData(void)
+{
+    uint8_t val;
+    queue_init(&queue_admin, kQueueDropNewest);
+    for (uint8_t i = 0; i <= QUEUE_SIZE; i++) {
+        if (!queue_isFull(&queue_admin, QUEUE_SIZE)) {
+            queue_buffer[queue_admin.head_ind] = i;
+        }
+        TEST_ASSERT_EQUAL_HEX8(RET_OK, queue_increment_head(&queue_admin, QUEUE_SIZE));
+    }
+    val = queue_buffer[queue_admin.tail_ind];
+    queue_increment_tail(&queue_admin, QUEUE_SIZE);
+    // do some output if we've defined verbose output
+    #ifdef VERBOSE_OUTPUT
+    printf("\nFunction: %s\n", __func__);
+    printf("\t%d + 1 values onto buffer of size %d\n", QUEUE_SIZE, QUEUE_SIZE);
+    printf("\t%d dropped, %d overwritten\n", queue_admin.dropped_count,
+           queue_admin.overwrite_count);
+    printf("\tgot 1 value back == %d\n", val);
+    printf("\n");
+    #endif
+
+    TEST_ASSERT_EQUAL_HEX8(0, val);
+    TEST_ASSERT_EQUAL_HEX8(1, queue_admin.dropped_count);
+    TEST_ASSERT_EQUAL_HEX8(0, queue_admin.overwrite_count);
+    TEST_ASSERT_EQUAL_HEX8(QUEUE_SIZE - 1, queue_admin.unread_items);
+}
+
+
+void test_reject_returnsError(void)
+{
+    ret_t retval = RET_OK;
+    queue_init(&queue_admin, kQueueReject);
+    for (uint8_t i = 0; i <= QUEUE_SIZE; i++) {
+        if (!queue_isFull(&queue_admin, QUEUE_SIZE)) {
+            queue_buffer[queue_admin.head_ind] = i;
+        }
+        retval = queue_increment_head(&queue_admin, QUEUE_SIZE);
+    }
+    // do some output if we've defined verbose output
+    #ifdef VERBOSE_OUTPUT
+    printf("\nFunction: %s\n", __func__);
+    printf("\t%d + 1 values onto buffer of size %d\n", QUEUE_SIZE, QUEUE_SIZE);
+    printf("\tlast retval: %d, %d rejected\n", retval, queue_admin.rejected_count);
+    printf("\n");
+    #endif
+
+    TEST_ASSERT_EQUAL_HEX8(RET_NOMEM_ERR, retval);
+    TEST_ASSERT_EQUAL_HEX8(1, queue_admin.rejected_count);
+    TEST_ASSERT_EQUAL_HEX8(0, queue_admin.overwrite_count);
+    TEST_ASSERT_EQUAL_HEX8(0, queue_buffer[queue_admin.tail_ind]);
+}
+
+
+void test_push_overflowKeepsUnreadItems(void)
+{
+    queue_overflow_policy_t policies[] = {kQueueDropNewest, kQueueReject};
+    ret_t expected[] = {RET_OK, RET_NOMEM_ERR};
+    uint8_t item;
+
+    for (uint8_t p = 0; p < 2; p++) {
+        queue_init(&queue_admin, policies[p]);
+        for (item = 0; item < QUEUE_SIZE; item++) {
+            TEST_ASSERT_EQUAL_HEX8(RET_OK, queue_push(&queue_admin, QUEUE_SIZE, queue_buffer,
+                                                      &item, sizeof(item)));
+        }
+        item = 0xFF;
+        TEST_ASSERT_EQUAL_HEX8(expected[p], queue_push(&queue_admin, QUEUE_SIZE, queue_buffer,
+                                                       &item, sizeof(item)));
+
+        // every unread item is still there, oldest first
+        for (uint8_t i = 0; i < QUEUE_SIZE; i++) {
+            TEST_ASSERT_EQUAL_HEX8(i, queue_buffer[queue_admin.tail_ind]);
+            queue_increment_tail(&queue_admin, QUEUE_SIZE);
+        }
+        TEST_ASSERT_EQUAL_HEX8(0, queue_admin.unread_items);
+        TEST_ASSERT_EQUAL_HEX8(0, queue_admin.overwrite_count);
+    }
+}
+
+
+void test_push_overwriteOldest(void)
+{
+    uint8_t item;
+    queue_init(&queue_admin, kQueueOverwriteOldest);
+    for (item = 0; item <= QUEUE_SIZE; item++) {
+        queue_push(&queue_admin, QUEUE_SIZE, queue_buffer, &item, sizeof(item));
+    }
+    TEST_ASSERT_EQUAL_HEX8(1, queue_admin.overwrite_count);
+    TEST_ASSERT_EQUAL_HEX8(1, queue_buffer[queue_admin.tail_ind]);
+}
+
+
 int main(void)
 {
     UNITY_BEGIN();
@@ -121,6 +214,10 @@ int main(void)
     RUN_TEST(test_basicGetDecrementsUnreadCount);
     RUN_TEST(test_overwriteCountIncreases);
     RUN_TEST(test_overwrite_getExpectedValue);
+    RUN_TEST(test_dropNewest_keepsOldData);
+    RUN_TEST(test_reject_returnsError);
+    RUN_TEST(test_push_overflowKeepsUnreadItems);
+    RUN_TEST(test_push_overwriteOldest);
 
     return UNITY_END();
 }
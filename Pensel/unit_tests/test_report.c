@@ -0,0 +1,403 @@
+#include "unity.h"
+#include <stdio.h>
+#include <string.h>
+#include "crc16.h"
+#include "report.h"
+
+report_parser_t parser;
+
+// What the last reply was
+uint8_t num_replies;
+uint8_t reply_id;
+ret_t reply_ret;
+uint8_t reply_payload[REPORT_MAX_PAYLOAD];
+uint8_t reply_len;
+
+// What the last version 2 reply was, as it was sent
+uint8_t num_sent;
+uint8_t sent[REPORT_FRAME_MAX];
+uint32_t sent_len;
+
+// Times the echo handler ran
+uint8_t echo_calls;
+
+ret_t reply(uint8_t report, ret_t retval, const uint8_t *payload_ptr, uint8_t payload_len)
+{
+    num_replies += 1;
+    reply_id = report;
+    reply_ret = retval;
+    reply_len = payload_len;
+    memcpy(reply_payload, payload_ptr, payload_len);
+    return RET_OK;
+}
+
+ret_t send(uint8_t *data_ptr, uint32_t num_bytes)
+{
+    num_sent += 1;
+    sent_len = num_bytes;
+    memcpy(sent, data_ptr, num_bytes);
+    return RET_OK;
+}
+
+ret_t rpt_echo(uint8_t *in_p, uint8_t in_len, uint8_t *out_p, uint8_t *out_len_ptr)
+{
+    echo_calls += 1;
+    memcpy(out_p, in_p, in_len);
+    *out_len_ptr = in_len;
+    return RET_OK;
+}
+
+ret_t rpt_fails(uint8_t *in_p, uint8_t in_len, uint8_t *out_p, uint8_t *out_len_ptr)
+{
+    return RET_VAL_ERR;
+}
+
+const report_entry_t table[] = {
+    {.id = 0x10, .handler = rpt_echo},
+    {.id = 0x20, .handler = rpt_fails},
+};
+
+void reset(void)
+{
+    report_init(&parser, table, sizeof(table) / sizeof(table[0]), reply, send);
+    num_replies = 0;
+    num_sent = 0;
+    reply_len = 0;
+    echo_calls = 0;
+}
+
+// Builds a request the way pensel_utils.py does, returns its length
+uint32_t frame(uint8_t *buf, uint8_t id, const uint8_t *payload, uint8_t len)
+{
+    uint8_t sum = 0;
+    uint32_t num = 0;
+    buf[num++] = 0xDE;
+    buf[num++] = 0xAD;
+    buf[num++] = 0xBE;
+    buf[num++] = 0xEF;
+    buf[num++] = id;
+    buf[num++] = len;
+    memcpy(&buf[num], payload, len);
+    num += len;
+    for (uint32_t i = 0; i < num; i++) {
+        sum += buf[i];
+    }
+    buf[num++] = -sum;
+    return num;
+}
+
+// Builds a version 2 request the way pensel_utils.py does: a zero, COBS, then another zero.
+// Returns its length.
+uint32_t cobs_frame(uint8_t *buf, uint8_t id, const uint8_t *payload, uint32_t len)
+{
+    uint8_t raw[512];
+    uint16_t crc;
+    uint32_t num = 0, code_pos = 1;
+    raw[0] = id;
+    memcpy(&raw[1], payload, len);
+    crc = crc16(CRC16_INIT, raw, len + 1);
+    raw[len + 1] = crc >> 8;
+    raw[len + 2] = crc & 0xFF;
+
+    buf[num++] = 0;
+    buf[num++] = 1;
+    for (uint32_t i = 0; i < len + 3; i++) {
+        if (raw[i] == 0) {
+            code_pos = num++;
+            buf[code_pos] = 1;
+            continue;
+        }
+        buf[num++] = raw[i];
+        buf[code_pos] += 1;
+        if (buf[code_pos] == 0xFF && i != len + 2) {
+            code_pos = num++;
+            buf[code_pos] = 1;
+        }
+    }
+    buf[num++] = 0;
+    return num;
+}
+
+// Undoes the COBS of the last version 2 reply, checks its CRC, and fills in the reply_* globals
+void decode_sent(void)
+{
+    uint8_t raw[REPORT_FRAME_MAX];
+    uint32_t num = 0, pos = 1;
+    TEST_ASSERT_EQUAL_HEX8(0, sent[0]);
+    TEST_ASSERT_EQUAL_HEX8(0, sent[sent_len - 1]);
+    while (pos < sent_len - 1) {
+        uint8_t code = sent[pos++];
+        for (uint8_t i = 1; i < code; i++) {
+            TEST_ASSERT_TRUE(sent[pos] != 0);
+            raw[num++] = sent[pos++];
+        }
+        if (code != 0xFF && pos < sent_len - 1) {
+            raw[num++] = 0;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(sent_len - 1, pos);
+    TEST_ASSERT_TRUE(num >= 4);
+    TEST_ASSERT_EQUAL_HEX16(0, crc16(CRC16_INIT, raw, num));
+    reply_id = raw[0];
+    reply_ret = raw[1];
+    reply_len = num - 4;
+    memcpy(reply_payload, &raw[2], reply_len);
+}
+
+// Switches the parser over to version 2
+void use_cobs(void)
+{
+    uint8_t buf[32];
+    uint8_t version = kReportProtocolCobs;
+    report_parse(&parser, buf, frame(buf, REPORT_ID_VERSION, &version, 1));
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, reply_ret);
+    TEST_ASSERT_EQUAL_UINT8(kReportProtocolCobs, parser.protocol);
+    num_replies = 0;
+}
+
+
+void test_dispatchesFrame(void)
+{
+    uint8_t buf[32];
+    uint8_t payload[] = {1, 2, 3};
+    reset();
+    report_parse(&parser, buf, frame(buf, 0x10, payload, sizeof(payload)));
+
+    TEST_ASSERT_EQUAL_UINT8(1, num_replies);
+    TEST_ASSERT_EQUAL_HEX8(0x10, reply_id);
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, reply_ret);
+    TEST_ASSERT_EQUAL_UINT8(3, reply_len);
+    TEST_ASSERT_EQUAL_MEMORY(payload, reply_payload, 3);
+    TEST_ASSERT_EQUAL_UINT32(1, parser.stats.frames);
+}
+
+
+void test_byteAtATimeWithNoise(void)
+{
+    uint8_t buf[32];
+    uint8_t noise[] = {0x00, 0xDE, 0xAD, 0xDE, 0xDE, 0xAD, 0xBE};
+    uint32_t len = frame(buf, 0x20, NULL, 0);
+    reset();
+    // half a magic number, then the real one starting on the repeated 0xDE
+    report_parse(&parser, noise, 4);
+    for (uint32_t i = 0; i < len; i++) {
+        TEST_ASSERT_EQUAL_UINT8(0, num_replies);
+        report_parseByte(&parser, buf[i]);
+    }
+    TEST_ASSERT_EQUAL_UINT8(1, num_replies);
+    TEST_ASSERT_EQUAL_HEX8(0x20, reply_id);
+    TEST_ASSERT_EQUAL_HEX8(RET_VAL_ERR, reply_ret);
+    TEST_ASSERT_EQUAL_UINT8(0, reply_len);
+
+    // a magic number that's cut short doesn't hold up the next one
+    report_parse(&parser, &noise[4], 3);
+    report_parse(&parser, buf, len);
+    TEST_ASSERT_EQUAL_UINT8(2, num_replies);
+}
+
+
+void test_badChecksumResyncs(void)
+{
+    uint8_t buf[64];
+    uint8_t payload[] = {0xAA};
+    uint32_t first = frame(buf, 0x10, payload, 1);
+    uint32_t len = first + frame(&buf[first], 0x10, payload, 1);
+    reset();
+    buf[first - 1] += 1;
+    report_parse(&parser, buf, len);
+
+    TEST_ASSERT_EQUAL_UINT32(1, parser.stats.bad_checksums);
+    TEST_ASSERT_EQUAL_UINT8(1, num_replies);
+    TEST_ASSERT_EQUAL_UINT8(1, echo_calls);
+}
+
+
+void test_lengthByteLost(void)
+{
+    // a dropped byte makes the parser wait on the wrong length. It gets back in step after
+    // dropping that one frame.
+    uint8_t buf[64];
+    uint8_t payload[] = {0x01, 0x02};
+    uint32_t len = frame(buf, 0x10, payload, 2);
+    uint32_t i;
+    reset();
+    memmove(&buf[5], &buf[6], len - 6); // drop the length byte, 0x01 becomes the length
+    report_parse(&parser, buf, len - 1);
+    TEST_ASSERT_EQUAL_UINT32(1, parser.stats.bad_checksums);
+
+    len = frame(buf, 0x10, payload, 2);
+    for (i = 0; i < len; i++) {
+        report_parseByte(&parser, buf[i]);
+    }
+    TEST_ASSERT_EQUAL_UINT8(1, num_replies);
+    TEST_ASSERT_EQUAL_UINT8(2, reply_len);
+}
+
+
+void test_unknownReport(void)
+{
+    uint8_t buf[32];
+    reset();
+    report_parse(&parser, buf, frame(buf, 0x7A, NULL, 0));
+    TEST_ASSERT_EQUAL_UINT8(1, num_replies);
+    TEST_ASSERT_EQUAL_HEX8(0x7A, reply_id);
+    TEST_ASSERT_EQUAL_HEX8(RET_NORPT_ERR, reply_ret);
+    TEST_ASSERT_EQUAL_UINT32(1, parser.stats.unknown);
+}
+
+
+void test_payloadTooLong(void)
+{
+    uint8_t buf[REPORT_MAX_PAYLOAD + 16];
+    uint8_t payload[REPORT_MAX_PAYLOAD + 1];
+    memset(payload, 0x55, sizeof(payload));
+    reset();
+    report_parse(&parser, buf, frame(buf, 0x10, payload, sizeof(payload)));
+    TEST_ASSERT_EQUAL_UINT8(1, num_replies);
+    TEST_ASSERT_EQUAL_HEX8(RET_MAX_LEN_ERR, reply_ret);
+    TEST_ASSERT_EQUAL_UINT8(0, echo_calls);
+
+    // and the next one's fine
+    report_parse(&parser, buf, frame(buf, 0x10, payload, REPORT_MAX_PAYLOAD));
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, reply_ret);
+    TEST_ASSERT_EQUAL_UINT8(REPORT_MAX_PAYLOAD, reply_len);
+}
+
+
+void test_crc16CheckValue(void)
+{
+    TEST_ASSERT_EQUAL_HEX16(0x29B1, crc16(CRC16_INIT, (const uint8_t *)"123456789", 9));
+}
+
+
+void test_versionReport(void)
+{
+    uint8_t buf[32];
+    reset();
+    report_parse(&parser, buf, frame(buf, REPORT_ID_VERSION, NULL, 0));
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, reply_ret);
+    TEST_ASSERT_EQUAL_UINT8(2, reply_len);
+    TEST_ASSERT_EQUAL_UINT8(kReportProtocolMagic, reply_payload[0]);
+    TEST_ASSERT_EQUAL_UINT8(kReportProtocolCobs, reply_payload[1]);
+
+    // no send function, no version 2
+    report_init(&parser, table, 2, reply, NULL);
+    report_parse(&parser, buf, frame(buf, REPORT_ID_VERSION, NULL, 0));
+    TEST_ASSERT_EQUAL_UINT8(kReportProtocolMagic, reply_payload[1]);
+    buf[0] = kReportProtocolCobs;
+    report_parse(&parser, &buf[1], frame(&buf[1], REPORT_ID_VERSION, buf, 1));
+    TEST_ASSERT_EQUAL_HEX8(RET_VAL_ERR, reply_ret);
+    TEST_ASSERT_EQUAL_UINT8(kReportProtocolMagic, parser.protocol);
+}
+
+
+void test_cobsDispatchesFrame(void)
+{
+    uint8_t buf[64];
+    // zeros, and the old magic number, are just data now
+    uint8_t payload[] = {0x00, 0xDE, 0xAD, 0xBE, 0xEF, 0x00, 0x00, 0x01};
+    reset();
+    use_cobs();
+    report_parse(&parser, buf, frame(buf, 0x10, payload, sizeof(payload)));
+    TEST_ASSERT_EQUAL_UINT8(0, num_sent);
+
+    report_parse(&parser, buf, cobs_frame(buf, 0x10, payload, sizeof(payload)));
+    TEST_ASSERT_EQUAL_UINT8(0, num_replies);
+    TEST_ASSERT_EQUAL_UINT8(1, num_sent);
+    decode_sent();
+    TEST_ASSERT_EQUAL_HEX8(0x10, reply_id);
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, reply_ret);
+    TEST_ASSERT_EQUAL_UINT8(sizeof(payload), reply_len);
+    TEST_ASSERT_EQUAL_MEMORY(payload, reply_payload, sizeof(payload));
+}
+
+
+void test_cobsResyncsAtNextZero(void)
+{
+    uint8_t buf[64];
+    uint8_t payload[] = {0x11, 0x22};
+    uint32_t len;
+    reset();
+    use_cobs();
+
+    // a bad CRC
+    len = cobs_frame(buf, 0x10, payload, sizeof(payload));
+    buf[2] ^= 0x40;
+    report_parse(&parser, buf, len);
+    // half a frame, and junk (e.g. text logs) that the zero in front of the next frame ends
+    len = cobs_frame(buf, 0x10, payload, sizeof(payload));
+    report_parse(&parser, buf, len / 2);
+    report_parse(&parser, (const uint8_t *)"junk", 4);
+    TEST_ASSERT_EQUAL_UINT32(1, parser.stats.bad_checksums);
+    TEST_ASSERT_EQUAL_UINT8(0, num_sent);
+
+    report_parse(&parser, buf, len);
+    TEST_ASSERT_EQUAL_UINT32(2, parser.stats.bad_checksums);
+    TEST_ASSERT_EQUAL_UINT8(1, num_sent);
+    TEST_ASSERT_EQUAL_UINT8(1, echo_calls);
+    decode_sent();
+    TEST_ASSERT_EQUAL_MEMORY(payload, reply_payload, sizeof(payload));
+}
+
+
+void test_cobsLongFrames(void)
+{
+    uint8_t buf[400];
+    uint8_t payload[300];
+    for (uint32_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = (uint8_t)(i % 255) + 1;
+    }
+    reset();
+    use_cobs();
+    // more than a whole COBS block
+    report_parse(&parser, buf, cobs_frame(buf, 0x10, payload, sizeof(payload)));
+    decode_sent();
+    TEST_ASSERT_EQUAL_HEX8(RET_MAX_LEN_ERR, reply_ret);
+    TEST_ASSERT_EQUAL_UINT8(0, echo_calls);
+
+    report_parse(&parser, buf, cobs_frame(buf, 0x10, payload, REPORT_MAX_PAYLOAD));
+    decode_sent();
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, reply_ret);
+    TEST_ASSERT_EQUAL_UINT8(REPORT_MAX_PAYLOAD, reply_len);
+    TEST_ASSERT_EQUAL_MEMORY(payload, reply_payload, REPORT_MAX_PAYLOAD);
+}
+
+
+void test_cobsBackToMagic(void)
+{
+    uint8_t buf[32];
+    uint8_t version = kReportProtocolMagic;
+    reset();
+    use_cobs();
+    report_parse(&parser, buf, cobs_frame(buf, REPORT_ID_VERSION, &version, 1));
+    // the reply to the switch is still in the old version
+    TEST_ASSERT_EQUAL_UINT8(1, num_sent);
+    decode_sent();
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, reply_ret);
+    TEST_ASSERT_EQUAL_UINT8(kReportProtocolMagic, parser.protocol);
+
+    report_parse(&parser, buf, frame(buf, 0x20, NULL, 0));
+    TEST_ASSERT_EQUAL_UINT8(1, num_replies);
+    TEST_ASSERT_EQUAL_HEX8(RET_VAL_ERR, reply_ret);
+}
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_dispatchesFrame);
+    RUN_TEST(test_byteAtATimeWithNoise);
+    RUN_TEST(test_badChecksumResyncs);
+    RUN_TEST(test_lengthByteLost);
+    RUN_TEST(test_unknownReport);
+    RUN_TEST(test_payloadTooLong);
+    RUN_TEST(test_crc16CheckValue);
+    RUN_TEST(test_versionReport);
+    RUN_TEST(test_cobsDispatchesFrame);
+    RUN_TEST(test_cobsResyncsAtNextZero);
+    RUN_TEST(test_cobsLongFrames);
+    RUN_TEST(test_cobsBackToMagic);
+
+    return UNITY_END();
+}
@@ -0,0 +1,693 @@
+#include "unity.h"
+#include <stdio.h>
+#include "scheduler.h"
+
+#define MAX_LOG (SCHEDULER_NUM_SLOTS + 64)
+
+schedule_t schedule;
+
+// Log of which callbacks ran, in order
+char run_log[MAX_LOG];
+uint16_t run_log_len;
+
+int32_t period_a, period_b, period_c;
+uint8_t remove_id;
+
+
+void reset(void)
+{
+    scheduler_init(&schedule);
+    run_log_len = 0;
+    period_a = SCHEDULER_FINISHED;
+    period_b = SCHEDULER_FINISHED;
+    period_c = SCHEDULER_FINISHED;
+}
+
+void log_run(char name)
+{
+    if (run_log_len < MAX_LOG - 1) {
+        run_log[run_log_len++] = name;
+        run_log[run_log_len] = '\0';
+    }
+}
+
+// The scheduler runs on us, the tests are easier to follow in ms
+int32_t run_ms(uint32_t current_time_ms)
+{
+    int32_t next_us = scheduler_run(&schedule, current_time_ms * 1000);
+    return (next_us == INT32_MAX) ? INT32_MAX : next_us / 1000;
+}
+
+ret_t cb_a(int32_t *callback_time_ms)
+{
+    log_run('a');
+    *callback_time_ms = period_a;
+    return RET_OK;
+}
+
+ret_t cb_b(int32_t *callback_time_ms)
+{
+    log_run('b');
+    *callback_time_ms = period_b;
+    return RET_OK;
+}
+
+ret_t cb_c(int32_t *callback_time_ms)
+{
+    log_run('c');
+    *callback_time_ms = period_c;
+    return RET_OK;
+}
+
+ret_t cb_removesOther(int32_t *callback_time_ms)
+{
+    log_run('r');
+    scheduler_remove(&schedule, remove_id);
+    *callback_time_ms = SCHEDULER_FINISHED;
+    return RET_OK;
+}
+
+ret_t cb_removesSelf(int32_t *callback_time_ms)
+{
+    log_run('s');
+    scheduler_remove(&schedule, remove_id);
+    *callback_time_ms = 5;
+    return RET_OK;
+}
+
+ret_t cb_addsA(int32_t *callback_time_ms)
+{
+    uint8_t id;
+    log_run('+');
+    scheduler_add(&schedule, 0, cb_a, &id);
+    *callback_time_ms = SCHEDULER_FINISHED;
+    return RET_OK;
+}
+
+
+void test_runsOnceAndFinishes(void)
+{
+    uint8_t id;
+    reset();
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, scheduler_add(&schedule, 0, cb_a, &id));
+    int32_t next = run_ms(100);
+    // do some output if we've defined verbose output
+    #ifdef VERBOSE_OUTPUT
+        printf("\nFunction: %s\n", __func__);
+        printf("\tran: %s, next in %d ms\n", run_log, next);
+        printf("\n");
+    #endif
+
+    TEST_ASSERT_EQUAL_STRING("a", run_log);
+    TEST_ASSERT_EQUAL_INT32(INT32_MAX, next);
+    TEST_ASSERT_EQUAL_HEX16(0, schedule.num_slots_used);
+}
+
+
+void test_periodicRunsOnTime(void)
+{
+    uint8_t id;
+    reset();
+    period_a = 10;
+    scheduler_add(&schedule, 0, cb_a, &id);
+
+    TEST_ASSERT_EQUAL_INT32(10, run_ms(0));
+    TEST_ASSERT_EQUAL_INT32(5, run_ms(5));
+    TEST_ASSERT_EQUAL_STRING("a", run_log);
+    TEST_ASSERT_EQUAL_INT32(10, run_ms(10));
+    TEST_ASSERT_EQUAL_STRING("aa", run_log);
+    // late, runs once and is rescheduled from now
+    TEST_ASSERT_EQUAL_INT32(10, run_ms(35));
+    TEST_ASSERT_EQUAL_STRING("aaa", run_log);
+}
+
+
+void test_runsInDeadlineOrder(void)
+{
+    uint8_t id;
+    reset();
+    scheduler_add(&schedule, 30, cb_c, &id);
+    scheduler_add(&schedule, 10, cb_b, &id);
+    scheduler_add(&schedule, 20, cb_a, &id);
+
+    TEST_ASSERT_EQUAL_INT32(10, run_ms(0));
+    TEST_ASSERT_EQUAL_INT32(0, (int32_t)run_log_len);
+    run_ms(50);
+    // do some output if we've defined verbose output
+    #ifdef VERBOSE_OUTPUT
+        printf("\nFunction: %s\n", __func__);
+        printf("\tran: %s\n", run_log);
+        printf("\n");
+    #endif
+
+    TEST_ASSERT_EQUAL_STRING("bac", run_log);
+}
+
+
+void test_equalDeadlinesKeepAddOrder(void)
+{
+    uint8_t id;
+    reset();
+    scheduler_add(&schedule, 0, cb_c, &id);
+    scheduler_add(&schedule, 0, cb_a, &id);
+    scheduler_add(&schedule, 0, cb_b, &id);
+    run_ms(0);
+
+    TEST_ASSERT_EQUAL_STRING("cab", run_log);
+}
+
+
+void test_periodZeroDoesNotStarveOthers(void)
+{
+    uint8_t id;
+    reset();
+    period_a = 0;
+    period_b = 0;
+    scheduler_add(&schedule, 0, cb_a, &id);
+    scheduler_add(&schedule, 0, cb_b, &id);
+    scheduler_add(&schedule, 0, cb_c, &id);
+
+    int32_t next = run_ms(0);
+    TEST_ASSERT_EQUAL_STRING("abc", run_log);
+    TEST_ASSERT_EQUAL_INT32(0, next);
+    run_ms(0);
+    TEST_ASSERT_EQUAL_STRING("abcab", run_log);
+}
+
+
+void test_removeQueued(void)
+{
+    uint8_t id_a, id_b;
+    reset();
+    period_a = 10;
+    period_b = 10;
+    scheduler_add(&schedule, 0, cb_a, &id_a);
+    scheduler_add(&schedule, 0, cb_b, &id_b);
+    run_ms(0);
+
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, scheduler_remove(&schedule, id_a));
+    TEST_ASSERT_EQUAL_HEX8(RET_VAL_ERR, scheduler_remove(&schedule, id_a));
+    run_ms(10);
+
+    TEST_ASSERT_EQUAL_STRING("abb", run_log);
+    TEST_ASSERT_EQUAL_HEX16(1, schedule.num_slots_used);
+}
+
+
+void test_removePending(void)
+{
+    uint8_t id;
+    reset();
+    scheduler_add(&schedule, 0, cb_a, &id);
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, scheduler_remove(&schedule, id));
+    run_ms(0);
+
+    TEST_ASSERT_EQUAL_INT32(0, (int32_t)run_log_len);
+    TEST_ASSERT_EQUAL_HEX16(0, schedule.num_slots_used);
+}
+
+
+void test_removeFromCallback(void)
+{
+    uint8_t id, self_id;
+    reset();
+    period_a = 10;
+    scheduler_add(&schedule, 0, cb_removesOther, &id);
+    scheduler_add(&schedule, 0, cb_a, &remove_id);
+    run_ms(0);
+    TEST_ASSERT_EQUAL_STRING("r", run_log);
+
+    scheduler_add(&schedule, 0, cb_removesSelf, &self_id);
+    remove_id = self_id;
+    run_ms(1);
+    run_ms(100);
+    TEST_ASSERT_EQUAL_STRING("rs", run_log);
+    TEST_ASSERT_EQUAL_HEX16(0, schedule.num_slots_used);
+}
+
+
+void test_addFromCallbackRunsNextPass(void)
+{
+    uint8_t id;
+    reset();
+    scheduler_add(&schedule, 0, cb_addsA, &id);
+
+    TEST_ASSERT_EQUAL_INT32(0, run_ms(0));
+    TEST_ASSERT_EQUAL_STRING("+", run_log);
+    run_ms(0);
+    TEST_ASSERT_EQUAL_STRING("+a", run_log);
+}
+
+
+void test_fullSchedule(void)
+{
+    uint8_t id;
+    reset();
+    for (uint16_t i = 0; i < SCHEDULER_NUM_SLOTS; i++) {
+        TEST_ASSERT_EQUAL_HEX8(RET_OK, scheduler_add(&schedule, 0, cb_a, &id));
+    }
+    TEST_ASSERT_EQUAL_HEX8(RET_LEN_ERR, scheduler_add(&schedule, 0, cb_b, &id));
+    run_ms(0);
+    TEST_ASSERT_EQUAL_INT32(SCHEDULER_NUM_SLOTS, (int32_t)run_log_len);
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, scheduler_add(&schedule, 0, cb_b, &id));
+}
+
+
+void test_timeWraps(void)
+{
+    uint8_t id;
+    reset();
+    period_a = 10;
+    period_b = 30;
+    scheduler_add(&schedule, 0, cb_a, &id);
+    scheduler_add(&schedule, 0, cb_b, &id);
+    run_ms(UINT32_MAX - 5);
+    TEST_ASSERT_EQUAL_STRING("ab", run_log);
+
+    // a is due 4 ms after the wrap, b isn't
+    TEST_ASSERT_EQUAL_INT32(4, run_ms(0));
+    run_ms(4);
+    TEST_ASSERT_EQUAL_STRING("aba", run_log);
+}
+
+
+ret_t cb_addsHighC(int32_t *callback_time_ms)
+{
+    uint8_t id;
+    log_run('+');
+    scheduler_addWithPriority(&schedule, kSchedulerPriorityHigh, 0, cb_c, &id);
+    *callback_time_ms = SCHEDULER_FINISHED;
+    return RET_OK;
+}
+
+uint16_t hook_calls;
+
+void count_hook(void)
+{
+    hook_calls += 1;
+}
+
+void test_highPriorityRunsFirst(void)
+{
+    uint8_t id;
+    reset();
+    scheduler_addWithPriority(&schedule, kSchedulerPriorityLow, 0, cb_a, &id);
+    scheduler_add(&schedule, 0, cb_b, &id);
+    scheduler_addWithPriority(&schedule, kSchedulerPriorityHigh, 0, cb_c, &id);
+    run_ms(0);
+
+    TEST_ASSERT_EQUAL_STRING("cba", run_log);
+}
+
+
+void test_priorityRecheckedAfterEachCallback(void)
+{
+    uint8_t id;
+    reset();
+    period_b = 10;
+    period_c = 10;
+    scheduler_addWithPriority(&schedule, kSchedulerPriorityLow, 0, cb_a, &id);
+    scheduler_add(&schedule, 0, cb_b, &id);
+    scheduler_addWithPriority(&schedule, kSchedulerPriorityHigh, 0, cb_c, &id);
+    run_ms(0);
+    TEST_ASSERT_EQUAL_STRING("cba", run_log);
+
+    // b is late by more than c, but c is higher priority
+    run_log_len = 0;
+    run_ms(30);
+    TEST_ASSERT_EQUAL_STRING("cb", run_log);
+}
+
+
+void test_lowPriorityStillRunsInPass(void)
+{
+    uint8_t id;
+    reset();
+    period_c = 0;
+    scheduler_addWithPriority(&schedule, kSchedulerPriorityHigh, 0, cb_c, &id);
+    scheduler_addWithPriority(&schedule, kSchedulerPriorityLow, 0, cb_a, &id);
+
+    TEST_ASSERT_EQUAL_INT32(0, run_ms(0));
+    TEST_ASSERT_EQUAL_STRING("ca", run_log);
+    run_ms(0);
+    TEST_ASSERT_EQUAL_STRING("cac", run_log);
+}
+
+
+void test_highPriorityAddedFromCallbackRunsNextPass(void)
+{
+    uint8_t id;
+    reset();
+    scheduler_addWithPriority(&schedule, kSchedulerPriorityLow, 0, cb_addsHighC, &id);
+    scheduler_addWithPriority(&schedule, kSchedulerPriorityLow, 0, cb_a, &id);
+
+    TEST_ASSERT_EQUAL_INT32(0, run_ms(0));
+    TEST_ASSERT_EQUAL_STRING("+a", run_log);
+    run_ms(0);
+    TEST_ASSERT_EQUAL_STRING("+ac", run_log);
+}
+
+
+void test_betweenCallbacksHook(void)
+{
+    uint8_t id;
+    reset();
+    hook_calls = 0;
+    scheduler_setBetweenCallbacksHook(&schedule, count_hook);
+    scheduler_add(&schedule, 0, cb_a, &id);
+    scheduler_addWithPriority(&schedule, kSchedulerPriorityHigh, 0, cb_b, &id);
+    scheduler_addWithPriority(&schedule, kSchedulerPriorityLow, 20, cb_c, &id);
+    run_ms(0);
+    TEST_ASSERT_EQUAL_HEX16(2, hook_calls);
+
+    scheduler_setBetweenCallbacksHook(&schedule, NULL);
+    run_ms(20);
+    TEST_ASSERT_EQUAL_STRING("bac", run_log);
+    TEST_ASSERT_EQUAL_HEX16(2, hook_calls);
+}
+
+
+// What the trace hook saw: id, then '<' before / '>' after, then what it returned
+char trace_log[MAX_LOG];
+uint16_t trace_len;
+
+void trace_hook(uint8_t schedule_id, bool done, ret_t ret)
+{
+    if (trace_len < MAX_LOG - 4) {
+        trace_log[trace_len++] = '0' + schedule_id;
+        trace_log[trace_len++] = done ? '>' : '<';
+        trace_log[trace_len++] = '0' + ret;
+        trace_log[trace_len] = '\0';
+    }
+}
+
+ret_t cb_failsOnce(int32_t *callback_time_ms)
+{
+    log_run('f');
+    *callback_time_ms = SCHEDULER_FINISHED;
+    return RET_GEN_ERR;
+}
+
+
+void test_traceHook(void)
+{
+    uint8_t id_a, id_f;
+    reset();
+    trace_len = 0;
+    trace_log[0] = '\0';
+    scheduler_setTraceHook(&schedule, trace_hook);
+    scheduler_add(&schedule, 0, cb_a, &id_a);
+    scheduler_add(&schedule, 0, cb_failsOnce, &id_f);
+    run_ms(0);
+    TEST_ASSERT_EQUAL_STRING("af", run_log);
+    TEST_ASSERT_EQUAL_UINT8(0, id_a);
+    TEST_ASSERT_EQUAL_UINT8(1, id_f);
+    TEST_ASSERT_EQUAL_STRING("0<00>01<01>7", trace_log);
+
+    scheduler_setTraceHook(&schedule, NULL);
+    period_a = 0;
+    scheduler_add(&schedule, 0, cb_a, &id_a);
+    run_ms(1);
+    TEST_ASSERT_EQUAL_STRING("0<00>01<01>7", trace_log);
+}
+
+
+void test_invalidPriority(void)
+{
+    uint8_t id;
+    reset();
+    TEST_ASSERT_EQUAL_HEX8(RET_INVALID_ARGS_ERR,
+                           scheduler_addWithPriority(&schedule, kSchedulerNumPriorities, 0, cb_a,
+                                                     &id));
+    TEST_ASSERT_EQUAL_HEX16(0, schedule.num_slots_used);
+}
+
+
+void test_deadlinesKeepMicroseconds(void)
+{
+    uint8_t id;
+    reset();
+    period_a = 10;
+    period_b = 10;
+    scheduler_add(&schedule, 0, cb_a, &id);
+    scheduler_run(&schedule, 0);
+    scheduler_add(&schedule, 0, cb_b, &id);
+    TEST_ASSERT_EQUAL_INT32(9500, scheduler_run(&schedule, 500));
+    TEST_ASSERT_EQUAL_STRING("ab", run_log);
+
+    // both are due in the same ms, but a half a ms ahead of b
+    TEST_ASSERT_EQUAL_INT32(500, scheduler_run(&schedule, 10000));
+    TEST_ASSERT_EQUAL_STRING("aba", run_log);
+    TEST_ASSERT_EQUAL_INT32(9500, scheduler_run(&schedule, 10500));
+    TEST_ASSERT_EQUAL_STRING("abab", run_log);
+}
+
+
+uint8_t wake_id;
+
+ret_t cb_wakesSelf(int32_t *callback_time_ms)
+{
+    log_run('w');
+    scheduler_wake(&schedule, wake_id);
+    *callback_time_ms = 100;
+    return RET_OK;
+}
+
+void test_wakeQueued(void)
+{
+    uint8_t id;
+    reset();
+    period_a = 100;
+    scheduler_add(&schedule, 0, cb_a, &id);
+    TEST_ASSERT_EQUAL_INT32(100, run_ms(0));
+
+    // woken at 30, it's due as of the last run and the next one picks it up
+    TEST_ASSERT_EQUAL_INT32(70, run_ms(30));
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, scheduler_wake(&schedule, id));
+    TEST_ASSERT_EQUAL_INT32(100, run_ms(31));
+    TEST_ASSERT_EQUAL_STRING("aa", run_log);
+}
+
+
+void test_wakePending(void)
+{
+    uint8_t id;
+    reset();
+    scheduler_add(&schedule, 50, cb_a, &id);
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, scheduler_wake(&schedule, id));
+    run_ms(0);
+    TEST_ASSERT_EQUAL_STRING("a", run_log);
+}
+
+
+void test_wakeWhileRunning(void)
+{
+    reset();
+    scheduler_add(&schedule, 0, cb_wakesSelf, &wake_id);
+
+    // asked for 100 ms, but was woken while running so it's due straight away (next pass)
+    TEST_ASSERT_EQUAL_INT32(0, run_ms(0));
+    TEST_ASSERT_EQUAL_STRING("w", run_log);
+    run_ms(1);
+    TEST_ASSERT_EQUAL_STRING("ww", run_log);
+}
+
+
+void test_wakeFreeSlot(void)
+{
+    uint8_t id;
+    reset();
+    TEST_ASSERT_EQUAL_HEX8(RET_VAL_ERR, scheduler_wake(&schedule, 0));
+    scheduler_add(&schedule, 0, cb_a, &id);
+    run_ms(0);
+    TEST_ASSERT_EQUAL_HEX8(RET_VAL_ERR, scheduler_wake(&schedule, id));
+    TEST_ASSERT_EQUAL_HEX8(RET_VAL_ERR, scheduler_wake(&schedule, SCHEDULER_NUM_SLOTS));
+}
+
+
+#ifdef SCHEDULER_PROFILING
+uint32_t fake_cycles;
+uint32_t cycles_per_call;
+
+uint32_t get_fake_cycles(void)
+{
+    return fake_cycles;
+}
+
+uint32_t fake_time_us;
+
+uint32_t get_fake_time_us(void)
+{
+    return fake_time_us;
+}
+
+ret_t cb_takes_5ms(int32_t *callback_time_ms)
+{
+    log_run('t');
+    fake_time_us += 5000;
+    *callback_time_ms = SCHEDULER_FINISHED;
+    return RET_OK;
+}
+
+ret_t cb_slow(int32_t *callback_time_ms)
+{
+    log_run('s');
+    fake_cycles += cycles_per_call;
+    *callback_time_ms = 10;
+    return RET_OK;
+}
+
+ret_t cb_fails(int32_t *callback_time_ms)
+{
+    log_run('f');
+    *callback_time_ms = 10;
+    return RET_COM_ERR;
+}
+
+void test_profileCountsCallsAndCycles(void)
+{
+    uint8_t id;
+    scheduler_slot_stats_t stats;
+    reset();
+    fake_cycles = 0;
+    scheduler_setCycleCounter(&schedule, get_fake_cycles);
+    scheduler_add(&schedule, 0, cb_slow, &id);
+
+    cycles_per_call = 100;
+    run_ms(0);
+    cycles_per_call = 300;
+    run_ms(10);
+    cycles_per_call = 200;
+    run_ms(20);
+
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, scheduler_getStats(&schedule, id, &stats));
+    TEST_ASSERT_EQUAL_UINT32(3, stats.calls);
+    TEST_ASSERT_EQUAL_UINT32(600, (uint32_t)stats.total_cycles);
+    TEST_ASSERT_EQUAL_UINT32(300, stats.max_cycles);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.missed_deadlines);
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)(uintptr_t)cb_slow, stats.callback_addr);
+}
+
+void test_profileTracksLateness(void)
+{
+    uint8_t id;
+    scheduler_slot_stats_t stats;
+    reset();
+    scheduler_add(&schedule, 0, cb_slow, &id);
+
+    run_ms(0);
+    run_ms(13); // due at 10
+    run_ms(23); // due at 23
+    run_ms(40); // due at 33
+    scheduler_run(&schedule, 50300); // due at 50, a little late isn't a miss
+
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, scheduler_getStats(&schedule, id, &stats));
+    TEST_ASSERT_EQUAL_UINT32(5, stats.calls);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.missed_deadlines);
+    TEST_ASSERT_EQUAL_UINT32(7000, stats.max_lateness_us);
+    // no cycle counter, no cycles
+    TEST_ASSERT_EQUAL_UINT32(0, stats.max_cycles);
+}
+
+void test_profileLatenessIncludesEarlierCallbacks(void)
+{
+    uint8_t slow_id, id;
+    scheduler_slot_stats_t stats;
+    reset();
+    scheduler_setTimeSource(&schedule, get_fake_time_us);
+    scheduler_add(&schedule, 0, cb_takes_5ms, &slow_id);
+    scheduler_add(&schedule, 0, cb_slow, &id);
+
+    fake_time_us = 0;
+    run_ms(0);
+    TEST_ASSERT_EQUAL_STRING("ts", run_log);
+
+    // both were due at 0, the second one only started once the first was done
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, scheduler_getStats(&schedule, id, &stats));
+    TEST_ASSERT_EQUAL_UINT32(5000, stats.max_lateness_us);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.missed_deadlines);
+}
+
+void test_profileCountsErrors(void)
+{
+    uint8_t id;
+    scheduler_slot_stats_t stats;
+    reset();
+    scheduler_add(&schedule, 0, cb_fails, &id);
+    run_ms(0);
+    run_ms(10);
+
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, scheduler_getStats(&schedule, id, &stats));
+    TEST_ASSERT_EQUAL_UINT32(2, stats.errors);
+    TEST_ASSERT_EQUAL_HEX8(RET_COM_ERR, stats.last_error);
+}
+
+void test_profileResets(void)
+{
+    uint8_t id;
+    scheduler_slot_stats_t stats;
+    reset();
+    period_a = 10;
+    scheduler_add(&schedule, 0, cb_fails, &id);
+    run_ms(0);
+
+    scheduler_resetStats(&schedule);
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, scheduler_getStats(&schedule, id, &stats));
+    TEST_ASSERT_EQUAL_UINT32(0, stats.calls);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.errors);
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)(uintptr_t)cb_fails, stats.callback_addr);
+
+    // a slot that gets reused starts from scratch
+    scheduler_remove(&schedule, id);
+    TEST_ASSERT_EQUAL_HEX8(RET_NODATA_ERR, scheduler_getStats(&schedule, id, &stats));
+    scheduler_add(&schedule, 0, cb_a, &id);
+    run_ms(5);
+    TEST_ASSERT_EQUAL_HEX8(RET_OK, scheduler_getStats(&schedule, id, &stats));
+    TEST_ASSERT_EQUAL_UINT32(1, stats.calls);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.errors);
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)(uintptr_t)cb_a, stats.callback_addr);
+}
+#endif
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_runsOnceAndFinishes);
+    RUN_TEST(test_periodicRunsOnTime);
+    RUN_TEST(test_runsInDeadlineOrder);
+    RUN_TEST(test_equalDeadlinesKeepAddOrder);
+    RUN_TEST(test_periodZeroDoesNotStarveOthers);
+
+    RUN_TEST(test_removeQueued);
+    RUN_TEST(test_removePending);
+    RUN_TEST(test_removeFromCallback);
+    RUN_TEST(test_addFromCallbackRunsNextPass);
+
+    RUN_TEST(test_fullSchedule);
+    RUN_TEST(test_timeWraps);
+    RUN_TEST(test_deadlinesKeepMicroseconds);
+    RUN_TEST(test_wakeQueued);
+    RUN_TEST(test_wakePending);
+    RUN_TEST(test_wakeWhileRunning);
+    RUN_TEST(test_wakeFreeSlot);
+
+    RUN_TEST(test_highPriorityRunsFirst);
+    RUN_TEST(test_priorityRecheckedAfterEachCallback);
+    RUN_TEST(test_lowPriorityStillRunsInPass);
+    RUN_TEST(test_highPriorityAddedFromCallbackRunsNextPass);
+    RUN_TEST(test_betweenCallbacksHook);
+    RUN_TEST(test_traceHook);
+    RUN_TEST(test_invalidPriority);
+
+#ifdef SCHEDULER_PROFILING
+    RUN_TEST(test_profileCountsCallsAndCycles);
+    RUN_TEST(test_profileTracksLateness);
+    RUN_TEST(test_profileLatenessIncludesEarlierCallbacks);
+    RUN_TEST(test_profileCountsErrors);
+    RUN_TEST(test_profileResets);
+#endif
+
+    return UNITY_END();
+}
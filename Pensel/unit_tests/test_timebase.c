@@ -0,0 +1,50 @@
+#include "unity.h"
+#include <stdio.h>
+#include <time.h>
+#include "timebase.h"
+
+
+void sleep_us(uint32_t us)
+{
+    struct timespec ts = {.tv_sec = us / 1000000, .tv_nsec = (long)(us % 1000000) * 1000};
+    nanosleep(&ts, NULL);
+}
+
+void test_countsMicroseconds(void)
+{
+    uint32_t start = time_us();
+    sleep_us(20000);
+    uint32_t elapsed = time_us() - start;
+    // do some output if we've defined verbose output
+    #ifdef VERBOSE_OUTPUT
+        printf("\nFunction: %s\n", __func__);
+        printf("\t20 ms sleep took %u us\n", elapsed);
+        printf("\n");
+    #endif
+
+    // never early, and a loaded machine can oversleep, but not by whole seconds
+    TEST_ASSERT_TRUE(elapsed >= 20000);
+    TEST_ASSERT_TRUE(elapsed < 1000000);
+}
+
+void test_neverGoesBackwards(void)
+{
+    uint32_t last = time_us();
+    for (uint32_t i = 0; i < 100000; i++) {
+        uint32_t now = time_us();
+        // signed difference, like everything using the timebase
+        TEST_ASSERT_TRUE((int32_t)(now - last) >= 0);
+        last = now;
+    }
+}
+
+
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_countsMicroseconds);
+    RUN_TEST(test_neverGoesBackwards);
+
+    return UNITY_END();
+}
@@ -0,0 +1,18 @@
+/*!
+ * @file    timebase_host.c
+ * @author  Tyler Holmes
+ *
+ * @date    18-Oct-2026
+ * @brief   Host implementation of time_us(), on the monotonic clock.
+ */
+#include "timebase.h"
+#include <stdint.h>
+#include <time.h>
+
+uint32_t time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    // truncated to 32 bits like the hardware counter, wrapping included
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000);
+}
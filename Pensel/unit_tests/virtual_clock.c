@@ -0,0 +1,112 @@
+/*!
+ * @file    virtual_clock.c
+ * @author  Tyler Holmes
+ *
+ * @date    18-Oct-2026
+ * @brief   Host stand-in for the clock, interrupts and sleep.
+ */
+#include "virtual_clock.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef struct {
+    uint64_t at_us;
+    vclock_isr_t isr;
+} vclock_irq_t;
+
+static uint64_t gNow_us;
+static bool gIrqsEnabled;
+static vclock_irq_t gIrqs[VCLOCK_MAX_IRQS]; //!< Kept sorted by time
+static uint32_t gNumIrqs;
+
+const idle_port_t gVclockIdlePort = {
+    .get_time_us = vclock_time_us,
+    .irq_disable = vclock_irq_disable,
+    .irq_enable = vclock_irq_enable,
+    .sleep = vclock_sleep,
+};
+
+/*! Runs (and forgets) every injected interrupt that is due, in time order.
+ */
+static void run_due_irqs(void)
+{
+    while (gIrqsEnabled && gNumIrqs > 0 && gIrqs[0].at_us <= gNow_us) {
+        vclock_isr_t isr = gIrqs[0].isr;
+        gNumIrqs -= 1;
+        memmove(&gIrqs[0], &gIrqs[1], gNumIrqs * sizeof(gIrqs[0]));
+        isr();
+    }
+}
+
+void vclock_reset(void)
+{
+    gNow_us = 0;
+    gIrqsEnabled = true;
+    gNumIrqs = 0;
+}
+
+uint64_t vclock_now_us(void) { return gNow_us; }
+
+uint32_t vclock_now_ms(void) { return (uint32_t)(gNow_us / 1000); }
+
+//! Like time_us(): truncated to 32 bits, so it wraps the same way
+uint32_t vclock_time_us(void) { return (uint32_t)gNow_us; }
+
+/*! Moves time forward, running interrupts at their own time along the way.
+ */
+void vclock_advance_us(uint64_t us)
+{
+    uint64_t end_us = gNow_us + us;
+    while (gIrqsEnabled && gNumIrqs > 0 && gIrqs[0].at_us <= end_us) {
+        if (gIrqs[0].at_us > gNow_us) {
+            gNow_us = gIrqs[0].at_us;
+        }
+        run_due_irqs();
+    }
+    gNow_us = end_us;
+}
+
+/*! Schedules an interrupt. One that's already due runs straight away if interrupts are enabled.
+ *
+ * @retval RET_OK, or RET_NOMEM_ERR if there are too many outstanding
+ */
+ret_t vclock_injectIrq(uint64_t at_us, vclock_isr_t isr)
+{
+    uint32_t i;
+    if (gNumIrqs >= VCLOCK_MAX_IRQS) {
+        return RET_NOMEM_ERR;
+    }
+    // insert after anything at the same time so equal times keep injection order
+    for (i = gNumIrqs; i > 0 && gIrqs[i - 1].at_us > at_us; i--) {
+        gIrqs[i] = gIrqs[i - 1];
+    }
+    gIrqs[i].at_us = at_us;
+    gIrqs[i].isr = isr;
+    gNumIrqs += 1;
+    run_due_irqs();
+    return RET_OK;
+}
+
+void vclock_irq_disable(void) { gIrqsEnabled = false; }
+
+void vclock_irq_enable(void)
+{
+    gIrqsEnabled = true;
+    run_due_irqs();
+}
+
+/*! Sleeps like the hardware would: until the next interrupt or `max_sleep_us` from now, whichever
+ *  is first. Interrupts are expected to be disabled, so the one that wakes us is left pending.
+ */
+uint32_t vclock_sleep(uint32_t max_sleep_us)
+{
+    uint64_t start_us = gNow_us;
+    uint64_t wake_us = gNow_us + max_sleep_us;
+
+    if (gNumIrqs > 0 && gIrqs[0].at_us < wake_us) {
+        wake_us = (gIrqs[0].at_us > gNow_us) ? gIrqs[0].at_us : gNow_us;
+    }
+    gNow_us = wake_us;
+    return (uint32_t)(gNow_us - start_us);
+}
@@ -0,0 +1,36 @@
+/*!
+ * @file    virtual_clock.h
+ * @author  Tyler Holmes
+ *
+ * @date    18-Oct-2026
+ * @brief   Host stand-in for the clock, interrupts and sleep, so time based firmware logic can be
+ *          tested deterministically.
+ *
+ * Time only moves when a test (or a sleep) moves it. "Interrupts" are callbacks injected at a
+ * virtual time. They run as soon as time reaches them, unless interrupts are disabled, in which
+ * case they stay pending until vclock_irq_enable().
+ */
+#pragma once
+
+#include "common.h"
+#include "idle.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define VCLOCK_MAX_IRQS (64) //!< Injected interrupts that can be outstanding at once
+
+typedef void (*vclock_isr_t)(void);
+
+void vclock_reset(void);
+uint64_t vclock_now_us(void);
+uint32_t vclock_now_ms(void);
+uint32_t vclock_time_us(void);
+void vclock_advance_us(uint64_t us);
+ret_t vclock_injectIrq(uint64_t at_us, vclock_isr_t isr);
+
+void vclock_irq_disable(void);
+void vclock_irq_enable(void);
+uint32_t vclock_sleep(uint32_t max_sleep_us);
+
+//! idle_port_t backed by the virtual clock
+extern const idle_port_t gVclockIdlePort;